@@ -24,6 +24,7 @@
 #include "gcn64lib.h"
 #include "uiio_gtk.h"
 #include "mempak_fill.h"
+#include "gui_devio.h"
 
 #ifdef WINDOWS
 #include <windows.h>
@@ -95,6 +96,47 @@ static void setsensitive_gc_adapter_widgets(struct application *app, int sensiti
 	}
 }
 
+/* Remember what the pak contains (NULL when unknown) */
+static void setMempakOnCard(struct application *app, const mempak_structure_t *mpk)
+{
+	free(app->mpk_on_card);
+	app->mpk_on_card = NULL;
+
+	if (mpk) {
+		app->mpk_on_card = malloc(sizeof(mempak_structure_t));
+		if (app->mpk_on_card) {
+			memcpy(app->mpk_on_card, mpk, sizeof(mempak_structure_t));
+		}
+	}
+}
+
+/* Get the I/O thread of the current adapter, starting it if needed */
+static struct devio *adapterIO(struct application *app)
+{
+	if (app->devio && devio_getHandle(app->devio) != app->current_adapter_handle) {
+		devio_free(app->devio);
+		app->devio = NULL;
+	}
+
+	if (!app->devio && app->current_adapter_handle) {
+		app->devio = devio_new(app, app->current_adapter_handle);
+	}
+
+	return app->devio;
+}
+
+void syncAdapterIO(struct application *app)
+{
+	devio_sync(app->devio);
+}
+
+/* Stop the I/O thread before the adapter is closed */
+static void stopAdapterIO(struct application *app)
+{
+	devio_free(app->devio);
+	app->devio = NULL;
+}
+
 void deselect_adapter(struct application *app)
 {
 	GET_UI_ELEMENT(GtkComboBox, cb_adapter_list);
@@ -102,10 +144,12 @@ void deselect_adapter(struct application *app)
 	printf("deselect adapter\n");
 
 	if (app->current_adapter_handle) {
+		stopAdapterIO(app);
 		rnt_closeDevice(app->current_adapter_handle);
 		app->current_adapter_handle = NULL;
 		desensitize_adapter_widgets(app);
 	}
+	setMempakOnCard(app, NULL);
 
 	gtk_combo_box_set_active_iter(cb_adapter_list, NULL);
 }
@@ -139,37 +183,57 @@ void errorPopup(struct application *app, const char *message)
 	gtk_widget_destroy(dialog);
 }
 
-static gboolean periodic_updater(gpointer data)
+static int probe_controller(rnt_hdl_t hdl, struct devio_request *rq)
+{
+	return rnt_getControllerType(hdl, 0);
+}
+
+static void probe_controller_done(struct application *app, void *data, int result)
 {
-	struct application *app = data;
 	GET_UI_ELEMENT(GtkLabel, label_controller_type);
 	GET_UI_ELEMENT(GtkButton, btn_rumble_test);
 
-	if (app->current_adapter_handle && !app->inhibit_periodic_updates) {
-		app->controller_type = rnt_getControllerType(app->current_adapter_handle, 0);
-		gtk_label_set_text(label_controller_type, rnt_controllerName(app->controller_type));
+	app->probe_pending = 0;
 
-		setsensitive_n64_adapter_widgets(app, FALSE);
-		setsensitive_gc_adapter_widgets(app, FALSE);
-		gtk_widget_set_sensitive(GTK_WIDGET(btn_rumble_test), FALSE);
+	if (result == DEVIO_ERR_CLOSED || app->inhibit_periodic_updates)
+		return;
 
-		switch (app->controller_type)
-		{
-			case CTL_TYPE_N64:
-				gtk_widget_set_sensitive(GTK_WIDGET(btn_rumble_test), TRUE);
-				setsensitive_n64_adapter_widgets(app, TRUE);
-				break;
+	app->controller_type = result;
+	gtk_label_set_text(label_controller_type, rnt_controllerName(app->controller_type));
 
-			case CTL_TYPE_GC:
-				gtk_widget_set_sensitive(GTK_WIDGET(btn_rumble_test), TRUE);
-				setsensitive_gc_adapter_widgets(app, TRUE);
-				break;
+	setsensitive_n64_adapter_widgets(app, FALSE);
+	setsensitive_gc_adapter_widgets(app, FALSE);
+	gtk_widget_set_sensitive(GTK_WIDGET(btn_rumble_test), FALSE);
 
-			default:
-			case CTL_TYPE_NONE:
-				break;
-		}
+	switch (app->controller_type)
+	{
+		case CTL_TYPE_N64:
+			gtk_widget_set_sensitive(GTK_WIDGET(btn_rumble_test), TRUE);
+			setsensitive_n64_adapter_widgets(app, TRUE);
+			break;
 
+		case CTL_TYPE_GC:
+			gtk_widget_set_sensitive(GTK_WIDGET(btn_rumble_test), TRUE);
+			setsensitive_gc_adapter_widgets(app, TRUE);
+			break;
+
+		default:
+		case CTL_TYPE_NONE:
+			break;
+	}
+}
+
+static gboolean periodic_updater(gpointer data)
+{
+	struct application *app = data;
+
+	/* Skip the probe while the adapter is busy (eg: reading a pak) rather than
+	 * queueing probes behind the transfer. */
+	if (app->current_adapter_handle && !app->inhibit_periodic_updates &&
+			!app->probe_pending && !devio_busy(app->devio)) {
+		if (0 == devio_submit(adapterIO(app), probe_controller, probe_controller_done, NULL, NULL)) {
+			app->probe_pending = 1;
+		}
 	}
 	return TRUE;
 }
@@ -249,6 +313,7 @@ void syncGuiToCurrentAdapter(struct application *app)
 	}
 
 
+	syncAdapterIO(app);
 	if (1 == rnt_getConfig(app->current_adapter_handle, CFG_PARAM_MODE, buf, sizeof(buf))) {
 		cur_mode = buf[0];
 
@@ -486,6 +551,7 @@ G_MODULE_EXPORT void snesMouseSpeedChanged(GtkWidget *win, gpointer data)
 	printf("Value: %d\n", (int)value);
 	buf = (int)value;
 
+	syncAdapterIO(app);
 	n = rnt_setConfig(app->current_adapter_handle, CFG_PARAM_SNES_MOUSE_SPEED, &buf, 1);
 	if (n != 0) {
 		errorPopup(app, "Error setting configuration");
@@ -507,6 +573,7 @@ G_MODULE_EXPORT void pollIntervalChanged(GtkWidget *win, gpointer data)
 	buf = (int)value;
 
 	if (app->current_adapter_info.caps.features & RNTF_POLL_RATE) {
+		syncAdapterIO(app);
 		n = rnt_setConfig(app->current_adapter_handle, CFG_PARAM_POLL_INTERVAL0, &buf, 1);
 		if (n != 0) {
 			errorPopup(app, "Error setting configuration");
@@ -525,6 +592,7 @@ G_MODULE_EXPORT void reset_adapter(GtkButton *button, gpointer data)
 	// Display the please wait dialog (blocks the main window)
 	gtk_widget_show(GTK_WIDGET(dialog_please_wait));
 
+	syncAdapterIO(app);
 	rnt_reset(app->current_adapter_handle);
 	deselect_adapter(app);
 
@@ -563,6 +631,7 @@ G_MODULE_EXPORT void cfg_adapter_mapping_changed(GtkWidget *win, gpointer data)
 	int next_mapping, i;
 	uint8_t mapdata[16];
 
+	syncAdapterIO(app);
 	if (1 != rnt_getMapping(app->current_adapter_handle, &cur_mapping)) {
 		printf("Could not read current mapping\n");
 		return;
@@ -619,6 +688,7 @@ G_MODULE_EXPORT void cfg_adapter_mode_changed(GtkWidget *win, gpointer data)
 
 //	printf("Adapter mode changed\n");
 
+	syncAdapterIO(app);
 	if (1 != rnt_getConfig(app->current_adapter_handle, CFG_PARAM_MODE, buf, sizeof(buf))) {
 		printf("Could not read current mode\n");
 		return;
@@ -677,6 +747,7 @@ G_MODULE_EXPORT void config_checkbox_changed(GtkWidget *win, gpointer data)
 			continue;
 
 		buf = gtk_toggle_button_get_active(configurable_bits[i].chkbtn);
+		syncAdapterIO(app);
 		n = rnt_setConfig(app->current_adapter_handle, configurable_bits[i].cfg_param, &buf, 1);
 		if (n != 0) {
 			errorPopup(app, "Error setting configuration");
@@ -768,6 +839,7 @@ G_MODULE_EXPORT void adapterSelected(GtkComboBox *cb, gpointer data)
 
 		desensitize_adapter_widgets(app);
 	}
+	setMempakOnCard(app, NULL);
 
 	if (gtk_combo_box_get_active_iter(cb, &iter)) {
 		gtk_tree_model_get(GTK_TREE_MODEL(list_store), &iter, 3, &info, -1);
@@ -800,6 +872,7 @@ G_MODULE_EXPORT void suspend_polling(GtkButton *button, gpointer data)
 {
 	struct application *app = data;
 
+	syncAdapterIO(app);
 	rnt_suspendPolling(app->current_adapter_handle, 1);
 }
 
@@ -807,6 +880,7 @@ G_MODULE_EXPORT void resume_polling(GtkButton *button, gpointer data)
 {
 	struct application *app = data;
 
+	syncAdapterIO(app);
 	rnt_suspendPolling(app->current_adapter_handle, 0);
 }
 
@@ -816,23 +890,18 @@ G_MODULE_EXPORT void onFileRescan(GtkWidget *wid, gpointer data)
 	rebuild_device_list_store(data, NULL);
 }
 
-static int mempak_io_progress_cb(int progress, void *ctx)
+static void mempak_io_progress(struct application *app, int progress)
 {
-	struct application *app = ctx;
 	GET_UI_ELEMENT(GtkProgressBar, mempak_io_progress);
 
 	gtk_progress_bar_set_fraction(mempak_io_progress, progress/((gdouble)MEMPAK_MEM_SIZE));
-	while (gtk_events_pending()) {
-		gtk_main_iteration_do(FALSE);
-	}
-
-	return app->stop_mempak_io;
 }
 
 G_MODULE_EXPORT void mempak_io_stop(GtkWidget *wid, gpointer data)
 {
 	struct application *app = data;
-	app->stop_mempak_io = 1;
+
+	devio_abort(app->devio);
 }
 
 G_MODULE_EXPORT void erase_n64_pak(GtkWidget *wid, gpointer data)
@@ -845,7 +914,71 @@ G_MODULE_EXPORT void erase_n64_pak(GtkWidget *wid, gpointer data)
 
 	u->caption = "Erasing Controller Pak...";
 
+	app->inhibit_periodic_updates = 1;
+	syncAdapterIO(app);
 	mempak_fill(app->current_adapter_handle, 0, 0xFF, 0, u);
+	app->inhibit_periodic_updates = 0;
+}
+
+struct n64_pak_write {
+	mempak_structure_t pak;
+	mempak_structure_t on_card;
+	int on_card_known;
+};
+
+static int n64_pak_write(rnt_hdl_t hdl, struct devio_request *rq)
+{
+	struct n64_pak_write *w = devio_getData(rq);
+	int res;
+
+	rnt_suspendPolling(hdl, 1);
+	if (w->on_card_known) {
+		// Only blocks that changed since the pak was last read or written are written.
+		res = gcn64lib_mempak_uploadDiff(hdl, 0, &w->pak, &w->on_card, MEMPAK_UPLOAD_VERIFY, devio_progressCallback, rq);
+	} else {
+		res = gcn64lib_mempak_upload(hdl, 0, &w->pak, devio_progressCallback, rq);
+		if (res == 0) {
+			res = MEMPAK_MEM_SIZE / 0x20;
+		}
+	}
+	rnt_suspendPolling(hdl, 0);
+
+	if (res >= 0) {
+		gcn64lib_mempak_storeCached(hdl, 0, &w->pak);
+	}
+
+	return res;
+}
+
+static void n64_pak_write_done(struct application *app, void *data, int res)
+{
+	struct n64_pak_write *w = data;
+	GET_UI_ELEMENT(GtkDialog, mempak_io_dialog);
+
+	gtk_widget_hide(GTK_WIDGET(mempak_io_dialog));
+
+	if (res == DEVIO_ERR_CLOSED) {
+		free(w);
+		return;
+	}
+
+	if (res >= 0) {
+		printf("%d block(s) written\n", res);
+		setMempakOnCard(app, &w->pak);
+	} else {
+		setMempakOnCard(app, NULL);
+		switch(res)
+		{
+			case -1: errorPopup(app, "No mempak detected"); break;
+			case -2: errorPopup(app, "I/O error writing to mempak"); break;
+			case -4: errorPopup(app, "Write aborted"); break;
+			case -5: errorPopup(app, "Verification failed"); break;
+			default:
+				errorPopup(app, "Error writing to mempak"); break;
+		}
+	}
+
+	free(w);
 }
 
 G_MODULE_EXPORT void write_n64_pak(GtkWidget *wid, gpointer data)
@@ -855,6 +988,7 @@ G_MODULE_EXPORT void write_n64_pak(GtkWidget *wid, gpointer data)
 	GET_UI_ELEMENT(GtkDialog, mempak_io_dialog);
 	GET_UI_ELEMENT(GtkLabel, mempak_op_label);
 	GtkWidget *confirm_dialog;
+	struct n64_pak_write *w;
 	gint res;
 
 	gtk_widget_show(GTK_WIDGET(win_mempak_edit));
@@ -864,6 +998,11 @@ G_MODULE_EXPORT void write_n64_pak(GtkWidget *wid, gpointer data)
 									GTK_MESSAGE_QUESTION, 0, "Your memory card will be completely overwritten by the content of the memory pack editor.\n\nAre you sure?");
 
 	gtk_dialog_add_buttons(GTK_DIALOG(confirm_dialog), "Cancel", 1, "Continue", 2, NULL);
+	if (app->mpk_on_card) {
+		gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(confirm_dialog),
+				"\"Write changes only\" is faster but must only be used if the pak was not used elsewhere since it was last read or written.");
+		gtk_dialog_add_buttons(GTK_DIALOG(confirm_dialog), "Write changes only", 3, NULL);
+	}
 
 	res = gtk_dialog_run(GTK_DIALOG(confirm_dialog));
 	gtk_widget_destroy(confirm_dialog);
@@ -871,28 +1010,29 @@ G_MODULE_EXPORT void write_n64_pak(GtkWidget *wid, gpointer data)
 	switch(res)
 	{
 		case 2:
+		case 3:
 			printf("Confirmed write N64 mempak.\n");
 
-			app->stop_mempak_io = 0;
-			gtk_label_set_text(mempak_op_label, "Writing memory pack...");
-			gtk_widget_show(GTK_WIDGET(mempak_io_dialog));
+			// The editor stays usable during the write: The thread works on a copy.
+			w = calloc(1, sizeof(struct n64_pak_write));
+			if (!w) {
+				perror("calloc");
+				break;
+			}
+			memcpy(&w->pak, mpke_getCurrentMempak(app), sizeof(mempak_structure_t));
+			if (res == 3 && app->mpk_on_card) {
+				memcpy(&w->on_card, app->mpk_on_card, sizeof(mempak_structure_t));
+				w->on_card_known = 1;
+			}
 
-			rnt_suspendPolling(app->current_adapter_handle, 1);
-			res = gcn64lib_mempak_upload(app->current_adapter_handle, 0, mpke_getCurrentMempak(app), mempak_io_progress_cb, app);
-			rnt_suspendPolling(app->current_adapter_handle, 0);
-			gtk_widget_hide(GTK_WIDGET(mempak_io_dialog));
-
-			if (res != 0) {
-				switch(res)
-				{
-					case -1: errorPopup(app, "No mempak detected"); break;
-					case -2: errorPopup(app, "I/O error writing to mempak"); break;
-					case -4: errorPopup(app, "Write aborted"); break;
-					default:
-						errorPopup(app, "Error writing to mempak"); break;
-				}
+			if (devio_submit(adapterIO(app), n64_pak_write, n64_pak_write_done, mempak_io_progress, w)) {
+				free(w);
+				errorPopup(app, "Error writing to mempak");
+				break;
 			}
 
+			gtk_label_set_text(mempak_op_label, "Writing memory pack...");
+			gtk_widget_show(GTK_WIDGET(mempak_io_dialog));
 			break;
 		case 1:
 		default:
@@ -901,28 +1041,71 @@ G_MODULE_EXPORT void write_n64_pak(GtkWidget *wid, gpointer data)
 
 }
 
-G_MODULE_EXPORT void read_n64_pak(GtkWidget *wid, gpointer data)
+static int n64_pak_read_cached(rnt_hdl_t hdl, struct devio_request *rq)
 {
-	struct application *app = data;
+	mempak_structure_t **mpk = devio_getData(rq);
+	int res;
+
+	rnt_suspendPolling(hdl, 1);
+	res = gcn64lib_mempak_loadCached(hdl, 0, mpk);
+	rnt_suspendPolling(hdl, 0);
+
+	return res;
+}
+
+// Show the contents from the image cache right away while the pak is read
+static void n64_pak_read_cached_done(struct application *app, void *data, int res)
+{
+	mempak_structure_t **mpk = data;
 	GET_UI_ELEMENT(GtkWindow, win_mempak_edit);
-	GET_UI_ELEMENT(GtkDialog, mempak_io_dialog);
-	GET_UI_ELEMENT(GtkLabel, mempak_op_label);
-	mempak_structure_t *mpk;
+
+	/* *mpk is only set on success */
+	if (*mpk) {
+		if (res == DEVIO_ERR_CLOSED) {
+			mempak_free(*mpk);
+		} else {
+			mpke_replaceMpk(app, *mpk, NULL);
+			// Stays marked if the pak cannot be read
+			mpke_setCached(app, 1);
+			gtk_widget_show(GTK_WIDGET(win_mempak_edit));
+		}
+	}
+
+	free(mpk);
+}
+
+static int n64_pak_read(rnt_hdl_t hdl, struct devio_request *rq)
+{
+	mempak_structure_t **mpk = devio_getData(rq);
 	int res;
 
-	printf("N64 read mempak\n");
-	if (!app->current_adapter_handle)
-		return;
+	rnt_suspendPolling(hdl, 1);
+	res = gcn64lib_mempak_download(hdl, 0, mpk, devio_progressCallback, rq);
+	rnt_suspendPolling(hdl, 0);
 
-	gtk_widget_show(GTK_WIDGET(mempak_io_dialog));
-	gtk_label_set_text(mempak_op_label, "Reading memory pack...");
+	if (res == 0) {
+		gcn64lib_mempak_storeCached(hdl, 0, *mpk);
+	}
 
-	app->stop_mempak_io = 0;
-	rnt_suspendPolling(app->current_adapter_handle, 1);
-	res = gcn64lib_mempak_download(app->current_adapter_handle, 0, &mpk, mempak_io_progress_cb, app);
-	rnt_suspendPolling(app->current_adapter_handle, 0);
+	return res;
+}
+
+static void n64_pak_read_done(struct application *app, void *data, int res)
+{
+	mempak_structure_t **mpk = data;
+	GET_UI_ELEMENT(GtkWindow, win_mempak_edit);
+	GET_UI_ELEMENT(GtkDialog, mempak_io_dialog);
 
 	gtk_widget_hide(GTK_WIDGET(mempak_io_dialog));
+
+	if (res == DEVIO_ERR_CLOSED) {
+		if (*mpk) {
+			mempak_free(*mpk);
+		}
+		free(mpk);
+		return;
+	}
+
 	if (res != 0) {
 		switch(res)
 		{
@@ -934,9 +1117,46 @@ G_MODULE_EXPORT void read_n64_pak(GtkWidget *wid, gpointer data)
 		}
 	}
 	else {
-		mpke_replaceMpk(app, mpk, NULL);
+		setMempakOnCard(app, *mpk);
+		mpke_replaceMpk(app, *mpk, NULL);
 		gtk_widget_show(GTK_WIDGET(win_mempak_edit));
 	}
+
+	free(mpk);
+}
+
+G_MODULE_EXPORT void read_n64_pak(GtkWidget *wid, gpointer data)
+{
+	struct application *app = data;
+	GET_UI_ELEMENT(GtkDialog, mempak_io_dialog);
+	GET_UI_ELEMENT(GtkLabel, mempak_op_label);
+	mempak_structure_t **cached, **mpk;
+
+	printf("N64 read mempak\n");
+	if (!app->current_adapter_handle)
+		return;
+
+	cached = calloc(1, sizeof(mempak_structure_t*));
+	mpk = calloc(1, sizeof(mempak_structure_t*));
+	if (!cached || !mpk) {
+		perror("calloc");
+		free(cached);
+		free(mpk);
+		return;
+	}
+
+	// Both requests run in order on the adapter thread
+	if (devio_submit(adapterIO(app), n64_pak_read_cached, n64_pak_read_cached_done, NULL, cached)) {
+		free(cached);
+	}
+	if (devio_submit(adapterIO(app), n64_pak_read, n64_pak_read_done, mempak_io_progress, mpk)) {
+		free(mpk);
+		errorPopup(app, "Error reading mempak");
+		return;
+	}
+
+	gtk_widget_show(GTK_WIDGET(mempak_io_dialog));
+	gtk_label_set_text(mempak_op_label, "Reading memory pack...");
 }
 
 G_MODULE_EXPORT void testVibration(GtkWidget *wid, gpointer data)
@@ -947,6 +1167,7 @@ G_MODULE_EXPORT void testVibration(GtkWidget *wid, gpointer data)
 	if ((app->firmware_maj < 3) || (app->firmware_min < 1)) {
 		errorPopup(app, "Firmware 3.1 or later required");
 	} else {
+		syncAdapterIO(app);
 		if (0 > rnt_forceVibration(app->current_adapter_handle, 0, 1)) {
 			errorPopup(app, "Error setting vibration");
 		} else {
@@ -12,6 +12,8 @@
 #include "gui_logger.h"
 #include "gui_dfu_programmer.h"
 
+struct devio;
+
 #define GET_ELEMENT(TYPE, ELEMENT)	(TYPE *)gtk_builder_get_object(app->builder, #ELEMENT)
 #define GET_UI_ELEMENT(TYPE, ELEMENT)   TYPE *ELEMENT = GET_ELEMENT(TYPE, ELEMENT)
 
@@ -22,6 +24,8 @@ struct application {
 
 	rnt_hdl_t current_adapter_handle;
 	struct rnt_adap_info current_adapter_info;
+	struct devio *devio; // I/O thread of the current adapter (see adapterIO())
+	int probe_pending;
 
 	GThreadFunc updater_thread_func;
 	GThread *updater_thread;
@@ -33,7 +37,7 @@ struct application {
 	int update_dialog_response;
 
 	struct mpkedit_data *mpke;
-	int stop_mempak_io;
+	mempak_structure_t *mpk_on_card; // Last known pak contents, for writing only what changed
 	int inhibit_periodic_updates;
 	int controller_type;
 	int firmware_maj, firmware_min, firmware_build;
@@ -46,6 +50,10 @@ struct application {
 void errorPopup(struct application *app, const char *message);
 void infoPopup(struct application *app, const char *message);
 
+/** Wait for adapter I/O started by the GUI. Call before using current_adapter_handle
+ * from code that does not go through the I/O thread. */
+void syncAdapterIO(struct application *app);
+
 /** Deselect the current adapter */
 void deselect_adapter(struct application *app);
 
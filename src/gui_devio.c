@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <gtk/gtk.h>
+#include "gcn64ctl_gui.h"
+#include "gui_devio.h"
+
+/* About once per frame */
+#define DEVIO_PROGRESS_INTERVAL_MS	16
+
+struct devio_request {
+	struct devio *io;
+	devio_func func;
+	devio_done_func done;
+	devio_progress_func progress;
+	void *data;
+	int result;
+	gint progress_value; // Written by the I/O thread
+	int progress_shown;
+};
+
+struct devio {
+	struct application *app;
+	rnt_hdl_t hdl;
+	GThread *thread;
+	GAsyncQueue *queue;
+	struct devio_request stop; // Queued to stop the thread
+	GMutex lock;
+	GCond idle;
+	int queued; // Requests queued or running (lock)
+
+	/* Main loop only */
+	int pending; // Requests submitted and not completed
+	int closed;
+	guint progress_source;
+
+	gint abort; // Abort the requests submitted so far
+	gint stopping; // Abort all requests
+	struct devio_request *current; // Running request (atomic)
+};
+
+static void devio_unref(struct devio *io)
+{
+	if (!io->closed || io->pending)
+		return;
+
+	g_async_queue_unref(io->queue);
+	g_mutex_clear(&io->lock);
+	g_cond_clear(&io->idle);
+	free(io);
+}
+
+static gboolean devio_showProgress(gpointer data)
+{
+	struct devio *io = data;
+	struct devio_request *rq = g_atomic_pointer_get(&io->current);
+	int value;
+
+	/* Requests are only released on the main loop, so rq stays valid here */
+	if (rq && rq->progress && !io->closed) {
+		value = g_atomic_int_get(&rq->progress_value);
+		if (value != rq->progress_shown) {
+			rq->progress_shown = value;
+			rq->progress(io->app, value);
+		}
+	}
+
+	if (!io->pending) {
+		io->progress_source = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean devio_complete(gpointer data)
+{
+	struct devio_request *rq = data;
+	struct devio *io = rq->io;
+
+	if (io->closed) {
+		if (rq->done) {
+			rq->done(io->app, rq->data, DEVIO_ERR_CLOSED);
+		}
+	} else {
+		if (rq->progress) {
+			int value = g_atomic_int_get(&rq->progress_value);
+
+			if (value != rq->progress_shown) {
+				rq->progress(io->app, value);
+			}
+		}
+		if (rq->done) {
+			rq->done(io->app, rq->data, rq->result);
+		}
+	}
+
+	/* Only now, so io stays valid if the done callback closes the adapter */
+	io->pending--;
+	free(rq);
+	devio_unref(io);
+
+	return FALSE;
+}
+
+static gpointer devio_thread(gpointer data)
+{
+	struct devio *io = data;
+	struct devio_request *rq;
+
+	while (1) {
+		rq = g_async_queue_pop(io->queue);
+		if (rq == &io->stop)
+			break;
+
+		g_atomic_pointer_set(&io->current, rq);
+		rq->result = rq->func(io->hdl, rq);
+		g_atomic_pointer_set(&io->current, NULL);
+
+		g_mutex_lock(&io->lock);
+		if (--io->queued == 0) {
+			g_atomic_int_set(&io->abort, 0);
+			g_cond_broadcast(&io->idle);
+		}
+		g_mutex_unlock(&io->lock);
+
+		gdk_threads_add_idle(devio_complete, rq);
+	}
+
+	return NULL;
+}
+
+struct devio *devio_new(struct application *app, rnt_hdl_t hdl)
+{
+	struct devio *io;
+
+	io = calloc(1, sizeof(struct devio));
+	if (!io) {
+		perror("calloc");
+		return NULL;
+	}
+
+	io->app = app;
+	io->hdl = hdl;
+	io->queue = g_async_queue_new();
+	g_mutex_init(&io->lock);
+	g_cond_init(&io->idle);
+	io->thread = g_thread_new("adapter-io", devio_thread, io);
+
+	return io;
+}
+
+void devio_free(struct devio *io)
+{
+	if (!io)
+		return;
+
+	/* Requests still queued run, but are told to stop at their first progress
+	 * report. Their completions are all scheduled once the thread has exited. */
+	g_atomic_int_set(&io->stopping, 1);
+	g_async_queue_push(io->queue, &io->stop);
+	g_thread_join(io->thread);
+
+	if (io->progress_source) {
+		g_source_remove(io->progress_source);
+		io->progress_source = 0;
+	}
+
+	io->closed = 1;
+	devio_unref(io);
+}
+
+rnt_hdl_t devio_getHandle(struct devio *io)
+{
+	return io->hdl;
+}
+
+int devio_submit(struct devio *io, devio_func func, devio_done_func done, devio_progress_func progress, void *data)
+{
+	struct devio_request *rq;
+
+	if (!io || io->closed)
+		return -1;
+
+	rq = calloc(1, sizeof(struct devio_request));
+	if (!rq) {
+		perror("calloc");
+		return -1;
+	}
+
+	rq->io = io;
+	rq->func = func;
+	rq->done = done;
+	rq->progress = progress;
+	rq->data = data;
+
+	io->pending++;
+	if (progress && !io->progress_source) {
+		io->progress_source = g_timeout_add(DEVIO_PROGRESS_INTERVAL_MS, devio_showProgress, io);
+	}
+
+	g_mutex_lock(&io->lock);
+	io->queued++;
+	g_mutex_unlock(&io->lock);
+
+	g_async_queue_push(io->queue, rq);
+
+	return 0;
+}
+
+int devio_busy(struct devio *io)
+{
+	return io && io->pending;
+}
+
+void devio_sync(struct devio *io)
+{
+	if (!io)
+		return;
+
+	g_mutex_lock(&io->lock);
+	while (io->queued) {
+		g_cond_wait(&io->idle, &io->lock);
+	}
+	g_mutex_unlock(&io->lock);
+}
+
+void devio_abort(struct devio *io)
+{
+	if (io) {
+		g_atomic_int_set(&io->abort, 1);
+	}
+}
+
+void *devio_getData(struct devio_request *rq)
+{
+	return rq->data;
+}
+
+int devio_progressCallback(int progress, void *ctx)
+{
+	struct devio_request *rq = ctx;
+
+	g_atomic_int_set(&rq->progress_value, progress);
+
+	return g_atomic_int_get(&rq->io->abort) || g_atomic_int_get(&rq->io->stopping);
+}
@@ -0,0 +1,57 @@
+#ifndef _gui_devio_h__
+#define _gui_devio_h__
+
+#include "gcn64ctl_gui.h"
+
+/* Adapter I/O thread. Each open adapter gets a thread that runs requests one
+ * at a time, in order, so the GTK main loop never waits for the adapter.
+ * Completion is reported on the main loop, and progress at most once per
+ * display frame. */
+
+#define DEVIO_ERR_CLOSED	-100 // Result given to the done callback when the adapter was closed
+
+struct devio;
+struct devio_request;
+
+/** Runs on the I/O thread. The return value is passed to the done callback. */
+typedef int (*devio_func)(rnt_hdl_t hdl, struct devio_request *rq);
+/** Runs on the main loop, once the request has completed. Must release data. */
+typedef void (*devio_done_func)(struct application *app, void *data, int result);
+/** Runs on the main loop */
+typedef void (*devio_progress_func)(struct application *app, int progress);
+
+struct devio *devio_new(struct application *app, rnt_hdl_t hdl);
+
+/** Abort the running request, wait for the I/O thread and release the context.
+ * Done callbacks of unfinished requests get DEVIO_ERR_CLOSED. */
+void devio_free(struct devio *io);
+
+rnt_hdl_t devio_getHandle(struct devio *io);
+
+/**
+ * \brief Queue a request
+ * \param func The function to run on the I/O thread
+ * \param done Called on the main loop with the result (can be NULL)
+ * \param progress Called on the main loop when the progress changes (can be NULL)
+ * \param data Request data, available to func through devio_getData()
+ */
+int devio_submit(struct devio *io, devio_func func, devio_done_func done, devio_progress_func progress, void *data);
+
+/** \brief Return true if requests are queued or running */
+int devio_busy(struct devio *io);
+
+/** \brief Wait until all queued requests have run (completions may still be pending).
+ * Can be called from any thread. */
+void devio_sync(struct devio *io);
+
+/** \brief Ask the running and queued requests to stop (see devio_progressCallback) */
+void devio_abort(struct devio *io);
+
+/* For use by devio_func */
+void *devio_getData(struct devio_request *rq);
+
+/** \brief Progress callback for gcn64lib functions. ctx is the request.
+ * \return Non-zero when the request should stop */
+int devio_progressCallback(int progress, void *ctx);
+
+#endif // _gui_devio_h__
@@ -7,6 +7,7 @@
 
 #include "gcn64ctl_gui.h"
 #include "gui_dfu_programmer.h"
+#include "timer.h"
 
 /**
  * \brief Execute a process, reading its output and returning the exit status.
@@ -29,11 +30,9 @@ int dfu_wrapper(const char *command, void (*lineCallback)(void *ctx, const char
 		return DFU_POPEN_FAILED;
 	}
 
-	do {
+	while (fgets(linebuf, sizeof(linebuf), dfu_fp)) {
 		char *nl = "\n";
 
-		fgets(linebuf, sizeof(linebuf), dfu_fp);
-
 		if (strrchr(linebuf, '\n'))
 			nl = "";
 		if (strrchr(linebuf, '\r'))
@@ -42,10 +41,9 @@ int dfu_wrapper(const char *command, void (*lineCallback)(void *ctx, const char
 		updatelog_append("[dfu-update message] : %s%s", linebuf, nl);
 
 		if (lineCallback) {
-			lineCallback(linebuf, ctx);
+			lineCallback(ctx, linebuf);
 		}
-
-	} while(!feof(dfu_fp));
+	}
 
 	res = pclose(dfu_fp);
 	if (res < 0) {
@@ -66,3 +64,62 @@ int dfu_wrapper(const char *command, void (*lineCallback)(void *ctx, const char
 
 	return DFU_OK;
 }
+
+/* Parse "dfu-programmer 0.7.2" into 7 (major * 100 + minor) */
+static void dfu_versionCallback(void *ctx, const char *ln)
+{
+	int *version = ctx;
+	int major, minor;
+
+	if (2 == sscanf(ln, "dfu-programmer %d.%d", &major, &minor)) {
+		*version = major * 100 + minor;
+	}
+}
+
+/**
+ * \brief Check if dfu-programmer supports erase --force (0.7.0 and later)
+ */
+int dfu_supportsForceErase(void)
+{
+	int version = 0;
+
+	dfu_wrapper("dfu-programmer --version 2>&1", dfu_versionCallback, &version);
+	updatelog_append("dfu-programmer version: %d.%d\n", version / 100, version % 100);
+
+	return version >= 7;
+}
+
+/**
+ * \brief Wait until the bootloader answers.
+ *
+ * The bootloader is queried when called, and again each time USB devices
+ * are connected or disconnected (or periodically when hotplug events are not
+ * available) until it answers or the timeout expires.
+ *
+ * \param mcu The MCU name for dfu-programmer
+ * \param timeout_ms How long to wait
+ * \return DFU_OK, DFU_POPEN_FAILED or DFU_ERROR_RETURN (timeout)
+ */
+int dfu_waitForDevice(const char *mcu, int timeout_ms)
+{
+	uint64_t deadline = getMilliseconds() + timeout_ms;
+	int64_t remaining;
+	char cmdstr[256];
+	int res;
+
+	snprintf(cmdstr, sizeof(cmdstr), "dfu-programmer %s get bootloader-version 2>&1", mcu);
+
+	while (1) {
+		res = dfu_wrapper(cmdstr, NULL, NULL);
+		if (res != DFU_ERROR_RETURN)
+			return res;
+
+		remaining = deadline - getMilliseconds();
+		if (remaining <= 0) {
+			updatelog_append("Timeout waiting for the bootloader\n");
+			return DFU_ERROR_RETURN;
+		}
+
+		rnt_waitDeviceChange(remaining);
+	}
+}
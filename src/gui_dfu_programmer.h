@@ -9,5 +9,7 @@
 #define DFU_ERROR_RETURN	-2
 
 int dfu_wrapper(const char *command, void (*lineCallback)(void *ctx, const char *ln), void *ctx);
+int dfu_supportsForceErase(void);
+int dfu_waitForDevice(const char *mcu, int timeout_ms);
 
 #endif // _gui_dfu_programmer_h__
@@ -6,13 +6,13 @@
 #include "gui_fwupd.h"
 #include "gui_update_progress_dialog.h"
 #include "ihex_signature.h"
+#include "timer.h"
 
-#define BOOTLOADER_DELAY	5
-#define FORCE_ERASE_DELAY	2
+#define BOOTLOADER_TIMEOUT_MS	10000
 #define ERASE_RETRIES	10
-#define ERASE_DELAY_S	5
 #define PROGRAMMING_RETRIES	3
-#define PROGRAMMING_DELAY_S	5
+#define RETRY_TIMEOUT_MS	5000
+#define RESTART_TIMEOUT_MS	7000
 
 static void update_preview_cb(GtkFileChooser *chooser, gpointer data)
 {
@@ -158,6 +158,8 @@ gpointer gcn64usb_updateFunc(gpointer data)
 	int res;
 	int retries = 10;
 	int n_adapters_before = 0;
+	int force_erase;
+	uint64_t deadline;
 	const char *mcu = "atmega32u2";
 	const char *xtra = "";
 	char cmdstr[1024];
@@ -169,6 +171,7 @@ gpointer gcn64usb_updateFunc(gpointer data)
 	}
 
 	app->inhibit_periodic_updates = 1;
+	syncAdapterIO(app);
 
 	setUpdateStatus(app, "Starting...", 1);
 
@@ -182,32 +185,33 @@ gpointer gcn64usb_updateFunc(gpointer data)
 		updatelog_append("%d adapters present before recovery\n", n_adapters_before);
 	}
 
-	sleep(BOOTLOADER_DELAY);
+	/* Continue as soon as the bootloader answers */
+	res = dfu_waitForDevice(mcu, BOOTLOADER_TIMEOUT_MS);
+	if (res == DFU_POPEN_FAILED) {
+		updateThreadDone(app, GTK_RESPONSE_REJECT);
+		updatelog_append("Could not run dfu-programmer");
+		return NULL;
+	}
+
+	/* For some reason, many users got in a situation where the adapter
+	 * was erased according to dfu-programmer:
+	 *
+	 *  "Chip already blank, to force erase use --force".
+	 *
+	 * Yet, flashing the firmware would fail until the command with --force
+	 * was run manually...
+	 *
+	 * --force is not available on older dfu-programmer versions, so it is
+	 * only used when the installed version supports it.
+	 */
+	force_erase = dfu_supportsForceErase();
 
 	/************* ERASE CHIP **************/
 	setUpdateStatus(app, "Erasing chip...", 19);
 	for (retries = 0; retries < ERASE_RETRIES; retries++)
 	{
-		snprintf(cmdstr, sizeof(cmdstr), "dfu-programmer %s erase --debug 99%s", mcu, xtra);
+		snprintf(cmdstr, sizeof(cmdstr), "dfu-programmer %s erase%s --debug 99%s", mcu, force_erase ? " --force" : "", xtra);
 		res = dfu_wrapper(cmdstr, NULL, NULL);
-
-		/* For some reason, many users got in a situation where the adapter
-		 * was erased according to dfu-programmer:
-		 *
-		 *  "Chip already blank, to force erase use --force".
-		 *
-		 * Yet, flashing the firmware would fail until the command with --force
-		 * was run manually...
-		 *
-		 * I would just use --force here, but since it is not available on older
-		 * dfu-programmer versions, I run the old command too and ignore the result
-		 * from the second.
-		 */
-		sleep(FORCE_ERASE_DELAY);
-		snprintf(cmdstr, sizeof(cmdstr), "dfu-programmer %s erase --force --debug 99%s", mcu, xtra);
-		dfu_wrapper(cmdstr, NULL, NULL);
-
-		// res from the first dfu-programmer execution without --force.
 		if (res == DFU_OK)
 			break;
 
@@ -218,7 +222,7 @@ gpointer gcn64usb_updateFunc(gpointer data)
 		}
 
 		setUpdateStatus(app, NULL, ++app->update_percent);
-		sleep(ERASE_DELAY_S);
+		dfu_waitForDevice(mcu, RETRY_TIMEOUT_MS);
 	}
 
 	if (retries == ERASE_RETRIES) {
@@ -250,7 +254,7 @@ gpointer gcn64usb_updateFunc(gpointer data)
 		}
 
 		setUpdateStatus(app, NULL, ++app->update_percent);
-		sleep(PROGRAMMING_DELAY_S);
+		dfu_waitForDevice(mcu, RETRY_TIMEOUT_MS);
 	}
 
 	if (retries == PROGRAMMING_RETRIES) {
@@ -275,23 +279,17 @@ gpointer gcn64usb_updateFunc(gpointer data)
 
 	setUpdateStatus(app, "Waiting for device...", 90);
 
-	retries = 6;
-	do {
-		if (app->recovery_mode) {
-			/* In recovery mode, we cannot know which serial number to expect. Detect the
-			 * new adapter by counting and comparing to what we had before reprogramming
-			 * the firmware. */
-			if (n_adapters_before != rnt_countDevices())
-				break;
-		} else {
-			app->current_adapter_handle = rnt_openBy(&app->current_adapter_info, GCN64_FLG_OPEN_BY_SERIAL);
-			if (app->current_adapter_handle)
-				break;
+	if (app->recovery_mode) {
+		/* In recovery mode, we cannot know which serial number to expect. Detect the
+		 * new adapter by counting and comparing to what we had before reprogramming
+		 * the firmware. The list is only enumerated again when devices come and go. */
+		deadline = getMilliseconds() + RESTART_TIMEOUT_MS;
+		while (n_adapters_before == rnt_countDevices() && getMilliseconds() < deadline) {
+			rnt_waitDeviceChange(deadline - getMilliseconds());
 		}
-
-		sleep(1);
-		setUpdateStatus(app, NULL, ++app->update_percent);
-	} while (retries--);
+	} else {
+		app->current_adapter_handle = rnt_waitOpenBy(&app->current_adapter_info, GCN64_FLG_OPEN_BY_SERIAL, RESTART_TIMEOUT_MS);
+	}
 
 	/* In recovery mode, don't bother selecting the now functional adapter. The
 	 * list of serial numbers would need to be stored before programming, etc etc. */
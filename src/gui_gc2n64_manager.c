@@ -76,7 +76,7 @@ gpointer gc2n64_updateFunc(gpointer data)
 	int channel = 0;
 
 	setUpdateStatus(app, "Installing new firmware...", 50);
-	x2gcn64_adapter_updateFirmware(app->current_adapter_handle, channel, app->updateHexFile, NULL);
+	x2gcn64_adapter_updateFirmware(app->current_adapter_handle, channel, app->updateHexFile, NULL, NULL);
 	setUpdateStatus(app, "Done", 100);
 
 	updateThreadDone(app, GTK_RESPONSE_OK);
@@ -99,6 +99,7 @@ G_MODULE_EXPORT void gc2n64_manager_upgrade(GtkWidget *win, gpointer data)
 	updatelog_append("GC2N64 firmware update clicked");
 
 	app->inhibit_periodic_updates = 1;
+	syncAdapterIO(app);
 
 	sig = x2gcn64_getAdapterSignature(app->inf.adapter_type);
 
@@ -26,6 +26,7 @@ struct mpkedit_data {
 	struct mempak_structure *mpk;
 	char *filename;
 	int modified;
+	int cached; // Shown from the image cache, not confirmed by reading the pak
 };
 
 struct mpkedit_data *mpkedit_new(struct application *app)
@@ -101,8 +102,10 @@ void mpke_syncTitle(struct application *app)
 		printf("New title: %s\n", titlebuf);
 		gtk_window_set_title(win_mempak_edit, titlebuf);
 	} else {
-		snprintf(titlebuf, sizeof(titlebuf), "N64 Mempak editor%s",
+		snprintf(titlebuf, sizeof(titlebuf), "N64 Mempak editor%s%s",
+			app->mpke->cached ? " [CACHED]" : "",
 			app->mpke->modified ? " [NOT SAVED]" : "");
+		gtk_window_set_title(win_mempak_edit, titlebuf);
 	}
 }
 
@@ -124,12 +127,19 @@ void mpke_replaceMpk(struct application *app, mempak_structure_t *mpk, const cha
 	}
 
 	app->mpke->mpk = mpk;
+	app->mpke->cached = 0;
 
 	mpke_syncModel(app);
 
 	mpke_updateFilename(app, filename);
 }
 
+void mpke_setCached(struct application *app, int cached)
+{
+	app->mpke->cached = cached;
+	mpke_syncTitle(app);
+}
+
 void mpke_syncModel(struct application *app)
 {
 	GET_UI_ELEMENT(GtkListStore, n64_notes);
@@ -401,7 +411,7 @@ G_MODULE_EXPORT void mpke_save(GtkWidget *win, gpointer data)
 	if (!app->mpke->filename) {
 		mpke_saveas(win, data);
 	} else {
-		mempak_saveToFile(app->mpke->mpk, app->mpke->filename, app->mpke->mpk->file_format);
+		mempak_updateFile(app->mpke->mpk, app->mpke->filename);
 		app->mpke->modified = 0;
 		mpke_syncTitle(app);
 	}
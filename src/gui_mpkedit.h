@@ -9,6 +9,8 @@ struct application;
 struct mpkedit_data *mpkedit_new(struct application *app);
 void mpkedit_free(struct mpkedit_data *mpke);
 void mpke_replaceMpk(struct application *app, mempak_structure_t *mpk, const char *filename);
+/* Mark the contents as coming from the image cache (until replaced) */
+void mpke_setCached(struct application *app, int cached);
 mempak_structure_t *mpke_getCurrentMempak(struct application *app);
 
 #endif
@@ -27,6 +27,7 @@ G_MODULE_EXPORT void read_psx_memcard(GtkWidget *wid, gpointer data)
 	}
 
 	app->inhibit_periodic_updates = 1;
+	syncAdapterIO(app);
 	rnt_suspendPolling(app->current_adapter_handle, 1);
 	res = psxlib_readMemoryCard(app->current_adapter_handle, 0, mc_data, u);
 	rnt_suspendPolling(app->current_adapter_handle, 0);
@@ -133,6 +134,7 @@ G_MODULE_EXPORT void write_psx_memcard(GtkWidget *wid, gpointer data)
 
 		if (res == GTK_RESPONSE_ACCEPT) {
 			app->inhibit_periodic_updates = 1;
+			syncAdapterIO(app);
 			rnt_suspendPolling(app->current_adapter_handle, 1);
 			res = psxlib_writeMemoryCard(app->current_adapter_handle, 0, mc_data, u);
 			if (res < 0) {
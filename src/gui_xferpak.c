@@ -7,9 +7,8 @@
 #include "xferpak_tools.h"
 #include "uiio_gtk.h"
 
-G_MODULE_EXPORT void gui_xferpak_readram(GtkWidget *win, gpointer data)
+static void xferpak_readram(struct application *app)
 {
-	struct application *app = data;
 	xferpak *xpak;
 	uiio *u = getUIIO_gtk(NULL, app->mainwindow);
 	GtkWidget *dialog;
@@ -22,9 +21,6 @@ G_MODULE_EXPORT void gui_xferpak_readram(GtkWidget *win, gpointer data)
 	unsigned char *mem;
 	u->caption = "Reading cartridge RAM...";
 
-	if (!app->current_adapter_handle)
-		return;
-
 	/* Prepare xferpak */
 	xpak = gcn64lib_xferpak_init(app->current_adapter_handle, 0, u);
 	if (!xpak) {
@@ -91,9 +87,8 @@ G_MODULE_EXPORT void gui_xferpak_readram(GtkWidget *win, gpointer data)
 	xferpak_free(xpak);
 }
 
-G_MODULE_EXPORT void gui_xferpak_readrom(GtkWidget *win, gpointer data)
+static void xferpak_readrom(struct application *app)
 {
-	struct application *app = data;
 	xferpak *xpak;
 	uiio *u = getUIIO_gtk(NULL, app->mainwindow);
 	GtkWidget *dialog;
@@ -106,9 +101,6 @@ G_MODULE_EXPORT void gui_xferpak_readrom(GtkWidget *win, gpointer data)
 	unsigned char *mem;
 	u->caption = "Reading cartridge ROM...";
 
-	if (!app->current_adapter_handle)
-		return;
-
 	/* Prepare xferpak */
 	xpak = gcn64lib_xferpak_init(app->current_adapter_handle, 0, u);
 	if (!xpak) {
@@ -169,9 +161,8 @@ G_MODULE_EXPORT void gui_xferpak_readrom(GtkWidget *win, gpointer data)
 	xferpak_free(xpak);
 }
 
-G_MODULE_EXPORT void gui_xferpak_writeram(GtkWidget *win, gpointer data)
+static void xferpak_writeram(struct application *app)
 {
-	struct application *app = data;
 	xferpak *xpak;
 	uiio *u = getUIIO_gtk(NULL, app->mainwindow);
 	GtkWidget *dialog;
@@ -182,9 +173,6 @@ G_MODULE_EXPORT void gui_xferpak_writeram(GtkWidget *win, gpointer data)
 	gint res;
 	u->caption = "Writing cartridge RAM...";
 
-	if (!app->current_adapter_handle)
-		return;
-
 	/* Prepare xferpak */
 	xpak = gcn64lib_xferpak_init(app->current_adapter_handle, 0, u);
 	if (!xpak) {
@@ -232,9 +220,8 @@ G_MODULE_EXPORT void gui_xferpak_writeram(GtkWidget *win, gpointer data)
 }
 
 
-G_MODULE_EXPORT void gui_xferpak_showinfo(GtkWidget *win, gpointer data)
+static void xferpak_showinfo(struct application *app)
 {
-	struct application *app = data;
 	GET_UI_ELEMENT(GtkDialog, gbcart_info_dialog);
 	gint res;
 	xferpak *xpak;
@@ -246,9 +233,6 @@ G_MODULE_EXPORT void gui_xferpak_showinfo(GtkWidget *win, gpointer data)
 	char tmpstr[64];
 	uiio *u = getUIIO_gtk(NULL, app->mainwindow);
 
-	if (!app->current_adapter_handle)
-		return;
-
 	/* Prepare xferpak */
 	xpak = gcn64lib_xferpak_init(app->current_adapter_handle, 0, u);
 	if (!xpak) {
@@ -276,3 +260,36 @@ G_MODULE_EXPORT void gui_xferpak_showinfo(GtkWidget *win, gpointer data)
 
 	xferpak_free(xpak);
 }
+
+/* The transfer pak stays powered and selected while the dialogs are open, so
+ * the periodic controller probe is held off for the whole operation. */
+static void run_xferpak_op(struct application *app, void (*op)(struct application *app))
+{
+	if (!app->current_adapter_handle)
+		return;
+
+	app->inhibit_periodic_updates = 1;
+	syncAdapterIO(app);
+	op(app);
+	app->inhibit_periodic_updates = 0;
+}
+
+G_MODULE_EXPORT void gui_xferpak_readram(GtkWidget *win, gpointer data)
+{
+	run_xferpak_op(data, xferpak_readram);
+}
+
+G_MODULE_EXPORT void gui_xferpak_readrom(GtkWidget *win, gpointer data)
+{
+	run_xferpak_op(data, xferpak_readrom);
+}
+
+G_MODULE_EXPORT void gui_xferpak_writeram(GtkWidget *win, gpointer data)
+{
+	run_xferpak_op(data, xferpak_writeram);
+}
+
+G_MODULE_EXPORT void gui_xferpak_showinfo(GtkWidget *win, gpointer data)
+{
+	run_xferpak_op(data, xferpak_showinfo);
+}
@@ -40,6 +40,10 @@
 #include "pcelib.h"
 #include "pollraw.h"
 #include "psxlib.h"
+#include "multiadapter.h"
+#include "rnt_sim.h"
+#include "rnt_trace.h"
+#include "timer.h"
 
 static void printUsage(void)
 {
@@ -49,14 +53,43 @@ static void printUsage(void)
 	printf("Options:\n");
 	printf("  -h, --help            Print help\n");
 	printf("  -l, --list            List devices\n");
+	printf("      --monitor         Print devices as they are connected and disconnected\n");
 	printf("  -s serial             Operate on specified device (required unless -f is specified)\n");
 	printf("  -f, --force           If no serial is specified, use first device detected.\n");
+	printf("      --all             Run the command on all adapters at once. Supported commands are\n");
+	printf("                        --n64_mempak_dump, --xfer_dump_rom, --psx_mc_dump and --x2gcn64_update.\n");
+	printf("                        The adapter serial number is appended to output file names.\n");
+	printf("      --sim spec        Add a simulated adapter (serial SIM0, SIM1, ...). Can be repeated. The spec is\n");
+	printf("                        a comma separated list of settings, for instance:\n");
+	printf("                        ch0=mempak,ch1=xferpak,latency=500,jitter=200,errors=1000,seed=1\n");
+	printf("                        Devices: none, controller, mempak, xferpak, psx_mc, wii_ext. Use pid=0x.... to\n");
+	printf("                        select the emulated adapter. Latency and jitter are in microseconds, errors\n");
+	printf("                        corrupts one transfer in N.\n");
+	printf("      --stats           Display adapter communication statistics when done.\n");
+	printf("      --trace file      Record every report exchanged with the adapter to a file.\n");
+	printf("      --replay file     Run the command on a session recorded with --trace instead of an adapter.\n");
+	printf("                        Answers are delayed as they were in the recorded session.\n");
+	printf("      --replay_fast     With --replay, do not delay answers.\n");
 	printf("  -o, --outfile file    Output file for read operations (eg: --n64-mempak-dump)\n");
 	//printf("  -i, --infile file     Input file for write operations (eg: --gc_to_n64_update)\n");
 	printf("      --nonstop         Continue testing forever or until an error occurs.\n");
 	printf("      --noconfirm       Skip asking the user for confirmation.\n");
 	printf("  -c, --channel chn     Specify channel to use where applicable (for multi-player adapters\n");
 	printf("                        and raw commands, development commands and GC2N64 I/O)\n");
+	printf("      --all_channels    With --n64_mempak_dump, read the mempaks of all ports at once. The channel\n");
+	printf("                        number is appended to output file names.\n");
+	printf("      --diff            With --n64_mempak_write or --psx_mc_write, read the card first and only\n");
+	printf("                        write what changed.\n");
+	printf("      --verify          With --diff, read back and compare what was written.\n");
+	printf("      --from_cache      With --n64_mempak_dump or --psx_mc_dump, use the image cached when the card\n");
+	printf("                        was last read or written instead of reading it. With --n64_mempak_write\n");
+	printf("                        --diff, compare with the cached image instead of reading the mempak. The\n");
+	printf("                        pak must not have been used elsewhere since: Mempaks are identified by their\n");
+	printf("                        ID block and memory cards by their directory, which saving a game may not\n");
+	printf("                        change.\n");
+	printf("      --timeout ms      Time to wait for the adapter to answer a command (default: %d)\n", RNT_DEFAULT_TIMEOUT_MS);
+	printf("      --busy_wait       Poll for answers continuously instead of backing off (uses more CPU)\n");
+	printf("      --wait ms         Wait up to ms for the adapter to be connected (eg: after a firmware update)\n");
 	printf("\n");
 	printf("Configuration commands:\n");
 	printf("  --get_version                      Read adapter firmware version\n");
@@ -98,7 +131,10 @@ static void printUsage(void)
 	printf("  --n64_init_rumble                  Send rumble pack init command\n");
 	printf("  --n64_control_rumble value         Turn rumble on when value != 0\n");
 	printf("  --biosensor                        Display heart beat using bio sensor\n");
-	printf("  --perftest                         Do a performance test (raw IO timing)\n");
+	printf("  --bench                            Measure latency, throughput and block IO packing. Mempak,\n");
+	printf("                                     transfer pak and PSX memory card tests run when one is present.\n");
+	printf("      --bench_json file              Also write the results to a file in JSON format\n");
+	printf("      --bench_cycles n               Number of samples per latency test (default %d)\n", PERFTEST_DEFAULT_CYCLES);
 	printf("\n");
 	printf("Raw Wiimote extension commands (for WUSBMote v2 adapters):\n");
 	printf("  --disable_encryption               Perform the steps to disable encryption on a controller\n");
@@ -217,6 +253,22 @@ static void printUsage(void)
 #define OPT_PSX_MC_WRITE				357
 #define OPT_N64_CRCA					358
 #define OPT_N64_CRCD					359
+#define OPT_TIMEOUT						360
+#define OPT_BUSY_WAIT					361
+#define OPT_ALL_ADAPTERS				362
+#define OPT_ALL_CHANNELS				363
+#define OPT_DIFF						364
+#define OPT_VERIFY						365
+#define OPT_FROM_CACHE					366
+#define OPT_BENCH_JSON					367
+#define OPT_BENCH_CYCLES				368
+#define OPT_SIM							369
+#define OPT_TRACE						370
+#define OPT_REPLAY						371
+#define OPT_REPLAY_FAST					372
+#define OPT_STATS						373
+#define OPT_WAIT						374
+#define OPT_MONITOR						375
 
 struct option longopts[] = {
 	{ "help", 0, NULL, 'h' },
@@ -268,6 +320,16 @@ struct option longopts[] = {
 	{ "n64_init_rumble", 0, NULL, OPT_N64_INIT_RUMBLE },
 	{ "n64_control_rumble", 1, NULL, OPT_N64_CONTROL_RUMBLE },
 	{ "perftest", 0, NULL, OPT_PERFTEST },
+	{ "bench", 0, NULL, OPT_PERFTEST },
+	{ "bench_json", required_argument, NULL, OPT_BENCH_JSON },
+	{ "bench_cycles", required_argument, NULL, OPT_BENCH_CYCLES },
+	{ "sim", required_argument, NULL, OPT_SIM },
+	{ "trace", required_argument, NULL, OPT_TRACE },
+	{ "replay", required_argument, NULL, OPT_REPLAY },
+	{ "replay_fast", 0, NULL, OPT_REPLAY_FAST },
+	{ "stats", 0, NULL, OPT_STATS },
+	{ "wait", required_argument, NULL, OPT_WAIT },
+	{ "monitor", 0, NULL, OPT_MONITOR },
 	{ "biosensor", 0, NULL, OPT_BIOSENSOR },
 	{ "xfer_info", 0, NULL, OPT_XFERPAK_INFO },
 	{ "xfer_dump_rom", required_argument, NULL, OPT_XFERPAK_DUMP_ROM },
@@ -287,6 +349,13 @@ struct option longopts[] = {
 	{ "db9_pollraw", 0, NULL, OPT_DB9_POLLRAW },
 	{ "n64_crca", required_argument, NULL, OPT_N64_CRCA },
 	{ "n64_crcd", required_argument, NULL, OPT_N64_CRCD },
+	{ "timeout", required_argument, NULL, OPT_TIMEOUT },
+	{ "busy_wait", 0, NULL, OPT_BUSY_WAIT },
+	{ "all", 0, NULL, OPT_ALL_ADAPTERS },
+	{ "all_channels", 0, NULL, OPT_ALL_CHANNELS },
+	{ "diff", 0, NULL, OPT_DIFF },
+	{ "verify", 0, NULL, OPT_VERIFY },
+	{ "from_cache", 0, NULL, OPT_FROM_CACHE },
 	{ },
 };
 
@@ -296,6 +365,208 @@ static int mempak_progress_cb(int addr, void *ctx)
 	return 0;
 }
 
+static int mempak_channels_progress_cb(int channel, int addr, void *ctx)
+{
+	printf("\rReading address 0x%04x / 0x%04x (channel %d)  ", addr, MEMPAK_MEM_SIZE, channel); fflush(stdout);
+	return 0;
+}
+
+static int dumpAllChannelMempaks(rnt_hdl_t hdl, const char *outfile)
+{
+	struct rnt_adap_info info;
+	mempak_structure_t **paks;
+	int *channels;
+	int i, n_channels, res, n_failed = 0;
+
+	if (rnt_getInfo(hdl, &info)) {
+		return -1;
+	}
+	// Raw channels: An adapter may have more SI ports than it presents controllers
+	n_channels = info.caps.n_raw_channels;
+	if (n_channels < 1) {
+		n_channels = info.caps.n_channels;
+	}
+	if (n_channels < 1) {
+		n_channels = 1;
+	}
+
+	channels = calloc(n_channels, sizeof(int));
+	paks = calloc(n_channels, sizeof(mempak_structure_t *));
+	if (!channels || !paks) {
+		perror("calloc");
+		free(channels);
+		free(paks);
+		return -1;
+	}
+	for (i=0; i<n_channels; i++) {
+		channels[i] = i;
+	}
+
+	printf("Reading mempaks on %d channel(s)...\n", n_channels);
+	res = gcn64lib_mempak_downloadChannels(hdl, channels, n_channels, paks, mempak_channels_progress_cb, NULL);
+	printf("\n");
+	if (res < 0) {
+		fprintf(stderr, "Error reading mempaks\n");
+		free(channels);
+		free(paks);
+		return res;
+	}
+
+	for (i=0; i<n_channels; i++) {
+		if (!paks[i]) {
+			n_failed++;
+			continue;
+		}
+
+		if (outfile) {
+			char filename[256];
+			const char *ext = strrchr(outfile, '.');
+			int file_format = mempak_getFilenameFormat(outfile);
+
+			if (!ext || strchr(ext, '/')) {
+				ext = outfile + strlen(outfile);
+			}
+			res = snprintf(filename, sizeof(filename), "%.*s_ch%d%s", (int)(ext - outfile), outfile, channels[i], ext);
+
+			if (res < 0 || res >= sizeof(filename)) {
+				fprintf(stderr, "Output file name too long\n");
+				n_failed++;
+			} else if (file_format == MPK_FORMAT_INVALID) {
+				fprintf(stderr, "Unknown file format (neither .MPK nor .N64). Not saving.\n");
+				n_failed++;
+			} else if (0 == mempak_saveToFile(paks[i], filename, file_format)) {
+				printf("Wrote file '%s' in %s format\n", filename, mempak_format2string(file_format));
+			} else {
+				fprintf(stderr, "error writing file '%s'\n", filename);
+				n_failed++;
+			}
+		} else {
+			printf("Channel %d:\n", channels[i]);
+			mempak_hexdump(paks[i]);
+		}
+		mempak_free(paks[i]);
+	}
+
+	free(channels);
+	free(paks);
+
+	return n_failed ? -1 : 0;
+}
+
+static int runOnAllAdapters(int argc, char **argv, const char *short_optstr, const char *outfile, int channel)
+{
+	struct multiadapter_job job = { };
+	int opt, n_jobs = 0;
+
+	job.channel = channel;
+
+	optind = 1;
+	while((opt = getopt_long(argc, argv, short_optstr, longopts, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case OPT_N64_MEMPAK_DUMP:
+				job.type = MULTIADAPTER_JOB_MEMPAK_DUMP;
+				job.filename = outfile;
+				n_jobs++;
+				break;
+			case OPT_PSX_MC_DUMP:
+				job.type = MULTIADAPTER_JOB_PSX_MC_DUMP;
+				job.filename = outfile;
+				n_jobs++;
+				break;
+			case OPT_XFERPAK_DUMP_ROM:
+				job.type = MULTIADAPTER_JOB_XFERPAK_DUMP_ROM;
+				job.filename = optarg;
+				n_jobs++;
+				break;
+			case OPT_GC_TO_N64_UPDATE:
+				job.type = MULTIADAPTER_JOB_X2GCN64_UPDATE;
+				job.filename = optarg;
+				n_jobs++;
+				break;
+		}
+	}
+
+	if (n_jobs != 1) {
+		fprintf(stderr, "--all requires exactly one supported command. Try -h\n");
+		return 1;
+	}
+
+	if (!job.filename) {
+		fprintf(stderr, "An output file is required (--outfile)\n");
+		return 1;
+	}
+
+	return multiadapter_run(&job) == 0 ? 0 : 1;
+}
+
+static const char *requestName(int rq)
+{
+	switch (rq)
+	{
+		case RQ_RNT_ECHO: return "ECHO";
+		case RQ_RNT_SET_CONFIG_PARAM: return "SET_CONFIG_PARAM";
+		case RQ_RNT_GET_CONFIG_PARAM: return "GET_CONFIG_PARAM";
+		case RQ_RNT_SUSPEND_POLLING: return "SUSPEND_POLLING";
+		case RQ_RNT_GET_VERSION: return "GET_VERSION";
+		case RQ_RNT_GET_SIGNATURE: return "GET_SIGNATURE";
+		case RQ_RNT_GET_CONTROLLER_TYPE: return "GET_CONTROLLER_TYPE";
+		case RQ_RNT_SET_VIBRATION: return "SET_VIBRATION";
+		case RQ_RNT_SET_MAPPING: return "SET_MAPPING";
+		case RQ_RNT_GET_MAPPING: return "GET_MAPPING";
+		case RQ_RNT_GET_SUPPORTED_REQUESTS: return "GET_SUPPORTED_REQUESTS";
+		case RQ_RNT_GET_SUPPORTED_MODES: return "GET_SUPPORTED_MODES";
+		case RQ_RNT_GET_SUPPORTED_CFG_PARAMS: return "GET_SUPPORTED_CFG_PARAMS";
+		case RQ_RNT_GET_SUPPORTED_MAPPINGS: return "GET_SUPPORTED_MAPPINGS";
+		case RQ_GCN64_RAW_SI_COMMAND: return "RAW_SI_COMMAND";
+		case RQ_GCN64_BLOCK_IO: return "BLOCK_IO";
+		case RQ_WUSBMOTE_I2C_TRANSACTIONS: return "I2C_TRANSACTIONS";
+		case RQ_PCENGINE_RAW: return "PCENGINE_RAW";
+		case RQ_PSX_RAW: return "PSX_RAW";
+		case RQ_DB9_RAW: return "DB9_RAW";
+	}
+	return "";
+}
+
+static void printStats(rnt_hdl_t hdl)
+{
+	struct rnt_stats *st;
+	int i;
+
+	st = malloc(sizeof(struct rnt_stats));
+	if (!st) {
+		perror("malloc");
+		return;
+	}
+
+	rnt_getStats(hdl, st);
+
+	printf("Statistics:\n");
+	printf("  Requests: %llu, bytes out: %llu, bytes in: %llu\n",
+		(unsigned long long)st->requests, (unsigned long long)st->bytes_out, (unsigned long long)st->bytes_in);
+	printf("  Empty polls: %llu, send retries: %llu, errors: %llu, timeouts: %llu, CRC errors: %llu\n",
+		(unsigned long long)st->empty_polls, (unsigned long long)st->send_retries, (unsigned long long)st->errors,
+		(unsigned long long)st->timeouts, (unsigned long long)st->crc_errors);
+	printf("  Latency (us)            request     count      mean       p50       p90       p99       max\n");
+	for (i=0; i<256; i++) {
+		const struct rnt_latency_hist *h = &st->latency[i];
+
+		if (!h->count)
+			continue;
+
+		printf("  %-24s 0x%02x %9llu %9llu %9llu %9llu %9llu %9llu\n", requestName(i), i,
+			(unsigned long long)h->count,
+			(unsigned long long)(h->total_us / h->count),
+			(unsigned long long)rnt_latencyPercentile(h, 0.50),
+			(unsigned long long)rnt_latencyPercentile(h, 0.90),
+			(unsigned long long)rnt_latencyPercentile(h, 0.99),
+			(unsigned long long)h->max_us);
+	}
+
+	free(st);
+}
+
 static int listDevices(void)
 {
 	int n_found = 0;
@@ -322,6 +593,24 @@ static int listDevices(void)
 	return n_found;
 }
 
+static void printHotplugEvent(int event, const struct rnt_adap_info *inf, void *ctx)
+{
+	printf("%s device '%ls', serial '%ls'\n", event == RNT_HOTPLUG_ADDED ? "Connected" : "Disconnected",
+		inf->str_prodname, inf->str_serial);
+	fflush(stdout);
+}
+
+static void monitorDevices(void)
+{
+	listDevices();
+	printf("Waiting for devices to be connected or disconnected (Ctrl+C to stop)...\n");
+	fflush(stdout);
+
+	while (1) {
+		rnt_waitHotplug(60000, printHotplugEvent, NULL);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	rnt_hdl_t hdl;
@@ -333,12 +622,29 @@ int main(int argc, char **argv)
 	int nonstop = 0;
 	int noconfirm = 0;
 	int cmd_list = 0;
+	int cmd_monitor = 0;
 #define TARGET_SERIAL_CHARS 128
 	wchar_t target_serial[TARGET_SERIAL_CHARS];
 	const char *short_optstr = "hls:vfo:c:";
 	const char *outfile = NULL;
 	const char *infile = NULL;
 	int channel = 0;
+	int timeout_ms = 0;
+	int busy_wait = 0;
+	int all_adapters = 0;
+	int all_channels = 0;
+	int diff_write = 0;
+	int verify_write = 0;
+	int from_cache = 0;
+	const char *bench_json = NULL;
+	int bench_cycles = PERFTEST_DEFAULT_CYCLES;
+	struct rnt_sim_config sim_configs[RNT_SIM_MAX_ADAPTERS];
+	int n_sims = 0, i;
+	const char *trace_file = NULL;
+	const char *replay_file = NULL;
+	int show_stats = 0;
+	int wait_ms = 0;
+	uint64_t wait_deadline = 0;
 	int res;
 
 	while((opt = getopt_long(argc, argv, short_optstr, longopts, NULL)) != -1) {
@@ -385,6 +691,74 @@ int main(int argc, char **argv)
 			case OPT_NO_CONFIRM:
 				noconfirm = 1;
 				break;
+			case OPT_TIMEOUT:
+				timeout_ms = atoi(optarg);
+				if (timeout_ms <= 0) {
+					fprintf(stderr, "Invalid timeout\n");
+					return -1;
+				}
+				break;
+			case OPT_BUSY_WAIT:
+				busy_wait = 1;
+				break;
+			case OPT_ALL_ADAPTERS:
+				all_adapters = 1;
+				break;
+			case OPT_ALL_CHANNELS:
+				all_channels = 1;
+				break;
+			case OPT_DIFF:
+				diff_write = 1;
+				break;
+			case OPT_VERIFY:
+				verify_write = 1;
+				break;
+			case OPT_FROM_CACHE:
+				from_cache = 1;
+				break;
+			case OPT_BENCH_JSON:
+				bench_json = optarg;
+				break;
+			case OPT_BENCH_CYCLES:
+				bench_cycles = atoi(optarg);
+				if (bench_cycles <= 0) {
+					fprintf(stderr, "Invalid number of cycles\n");
+					return -1;
+				}
+				break;
+			case OPT_SIM:
+				if (n_sims >= RNT_SIM_MAX_ADAPTERS) {
+					fprintf(stderr, "Too many simulated adapters (max %d)\n", RNT_SIM_MAX_ADAPTERS);
+					return -1;
+				}
+				if (rnt_sim_parseConfig(optarg, &sim_configs[n_sims])) {
+					fprintf(stderr, "Invalid simulated adapter specification: %s\n", optarg);
+					return -1;
+				}
+				n_sims++;
+				break;
+			case OPT_TRACE:
+				trace_file = optarg;
+				break;
+			case OPT_REPLAY:
+				replay_file = optarg;
+				break;
+			case OPT_REPLAY_FAST:
+				rnt_trace_setReplayMode(RNT_TRACE_REPLAY_FAST);
+				break;
+			case OPT_STATS:
+				show_stats = 1;
+				break;
+			case OPT_MONITOR:
+				cmd_monitor = 1;
+				break;
+			case OPT_WAIT:
+				wait_ms = atoi(optarg);
+				if (wait_ms <= 0) {
+					fprintf(stderr, "Invalid wait time\n");
+					return -1;
+				}
+				break;
 			case '?':
 				fprintf(stderr, "Unrecognized argument. Try -h\n");
 				return -1;
@@ -447,6 +821,25 @@ int main(int argc, char **argv)
 
 	rnt_init(verbose);
 
+	for (i=0; i<n_sims; i++) {
+		if (rnt_sim_addAdapter(&sim_configs[i]) < 0) {
+			fprintf(stderr, "Could not add simulated adapter\n");
+			rnt_shutdown();
+			return -1;
+		}
+	}
+
+	if (trace_file && all_adapters) {
+		fprintf(stderr, "--trace records a single adapter and cannot be used with --all\n");
+		rnt_shutdown();
+		return -1;
+	}
+
+	if (trace_file && rnt_trace_setRecordFile(trace_file)) {
+		rnt_shutdown();
+		return -1;
+	}
+
 	if (cmd_list) {
 		printf("Simply listing the devices...\n");
 		res = listDevices();
@@ -459,26 +852,52 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (!serial_specified && !use_first) {
-		fprintf(stderr, "A serial number or -f must be used. Try -h for more information.\n");
-		return 1;
+	if (cmd_monitor) {
+		monitorDevices();
 	}
 
-	listctx = rnt_allocListCtx();
-	while ((selected_device = rnt_listDevices(&inf, listctx)))
-	{
-		if (serial_specified) {
-			if (0 == wcscmp(inf.str_serial, target_serial)) {
-				break;
-			}
+	if (all_adapters) {
+		res = runOnAllAdapters(argc, argv, short_optstr, outfile, channel);
+		rnt_shutdown();
+		return res;
+	}
+
+	if (replay_file) {
+		if (rnt_trace_getReplayInfo(replay_file, &inf)) {
+			return 1;
+		}
+		printf("Replaying session with device '%ls' serial '%ls'\n", inf.str_prodname, inf.str_serial);
+		selected_device = &inf;
+	} else {
+		if (!serial_specified && !use_first) {
+			fprintf(stderr, "A serial number or -f must be used. Try -h for more information.\n");
+			return 1;
 		}
-		else {
-			// use_first == 1
-			printf("Will use device '%ls' serial '%ls'\n", inf.str_prodname, inf.str_serial);
-			break;
+
+		wait_deadline = getMilliseconds() + wait_ms;
+		while (1) {
+			listctx = rnt_allocListCtx();
+			while ((selected_device = rnt_listDevices(&inf, listctx)))
+			{
+				if (serial_specified) {
+					if (0 == wcscmp(inf.str_serial, target_serial)) {
+						break;
+					}
+				}
+				else {
+					// use_first == 1
+					printf("Will use device '%ls' serial '%ls'\n", inf.str_prodname, inf.str_serial);
+					break;
+				}
+			}
+			rnt_freeListCtx(listctx);
+
+			// The device list is only enumerated again when adapters are connected
+			if (selected_device || getMilliseconds() >= wait_deadline)
+				break;
+			rnt_waitDeviceChange(wait_deadline - getMilliseconds());
 		}
 	}
-	rnt_freeListCtx(listctx);
 
 	if (!selected_device) {
 		if (serial_specified) {
@@ -490,11 +909,22 @@ int main(int argc, char **argv)
 	}
 
 	hdl = rnt_openDevice(selected_device);
+	if (!hdl && wait_ms && getMilliseconds() < wait_deadline) {
+		// Access to a new device may only be granted a moment after it appears
+		hdl = rnt_waitOpenBy(selected_device, GCN64_FLG_OPEN_BY_PATH, wait_deadline - getMilliseconds());
+	}
 	if (!hdl) {
 		printf("Error opening device. (Do you have permissions?)\n");
 		return 1;
 	}
 
+	if (timeout_ms) {
+		rnt_setTimeout(hdl, timeout_ms);
+	}
+	if (busy_wait) {
+		rnt_setWaitMode(hdl, RNT_WAIT_SPIN);
+	}
+
 	optind = 1;
 	while((opt = getopt_long(argc, argv, short_optstr, longopts, NULL)) != -1)
 	{
@@ -760,9 +1190,25 @@ int main(int argc, char **argv)
 					mempak_structure_t *pak;
 					int res;
 
-					printf("Reading mempak...\n");
-					res = gcn64lib_mempak_download(hdl, channel, &pak, mempak_progress_cb, "Reading address");
-					printf("\n");
+					if (all_channels) {
+						retval = dumpAllChannelMempaks(hdl, outfile);
+						break;
+					}
+
+					if (from_cache) {
+						res = gcn64lib_mempak_loadCached(hdl, channel, &pak);
+						if (res == -3) {
+							fprintf(stderr, "Mempak not in cache\n");
+							break;
+						}
+					} else {
+						printf("Reading mempak...\n");
+						res = gcn64lib_mempak_download(hdl, channel, &pak, mempak_progress_cb, "Reading address");
+						printf("\n");
+						if (res == 0) {
+							gcn64lib_mempak_storeCached(hdl, channel, pak);
+						}
+					}
 					switch (res)
 					{
 						case 0:
@@ -812,9 +1258,26 @@ int main(int argc, char **argv)
 						return -1;
 					}
 
-					printf("Writing to mempak...\n");
-					res = gcn64lib_mempak_upload(hdl, channel, pak, mempak_progress_cb, "Writing address");
-					printf("\n");
+					if (diff_write) {
+						mempak_structure_t *cached = NULL;
+
+						if (from_cache && 0 == gcn64lib_mempak_loadCached(hdl, channel, &cached)) {
+							printf("Using cached mempak image\n");
+							printf("Warning: Blocks are compared with the cached image. If this pak was used elsewhere since, it will be corrupted.\n");
+						}
+						printf("Writing changes to mempak...\n");
+						res = gcn64lib_mempak_uploadDiff(hdl, channel, pak, cached, verify_write ? MEMPAK_UPLOAD_VERIFY : 0, mempak_progress_cb, "Address");
+						printf("\n");
+						mempak_free(cached);
+						if (res >= 0) {
+							printf("%d block(s) written\n", res);
+							res = 0;
+						}
+					} else {
+						printf("Writing to mempak...\n");
+						res = gcn64lib_mempak_upload(hdl, channel, pak, mempak_progress_cb, "Writing address");
+						printf("\n");
+					}
 					if (res) {
 						switch(res)
 						{
@@ -824,11 +1287,15 @@ int main(int argc, char **argv)
 							case -2:
 								fprintf(stderr, "I/O error writing to pak.\n");
 								break;
+							case -5:
+								fprintf(stderr, "Error: Verification failed.\n");
+								break;
 							default:
 								fprintf(stderr, "Error uploading mempak\n");
 						}
 					} else {
 						printf("Mempak uploaded\n");
+						gcn64lib_mempak_storeCached(hdl, channel, pak);
 					}
 					mempak_free(pak);
 				}
@@ -916,7 +1383,7 @@ int main(int argc, char **argv)
 				break;
 
 			case OPT_GC_TO_N64_UPDATE:
-				x2gcn64_adapter_updateFirmware(hdl, channel, optarg, NULL);
+				x2gcn64_adapter_updateFirmware(hdl, channel, optarg, NULL, NULL);
 				break;
 
 			case OPT_GC_TO_N64_DUMP:
@@ -1023,7 +1490,26 @@ int main(int argc, char **argv)
 				break;
 
 			case OPT_PERFTEST:
-				perftest1(hdl, channel);
+				{
+					FILE *json = NULL;
+
+					if (bench_json) {
+						json = fopen(bench_json, "w");
+						if (!json) {
+							perror(bench_json);
+							retval = 1;
+							break;
+						}
+					}
+
+					if (perftest_bench(hdl, channel, bench_cycles, json)) {
+						retval = 1;
+					}
+
+					if (json) {
+						fclose(json);
+					}
+				}
 				break;
 
 			case OPT_DISABLE_ENCRYPTION:
@@ -1052,9 +1538,18 @@ int main(int argc, char **argv)
 					struct psx_memorycard mc_data;
 					int res;
 
-					rnt_suspendPolling(hdl, 1);
-					res = psxlib_readMemoryCard(hdl, channel, &mc_data, NULL);
-					rnt_suspendPolling(hdl, 0);
+					if (from_cache) {
+						rnt_suspendPolling(hdl, 1);
+						res = psxlib_loadCached(hdl, channel, &mc_data);
+						rnt_suspendPolling(hdl, 0);
+					} else {
+						rnt_suspendPolling(hdl, 1);
+						res = psxlib_readMemoryCard(hdl, channel, &mc_data, NULL);
+						rnt_suspendPolling(hdl, 0);
+						if (res == 0) {
+							psxlib_storeCached(hdl, channel, &mc_data);
+						}
+					}
 
 					if (res == 0) {
 						// Todo: filename-based format selection
@@ -1078,13 +1573,22 @@ int main(int argc, char **argv)
 					}
 
 					rnt_suspendPolling(hdl, 1);
-					retval = psxlib_writeMemoryCard(hdl, channel, &mc_data, NULL);
+					if (diff_write) {
+						retval = psxlib_writeMemoryCardDiff(hdl, channel, &mc_data, NULL, verify_write, NULL);
+						if (retval >= 0) {
+							printf("%d sector(s) written\n", retval);
+							retval = 0;
+						}
+					} else {
+						retval = psxlib_writeMemoryCard(hdl, channel, &mc_data, NULL);
+					}
 					rnt_suspendPolling(hdl, 0);
 
 					if (retval < 0) {
 						fprintf(stderr, "%s\n", psxlib_getErrorString(retval));
 						break;
 					}
+					psxlib_storeCached(hdl, channel, &mc_data);
 				}
 				break;
 		}
@@ -1103,6 +1607,10 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (show_stats) {
+		printStats(hdl);
+	}
+
 	rnt_closeDevice(hdl);
 	rnt_shutdown();
 
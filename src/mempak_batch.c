@@ -0,0 +1,1019 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB adapter firmware
+	Copyright (C) 2007-2015  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "mempak.h"
+#include "mapfile.h"
+#include "notestore.h"
+
+/* Process many mempak images (files, directories and tar archives) in
+ * parallel and write an index of their content. */
+
+#define DEFAULT_FORMAT_STR		"n64"
+#define MAX_THREADS				64
+#define QUEUE_SIZE				256
+#define MAX_IMAGE_FILE_SIZE		0x100000
+
+#define INDEX_JSON	0
+#define INDEX_CSV	1
+
+/* Status of an image in the index */
+#define STATUS_OK				0
+#define STATUS_INVALID			1 // Not formatted or corrupted filesystem
+#define STATUS_UNKNOWN_FORMAT	2 // Not a .mpk/.n64 image
+#define STATUS_READ_ERROR		3
+#define STATUS_TOO_LARGE		4
+
+static const char *status_names[] = { "ok", "invalid", "unknown_format", "read_error", "too_large" };
+
+struct note_key {
+	char hash[NOTESTORE_HASH_CHARS+1]; // Empty for unused slots
+};
+
+struct seen_note {
+	struct note_key key;
+	int listed;
+};
+
+struct note_result {
+	int id;
+	entry_structure_t entry;
+	struct note_key key;
+	int duplicate;
+	char *comment; // NULL when there is none
+};
+
+struct image_result {
+	char *name;
+	int format;
+	int status;
+	int used_blocks;
+	int n_notes;
+	struct note_result notes[MEMPAK_NUM_NOTES];
+	int write_errors; // Extracted, stored or converted files that could not be written
+};
+
+struct job {
+	int seq;
+	char *name;
+	struct mapfile *mf; // Image file, or NULL for tar members
+	unsigned char *buf; // Tar member content. NULL when it could not be read.
+	long size;
+	int status;
+};
+
+static struct {
+	/* Options */
+	int index_format;
+	const char *extract_dir;
+	struct notestore *store;
+	const char *convert_dir;
+	int convert_format;
+	FILE *index_fptr;
+
+	/* Work queue, filled by the main thread */
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	struct job queue[QUEUE_SIZE];
+	int q_head, q_count;
+	int done;
+	int next_seq;
+
+	/* Results waiting to be written in order. Protected by lock. */
+	struct image_result **results;
+	int results_size;
+	int next_output;
+
+	/* Distinct notes seen. Protected by notes_lock. */
+	pthread_mutex_t notes_lock;
+	struct seen_note *seen;
+	int seen_size, seen_count;
+
+	/* Note store, protected by store_lock */
+	pthread_mutex_t store_lock;
+	int n_stored;
+
+	/* Totals, protected by lock */
+	int n_images, n_valid, n_notes, n_unreadable, n_write_errors;
+} batch;
+
+static void print_usage(void)
+{
+	printf("Usage: ./mempak_batch <options> inputs...\n");
+	printf("\n");
+	printf("Inputs are mempak images, directories (searched recursively for .mpk\n");
+	printf("and .n64 files) and tar archives (.tar, .tar.gz or .tgz).\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("   -h, --help                   Display help\n");
+	printf("   -j, --jobs n                 Number of worker threads (default: number of CPUs)\n");
+	printf("   -o, --output file            Write the index to a file (default: standard output)\n");
+	printf("   -i, --index format           Index format: json or csv (default: json)\n");
+	printf("   -x, --extract dir            Extract notes to a directory, once per distinct content\n");
+	printf("   -s, --store dir              Add notes to a note store (see mempak_store)\n");
+	printf("   -c, --convert dir            Write valid images to a directory\n");
+	printf("   -f, --format format          Format of converted images (default: %s)\n", DEFAULT_FORMAT_STR);
+	printf("\n");
+	printf("Formats:\n");
+	printf("   mpk               Standard 32kB .mpk file format\n");
+	printf("   mpk4              128kB .mpk file (4 copies or the 32kB block)\n");
+	printf("   n64               .N64 file format\n");
+	printf("\n");
+	printf("Notes are identified by a hash of their content (note file, as written\n");
+	printf("by mempak_extract_note). Extracted notes are named after it.\n");
+}
+
+static struct note_key hashNote(const unsigned char *data, int size)
+{
+	struct note_key key;
+
+	notestore_hash(data, size, key.hash);
+
+	return key;
+}
+
+/* The hash is hexadecimal. Its first characters are as good as any hash of it. */
+static int keySlot(const struct note_key *key, int mask)
+{
+	char tmp[9];
+
+	memcpy(tmp, key->hash, 8);
+	tmp[8] = 0;
+
+	return strtoul(tmp, NULL, 16) & mask;
+}
+
+/* Find a note in the set of distinct notes, adding it if needed.
+ * Called with batch.notes_lock held. */
+static struct seen_note *findNote(const struct note_key *key, int *added)
+{
+	int i, mask;
+
+	if (batch.seen_count * 2 >= batch.seen_size) {
+		struct seen_note *old = batch.seen;
+		int old_size = batch.seen_size;
+
+		batch.seen_size = old_size ? old_size * 2 : 4096;
+		batch.seen = calloc(batch.seen_size, sizeof(struct seen_note));
+		if (!batch.seen) {
+			perror("calloc");
+			exit(1);
+		}
+
+		mask = batch.seen_size - 1;
+		for (i=0; i<old_size; i++) {
+			int j;
+
+			if (!old[i].key.hash[0])
+				continue;
+
+			for (j = keySlot(&old[i].key, mask); batch.seen[j].key.hash[0]; j = (j + 1) & mask)
+				;
+			batch.seen[j] = old[i];
+		}
+		free(old);
+	}
+
+	*added = 0;
+	mask = batch.seen_size - 1;
+	for (i = keySlot(key, mask); batch.seen[i].key.hash[0]; i = (i + 1) & mask) {
+		if (0 == strcmp(batch.seen[i].key.hash, key->hash)) {
+			return &batch.seen[i];
+		}
+	}
+
+	batch.seen[i].key = *key;
+	batch.seen_count++;
+	*added = 1;
+
+	return &batch.seen[i];
+}
+
+/* \return 1 if an identical note was processed before (in any order) */
+static int noteSeen(const struct note_key *key)
+{
+	int added;
+
+	pthread_mutex_lock(&batch.notes_lock);
+	findNote(key, &added);
+	pthread_mutex_unlock(&batch.notes_lock);
+
+	return !added;
+}
+
+/* \return 1 if an identical note was listed in the index before */
+static int noteListed(const struct note_key *key)
+{
+	struct seen_note *note;
+	int added, listed;
+
+	pthread_mutex_lock(&batch.notes_lock);
+	note = findNote(key, &added);
+	listed = note->listed;
+	note->listed = 1;
+	pthread_mutex_unlock(&batch.notes_lock);
+
+	return listed;
+}
+
+static int makeDir(const char *path)
+{
+	int res;
+
+#ifdef WINDOWS
+	res = mkdir(path);
+#else
+	res = mkdir(path, 0755);
+#endif
+	if (res && errno != EEXIST) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+static int writeFile(const char *filename, const unsigned char *data, int size)
+{
+	FILE *fptr;
+
+	fptr = fopen(filename, "wb");
+	if (!fptr) {
+		perror(filename);
+		return -1;
+	}
+
+	if (1 != fwrite(data, size, 1, fptr)) {
+		perror(filename);
+		fclose(fptr);
+		return -1;
+	}
+
+	if (fclose(fptr)) {
+		perror(filename);
+		return -1;
+	}
+	return 0;
+}
+
+/* Build the name of a converted image from the input name: Directory
+ * separators become underscores and the extension matches the format. */
+static void convertedName(const char *name, int format, char *dst, int dstmax)
+{
+	char flat[512];
+	char *s;
+	int i;
+
+	while (name[0] == '.' && name[1] == '/')
+		name += 2;
+	while (*name == '/')
+		name++;
+
+	for (i=0; name[i] && i < sizeof(flat)-1; i++) {
+		flat[i] = (name[i] == '/' || name[i] == '\\') ? '_' : name[i];
+	}
+	flat[i] = 0;
+
+	s = strrchr(flat, '.');
+	if (s && (0 == strcasecmp(s, ".mpk") || 0 == strcasecmp(s, ".n64")))
+		*s = 0;
+
+	snprintf(dst, dstmax, "%s/%s.%s", batch.convert_dir, flat, format == MPK_FORMAT_N64 ? "n64" : "mpk");
+}
+
+static void processImage(const struct job *job, struct image_result *res)
+{
+	mempak_structure_t *mpk;
+	unsigned char note_file[MEMPAK_NOTE_MAX_FILE_SIZE];
+	int i;
+
+	if (job->status != STATUS_OK) {
+		res->status = job->status;
+		return;
+	}
+
+	if (job->mf) {
+		mpk = mempak_loadFromMemory(job->mf->data, job->mf->size);
+	} else {
+		mpk = mempak_loadFromMemory(job->buf, job->size);
+	}
+	if (!mpk) {
+		res->status = STATUS_READ_ERROR;
+		return;
+	}
+
+	res->format = mpk->file_format;
+	if (mpk->file_format == MPK_FORMAT_INVALID) {
+		res->status = STATUS_UNKNOWN_FORMAT;
+		goto done;
+	}
+
+	if (0 != validate_mempak(mpk)) {
+		res->status = STATUS_INVALID;
+		goto done;
+	}
+
+	res->used_blocks = 123 - get_mempak_free_space(mpk);
+
+	for (i=0; i<MEMPAK_NUM_NOTES; i++) {
+		struct note_result *note = &res->notes[res->n_notes];
+		int size;
+
+		if (0 != get_mempak_entry(mpk, i, &note->entry) || !note->entry.valid)
+			continue;
+
+		size = mempak_exportNoteToBuffer(mpk, i, note_file, sizeof(note_file));
+		if (size < 0)
+			continue;
+
+		note->id = i;
+		note->key = hashNote(note_file, size);
+		if (mpk->note_comments[i][0]) {
+			note->comment = strdup(mpk->note_comments[i]);
+		}
+
+		/* Whichever thread sees a note first extracts and stores it. Duplicates are
+		 * flagged when writing the index, so the flags follow input order. */
+		if (!noteSeen(&note->key)) {
+			if (batch.extract_dir) {
+				char filename[512];
+
+				snprintf(filename, sizeof(filename), "%s/%s.note", batch.extract_dir, note->key.hash);
+				if (writeFile(filename, note_file, size)) {
+					res->write_errors++;
+				}
+			}
+
+			if (batch.store) {
+				int put;
+
+				pthread_mutex_lock(&batch.store_lock);
+				put = notestore_put(batch.store, note_file, size, NULL);
+				if (put == 0) {
+					batch.n_stored++;
+				}
+				pthread_mutex_unlock(&batch.store_lock);
+				if (put < 0) {
+					fprintf(stderr, "Could not add note %s to the store\n", note->key.hash);
+					res->write_errors++;
+				}
+			}
+		}
+
+		res->n_notes++;
+	}
+
+	if (batch.convert_dir) {
+		char filename[1024];
+
+		convertedName(job->name, batch.convert_format, filename, sizeof(filename));
+		if (mempak_saveToFile(mpk, filename, batch.convert_format)) {
+			fprintf(stderr, "Could not write %s\n", filename);
+			res->write_errors++;
+		}
+	}
+
+done:
+	mempak_free(mpk);
+}
+
+static void jsonString(FILE *fptr, const char *str)
+{
+	fputc('"', fptr);
+	for (; *str; str++) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\') {
+			fprintf(fptr, "\\%c", c);
+		} else if (c < 0x20) {
+			fprintf(fptr, "\\u%04x", c);
+		} else {
+			fputc(c, fptr);
+		}
+	}
+	fputc('"', fptr);
+}
+
+static void csvString(FILE *fptr, const char *str)
+{
+	fputc('"', fptr);
+	for (; *str; str++) {
+		if (*str == '"')
+			fputc('"', fptr);
+		fputc(*str, fptr);
+	}
+	fputc('"', fptr);
+}
+
+static void writeResult(struct image_result *res, int first)
+{
+	FILE *fptr = batch.index_fptr;
+	int i;
+
+	for (i=0; i<res->n_notes; i++) {
+		res->notes[i].duplicate = noteListed(&res->notes[i].key);
+	}
+
+	if (batch.index_format == INDEX_CSV) {
+		for (i=0; i<res->n_notes || (i == 0 && res->n_notes == 0); i++) {
+			const struct note_result *note = &res->notes[i];
+
+			csvString(fptr, res->name);
+			fprintf(fptr, ",%s,%s,", mempak_format2string(res->format), status_names[res->status]);
+			if (res->status == STATUS_OK) {
+				fprintf(fptr, "%d", res->used_blocks);
+			}
+			if (i < res->n_notes) {
+				fprintf(fptr, ",%d,", note->id);
+				csvString(fptr, note->entry.utf8_name);
+				fprintf(fptr, ",%06x,%04x,%02x,%d,%s,%d,", note->entry.vendor, note->entry.game_id,
+										note->entry.region, note->entry.blocks, note->key.hash, note->duplicate);
+				csvString(fptr, note->comment ? note->comment : "");
+			} else {
+				fprintf(fptr, ",,,,,,,,,");
+			}
+			fprintf(fptr, "\n");
+		}
+		return;
+	}
+
+	fprintf(fptr, "%s\n  { \"file\": ", first ? "" : ",");
+	jsonString(fptr, res->name);
+	fprintf(fptr, ", \"format\": \"%s\", \"status\": \"%s\"", mempak_format2string(res->format), status_names[res->status]);
+	if (res->status == STATUS_OK) {
+		fprintf(fptr, ", \"used_blocks\": %d, \"notes\": [", res->used_blocks);
+		for (i=0; i<res->n_notes; i++) {
+			const struct note_result *note = &res->notes[i];
+
+			fprintf(fptr, "%s\n    { \"note\": %d, \"name\": ", i ? "," : "", note->id);
+			jsonString(fptr, note->entry.utf8_name);
+			fprintf(fptr, ", \"vendor\": \"%06x\", \"game_id\": \"%04x\", \"region\": \"%02x\", \"blocks\": %d, \"hash\": \"%s\", \"duplicate\": %s",
+						note->entry.vendor, note->entry.game_id, note->entry.region, note->entry.blocks,
+						note->key.hash, note->duplicate ? "true" : "false");
+			if (note->comment) {
+				fprintf(fptr, ", \"comment\": ");
+				jsonString(fptr, note->comment);
+			}
+			fprintf(fptr, " }");
+		}
+		fprintf(fptr, "%s]", i ? "\n  " : "");
+	}
+	fprintf(fptr, " }");
+}
+
+static void freeResult(struct image_result *res)
+{
+	int i;
+
+	for (i=0; i<res->n_notes; i++) {
+		free(res->notes[i].comment);
+	}
+	free(res->name);
+	free(res);
+}
+
+/* Called with batch.lock held. Results are written in input order, as soon as
+ * all the preceding ones are available. */
+static void flushResults(void)
+{
+	struct image_result *res;
+
+	while (batch.next_output < batch.next_seq && (res = batch.results[batch.next_output])) {
+		batch.results[batch.next_output] = NULL;
+		writeResult(res, batch.next_output == 0);
+		batch.next_output++;
+
+		batch.n_images++;
+		batch.n_write_errors += res->write_errors;
+		if (res->status == STATUS_OK) {
+			batch.n_valid++;
+			batch.n_notes += res->n_notes;
+		} else if (res->status == STATUS_READ_ERROR || res->status == STATUS_TOO_LARGE) {
+			batch.n_unreadable++;
+		}
+
+		freeResult(res);
+	}
+}
+
+static void *worker(void *arg)
+{
+	struct job job;
+	struct image_result *res;
+
+	while (1) {
+		pthread_mutex_lock(&batch.lock);
+		while (!batch.q_count && !batch.done) {
+			pthread_cond_wait(&batch.not_empty, &batch.lock);
+		}
+		if (!batch.q_count) {
+			pthread_mutex_unlock(&batch.lock);
+			break;
+		}
+		job = batch.queue[batch.q_head];
+		batch.q_head = (batch.q_head + 1) % QUEUE_SIZE;
+		batch.q_count--;
+		pthread_cond_signal(&batch.not_full);
+		pthread_mutex_unlock(&batch.lock);
+
+		res = calloc(1, sizeof(struct image_result));
+		if (!res) {
+			perror("calloc");
+			exit(1);
+		}
+		res->name = job.name;
+		processImage(&job, res);
+		mapfile_close(job.mf);
+		free(job.buf);
+
+		pthread_mutex_lock(&batch.lock);
+		batch.results[job.seq] = res;
+		flushResults();
+		pthread_mutex_unlock(&batch.lock);
+	}
+
+	return NULL;
+}
+
+/* Queue an image for the workers. Takes ownership of name, mf and buf. */
+static void queueImage(char *name, struct mapfile *mf, unsigned char *buf, long size, int status)
+{
+	struct job *job;
+
+	pthread_mutex_lock(&batch.lock);
+	while (batch.q_count == QUEUE_SIZE) {
+		pthread_cond_wait(&batch.not_full, &batch.lock);
+	}
+
+	if (batch.next_seq >= batch.results_size) {
+		struct image_result **results;
+		int size = batch.results_size ? batch.results_size * 2 : 1024;
+
+		results = realloc(batch.results, size * sizeof(struct image_result *));
+		if (!results) {
+			perror("realloc");
+			exit(1);
+		}
+		memset(results + batch.results_size, 0, (size - batch.results_size) * sizeof(struct image_result *));
+		batch.results = results;
+		batch.results_size = size;
+	}
+
+	job = &batch.queue[(batch.q_head + batch.q_count) % QUEUE_SIZE];
+	job->seq = batch.next_seq++;
+	job->name = name;
+	job->mf = mf;
+	job->buf = buf;
+	job->size = size;
+	job->status = status;
+	batch.q_count++;
+
+	pthread_cond_signal(&batch.not_empty);
+	pthread_mutex_unlock(&batch.lock);
+}
+
+/* Image files are mapped, and read by the worker processing them */
+static void queueFile(const char *filename)
+{
+	struct mapfile *mf;
+
+	mf = mapfile_open(filename, MAPFILE_READ);
+	if (!mf) {
+		perror(filename);
+		queueImage(strdup(filename), NULL, NULL, 0, STATUS_READ_ERROR);
+		return;
+	}
+
+	if (mf->size > MAX_IMAGE_FILE_SIZE) {
+		mapfile_close(mf);
+		queueImage(strdup(filename), NULL, NULL, 0, STATUS_TOO_LARGE);
+		return;
+	}
+
+	queueImage(strdup(filename), mf, NULL, 0, STATUS_OK);
+}
+
+static int isTarFile(const char *filename)
+{
+	static const char *extensions[] = { ".tar", ".tar.gz", ".tgz" };
+	int len = strlen(filename);
+	int i;
+
+	for (i=0; i<sizeof(extensions)/sizeof(extensions[0]); i++) {
+		int elen = strlen(extensions[i]);
+
+		if (len > elen && 0 == strcasecmp(filename + len - elen, extensions[i]))
+			return 1;
+	}
+
+	return 0;
+}
+
+static long tarOctal(const unsigned char *field, int len)
+{
+	long val = 0;
+	int i;
+
+	for (i=0; i<len && field[i] == ' '; i++)
+		;
+	for (; i<len && field[i] >= '0' && field[i] <= '7'; i++) {
+		val = (val << 3) | (field[i] - '0');
+	}
+
+	return val;
+}
+
+/* Queue the images in a tar archive. Compressed archives are read through zlib. */
+static int queueTar(const char *filename)
+{
+	gzFile gz;
+	unsigned char header[512];
+	char longname[1024] = { };
+	int res = 0;
+
+	gz = gzopen(filename, "rb");
+	if (!gz) {
+		perror(filename);
+		return -1;
+	}
+
+	while (1) {
+		char name[1024], member[512], *m;
+		long size, padded;
+		int i;
+
+		if (gzread(gz, header, sizeof(header)) != sizeof(header)) {
+			break;
+		}
+
+		for (i=0; i<sizeof(header) && !header[i]; i++)
+			;
+		if (i == sizeof(header)) {
+			break; // End of archive
+		}
+
+		if (header[124] & 0x80) {
+			fprintf(stderr, "%s: Unsupported member size\n", filename);
+			res = -1;
+			break;
+		}
+		size = tarOctal(header + 124, 12);
+		padded = (size + 511) & ~511L;
+
+		/* GNU long name: The data is the name of the next member */
+		if (header[156] == 'L') {
+			int n = size < sizeof(longname) - 1 ? size : sizeof(longname) - 1;
+
+			if (gzread(gz, longname, n) != n) {
+				break;
+			}
+			longname[n] = 0;
+			gzseek(gz, padded - n, SEEK_CUR);
+			continue;
+		}
+
+		if (longname[0]) {
+			snprintf(member, sizeof(member), "%s", longname);
+			longname[0] = 0;
+		} else if (0 == memcmp(header + 257, "ustar", 5) && header[345]) {
+			snprintf(member, sizeof(member), "%.155s/%.100s", header + 345, header);
+		} else {
+			snprintf(member, sizeof(member), "%.100s", header);
+		}
+		for (m = member; m[0] == '.' && m[1] == '/'; m += 2)
+			;
+
+		/* Regular files with a mempak image extension */
+		if ((header[156] != '0' && header[156] != 0) || mempak_getFilenameFormat(m) == MPK_FORMAT_INVALID) {
+			gzseek(gz, padded, SEEK_CUR);
+			continue;
+		}
+
+		snprintf(name, sizeof(name), "%s/%s", filename, m);
+
+		if (size > MAX_IMAGE_FILE_SIZE) {
+			queueImage(strdup(name), NULL, NULL, 0, STATUS_TOO_LARGE);
+			gzseek(gz, padded, SEEK_CUR);
+			continue;
+		}
+
+		{
+			unsigned char *buf = malloc(padded > 0 ? padded : 1);
+
+			if (!buf) {
+				perror("malloc");
+				exit(1);
+			}
+			if (gzread(gz, buf, padded) != padded) {
+				fprintf(stderr, "%s: Truncated archive\n", filename);
+				free(buf);
+				queueImage(strdup(name), NULL, NULL, 0, STATUS_READ_ERROR);
+				res = -1;
+				break;
+			}
+			queueImage(strdup(name), NULL, buf, size, STATUS_OK);
+		}
+	}
+
+	gzclose(gz);
+	return res;
+}
+
+static int compareNames(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+static int queuePath(const char *path, int explicit)
+{
+	struct stat st;
+	int res;
+
+#ifdef WINDOWS
+	res = stat(path, &st);
+#else
+	/* Links to directories are only followed when given explicitly, so the
+	 * recursive walk cannot loop. */
+	res = explicit ? stat(path, &st) : lstat(path, &st);
+	if (res == 0 && S_ISLNK(st.st_mode)) {
+		res = stat(path, &st);
+		if (res == 0 && S_ISDIR(st.st_mode)) {
+			return 0;
+		}
+	}
+#endif
+	if (res) {
+		perror(path);
+		queueImage(strdup(path), NULL, NULL, 0, STATUS_READ_ERROR);
+		return -1;
+	}
+
+	if (S_ISDIR(st.st_mode)) {
+		DIR *dir;
+		struct dirent *de;
+		char **names = NULL;
+		int n = 0, i;
+
+		dir = opendir(path);
+		if (!dir) {
+			perror(path);
+			return -1;
+		}
+
+		/* Sorted, so the index does not depend on the directory order */
+		while ((de = readdir(dir))) {
+			char **tmp;
+
+			if (0 == strcmp(de->d_name, ".") || 0 == strcmp(de->d_name, ".."))
+				continue;
+
+			tmp = realloc(names, (n + 1) * sizeof(char *));
+			if (!tmp) {
+				perror("realloc");
+				exit(1);
+			}
+			names = tmp;
+			names[n] = malloc(strlen(path) + strlen(de->d_name) + 2);
+			if (!names[n]) {
+				perror("malloc");
+				exit(1);
+			}
+			sprintf(names[n], "%s/%s", path, de->d_name);
+			n++;
+		}
+		closedir(dir);
+
+		qsort(names, n, sizeof(char *), compareNames);
+
+		for (i=0; i<n; i++) {
+			queuePath(names[i], 0);
+			free(names[i]);
+		}
+		free(names);
+
+		return 0;
+	}
+
+	if (isTarFile(path)) {
+		return queueTar(path);
+	}
+
+	if (explicit || mempak_getFilenameFormat(path) != MPK_FORMAT_INVALID) {
+		queueFile(path);
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct option long_options[] = {
+		{ "help", no_argument, 0, 'h' },
+		{ "jobs", required_argument, 0, 'j' },
+		{ "output", required_argument, 0, 'o' },
+		{ "index", required_argument, 0, 'i' },
+		{ "extract", required_argument, 0, 'x' },
+		{ "store", required_argument, 0, 's' },
+		{ "convert", required_argument, 0, 'c' },
+		{ "format", required_argument, 0, 'f' },
+		{ }, // terminator
+	};
+	const char *format = DEFAULT_FORMAT_STR;
+	const char *output = NULL;
+	const char *store_dir = NULL;
+	pthread_t threads[MAX_THREADS];
+	int n_threads = 0;
+	int i;
+
+	batch.index_format = INDEX_JSON;
+
+	while(1) {
+		int c;
+
+		c = getopt_long(argc, argv, "hj:o:i:x:s:c:f:", long_options, NULL);
+		if (c==-1)
+			break;
+
+		switch(c)
+		{
+			case 'h':
+				print_usage();
+				return 0;
+
+			case 'j':
+				n_threads = atoi(optarg);
+				if (n_threads < 1 || n_threads > MAX_THREADS) {
+					fprintf(stderr, "Number of jobs must be between 1 and %d\n", MAX_THREADS);
+					return 1;
+				}
+				break;
+
+			case 'o':
+				output = optarg;
+				break;
+
+			case 'i':
+				if (0 == strcasecmp(optarg, "json")) {
+					batch.index_format = INDEX_JSON;
+				} else if (0 == strcasecmp(optarg, "csv")) {
+					batch.index_format = INDEX_CSV;
+				} else {
+					fprintf(stderr, "Unknown index format specified\n");
+					return 1;
+				}
+				break;
+
+			case 'x':
+				batch.extract_dir = optarg;
+				break;
+
+			case 's':
+				store_dir = optarg;
+				break;
+
+			case 'c':
+				batch.convert_dir = optarg;
+				break;
+
+			case 'f':
+				format = optarg;
+				break;
+
+			case '?':
+				fprintf(stderr, "Unknown argument. Try -h\n");
+				return 1;
+		}
+	}
+
+	if (optind >= argc) {
+		print_usage();
+		return 1;
+	}
+
+	batch.convert_format = mempak_string2format(format);
+	if (batch.convert_format == MPK_FORMAT_INVALID) {
+		fprintf(stderr, "Unknown format specified\n");
+		return 1;
+	}
+
+	if (!n_threads) {
+#ifdef _SC_NPROCESSORS_ONLN
+		n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (n_threads < 1)
+			n_threads = 1;
+		if (n_threads > MAX_THREADS)
+			n_threads = MAX_THREADS;
+	}
+
+	/* Created once here rather than failing for each note or image */
+	if (batch.extract_dir && makeDir(batch.extract_dir)) {
+		return 1;
+	}
+	if (batch.convert_dir && makeDir(batch.convert_dir)) {
+		return 1;
+	}
+
+	if (store_dir) {
+		batch.store = notestore_open(store_dir);
+		if (!batch.store) {
+			fprintf(stderr, "Could not open note store '%s'\n", store_dir);
+			return 1;
+		}
+	}
+
+	batch.index_fptr = stdout;
+	if (output) {
+		batch.index_fptr = fopen(output, "w");
+		if (!batch.index_fptr) {
+			perror(output);
+			return 1;
+		}
+	}
+
+	if (batch.index_format == INDEX_CSV) {
+		fprintf(batch.index_fptr, "file,format,status,used_blocks,note,name,vendor,game_id,region,blocks,hash,duplicate,comment\n");
+	} else {
+		fprintf(batch.index_fptr, "[");
+	}
+
+	pthread_mutex_init(&batch.lock, NULL);
+	pthread_mutex_init(&batch.notes_lock, NULL);
+	pthread_mutex_init(&batch.store_lock, NULL);
+	pthread_cond_init(&batch.not_empty, NULL);
+	pthread_cond_init(&batch.not_full, NULL);
+
+	for (i=0; i<n_threads; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL)) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	for (i=optind; i<argc; i++) {
+		queuePath(argv[i], 1);
+	}
+
+	pthread_mutex_lock(&batch.lock);
+	batch.done = 1;
+	pthread_cond_broadcast(&batch.not_empty);
+	pthread_mutex_unlock(&batch.lock);
+
+	for (i=0; i<n_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	if (batch.index_format == INDEX_JSON) {
+		fprintf(batch.index_fptr, "%s]\n", batch.n_images ? "\n" : "");
+	}
+
+	if (output) {
+		fclose(batch.index_fptr);
+	}
+
+	fprintf(stderr, "%d images (%d valid, %d invalid or unknown, %d unreadable), %d notes (%d distinct)\n",
+					batch.n_images, batch.n_valid, batch.n_images - batch.n_valid - batch.n_unreadable,
+					batch.n_unreadable, batch.n_notes, batch.seen_count);
+
+	if (batch.n_write_errors) {
+		fprintf(stderr, "%d extracted, stored or converted files could not be written\n", batch.n_write_errors);
+	}
+
+	if (batch.store) {
+		fprintf(stderr, "%d notes added to the store (%d notes in store)\n", batch.n_stored, notestore_count(batch.store));
+		notestore_close(batch.store);
+	}
+
+	free(batch.results);
+	free(batch.seen);
+
+	if (batch.n_write_errors) {
+		return 1;
+	}
+
+	return batch.n_unreadable ? 2 : 0;
+}
@@ -107,7 +107,7 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (0 != mempak_saveToFile(mpk, pakfile, mpk->file_format)) {
+	if (0 != mempak_updateFile(mpk, pakfile)) {
 		fprintf(stderr, "could not write to memory pak file\n");
 	}
 
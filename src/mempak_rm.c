@@ -96,7 +96,7 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
-	if (0 != mempak_saveToFile(mpk, pakfile, mpk->file_format)) {
+	if (0 != mempak_updateFile(mpk, pakfile)) {
 		fprintf(stderr, "could not write to memory pak file\n");
 	}
 
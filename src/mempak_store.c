@@ -0,0 +1,248 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB adapter firmware
+	Copyright (C) 2007-2015  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "mempak.h"
+#include "notestore.h"
+
+static void print_usage(void)
+{
+	printf("Usage: ./mempak_store store_dir command <arguments>\n");
+	printf("\n");
+	printf("Commands:\n");
+	printf("   add pakfile...               Add the notes of mempak images to the store\n");
+	printf("   ls <options>                 List the notes in the store\n");
+	printf("   export hash notefile         Write a note from the store to a file\n");
+	printf("   import hash pakfile [id]     Write a note from the store to a mempak image\n");
+	printf("                                (first free note, or overwrite note id 0-15)\n");
+	printf("\n");
+	printf("ls options:\n");
+	printf("   -v, --vendor code            Only notes with this vendor code (hex)\n");
+	printf("   -g, --game_id id             Only notes with this game id (hex)\n");
+	printf("   -n, --name text              Only notes with names containing text\n");
+	printf("\n");
+	printf("Notes are stored once, under a hash of their content (note file, as\n");
+	printf("written by mempak_extract_note).\n");
+}
+
+static int cmd_add(struct notestore *ns, int argc, char **argv)
+{
+	int i, note;
+	int added = 0, known = 0;
+
+	for (i=0; i<argc; i++) {
+		mempak_structure_t *mpk;
+
+		mpk = mempak_loadFromFile(argv[i]);
+		if (!mpk) {
+			fprintf(stderr, "Could not load mempak file '%s'\n", argv[i]);
+			return 1;
+		}
+
+		if (0 != validate_mempak(mpk)) {
+			fprintf(stderr, "%s: Mempak invalid (not formatted or corrupted)\n", argv[i]);
+			mempak_free(mpk);
+			continue;
+		}
+
+		for (note = 0; note<MEMPAK_NUM_NOTES; note++) {
+			entry_structure_t note_data;
+			char hash[NOTESTORE_HASH_CHARS+1];
+			int res;
+
+			if (0 != get_mempak_entry(mpk, note, &note_data) || !note_data.valid)
+				continue;
+
+			res = mempak_exportNoteToStore(mpk, note, ns, hash);
+			if (res < 0) {
+				fprintf(stderr, "%s: Could not store note %d\n", argv[i], note);
+				continue;
+			}
+
+			printf("%s %s %s\n", hash, res ? "known" : "added", note_data.utf8_name);
+			if (res) {
+				known++;
+			} else {
+				added++;
+			}
+		}
+
+		mempak_free(mpk);
+	}
+
+	printf("%d notes added, %d already in store\n", added, known);
+
+	return 0;
+}
+
+static int cmd_ls(struct notestore *ns, int argc, char **argv)
+{
+	struct option long_options[] = {
+		{ "vendor", required_argument, 0, 'v' },
+		{ "game_id", required_argument, 0, 'g' },
+		{ "name", required_argument, 0, 'n' },
+		{ }, // terminator
+	};
+	long vendor = -1, game_id = -1;
+	const char *name = NULL;
+	int i;
+
+	optind = 0;
+	while(1) {
+		int c;
+
+		c = getopt_long(argc, argv, "v:g:n:", long_options, NULL);
+		if (c==-1)
+			break;
+
+		switch(c)
+		{
+			case 'v':
+				vendor = strtol(optarg, NULL, 16);
+				break;
+
+			case 'g':
+				game_id = strtol(optarg, NULL, 16);
+				break;
+
+			case 'n':
+				name = optarg;
+				break;
+
+			case '?':
+				fprintf(stderr, "Unknown argument. Try -h\n");
+				return 1;
+		}
+	}
+
+	for (i = notestore_find(ns, vendor, game_id, name, 0); i >= 0; i = notestore_find(ns, vendor, game_id, name, i + 1)) {
+		const struct notestore_entry *entry = notestore_getEntry(ns, i);
+
+		printf("%s %06x %04x %02x %3d %s\n", entry->hash, entry->vendor, entry->game_id, entry->region, entry->blocks, entry->name);
+	}
+
+	return 0;
+}
+
+static int cmd_export(struct notestore *ns, int argc, char **argv)
+{
+	unsigned char note[MEMPAK_NOTE_MAX_FILE_SIZE];
+	long size;
+	FILE *fptr;
+
+	if (argc != 2) {
+		print_usage();
+		return 1;
+	}
+
+	size = notestore_get(ns, argv[0], note, sizeof(note));
+	if (size < 0) {
+		fprintf(stderr, "Note %s not found in store\n", argv[0]);
+		return 1;
+	}
+
+	fptr = fopen(argv[1], "wb");
+	if (!fptr) {
+		perror(argv[1]);
+		return 1;
+	}
+	fwrite(note, size, 1, fptr);
+	fclose(fptr);
+
+	printf("Exported note %s to file '%s'\n", argv[0], argv[1]);
+
+	return 0;
+}
+
+static int cmd_import(struct notestore *ns, int argc, char **argv)
+{
+	mempak_structure_t *mpk;
+	int dst_id = -1, used_id;
+
+	if (argc != 2 && argc != 3) {
+		print_usage();
+		return 1;
+	}
+
+	if (argc == 3) {
+		dst_id = atoi(argv[2]);
+	}
+
+	mpk = mempak_loadFromFile(argv[1]);
+	if (!mpk) {
+		fprintf(stderr, "Could not load mempak file '%s'\n", argv[1]);
+		return 1;
+	}
+
+	if (mempak_importNoteFromStore(mpk, ns, argv[0], dst_id, &used_id)) {
+		fprintf(stderr, "Could not import note\n");
+		mempak_free(mpk);
+		return 1;
+	}
+
+	printf("Note imported and written to slot %d\n", used_id);
+
+	if (0 != mempak_updateFile(mpk, argv[1])) {
+		fprintf(stderr, "could not write to memory pak file\n");
+		mempak_free(mpk);
+		return 1;
+	}
+
+	mempak_free(mpk);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct notestore *ns;
+	const char *cmd;
+	int res;
+
+	if (argc < 3 || 0 == strcmp(argv[1], "-h") || 0 == strcmp(argv[1], "--help")) {
+		print_usage();
+		return argc < 3 ? 1 : 0;
+	}
+
+	cmd = argv[2];
+	if (strcmp(cmd, "add") && strcmp(cmd, "ls") && strcmp(cmd, "export") && strcmp(cmd, "import")) {
+		fprintf(stderr, "Unknown command '%s'. Try -h\n", cmd);
+		return 1;
+	}
+
+	ns = notestore_open(argv[1]);
+	if (!ns) {
+		fprintf(stderr, "Could not open note store '%s'\n", argv[1]);
+		return 1;
+	}
+
+	if (0 == strcmp(cmd, "add")) {
+		res = cmd_add(ns, argc - 3, argv + 3);
+	} else if (0 == strcmp(cmd, "ls")) {
+		res = cmd_ls(ns, argc - 2, argv + 2);
+	} else if (0 == strcmp(cmd, "export")) {
+		res = cmd_export(ns, argc - 3, argv + 3);
+	} else {
+		res = cmd_import(ns, argc - 3, argv + 3);
+	}
+
+	notestore_close(ns);
+
+	return res;
+}
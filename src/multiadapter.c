@@ -0,0 +1,320 @@
+/*	gcn64ctl : raphnet adapter management tools
+	Copyright (C) 2007-2018  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "multiadapter.h"
+#include "raphnetadapter.h"
+#include "mempak.h"
+#include "mempak_gcn64usb.h"
+#include "xferpak_tools.h"
+#include "psxlib.h"
+#include "x2gcn64_adapters.h"
+#include "uiio.h"
+
+#define MAX_ADAPTERS	128
+#define WORKER_FILENAME_MAXCHARS	512
+
+#define WORKER_WAITING	0
+#define WORKER_RUNNING	1
+#define WORKER_DONE		2
+#define WORKER_FAILED	3
+
+struct worker {
+	uiio u; // Must be first. The uiio callbacks cast it back to struct worker.
+	struct rnt_adap_info info;
+	const struct multiadapter_job *job;
+	char filename[WORKER_FILENAME_MAXCHARS];
+	pthread_t thread;
+	volatile int state;
+	int result;
+};
+
+/* Workers run unattended: Questions get their default answer and
+ * normal output is not printed. Errors are printed as they happen. */
+static int worker_ask(int type, const char *fmt, ...)
+{
+	switch (type)
+	{
+		case UIIO_YESNO: return UIIO_YES;
+		case UIIO_CONTINUE_ABORT: return UIIO_CONTINUE;
+		default:
+		case UIIO_NOYES: return UIIO_NO;
+	}
+}
+
+static int worker_error(const char *fmt, ...)
+{
+	va_list ap;
+	int i;
+
+	va_start(ap, fmt);
+	i = vfprintf(stderr, fmt, ap);
+	va_end(ap);
+
+	return i;
+}
+
+static void worker_perror(const char *s)
+{
+	perror(s);
+}
+
+static int worker_printf(const char *fmt, ...)
+{
+	return 0;
+}
+
+static void worker_progressStart(uiio *u)
+{
+	u->progress_status = UIIO_PROGRESS_STARTED;
+}
+
+static int worker_update(uiio *u)
+{
+	return 0;
+}
+
+static void worker_progressEnd(uiio *u, const char *msg)
+{
+	u->progress_status = UIIO_PROGRESS_STOPPED;
+}
+
+static int worker_mempak_progress(int addr, void *ctx)
+{
+	struct worker *w = ctx;
+
+	w->u.cur_progress = addr + 0x20;
+	return 0;
+}
+
+/* dump.mpk -> dump_SERIAL.mpk */
+static void worker_makeFilename(struct worker *w, const char *filename)
+{
+	const char *ext = strrchr(filename, '.');
+
+	if (!ext || strchr(ext, '/')) {
+		snprintf(w->filename, sizeof(w->filename), "%s_%ls", filename, w->info.str_serial);
+	} else {
+		snprintf(w->filename, sizeof(w->filename), "%.*s_%ls%s", (int)(ext - filename), filename, w->info.str_serial, ext);
+	}
+}
+
+static int worker_runJob(struct worker *w, rnt_hdl_t hdl)
+{
+	const struct multiadapter_job *job = w->job;
+	int res;
+
+	switch (job->type)
+	{
+		case MULTIADAPTER_JOB_MEMPAK_DUMP:
+			{
+				mempak_structure_t *pak;
+
+				w->u.max_progress = MEMPAK_MEM_SIZE;
+				res = gcn64lib_mempak_download(hdl, job->channel, &pak, worker_mempak_progress, w);
+				if (res < 0) {
+					return res;
+				}
+				res = mempak_saveToFile(pak, w->filename, mempak_getFilenameFormat(w->filename));
+				mempak_free(pak);
+				return res;
+			}
+
+		case MULTIADAPTER_JOB_XFERPAK_DUMP_ROM:
+			return gcn64lib_xferpak_readROM_to_file(hdl, job->channel, w->filename, &w->u);
+
+		case MULTIADAPTER_JOB_PSX_MC_DUMP:
+			{
+				struct psx_memorycard *mc_data;
+
+				mc_data = malloc(sizeof(struct psx_memorycard));
+				if (!mc_data) {
+					return -1;
+				}
+
+				rnt_suspendPolling(hdl, 1);
+				res = psxlib_readMemoryCard(hdl, job->channel, mc_data, &w->u);
+				rnt_suspendPolling(hdl, 0);
+
+				if (res == 0) {
+					res = psxlib_writeMemoryCardToFile(mc_data, w->filename, PSXLIB_FILE_FORMAT_RAW);
+				} else {
+					fprintf(stderr, "%ls: %s\n", w->info.str_serial, psxlib_getErrorString(res));
+				}
+				free(mc_data);
+				return res;
+			}
+
+		case MULTIADAPTER_JOB_X2GCN64_UPDATE:
+			return x2gcn64_adapter_updateFirmware(hdl, job->channel, job->filename, NULL, &w->u);
+	}
+
+	return -1;
+}
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	rnt_hdl_t hdl;
+
+	w->state = WORKER_RUNNING;
+
+	hdl = rnt_openDevice(&w->info);
+	if (!hdl) {
+		fprintf(stderr, "%ls: Error opening device\n", w->info.str_serial);
+		w->result = -1;
+	} else {
+		w->result = worker_runJob(w, hdl);
+		rnt_closeDevice(hdl);
+	}
+
+	w->state = w->result < 0 ? WORKER_FAILED : WORKER_DONE;
+
+	return NULL;
+}
+
+static void printProgress(struct worker *workers, int n_workers)
+{
+	int i, running = 0, done = 0, failed = 0;
+	double progress = 0;
+
+	for (i=0; i<n_workers; i++) {
+		switch (workers[i].state)
+		{
+			case WORKER_RUNNING:
+				running++;
+				if (workers[i].u.max_progress) {
+					progress += workers[i].u.cur_progress / (double)workers[i].u.max_progress;
+				}
+				break;
+			case WORKER_DONE: done++; progress += 1; break;
+			case WORKER_FAILED: failed++; progress += 1; break;
+		}
+	}
+
+	printf("\rAdapters: %d running, %d done, %d failed (%.1f%%)  ", running, done, failed, progress * 100 / n_workers);
+	fflush(stdout);
+}
+
+int multiadapter_run(const struct multiadapter_job *job)
+{
+	struct rnt_adap_list_ctx *listctx;
+	struct rnt_adap_info inf;
+	struct worker *workers;
+	int i, n_workers = 0, n_started, n_failed = 0, finished;
+
+	if (!job) {
+		return -1;
+	}
+
+	if (job->type == MULTIADAPTER_JOB_MEMPAK_DUMP) {
+		if (mempak_getFilenameFormat(job->filename) == MPK_FORMAT_INVALID) {
+			fprintf(stderr, "Unknown file format (neither .MPK nor .N64)\n");
+			return -1;
+		}
+	}
+
+	workers = calloc(MAX_ADAPTERS, sizeof(struct worker));
+	if (!workers) {
+		perror("calloc");
+		return -1;
+	}
+
+	listctx = rnt_allocListCtx();
+	if (!listctx) {
+		free(workers);
+		return -1;
+	}
+	while (rnt_listDevices(&inf, listctx) && n_workers < MAX_ADAPTERS)
+	{
+		if (inf.legacy_adapter)
+			continue;
+
+		memcpy(&workers[n_workers].info, &inf, sizeof(inf));
+		n_workers++;
+	}
+	rnt_freeListCtx(listctx);
+
+	if (!n_workers) {
+		fprintf(stderr, "No device found\n");
+		free(workers);
+		return -1;
+	}
+
+	printf("Starting job on %d adapter(s)...\n", n_workers);
+
+	for (n_started=0; n_started<n_workers; n_started++) {
+		struct worker *w = &workers[n_started];
+
+		w->job = job;
+		w->u.ask = worker_ask;
+		w->u.error = worker_error;
+		w->u.perror = worker_perror;
+		w->u.printf = worker_printf;
+		w->u.progressStart = worker_progressStart;
+		w->u.update = worker_update;
+		w->u.progressEnd = worker_progressEnd;
+		if (job->filename) {
+			worker_makeFilename(w, job->filename);
+		}
+
+		if (pthread_create(&w->thread, NULL, worker_thread, w)) {
+			fprintf(stderr, "Could not start thread\n");
+			break;
+		}
+	}
+
+	do {
+		usleep(250000);
+		printProgress(workers, n_started);
+
+		finished = 0;
+		for (i=0; i<n_started; i++) {
+			if (workers[i].state >= WORKER_DONE)
+				finished++;
+		}
+	} while (finished < n_started);
+	printf("\n");
+
+	for (i=0; i<n_started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	for (i=0; i<n_workers; i++) {
+		struct worker *w = &workers[i];
+
+		if (i < n_started && w->state == WORKER_DONE) {
+			if (job->type == MULTIADAPTER_JOB_X2GCN64_UPDATE) {
+				printf("%ls: Ok\n", w->info.str_serial);
+			} else {
+				printf("%ls: Ok (%s)\n", w->info.str_serial, w->filename);
+			}
+		} else {
+			printf("%ls: Failed (%d)\n", w->info.str_serial, w->result);
+			n_failed++;
+		}
+	}
+
+	free(workers);
+
+	return n_failed;
+}
@@ -0,0 +1,23 @@
+#ifndef _multiadapter_h__
+#define _multiadapter_h__
+
+#define MULTIADAPTER_JOB_MEMPAK_DUMP		1
+#define MULTIADAPTER_JOB_XFERPAK_DUMP_ROM	2
+#define MULTIADAPTER_JOB_PSX_MC_DUMP		3
+#define MULTIADAPTER_JOB_X2GCN64_UPDATE		4
+
+struct multiadapter_job {
+	int type;
+	int channel;
+	/* Output file (the adapter serial is inserted before the extension) or
+	 * input file (.hex firmware) */
+	const char *filename;
+};
+
+/**
+ * \brief Run a job on all connected adapters at the same time (one thread per adapter)
+ * \return The number of adapters on which the job failed, or -1 on error.
+ */
+int multiadapter_run(const struct multiadapter_job *job);
+
+#endif // _multiadapter_h__
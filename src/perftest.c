@@ -1,147 +1,562 @@
 #include <stdio.h>
-#include <sys/time.h>
+#include <stdlib.h>
 #include <string.h>
+#include <wchar.h>
 #include "perftest.h"
 #include "gcn64_protocol.h"
 #include "gcn64lib.h"
-#include "hexdump.h"
+#include "mempak.h"
+#include "mempak_gcn64usb.h"
+#include "xferpak.h"
+#include "psxlib.h"
+#include "timer.h"
 
-#define N_CYCLES	60
-#define N_CYCLESLONG	1200
+#define BENCH_MAX_RESULTS	16
 
-static long getElaps_us(struct timeval *tv_before, struct timeval *tv_after)
+struct bench_result {
+	const char *name;
+	const char *description;
+	int skipped;
+
+	/* Latency: one sample per operation */
+	int n_samples;
+	int errors; // Failed operations. Failed when there are only errors.
+	uint64_t total_us;
+	uint64_t min_us, p50_us, p95_us, p99_us, max_us;
+
+	/* Throughput (when bytes is non-zero) */
+	long bytes;
+	uint64_t elapsed_us;
+
+	/* Block IO packing (when n_ops is non-zero) */
+	int n_ops;
+	int n_reports;
+	int payload_bytes;
+};
+
+struct bench {
+	rnt_hdl_t hdl;
+	int channel;
+	int cycles;
+	uint64_t *samples;
+	int n_results;
+	struct bench_result results[BENCH_MAX_RESULTS];
+};
+
+static struct bench_result *bench_newResult(struct bench *b, const char *name, const char *description)
 {
-	return (tv_after->tv_sec - tv_before->tv_sec)*1000000 + (tv_after->tv_usec - tv_before->tv_usec);
+	struct bench_result *r;
+
+	if (b->n_results >= BENCH_MAX_RESULTS) {
+		fprintf(stderr, "Too many benchmark results\n");
+		return NULL;
+	}
+
+	r = &b->results[b->n_results++];
+	memset(r, 0, sizeof(struct bench_result));
+	r->name = name;
+	r->description = description;
+
+	return r;
 }
 
-static void printTestResult(long total_us, int cycles)
+static int cmp_u64(const void *a, const void *b)
 {
-	printf("Total time (microseconds): %ld\n", total_us);
-	printf("Cycles: %d\n", cycles);
-	printf("Average: %ld us\n", total_us / cycles);
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
 }
 
-int perftest1(rnt_hdl_t hdl, int channel)
+/* Nearest-rank percentile of sorted samples */
+static uint64_t percentile(const uint64_t *sorted, int n, int pct)
 {
-	int n, i, res, j;
-	unsigned char cmd[64];
-	char version[64];
-	long total_us = 0;
-	struct timeval tv_before, tv_after;
-	unsigned char cmd_getcaps[1] = { N64_GET_CAPABILITIES };
-	unsigned char cmd_getstatus[1] = { N64_GET_STATUS };
-	struct blockio_op ops[4] = {
-		{ 0, sizeof(cmd_getcaps), cmd_getcaps, 3, cmd + 0 },
-		{ 0, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 3 },
-		{ 1, sizeof(cmd_getcaps), cmd_getcaps, 3, cmd + 7 },
-		{ 1, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 10 },
-	};
-	struct blockio_op ops2[2] = {
-		{ 0, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 0 },
-		{ 1, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 4 },
-	};
+	int rank = (pct * n + 99) / 100;
 
-	printf("Requesting the firmware version %d times...\n", N_CYCLES);
-	for (i=0; i<N_CYCLES; i++) {
+	if (rank < 1)
+		rank = 1;
 
-		gettimeofday(&tv_before, NULL);
-		res = rnt_getVersion(hdl, version, sizeof(version));
-		gettimeofday(&tv_after, NULL);
+	return sorted[rank - 1];
+}
 
-		total_us += getElaps_us(&tv_before, &tv_after);
+static void bench_computeLatency(struct bench *b, struct bench_result *r)
+{
+	int i;
 
-		if (res != 0) {
-			fprintf(stderr, "error during test after %d cycles\n", i);
-			return -1;
+	if (r->n_samples < 1) {
+		// All operations failing is a result, not a skipped test
+		if (!r->errors) {
+			r->skipped = 1;
 		}
+		return;
+	}
+
+	qsort(b->samples, r->n_samples, sizeof(uint64_t), cmp_u64);
 
-	//	printf("Version: %s\n", version);
+	for (r->total_us = 0, i=0; i<r->n_samples; i++) {
+		r->total_us += b->samples[i];
 	}
+	r->min_us = b->samples[0];
+	r->max_us = b->samples[r->n_samples - 1];
+	r->p50_us = percentile(b->samples, r->n_samples, 50);
+	r->p95_us = percentile(b->samples, r->n_samples, 95);
+	r->p99_us = percentile(b->samples, r->n_samples, 99);
+}
 
-	printTestResult(total_us, N_CYCLES);
+static void bench_printResult(const struct bench_result *r)
+{
+	printf("%s: %s\n", r->name, r->description);
 
-	total_us = 0;
-	printf("Sending the N64_GET_CAPABILITIES command %d times...\n", N_CYCLES);
-	for (i=0; i<N_CYCLES; i++) {
-		cmd[0] = N64_GET_CAPABILITIES;
-		gettimeofday(&tv_before, NULL);
-		n = gcn64lib_rawSiCommand(hdl, channel, cmd, 1, cmd, sizeof(cmd));
-		gettimeofday(&tv_after, NULL);
-		if (n >= 0) {
-			total_us += getElaps_us(&tv_before, &tv_after);
+	if (r->skipped) {
+		printf("  Skipped\n");
+		return;
+	}
+
+	if (r->n_samples) {
+		printf("  %d samples (%d errors), us: min %llu, p50 %llu, p95 %llu, p99 %llu, max %llu, mean %llu\n",
+				r->n_samples, r->errors,
+				(unsigned long long)r->min_us, (unsigned long long)r->p50_us,
+				(unsigned long long)r->p95_us, (unsigned long long)r->p99_us,
+				(unsigned long long)r->max_us, (unsigned long long)(r->total_us / r->n_samples));
+	} else if (r->errors) {
+		printf("  0 samples (%d errors), failed\n", r->errors);
+	}
+	if (r->n_ops) {
+		printf("  %d ops in %d report(s), %d payload bytes (%.1f%% of report bytes)",
+				r->n_ops, r->n_reports, r->payload_bytes,
+				100.0 * r->payload_bytes / (r->n_reports * 2 * 63));
+		if (r->n_samples) {
+			printf(", p50 %llu us per op", (unsigned long long)(r->p50_us / r->n_ops));
+		}
+		printf("\n");
+	}
+	if (r->bytes && r->elapsed_us) {
+		printf("  %ld bytes in %llu us (%.0f bytes/s)\n", r->bytes,
+				(unsigned long long)r->elapsed_us, r->bytes * 1000000.0 / r->elapsed_us);
+	}
+}
+
+static void json_string(FILE *fptr, const char *s)
+{
+	fputc('"', fptr);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fprintf(fptr, "\\%c", *s);
+		} else if ((unsigned char)*s < 0x20) {
+			fprintf(fptr, "\\u%04x", (unsigned char)*s);
 		} else {
-			fprintf(stderr, "error during test after %d cycles\n", i);
-			return -1;
+			fputc(*s, fptr);
 		}
 	}
-	printTestResult(total_us, N_CYCLES);
+	fputc('"', fptr);
+}
 
+static void bench_writeJSON(struct bench *b, FILE *fptr)
+{
+	struct rnt_adap_info inf;
+	char str[PRODNAME_MAXCHARS * 4];
+	char version[64] = "";
+	int i;
 
-	total_us = 0;
-	printf("Doing N64_GET_CAPS + READ_STATUS on controllers 0 and 1 through the block IO api %d times...\n", N_CYCLES);
+	rnt_getInfo(b->hdl, &inf);
+	rnt_getVersion(b->hdl, version, sizeof(version));
 
-	for (i=0; i<N_CYCLES; i++) {
-		memset(cmd, 0xff, sizeof(cmd));
+	fprintf(fptr, "{\n");
+	fprintf(fptr, "  \"tool_version\": ");
+	json_string(fptr, VERSION_STR);
+	fprintf(fptr, ",\n  \"adapter\": {\n    \"product\": ");
+	if (wcstombs(str, inf.str_prodname, sizeof(str)) == (size_t)-1)
+		str[0] = 0;
+	json_string(fptr, str);
+	fprintf(fptr, ",\n    \"serial\": ");
+	if (wcstombs(str, inf.str_serial, sizeof(str)) == (size_t)-1)
+		str[0] = 0;
+	json_string(fptr, str);
+	fprintf(fptr, ",\n    \"usb_pid\": %d,\n    \"firmware\": ", inf.usb_pid);
+	json_string(fptr, version);
+	fprintf(fptr, ",\n    \"block_io\": %s\n  },\n", (inf.caps.features & RNTF_BLOCK_IO) ? "true" : "false");
+	fprintf(fptr, "  \"channel\": %d,\n", b->channel);
+	fprintf(fptr, "  \"cycles\": %d,\n", b->cycles);
+	fprintf(fptr, "  \"results\": [");
 
-		gettimeofday(&tv_before, NULL);
-		res = gcn64lib_blockIO(hdl, ops, 4);
-		gettimeofday(&tv_after, NULL);
-		total_us += getElaps_us(&tv_before, &tv_after);
+	for (i=0; i<b->n_results; i++) {
+		const struct bench_result *r = &b->results[i];
 
-		if (res < 0) {
-			fprintf(stderr, "Error in blockIO\n");
-			break;
+		fprintf(fptr, "%s\n    { \"name\": ", i ? "," : "");
+		json_string(fptr, r->name);
+		fprintf(fptr, ", \"skipped\": %s", r->skipped ? "true" : "false");
+		if (r->skipped) {
+			fprintf(fptr, " }");
+			continue;
+		}
+		fprintf(fptr, ", \"samples\": %d, \"errors\": %d, \"failed\": %s",
+				r->n_samples, r->errors, (!r->n_samples && r->errors) ? "true" : "false");
+		if (r->n_samples) {
+			fprintf(fptr, ", \"min_us\": %llu, \"p50_us\": %llu, \"p95_us\": %llu, \"p99_us\": %llu, \"max_us\": %llu, \"mean_us\": %llu",
+				(unsigned long long)r->min_us, (unsigned long long)r->p50_us,
+				(unsigned long long)r->p95_us, (unsigned long long)r->p99_us,
+				(unsigned long long)r->max_us, (unsigned long long)(r->total_us / r->n_samples));
+		}
+		if (r->n_ops) {
+			fprintf(fptr, ", \"ops\": %d, \"reports\": %d, \"payload_bytes\": %d, \"packing_efficiency\": %.4f",
+				r->n_ops, r->n_reports, r->payload_bytes,
+				(double)r->payload_bytes / (r->n_reports * 2 * 63));
+			if (r->n_samples) {
+				fprintf(fptr, ", \"us_per_op\": %llu", (unsigned long long)(r->p50_us / r->n_ops));
+			}
+		}
+		if (r->bytes && r->elapsed_us) {
+			fprintf(fptr, ", \"bytes\": %ld, \"elapsed_us\": %llu, \"bytes_per_s\": %.0f",
+				r->bytes, (unsigned long long)r->elapsed_us, r->bytes * 1000000.0 / r->elapsed_us);
 		}
+		fprintf(fptr, " }");
 	}
 
-	for (j=0; j<4; j++) {
-		printf("blockio[%d]: tx %d bytes, result: 0x%02x, ", j, ops[j].tx_len, ops[j].rx_len);
-		if (ops[j].rx_len & BIO_RX_LEN_TIMEDOUT) {
-			printf("Timeout\n");
-		} else if (ops[j].rx_len & BIO_RX_LEN_PARTIAL) {
-			printf("Partial read\n");
-		} else {
-			printHexBuf(ops[j].rx_data, ops[j].rx_len);
+	fprintf(fptr, "\n  ]\n}\n");
+}
+
+static void bench_usbRoundtrip(struct bench *b)
+{
+	struct bench_result *r = bench_newResult(b, "usb_roundtrip", "Firmware version request (one USB round trip)");
+	char version[64];
+	uint64_t t;
+	int i;
+
+	if (!r)
+		return;
+
+	for (i=0; i<b->cycles; i++) {
+		t = getMicroseconds();
+		if (rnt_getVersion(b->hdl, version, sizeof(version))) {
+			r->errors++;
+			continue;
+		}
+		b->samples[r->n_samples++] = getMicroseconds() - t;
+	}
+
+	bench_computeLatency(b, r);
+}
+
+static void bench_rawSi(struct bench *b)
+{
+	struct bench_result *r = bench_newResult(b, "si_raw", "N64_GET_CAPABILITIES through a raw SI command");
+	unsigned char cmd[64];
+	uint64_t t;
+	int i, n;
+
+	if (!r)
+		return;
+
+	for (i=0; i<b->cycles; i++) {
+		cmd[0] = N64_GET_CAPABILITIES;
+		t = getMicroseconds();
+		n = gcn64lib_rawSiCommand(b->hdl, b->channel, cmd, 1, cmd, sizeof(cmd));
+		if (n <= 0) {
+			r->errors++;
+			continue;
+		}
+		b->samples[r->n_samples++] = getMicroseconds() - t;
+	}
+
+	bench_computeLatency(b, r);
+}
+
+static void bench_setPacking(struct bench *b, struct bench_result *r, const struct blockio_op *ops, int n_ops)
+{
+	int i;
+
+	r->n_ops = n_ops;
+	r->n_reports = gcn64lib_siqCountReports(b->hdl, ops, n_ops);
+	for (r->payload_bytes = 0, i=0; i<n_ops; i++) {
+		r->payload_bytes += ops[i].tx_len + (ops[i].rx_len & BIO_RXTX_MASK);
+	}
+}
+
+static void bench_blockIO(struct bench *b, const char *name, const char *description, struct blockio_op *ops, int n_ops)
+{
+	struct bench_result *r = bench_newResult(b, name, description);
+	unsigned char rx_len[8];
+	uint64_t t;
+	int i, j, failed;
+
+	if (!r)
+		return;
+
+	bench_setPacking(b, r, ops, n_ops);
+
+	for (j=0; j<n_ops; j++) {
+		rx_len[j] = ops[j].rx_len;
+	}
+
+	for (i=0; i<b->cycles; i++) {
+		t = getMicroseconds();
+		failed = gcn64lib_blockIO(b->hdl, ops, n_ops) < 0;
+		t = getMicroseconds() - t;
+
+		for (j=0; j<n_ops; j++) {
+			if (ops[j].rx_len & (BIO_RX_LEN_TIMEDOUT | BIO_RX_LEN_PARTIAL)) {
+				failed = 1;
+			}
+			ops[j].rx_len = rx_len[j];
 		}
+
+		if (failed) {
+			r->errors++;
+			continue;
+		}
+		b->samples[r->n_samples++] = t;
 	}
 
-	printTestResult(total_us, N_CYCLES);
+	bench_computeLatency(b, r);
+	// Packing figures are meaningful even without a controller
+	r->skipped = 0;
+}
+
+/* The packing of the SI operations used to transfer mempak and transfer pak blocks */
+static void bench_packing(struct bench *b)
+{
+	static unsigned char tx_read[3], tx_write[35];
+	static unsigned char rx[33];
+	struct blockio_op ops[16];
+	struct bench_result *r;
+	int i;
+
+	r = bench_newResult(b, "packing_pak_read", "SI queue packing of 16 pak block reads");
+	if (r) {
+		for (i=0; i<16; i++) {
+			ops[i] = (struct blockio_op){ b->channel, sizeof(tx_read), tx_read, 33, rx };
+		}
+		bench_setPacking(b, r, ops, 16);
+	}
 
-	// This test averages at 14665 us when gcn64lib_blockIO_compat() is used.
-	// On adapters supporting block IO this averages at 4466 us... More than 3 times faster.
+	r = bench_newResult(b, "packing_pak_write", "SI queue packing of 16 pak block writes");
+	if (r) {
+		for (i=0; i<16; i++) {
+			ops[i] = (struct blockio_op){ b->channel, sizeof(tx_write), tx_write, 1, rx };
+		}
+		bench_setPacking(b, r, ops, 16);
+	}
+}
 
-	total_us = 0;
-	printf("Doing N64_GET_CAPS + READ_STATUS on controllers 0 and 1 through the block IO api %d times...\n", N_CYCLESLONG);
+/* Returns -1 when no mempak is detected */
+static int bench_mempak(struct bench *b)
+{
+	struct bench_result *lat = bench_newResult(b, "mempak_block_read", "Single mempak block reads");
+	struct bench_result *thr = bench_newResult(b, "mempak_read", "Full mempak read");
+	mempak_structure_t *mpk;
+	unsigned char block[32];
+	uint64_t t;
+	int i;
 
-	for (i=0; i<N_CYCLESLONG; i++) {
-		memset(cmd, 0xff, sizeof(cmd));
+	if (!lat || !thr)
+		return 0;
 
-		gettimeofday(&tv_before, NULL);
-		res = gcn64lib_blockIO(hdl, ops2, 2);
-		gettimeofday(&tv_after, NULL);
-		total_us += getElaps_us(&tv_before, &tv_after);
+	if (gcn64lib_mempak_detect(b->hdl, b->channel)) {
+		lat->skipped = 1;
+		thr->skipped = 1;
+		return -1;
+	}
 
-		if (res < 0) {
-			fprintf(stderr, "Error in blockIO\n");
-			break;
+	for (i=0; i<b->cycles; i++) {
+		t = getMicroseconds();
+		if (gcn64lib_mempak_readBlock(b->hdl, b->channel, (i * 0x20) % MEMPAK_MEM_SIZE, block) != 32) {
+			lat->errors++;
+			continue;
 		}
+		b->samples[lat->n_samples++] = getMicroseconds() - t;
+	}
+	bench_computeLatency(b, lat);
+
+	t = getMicroseconds();
+	if (gcn64lib_mempak_download(b->hdl, b->channel, &mpk, NULL, NULL)) {
+		thr->skipped = 1;
+		return 0;
 	}
+	thr->elapsed_us = getMicroseconds() - t;
+	thr->bytes = MEMPAK_MEM_SIZE;
+	mempak_free(mpk);
 
-	for (j=0; j<2; j++) {
-		printf("blockio[%d]: tx %d bytes, result: 0x%02x, ", j, ops[j].tx_len, ops[j].rx_len);
-		if (ops[j].rx_len & BIO_RX_LEN_TIMEDOUT) {
-			printf("Timeout\n");
-		} else if (ops[j].rx_len & BIO_RX_LEN_PARTIAL) {
-			printf("Partial read\n");
+	return 0;
+}
+
+#define BENCH_XFERPAK_READ_SIZE	0x4000
+
+static void bench_xferpak(struct bench *b)
+{
+	struct bench_result *lat = bench_newResult(b, "xferpak_block_read", "Single transfer pak block reads");
+	struct bench_result *thr = bench_newResult(b, "xferpak_read", "Read of the first 16K of cartridge ROM");
+	unsigned char block[32];
+	unsigned char *buf;
+	xferpak *xpak;
+	uint64_t t;
+	int i;
+
+	if (!lat || !thr)
+		return;
+
+	xpak = gcn64lib_xferpak_init(b->hdl, b->channel, NULL);
+	if (!xpak) {
+		lat->skipped = 1;
+		thr->skipped = 1;
+		return;
+	}
+
+	if (xferpak_setBank(xpak, 0) == 0) {
+		for (i=0; i<b->cycles; i++) {
+			t = getMicroseconds();
+			if (xferpak_readBlock(xpak, 0xC000 + (i * 0x20) % 0x4000, block) != 32) {
+				lat->errors++;
+				continue;
+			}
+			b->samples[lat->n_samples++] = getMicroseconds() - t;
+		}
+	}
+	bench_computeLatency(b, lat);
+
+	buf = malloc(BENCH_XFERPAK_READ_SIZE);
+	if (!buf) {
+		perror("malloc");
+		thr->skipped = 1;
+	} else {
+		t = getMicroseconds();
+		if (xferpak_readCart(xpak, 0, BENCH_XFERPAK_READ_SIZE, buf)) {
+			thr->skipped = 1;
 		} else {
-			printHexBuf(ops[j].rx_data, ops[j].rx_len);
+			thr->elapsed_us = getMicroseconds() - t;
+			thr->bytes = BENCH_XFERPAK_READ_SIZE;
+		}
+		free(buf);
+	}
+
+	xferpak_free(xpak);
+}
+
+static void quiet_progress(uiio *u)
+{
+}
+
+static int quiet_update(uiio *u)
+{
+	return 0;
+}
+
+static void quiet_progressEnd(uiio *u, const char *msg)
+{
+}
+
+static void bench_psx(struct bench *b)
+{
+	struct bench_result *lat = bench_newResult(b, "psx_sector_read", "Single PSX memory card sector reads");
+	struct bench_result *thr = bench_newResult(b, "psx_mc_read", "Full PSX memory card read");
+	struct psx_memorycard *mc;
+	unsigned char sector[PSXLIB_MC_SECTOR_SIZE];
+	uiio u;
+	uint64_t t;
+	int i;
+
+	if (!lat || !thr)
+		return;
+
+	if (psxlib_readMemoryCardSector(b->hdl, b->channel, 0, sector)) {
+		lat->skipped = 1;
+		thr->skipped = 1;
+		return;
+	}
+
+	for (i=0; i<b->cycles; i++) {
+		t = getMicroseconds();
+		if (psxlib_readMemoryCardSector(b->hdl, b->channel, i % PSXLIB_MC_N_SECTORS, sector)) {
+			lat->errors++;
+			continue;
 		}
+		b->samples[lat->n_samples++] = getMicroseconds() - t;
+	}
+	bench_computeLatency(b, lat);
+
+	mc = malloc(sizeof(struct psx_memorycard));
+	if (!mc) {
+		perror("malloc");
+		thr->skipped = 1;
+		return;
 	}
 
-	printTestResult(total_us, N_CYCLESLONG);
+	uiio_init_std(&u);
+	u.progressStart = quiet_progress;
+	u.update = quiet_update;
+	u.progressEnd = quiet_progressEnd;
 
+	t = getMicroseconds();
+	if (psxlib_readMemoryCard(b->hdl, b->channel, mc, &u)) {
+		thr->skipped = 1;
+	} else {
+		thr->elapsed_us = getMicroseconds() - t;
+		thr->bytes = PSXLIB_MC_TOTAL_SIZE;
+	}
+
+	free(mc);
+}
 
+int perftest_bench(rnt_hdl_t hdl, int channel, int cycles, FILE *json)
+{
+	struct bench *b;
+	struct rnt_adap_info inf;
+	unsigned char cmd[16];
+	unsigned char cmd_getcaps[1] = { N64_GET_CAPABILITIES };
+	unsigned char cmd_getstatus[1] = { N64_GET_STATUS };
+	struct blockio_op ops[4] = {
+		{ 0, sizeof(cmd_getcaps), cmd_getcaps, 3, cmd + 0 },
+		{ 0, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 3 },
+		{ 1, sizeof(cmd_getcaps), cmd_getcaps, 3, cmd + 7 },
+		{ 1, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 10 },
+	};
+	struct blockio_op ops2[2] = {
+		{ 0, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 0 },
+		{ 1, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 4 },
+	};
+	int i;
+
+	if (cycles < 1 || rnt_getInfo(hdl, &inf)) {
+		return -1;
+	}
+
+	b = calloc(1, sizeof(struct bench));
+	if (!b) {
+		perror("calloc");
+		return -1;
+	}
+	b->hdl = hdl;
+	b->channel = channel;
+	b->cycles = cycles;
+	b->samples = calloc(cycles, sizeof(uint64_t));
+	if (!b->samples) {
+		perror("calloc");
+		free(b);
+		return -1;
+	}
+
+	bench_usbRoundtrip(b);
+
+	if (inf.caps.ports & RNTF_PORT_PSX) {
+		bench_psx(b);
+	} else {
+		bench_rawSi(b);
+		bench_blockIO(b, "blockio_4ops", "N64_GET_CAPS + N64_GET_STATUS on channels 0 and 1 in one block IO", ops, 4);
+		bench_blockIO(b, "blockio_2ops", "N64_GET_STATUS on channels 0 and 1 in one block IO", ops2, 2);
+		bench_packing(b);
+		// A transfer pak is not a mempak, and vice versa
+		if (bench_mempak(b)) {
+			bench_xferpak(b);
+		}
+	}
+
+	for (i=0; i<b->n_results; i++) {
+		bench_printResult(&b->results[i]);
+	}
+
+	if (json) {
+		bench_writeJSON(b, json);
+	}
 
+	free(b->samples);
+	free(b);
 
 	return 0;
 }
@@ -1,8 +1,23 @@
 #ifndef _perftest_h__
 #define _perftest_h__
 
+#include <stdio.h>
 #include "raphnetadapter.h"
 
-int perftest1(rnt_hdl_t hdl, int channel);
+#define PERFTEST_DEFAULT_CYCLES	200
+
+/**
+ * \brief Measure transport latency, throughput and block IO packing
+ *
+ * Tests that need hardware which is not connected (eg: mempak, memory card)
+ * are reported as skipped.
+ *
+ * \param hdl The adapter handle
+ * \param channel The channel (port) to use
+ * \param cycles Number of samples per latency test
+ * \param json If non-NULL, results are also written to this file in JSON format
+ * \return 0 on success
+ **/
+int perftest_bench(rnt_hdl_t hdl, int channel, int cycles, FILE *json);
 
 #endif // _perftest_h__
@@ -16,6 +16,7 @@
 */
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "rnt_priv.h"
 #include "gcn64lib.h"
 #include "requests.h"
@@ -166,9 +167,58 @@ static int gcn64lib_blockIO_compat(rnt_hdl_t hdl, struct blockio_op *iops, int n
 	return 0;
 }
 
+#define BIO_BUFSIZE	63
+
+/* Check if an operation fits in a block IO buffer where tx_used bytes
+ * of request and rx_used bytes of answer are already used. */
+static int blockio_fits(int tx_used, int rx_used, const struct blockio_op *op)
+{
+	if (tx_used + 3 + op->tx_len > BIO_BUFSIZE)
+		return 0;
+	// Answer parsing requires the data to end before the last byte.
+	if (rx_used + 1 + (op->rx_len & BIO_RXTX_MASK) >= BIO_BUFSIZE)
+		return 0;
+	return 1;
+}
+
+static int blockio_pack(unsigned char *iobuf, int p, const struct blockio_op *op)
+{
+	iobuf[p] = op->chn;
+	p++;
+	iobuf[p] = op->tx_len & BIO_RXTX_MASK;
+	p++;
+	iobuf[p] = op->rx_len & BIO_RXTX_MASK;
+	p++;
+
+	memcpy(iobuf + p, op->tx_data, op->tx_len);
+	p += op->tx_len;
+
+	return p;
+}
+
+/* Returns the position of the next answer, or -1 if the adapter answer is not valid */
+static int blockio_unpack(const unsigned char *iobuf, int p, struct blockio_op *op)
+{
+	if (p >= BIO_BUFSIZE) {
+		fprintf(stderr, "blockIO: adapter reports too much received data\n");
+		return -1;
+	}
+
+	op->rx_len = iobuf[p];
+	p++;
+	if (p + (op->rx_len & BIO_RXTX_MASK) >= BIO_BUFSIZE) {
+		fprintf(stderr, "blockIO: adapter reports too much received data\n");
+		return -1;
+	}
+	memcpy(op->rx_data, iobuf + p, op->rx_len & BIO_RXTX_MASK);
+	p += op->rx_len & BIO_RXTX_MASK;
+
+	return p;
+}
+
 int gcn64lib_blockIO(rnt_hdl_t hdl, struct blockio_op *iops, int n_iops)
 {
-	unsigned char iobuf[63];
+	unsigned char iobuf[BIO_BUFSIZE];
 	int p, i, n;
 	if (!hdl)
 		return -1;
@@ -193,15 +243,7 @@ int gcn64lib_blockIO(rnt_hdl_t hdl, struct blockio_op *iops, int n_iops)
 				fprintf(stderr, "io blocks do not fit in buffer\n");
 				return -1;
 			}
-			iobuf[p] = iops[i].chn;
-			p++;
-			iobuf[p] = iops[i].tx_len & BIO_RXTX_MASK;
-			p++;
-			iobuf[p] = iops[i].rx_len & BIO_RXTX_MASK;
-			p++;
-
-			memcpy(iobuf + p, iops[i].tx_data, iops[i].tx_len);
-			p += iops[i].tx_len;
+			p = blockio_pack(iobuf, p, &iops[i]);
 		}
 #ifdef DEBUG_BLOCKIO
 		fputs("blockIO request: ", stdout);
@@ -236,22 +278,240 @@ int gcn64lib_blockIO(rnt_hdl_t hdl, struct blockio_op *iops, int n_iops)
 		}
 
 		for (p=1,i=0; i<n_iops; i++) {
-			if (p >= sizeof(iobuf)) {
-				fprintf(stderr, "blockIO: adapter reports too much received data\n");
+			p = blockio_unpack(iobuf, p, &iops[i]);
+			if (p < 0) {
 				break;
 			}
+		}
+	}
 
-			iops[i].rx_len = iobuf[p];
-			p++;
-			if (p + (iops[i].rx_len & BIO_RXTX_MASK) >= sizeof(iobuf)) {
-				fprintf(stderr, "blockIO: adapter reports too much received data\n");
-				break;
+	return 0;
+}
+
+/* Worst case is ops with neither tx nor rx data: 3 bytes each */
+#define SIQ_MAX_OPS_PER_REPORT	((BIO_BUFSIZE-1)/3)
+
+struct siq_entry {
+	struct blockio_op *op;
+	gcn64lib_siq_cb cb;
+	void *ctx;
+};
+
+struct siq_report {
+	struct rnt_request rq;
+	unsigned char iobuf[BIO_BUFSIZE];
+	int raw_si; // Single RQ_GCN64_RAW_SI_COMMAND instead of block IO
+	int tx_used, rx_used;
+	int n_ops;
+	struct siq_entry ops[SIQ_MAX_OPS_PER_REPORT];
+};
+
+struct gcn64lib_siq {
+	rnt_hdl_t hdl;
+	struct siq_report *cur; // Block IO report being filled
+};
+
+static void siq_timeout(struct blockio_op *op)
+{
+	op->rx_len &= BIO_RXTX_MASK;
+	op->rx_len |= BIO_RX_LEN_TIMEDOUT;
+}
+
+static void siq_reportCompleted(rnt_hdl_t hdl, struct rnt_request *rq)
+{
+	struct siq_report *rep = rq->ctx;
+	int i, p, rx_len;
+
+	if (rep->raw_si) {
+		struct blockio_op *op = rep->ops[0].op;
+
+		// Same rules as gcn64lib_blockIO_compat()
+		rx_len = rq->result_len < 3 ? 0 : rep->iobuf[2];
+		if (rx_len <= 0 || rx_len != op->rx_len || rx_len > rq->result_len - 3) {
+			siq_timeout(op);
+		} else {
+			memcpy(op->rx_data, rep->iobuf + 3, rx_len);
+		}
+	}
+	else if (rq->result_len != BIO_BUFSIZE || rep->iobuf[0] != RQ_GCN64_BLOCK_IO) {
+		if (rq->result_len >= 0) {
+			fprintf(stderr, "Invalid iobuf reply\n");
+		}
+		for (i=0; i<rep->n_ops; i++) {
+			siq_timeout(rep->ops[i].op);
+		}
+	}
+	else {
+		for (p=1,i=0; i<rep->n_ops; i++) {
+			if (p >= 0) {
+				p = blockio_unpack(rep->iobuf, p, rep->ops[i].op);
+			}
+			if (p < 0) {
+				siq_timeout(rep->ops[i].op);
 			}
-			memcpy(iops[i].rx_data, iobuf + p, iops[i].rx_len & BIO_RXTX_MASK);
-			p += iops[i].rx_len & BIO_RXTX_MASK;
 		}
 	}
 
+	for (i=0; i<rep->n_ops; i++) {
+		if (rep->ops[i].cb) {
+			rep->ops[i].cb(rep->ops[i].op, rep->ops[i].ctx);
+		}
+	}
+
+	free(rep);
+}
+
+static struct siq_report *siq_newReport(gcn64lib_siq *q)
+{
+	struct siq_report *rep;
+
+	rep = calloc(1, sizeof(struct siq_report));
+	if (!rep) {
+		perror("could not allocate siq report");
+		return NULL;
+	}
+
+	rep->rq.outcmd = rep->iobuf;
+	rep->rq.result = rep->iobuf;
+	rep->rq.result_max = sizeof(rep->iobuf);
+	rep->rq.completed = siq_reportCompleted;
+	rep->rq.ctx = rep;
+
+	return rep;
+}
+
+static int siq_submitCurrent(gcn64lib_siq *q)
+{
+	struct siq_report *rep = q->cur;
+
+	if (!rep)
+		return 0;
+
+	q->cur = NULL;
+	rep->rq.outlen = sizeof(rep->iobuf);
+
+	return rnt_submit(q->hdl, &rep->rq);
+}
+
+gcn64lib_siq *gcn64lib_siqNew(rnt_hdl_t hdl)
+{
+	gcn64lib_siq *q;
+
+	if (!hdl)
+		return NULL;
+
+	q = calloc(1, sizeof(gcn64lib_siq));
+	if (!q) {
+		perror("could not allocate siq");
+		return NULL;
+	}
+	q->hdl = hdl;
+
+	return q;
+}
+
+void gcn64lib_siqFree(gcn64lib_siq *q)
+{
+	if (q) {
+		gcn64lib_siqFlush(q);
+		free(q);
+	}
+}
+
+int gcn64lib_siqSubmit(gcn64lib_siq *q, struct blockio_op *op, gcn64lib_siq_cb cb, void *ctx)
+{
+	struct siq_report *rep;
+
+	if (!q || !op)
+		return -1;
+
+	if (op->tx_len > BIO_BUFSIZE - 4 || (op->rx_len & BIO_RXTX_MASK) > BIO_BUFSIZE - 3) {
+		fprintf(stderr, "siq: operation too large\n");
+		return -1;
+	}
+
+	if (!(q->hdl->info.caps.features & RNTF_BLOCK_IO)) {
+		rep = siq_newReport(q);
+		if (!rep)
+			return -1;
+
+		rep->raw_si = 1;
+		rep->iobuf[0] = RQ_GCN64_RAW_SI_COMMAND;
+		rep->iobuf[1] = op->chn;
+		rep->iobuf[2] = op->tx_len;
+		memcpy(rep->iobuf + 3, op->tx_data, op->tx_len);
+		rep->rq.outlen = 3 + op->tx_len;
+		rep->ops[0].op = op;
+		rep->ops[0].cb = cb;
+		rep->ops[0].ctx = ctx;
+		rep->n_ops = 1;
+
+		return rnt_submit(q->hdl, &rep->rq);
+	}
+
+	if (q->cur && !blockio_fits(q->cur->tx_used, q->cur->rx_used, op)) {
+		siq_submitCurrent(q);
+	}
+
+	if (!q->cur) {
+		rep = siq_newReport(q);
+		if (!rep)
+			return -1;
+
+		memset(rep->iobuf, 0xff, sizeof(rep->iobuf));
+		rep->iobuf[0] = RQ_GCN64_BLOCK_IO;
+		rep->tx_used = 1;
+		rep->rx_used = 1;
+		q->cur = rep;
+	}
+
+	rep = q->cur;
+	rep->tx_used = blockio_pack(rep->iobuf, rep->tx_used, op);
+	rep->rx_used += 1 + (op->rx_len & BIO_RXTX_MASK);
+	rep->ops[rep->n_ops].op = op;
+	rep->ops[rep->n_ops].cb = cb;
+	rep->ops[rep->n_ops].ctx = ctx;
+	rep->n_ops++;
+
+	if (rep->n_ops >= SIQ_MAX_OPS_PER_REPORT) {
+		return siq_submitCurrent(q);
+	}
+
 	return 0;
 }
 
+int gcn64lib_siqFlush(gcn64lib_siq *q)
+{
+	if (!q)
+		return -1;
+
+	siq_submitCurrent(q);
+
+	return rnt_harvest(q->hdl, 0) < 0 ? -1 : 0;
+}
+
+int gcn64lib_siqCountReports(rnt_hdl_t hdl, const struct blockio_op *iops, int n_iops)
+{
+	int i, n_reports = 0, n_ops = 0, tx_used = 0, rx_used = 0;
+
+	if (!hdl)
+		return -1;
+
+	if (!(hdl->info.caps.features & RNTF_BLOCK_IO)) {
+		return n_iops;
+	}
+
+	for (i=0; i<n_iops; i++) {
+		if (!n_reports || n_ops >= SIQ_MAX_OPS_PER_REPORT || !blockio_fits(tx_used, rx_used, &iops[i])) {
+			n_reports++;
+			n_ops = 0;
+			tx_used = 1;
+			rx_used = 1;
+		}
+		tx_used += 3 + iops[i].tx_len;
+		rx_used += 1 + (iops[i].rx_len & BIO_RXTX_MASK);
+		n_ops++;
+	}
+
+	return n_reports;
+}
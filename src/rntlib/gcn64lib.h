@@ -23,4 +23,22 @@ struct blockio_op {
 
 int gcn64lib_blockIO(rnt_hdl_t hdl, struct blockio_op *iops, int n_iops);
 
+/* SI operation queue. Submitted operations are packed in as few
+ * block IO reports as possible (or sent one by one using raw SI commands
+ * on adapters without block IO) and queued with rnt_submit(). Completion
+ * callbacks are called in submission order, with rx_len updated as
+ * by gcn64lib_blockIO(). */
+typedef struct gcn64lib_siq gcn64lib_siq;
+typedef void (*gcn64lib_siq_cb)(struct blockio_op *op, void *ctx);
+
+gcn64lib_siq *gcn64lib_siqNew(rnt_hdl_t hdl);
+/** \brief Flushes the queue and free it */
+void gcn64lib_siqFree(gcn64lib_siq *q);
+/** \brief Queue an operation. op (and its buffers) must remain valid until cb is called. */
+int gcn64lib_siqSubmit(gcn64lib_siq *q, struct blockio_op *op, gcn64lib_siq_cb cb, void *ctx);
+/** \brief Send everything submitted so far and wait until all callbacks were called */
+int gcn64lib_siqFlush(gcn64lib_siq *q);
+/** \brief Return the number of reports the queue would use to send the operations */
+int gcn64lib_siqCountReports(rnt_hdl_t hdl, const struct blockio_op *iops, int n_iops);
+
 #endif // _gcn64_lib_h__
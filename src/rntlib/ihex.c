@@ -14,9 +14,48 @@
 	You should have received a copy of the GNU General Public License
 	along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#define _GNU_SOURCE // for memmem
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include "hexdump.h"
+#include <pthread.h>
+#include <zlib.h>
+#include "ihex.h"
+#include "mapfile.h"
+
+#ifdef WINDOWS
+#include "memmem.h"
+#endif
+
+#define IHEX_CACHE_ENTRIES	4
+
+/* Hexadecimal digit values + 0x10. 0 for other characters. */
+#define HEXDIGIT(v)	(0x10 | (v))
+static const unsigned char nibble_value[256] = {
+	['0'] = HEXDIGIT(0), ['1'] = HEXDIGIT(1), ['2'] = HEXDIGIT(2), ['3'] = HEXDIGIT(3),
+	['4'] = HEXDIGIT(4), ['5'] = HEXDIGIT(5), ['6'] = HEXDIGIT(6), ['7'] = HEXDIGIT(7),
+	['8'] = HEXDIGIT(8), ['9'] = HEXDIGIT(9),
+	['A'] = HEXDIGIT(10), ['B'] = HEXDIGIT(11), ['C'] = HEXDIGIT(12),
+	['D'] = HEXDIGIT(13), ['E'] = HEXDIGIT(14), ['F'] = HEXDIGIT(15),
+	['a'] = HEXDIGIT(10), ['b'] = HEXDIGIT(11), ['c'] = HEXDIGIT(12),
+	['d'] = HEXDIGIT(13), ['e'] = HEXDIGIT(14), ['f'] = HEXDIGIT(15),
+};
+
+/* Decoded files, identified by the CRC32 and Adler-32 of their content. The bytes written
+ * by the records are marked in a bitmap so loading from the cache writes exactly
+ * what decoding the file would. */
+struct ihex_cache_entry {
+	long size;
+	uLong crc, adler;
+	int max_address; // 0 for unused entries
+	unsigned char *image;
+	unsigned char *written;
+	unsigned int last_used;
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ihex_cache_entry cache[IHEX_CACHE_ENTRIES];
+static unsigned int cache_clock;
 
 static unsigned char chk(unsigned char *buf, int len)
 {
@@ -29,131 +68,262 @@ static unsigned char chk(unsigned char *buf, int len)
 	return r;
 }
 
-/* \return The highest address written to, or negative on errors.
+/* Decode the records of a hex file in a single pass. If written is not NULL, the
+ * bits for the bytes written to dstbuf are set.
+ *
+ * \return The highest address written to, or negative on errors.
  */
-int load_ihex(const char *file, unsigned char *dstbuf, int bufsize)
+static int ihex_decode(const unsigned char *text, long size, unsigned char *dstbuf, int bufsize, unsigned char *written)
 {
-	FILE *fptr;
-	char linebuf[550];
+	const unsigned char *p = text, *end = text + size, *eol, *c;
 	unsigned char databuf[2+1+255+1];
-	int ret = 0;
 	int line = 0;
 	int eof_seen = 0;
 	unsigned int max_address = 0;
 	unsigned int offset = 0;
 
-	fptr = fopen(file, "r");
-	if (!fptr) {
-		perror("fopen");
-		return -1;
-	}
+	for (; p < end; p = eol + 1) {
+		unsigned int data_count;
+		unsigned int address;
+		int input_bytes;
+		unsigned int i;
 
-	do {
-		if (fgets(linebuf, sizeof(linebuf), fptr)) {
-			unsigned int data_count;
-			unsigned int address;
-			int input_nibbles, input_bytes;
-			int i;
+		eol = memchr(p, '\n', end - p);
+		if (!eol) {
+			eol = end;
+		}
 
-			line++;
+		line++;
 
-			if (linebuf[0] != ':') {
-				fprintf(stderr, "Ignored invalid line %d\n", line);
-				continue;
-			}
+		if (*p != ':') {
+			fprintf(stderr, "Ignored invalid line %d\n", line);
+			continue;
+		}
+
+		if (eof_seen) {
+			fprintf(stderr, "extra data after EOF record in hex file\n");
+			return -7;
+		}
 
-			if (eof_seen) {
-				fprintf(stderr, "extra data after EOF record in hex file\n");
-				ret = -7;
-				goto err;
+		// :10 0000 00 92C064C7ABC0AAC0A9C0A8C0A7C0A6C0 00
+		//  ^  ^    ^  ^                                ^-- Checksum
+		//  |  |    |  +----- Data [data_count]
+		//  |  |    +---- Record type
+		//  |  +------ Address
+		//  +----- data_count
+		//
+
+		for (input_bytes=0,c=p+1; c+1<eol && input_bytes<sizeof(databuf); c+=2) {
+			unsigned char hi = nibble_value[c[0]], lo = nibble_value[c[1]];
+
+			if (!hi || !lo) {
+				break;
 			}
+			databuf[input_bytes] = (hi << 4) | (lo & 0x0f);
+			input_bytes++;
+		}
 
-			// :10 0000 00 92C064C7ABC0AAC0A9C0A8C0A7C0A6C0 00
-			//  ^  ^    ^  ^                                ^-- Checksum
-			//  |  |    |  +----- Data [data_count]
-			//  |  |    +---- Record type
-			//  |  +------ Address
-			//  +----- data_count
-			//
+		// Validate the record checksum
+		if (chk(databuf, input_bytes)) {
+			fprintf(stderr, "Bad checksum at line %d\n", line);
+			return -4;
+		}
+
+		// Data length sanity check
+		data_count = databuf[0];
+		if (input_bytes != 1+2+1+data_count+1) {
+			fprintf(stderr, "Invalid record (less data than expected) at line %d\n", line);
+			return -5;
+		}
 
-			input_nibbles = strlen(linebuf) - 1;
+		address = databuf[1]<<8 | databuf[2];
 
-			for (input_bytes=0,i=0; i<input_nibbles; i+=2) {
-				unsigned int byte;
-				if (1 != sscanf(linebuf + 1 + i, "%02x", &byte)) {
-					break;
+		switch(databuf[3])
+		{
+			case 0x00: // Data
+				if (address + offset + data_count > bufsize) {
+					fprintf(stderr, "hex file too large\n");
+					return -6;
 				}
-				databuf[input_bytes] = byte;
-				input_bytes++;
-			}
+				if (address + offset + data_count > max_address) {
+					max_address = address + offset + data_count;
+				}
+				memcpy(dstbuf + address + offset, databuf + 4, data_count);
+				if (written) {
+					for (i=address+offset; i<address+offset+data_count; i++) {
+						written[i >> 3] |= 1 << (i & 7);
+					}
+				}
+				break;
 
-			//printf("Input bytes: %d\n", input_bytes);
-			//printHexBuf(databuf, input_bytes);
+			case 0x01: // EOF
+				eof_seen = 1;
+				break;
 
-			// Validate the record checksum
-			if (chk(databuf, input_bytes)) {
-				fprintf(stderr, "Bad checksum at line %d\n", line);
-				ret = -4;
-				goto err;
-			}
+			case 0x04: // Extended linear address
+				if (data_count != 2) {
+					fprintf(stderr, "ihex parser: Malformatted 0x04 record at line %d\n", line);
+					return -8;
+				}
+				offset = (databuf[4] << 24) | (databuf[5] << 16);
+				break;
 
-			// Data length sanity check
-			data_count = databuf[0];
-			if (input_bytes != 1+2+1+data_count+1) {
-				fprintf(stderr, "Invalid record (less data than expected) at line %d\n", line);
-				ret = -5;
-				goto err;
-			}
+			case 0x03: // Start segment address
+			case 0x05: // Start linear address
+				// Ignored
+				break;
 
-			address = databuf[1]<<8 | databuf[2];
+			default:
+			case 0x02: // Extended segment address
+				fprintf(stderr, "ihex parser: Unimplemented record type 0x%02x at line %d\n", databuf[3], line);
+				return -2;
+		}
+	}
 
-			switch(databuf[3])
-			{
-				case 0x00: // Data
-					if (address + offset + data_count > bufsize) {
-						fprintf(stderr, "hex file too large\n");
-						ret = -6;
-						goto err;
-					}
-					if (address + offset + data_count > max_address) {
-						max_address = address + offset + data_count;
-					}
-					memcpy(dstbuf + address + offset, databuf + 4, data_count);
-					break;
-
-				case 0x01: // EOF
-					eof_seen = 1;
-					break;
-
-				case 0x04: // Extended linear address
-					if (data_count != 2) {
-						fprintf(stderr, "ihex parser: Malformatted 0x04 record at line %d\n", line);
-						ret = -8;
-						goto err;
-					}
-					offset = (databuf[4] << 24) | (databuf[5] << 16);
-					//printf("OFfset: 0x%08x\n", offset);
-					break;
-
-				case 0x03: // Start segment address
-				case 0x05: // Start linear address
-					// Ignored
-					break;
-
-				default:
-				case 0x02: // Extended segment address
-					fprintf(stderr, "ihex parser: Unimplemented record type 0x%02x at line %d\n", databuf[3], line);
-					ret = -2;
-					goto err;
-			}
+	return max_address;
+}
+
+/* Must be called with cache_lock held */
+static struct ihex_cache_entry *cache_find(long size, uLong crc, uLong adler)
+{
+	int i;
+
+	for (i=0; i<IHEX_CACHE_ENTRIES; i++) {
+		struct ihex_cache_entry *e = &cache[i];
+
+		if (e->image && e->size == size && e->crc == crc && e->adler == adler) {
+			e->last_used = ++cache_clock;
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+/* Write the bytes of a cached file to dstbuf. Must be called with cache_lock held. */
+static void cache_load(struct ihex_cache_entry *e, unsigned char *dstbuf)
+{
+	int i = 0, j;
+
+	while (i < e->max_address) {
+		if (!(e->written[i >> 3] & (1 << (i & 7)))) {
+			i++;
+			continue;
+		}
+		for (j=i+1; j<e->max_address && (e->written[j >> 3] & (1 << (j & 7))); j++)
+			;
+		memcpy(dstbuf + i, e->image + i, j - i);
+		i = j;
+	}
+}
+
+/* Keep a decoded file, replacing the least recently used entry. Takes ownership of written. */
+static void cache_store(long size, uLong crc, uLong adler, int max_address, const unsigned char *dstbuf, unsigned char *written)
+{
+	struct ihex_cache_entry *e;
+	unsigned char *image;
+	int i;
+
+	image = malloc(max_address > 0 ? max_address : 1);
+	if (!image) {
+		perror("malloc");
+		free(written);
+		return;
+	}
+	memcpy(image, dstbuf, max_address);
+
+	pthread_mutex_lock(&cache_lock);
+
+	if (cache_find(size, crc, adler)) {
+		// Another thread got there first
+		pthread_mutex_unlock(&cache_lock);
+		free(image);
+		free(written);
+		return;
+	}
 
+	e = &cache[0];
+	for (i=1; i<IHEX_CACHE_ENTRIES; i++) {
+		if (!cache[i].image) {
+			e = &cache[i];
+			break;
+		}
+		if (cache[i].last_used < e->last_used) {
+			e = &cache[i];
 		}
-	} while (!feof(fptr));
+	}
+
+	free(e->image);
+	free(e->written);
+	e->size = size;
+	e->crc = crc;
+	e->adler = adler;
+	e->max_address = max_address;
+	e->image = image;
+	e->written = written;
+	e->last_used = ++cache_clock;
+
+	pthread_mutex_unlock(&cache_lock);
+}
+
+int load_ihex_with_signature(const char *file, unsigned char *dstbuf, int bufsize, const char *signature)
+{
+	struct mapfile *mf;
+	struct ihex_cache_entry *e;
+	unsigned char *written;
+	uLong crc, adler;
+	long size;
+	int max_address = -1;
+
+	mf = mapfile_open(file, MAPFILE_READ);
+	if (!mf) {
+		perror(file);
+		return -1;
+	}
+
+	size = mf->size;
+	crc = crc32(0, mf->data, size);
+	adler = adler32(1, mf->data, size);
+
+	pthread_mutex_lock(&cache_lock);
+	e = cache_find(size, crc, adler);
+	if (e && e->max_address <= bufsize) {
+		cache_load(e, dstbuf);
+		max_address = e->max_address;
+	}
+	pthread_mutex_unlock(&cache_lock);
+
+	if (max_address < 0) {
+		written = calloc(1, (bufsize + 7) / 8);
+
+		max_address = ihex_decode(mf->data, size, dstbuf, bufsize, written);
+		if (max_address >= 0 && written) {
+			cache_store(size, crc, adler, max_address, dstbuf, written);
+		} else {
+			free(written);
+		}
+	}
+
+	mapfile_close(mf);
+
+	if (max_address < 0) {
+		return max_address;
+	}
+
+	if (signature) {
+		// look for the signature somewhere in the file to make sure
+		// this firmware is intended for this product
+		if (!memmem(dstbuf, max_address < bufsize ? max_address + 1 : bufsize, signature, strlen(signature))) {
+			return IHEX_ERR_SIGNATURE;
+		}
+	}
 
-	fclose(fptr);
 	return max_address;
+}
 
-err:
-	fclose(fptr);
-	return ret;
+/* \return The highest address written to, or negative on errors.
+ */
+int load_ihex(const char *file, unsigned char *dstbuf, int bufsize)
+{
+	return load_ihex_with_signature(file, dstbuf, bufsize, NULL);
 }
@@ -1,8 +1,18 @@
 #ifndef _ihex_h__
 #define _ihex_h__
 
+#define IHEX_ERR_SIGNATURE	-9
+
+/* Decoded files are kept in a small cache identified by the file content, so
+ * loading the same file again only costs hashing it. */
+
 /* \return File size, or negative value on error.*/
 int load_ihex(const char *file, unsigned char *dstbuf, int bufsize);
 
+/* Same as load_ihex, but also make sure the signature (if not NULL) is
+ * somewhere in the data.
+ * \return File size, IHEX_ERR_SIGNATURE if the signature is not found, or other negative values on error. */
+int load_ihex_with_signature(const char *file, unsigned char *dstbuf, int bufsize, const char *signature);
+
 #endif // _ihex_h__
 
@@ -0,0 +1,278 @@
+/*	gcn64ctl : raphnet adapter management tools
+	Copyright (C) 2007-2018  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "imgcache.h"
+
+#ifdef WINDOWS
+#include <io.h>
+#endif
+
+#define IMGCACHE_MAGIC		"RNTIMGC1"
+#define IMGCACHE_PATH_MAX	512
+
+static int imgcache_mkdir(const char *path)
+{
+	int res;
+
+#ifdef WINDOWS
+	res = mkdir(path);
+#else
+	res = mkdir(path, 0755);
+#endif
+	if (res && errno != EEXIST) {
+		return -1;
+	}
+	return 0;
+}
+
+/* Get (and create if needed) the cache directory */
+static int imgcache_getDir(char *dst, int dstmax)
+{
+	const char *base;
+
+#ifdef WINDOWS
+	base = getenv("LOCALAPPDATA");
+	if (!base) {
+		return -1;
+	}
+	snprintf(dst, dstmax, "%s\\raphnet-tech", base);
+	if (imgcache_mkdir(dst)) {
+		return -1;
+	}
+	snprintf(dst, dstmax, "%s\\raphnet-tech\\cache", base);
+#else
+	base = getenv("XDG_CACHE_HOME");
+	if (base && *base) {
+		snprintf(dst, dstmax, "%s", base);
+	} else {
+		base = getenv("HOME");
+		if (!base) {
+			return -1;
+		}
+		snprintf(dst, dstmax, "%s/.cache", base);
+	}
+	if (imgcache_mkdir(dst)) {
+		return -1;
+	}
+	strncat(dst, "/gcn64tools", dstmax - strlen(dst) - 1);
+#endif
+
+	return imgcache_mkdir(dst);
+}
+
+static int imgcache_getPath(const char *key, char *dst, int dstmax)
+{
+	char dir[IMGCACHE_PATH_MAX];
+	int n;
+
+	if (imgcache_getDir(dir, sizeof(dir))) {
+		return -1;
+	}
+
+#ifdef WINDOWS
+	n = snprintf(dst, dstmax, "%s\\%s.img", dir, key);
+#else
+	n = snprintf(dst, dstmax, "%s/%s.img", dir, key);
+#endif
+	if (n < 0 || n >= dstmax) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Fletcher-16 */
+static uint16_t imgcache_checksum(const unsigned char *data, int len)
+{
+	uint16_t a = 0, b = 0;
+
+	while (len--) {
+		a = (a + *data++) % 255;
+		b = (b + a) % 255;
+	}
+
+	return (b << 8) | a;
+}
+
+static void put32(unsigned char *dst, uint32_t v)
+{
+	dst[0] = v;
+	dst[1] = v >> 8;
+	dst[2] = v >> 16;
+	dst[3] = v >> 24;
+}
+
+static uint32_t get32(const unsigned char *src)
+{
+	return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t)src[3] << 24;
+}
+
+int imgcache_makeKey(rnt_hdl_t hdl, int channel, const char *card_id, char *dst, int dstmax)
+{
+	struct rnt_adap_info info;
+	char serial[64];
+	int i;
+
+	if (!card_id || rnt_getInfo(hdl, &info)) {
+		return -1;
+	}
+
+	// Only keep characters that are safe in file names
+	for (i=0; i<sizeof(serial)-1 && info.str_serial[i]; i++) {
+		wchar_t c = info.str_serial[i];
+
+		if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-') {
+			serial[i] = c;
+		} else {
+			serial[i] = '_';
+		}
+	}
+	serial[i] = 0;
+
+	snprintf(dst, dstmax, "%04x_%s_ch%d_%s", info.usb_pid, serial, channel, card_id);
+
+	return 0;
+}
+
+/**
+ * \brief Load a cached image
+ * \param key The cache key (see imgcache_makeKey)
+ * \param image Destination for the image
+ * \param size The expected image size
+ * \param block_size Size of the blocks (each has a stored checksum)
+ * \return 0 on success, -1 if not in cache or if the cached file is not valid
+ */
+int imgcache_load(const char *key, unsigned char *image, int size, int block_size)
+{
+	char path[IMGCACHE_PATH_MAX];
+	unsigned char header[16];
+	unsigned char chk[2];
+	FILE *fptr;
+	int ofs, res = -1;
+
+	if (!key || !image || size <= 0 || block_size <= 0 || size % block_size) {
+		return -1;
+	}
+
+	if (imgcache_getPath(key, path, sizeof(path))) {
+		return -1;
+	}
+
+	fptr = fopen(path, "rb");
+	if (!fptr) {
+		return -1;
+	}
+
+	if (1 != fread(header, sizeof(header), 1, fptr)) {
+		goto done;
+	}
+	if (memcmp(header, IMGCACHE_MAGIC, 8) || get32(header + 8) != size || get32(header + 12) != block_size) {
+		goto done;
+	}
+
+	for (ofs = 0; ofs < size; ofs += block_size) {
+		if (1 != fread(image + ofs, block_size, 1, fptr)) {
+			goto done;
+		}
+		if (1 != fread(chk, 2, 1, fptr)) {
+			goto done;
+		}
+		if (imgcache_checksum(image + ofs, block_size) != (chk[0] | chk[1] << 8)) {
+			fprintf(stderr, "imgcache: Bad checksum in %s\n", path);
+			goto done;
+		}
+	}
+	res = 0;
+
+done:
+	fclose(fptr);
+	return res;
+}
+
+/**
+ * \brief Store an image in the cache
+ * \return 0 on success
+ */
+int imgcache_store(const char *key, const unsigned char *image, int size, int block_size)
+{
+	char path[IMGCACHE_PATH_MAX];
+	char tmppath[IMGCACHE_PATH_MAX + 4];
+	unsigned char header[16];
+	unsigned char chk[2];
+	uint16_t c;
+	FILE *fptr;
+	int ofs;
+
+	if (!key || !image || size <= 0 || block_size <= 0 || size % block_size) {
+		return -1;
+	}
+
+	if (imgcache_getPath(key, path, sizeof(path))) {
+		return -1;
+	}
+
+	// Write to a temporary file first so an interrupted write does not leave a truncated image.
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+	fptr = fopen(tmppath, "wb");
+	if (!fptr) {
+		perror(tmppath);
+		return -1;
+	}
+
+	memcpy(header, IMGCACHE_MAGIC, 8);
+	put32(header + 8, size);
+	put32(header + 12, block_size);
+	if (1 != fwrite(header, sizeof(header), 1, fptr)) {
+		goto error;
+	}
+
+	for (ofs = 0; ofs < size; ofs += block_size) {
+		c = imgcache_checksum(image + ofs, block_size);
+		chk[0] = c;
+		chk[1] = c >> 8;
+		if (1 != fwrite(image + ofs, block_size, 1, fptr) || 1 != fwrite(chk, 2, 1, fptr)) {
+			goto error;
+		}
+	}
+
+	if (fclose(fptr)) {
+		remove(tmppath);
+		return -1;
+	}
+
+	// rename() does not replace existing files on Windows
+	remove(path);
+	if (rename(tmppath, path)) {
+		perror(path);
+		remove(tmppath);
+		return -1;
+	}
+
+	return 0;
+
+error:
+	perror(tmppath);
+	fclose(fptr);
+	remove(tmppath);
+	return -1;
+}
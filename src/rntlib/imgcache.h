@@ -0,0 +1,17 @@
+#ifndef _imgcache_h__
+#define _imgcache_h__
+
+#include "raphnetadapter.h"
+
+/* On-disk cache of card images (mempaks, memory cards). Images are kept under
+ * the user cache directory, keyed by adapter serial, channel and card identity.
+ * Each block is stored with a checksum and damaged files are never used. */
+
+#define IMGCACHE_KEY_MAXCHARS	256
+
+/** \brief Build the cache key for a card connected to an adapter channel */
+int imgcache_makeKey(rnt_hdl_t hdl, int channel, const char *card_id, char *dst, int dstmax);
+int imgcache_load(const char *key, unsigned char *image, int size, int block_size);
+int imgcache_store(const char *key, const unsigned char *image, int size, int block_size);
+
+#endif // _imgcache_h__
@@ -0,0 +1,190 @@
+/*	gcn64ctl : raphnet adapter management tools
+	Copyright (C) 2007-2018  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "mapfile.h"
+
+#ifndef WINDOWS
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef WINDOWS
+
+/* No mmap: The file is read in a buffer, and written back by mapfile_sync */
+struct mapfile *mapfile_open(const char *filename, int mode)
+{
+	struct mapfile *mf;
+	FILE *fptr;
+
+	fptr = fopen(filename, mode == MAPFILE_SHARED ? "r+b" : "rb");
+	if (!fptr) {
+		return NULL;
+	}
+
+	mf = calloc(1, sizeof(struct mapfile));
+	if (!mf) {
+		perror("calloc");
+		fclose(fptr);
+		return NULL;
+	}
+	mf->mode = mode;
+
+	fseek(fptr, 0, SEEK_END);
+	mf->size = ftell(fptr);
+	fseek(fptr, 0, SEEK_SET);
+
+	if (mf->size < 0) {
+		goto error;
+	}
+
+	mf->data = malloc(mf->size > 0 ? mf->size : 1);
+	if (!mf->data) {
+		perror("malloc");
+		goto error;
+	}
+
+	if (mf->size > 0 && 1 != fread(mf->data, mf->size, 1, fptr)) {
+		goto error;
+	}
+
+	if (mode == MAPFILE_SHARED) {
+		mf->priv = fptr;
+	} else {
+		fclose(fptr);
+	}
+
+	return mf;
+
+error:
+	fclose(fptr);
+	free(mf->data);
+	free(mf);
+	return NULL;
+}
+
+int mapfile_sync(struct mapfile *mf, long offset, long len)
+{
+	FILE *fptr = mf->priv;
+
+	if (mf->mode != MAPFILE_SHARED)
+		return -1;
+	if (offset < 0 || len < 0 || offset + len > mf->size)
+		return -1;
+
+	fseek(fptr, offset, SEEK_SET);
+	if (len > 0 && 1 != fwrite(mf->data + offset, len, 1, fptr)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+void mapfile_close(struct mapfile *mf)
+{
+	if (!mf)
+		return;
+
+	if (mf->priv) {
+		fclose(mf->priv);
+	}
+	free(mf->data);
+	free(mf);
+}
+
+#else
+
+struct mapfile *mapfile_open(const char *filename, int mode)
+{
+	struct mapfile *mf;
+	struct stat st;
+	int fd;
+	int prot = PROT_READ, flags = MAP_PRIVATE;
+
+	fd = open(filename, mode == MAPFILE_SHARED ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+
+	mf = calloc(1, sizeof(struct mapfile));
+	if (!mf) {
+		perror("calloc");
+		close(fd);
+		return NULL;
+	}
+	mf->mode = mode;
+	mf->size = st.st_size;
+
+	if (mode != MAPFILE_READ) {
+		prot |= PROT_WRITE;
+	}
+	if (mode == MAPFILE_SHARED) {
+		flags = MAP_SHARED;
+	}
+
+	/* Empty files cannot be mapped */
+	if (mf->size > 0) {
+		mf->data = mmap(NULL, mf->size, prot, flags, fd, 0);
+		if (mf->data == MAP_FAILED) {
+			close(fd);
+			free(mf);
+			return NULL;
+		}
+	}
+
+	/* The mapping stays valid after closing the file */
+	close(fd);
+
+	return mf;
+}
+
+int mapfile_sync(struct mapfile *mf, long offset, long len)
+{
+	long pagesize = sysconf(_SC_PAGESIZE);
+	long start;
+
+	if (mf->mode != MAPFILE_SHARED)
+		return -1;
+	if (offset < 0 || len < 0 || offset + len > mf->size)
+		return -1;
+	if (len == 0)
+		return 0;
+
+	start = offset - (offset % pagesize);
+
+	return msync(mf->data + start, offset + len - start, MS_ASYNC);
+}
+
+void mapfile_close(struct mapfile *mf)
+{
+	if (!mf)
+		return;
+
+	if (mf->data) {
+		munmap(mf->data, mf->size);
+	}
+	free(mf);
+}
+
+#endif
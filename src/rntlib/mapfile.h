@@ -0,0 +1,30 @@
+#ifndef _mapfile_h__
+#define _mapfile_h__
+
+/* Files mapped in memory. Images are used in place instead of being read
+ * into a buffer, and only the parts that change are written back. Where
+ * mmap is not available, the file is read and written with stdio. */
+
+#define MAPFILE_READ	0 // Read-only
+#define MAPFILE_PRIVATE	1 // Writable copy-on-write. The file is not modified.
+#define MAPFILE_SHARED	2 // Writable. Changes are written to the file.
+
+struct mapfile {
+	unsigned char *data;
+	long size;
+	int mode;
+	void *priv;
+};
+
+struct mapfile *mapfile_open(const char *filename, int mode);
+
+/**
+ * \brief Write back a modified range of a MAPFILE_SHARED mapping
+ *
+ * With mmap, the pages are written by the system anyway. This only starts
+ * writing them. Without mmap, this is what updates the file.
+ */
+int mapfile_sync(struct mapfile *mf, long offset, long len);
+void mapfile_close(struct mapfile *mf);
+
+#endif // _mapfile_h__
@@ -22,6 +22,8 @@
 #include <ctype.h>
 #include <libgen.h>
 #include "mempak.h"
+#include "mapfile.h"
+#include "notestore.h"
 
 #define DEXDRIVE_DATA_OFFSET	0x1040
 #define DEXDRIVE_COMMENT_OFFSET	0x40
@@ -69,18 +71,19 @@ static int mempak_findFreeNote(mempak_structure_t *mpk, entry_structure_t *entry
 
 /**
  * \param mpk The memory pack to operate on
- * \param notefile The filename of the note to load
+ * \param note The note file content
+ * \param size The note file size
  * \param dst_note_id 0-15: (Over)write to specific note, -1: auto (first free)
  * \param note_id Stores the id of the note that was used
  * \return -1: Error, -2: Not enough space in mempak
  */
-int mempak_importNote(mempak_structure_t *mpk, const char *notefile, int dst_note_id, int *note_id)
+int mempak_importNoteFromBuffer(mempak_structure_t *mpk, const unsigned char *note, long size, int dst_note_id, int *note_id)
 {
 	int free_blocks = get_mempak_free_space(mpk);
-	FILE *fptr;
 	unsigned char entry_data[32];
 	unsigned char *data = NULL;
 	entry_structure_t entry;
+	entry_structure_t oldentry;
 	int res;
 
 	if (dst_note_id < -1 || dst_note_id > 15) {
@@ -90,17 +93,11 @@ int mempak_importNote(mempak_structure_t *mpk, const char *notefile, int dst_not
 
 	printf("Current free blocks: %d\n", free_blocks);
 
-	fptr = fopen(notefile, "rb");
-	if (!fptr) {
-		perror("fopen");
-		return -1;
-	}
-
-	if (1 != fread(entry_data, 32, 1, fptr)) {
-		perror("fread");
-		fclose(fptr);
+	if (size < 32) {
+		fprintf(stderr, "Note file too short\n");
 		return -1;
 	}
+	memcpy(entry_data, note, 32);
 
 	/* I follow the same convention as bryc's javascript mempak editor[1]
 	 * by looking for an inode number of 0xCAFE.
@@ -109,129 +106,167 @@ int mempak_importNote(mempak_structure_t *mpk, const char *notefile, int dst_not
 	 *
 	 * If there are other note formats to support, this will need updating.
 	 */
-	if ((entry_data[0x06] == 0xCA) &&
-		(entry_data[0x07] == 0xFE))
+	if ((entry_data[0x06] != 0xCA) ||
+		(entry_data[0x07] != 0xFE))
 	{
-		entry_structure_t oldentry;
-		long filesize;
+		fprintf(stderr, "Input file does not appear to be in a supported format.\n");
+		return -1;
+	}
 
-		// Fixup the inode number (0xCAFE is invalid)
-		entry_data[0x06] = 0x00;
-		entry_data[0x07] = 0x05; // BLOCK_VALID_FIRST;
+	// Fixup the inode number (0xCAFE is invalid)
+	entry_data[0x06] = 0x00;
+	entry_data[0x07] = 0x05; // BLOCK_VALID_FIRST;
 
-		if (0 != mempak_parse_entry(entry_data, &entry)) {
-			fprintf(stderr, "Error loading note (invalid)\n");
-			fclose(fptr);
-			return -1;
-		}
+	if (0 != mempak_parse_entry(entry_data, &entry)) {
+		fprintf(stderr, "Error loading note (invalid)\n");
+		return -1;
+	}
 
-		fseek(fptr, 0, SEEK_END);
-		filesize = ftell(fptr);
-		fseek(fptr, 32, SEEK_SET);
+	// Remove the note header
+	size -= 32;
+	if (size % MEMPAK_BLOCK_SIZE) {
+		fprintf(stderr, "Invalid note file size\n");
+		return -1;
+	}
 
-		// Remove the note header
-		filesize -= 32;
-		if (filesize % MEMPAK_BLOCK_SIZE) {
-			fprintf(stderr, "Invalid note file size\n");
-			fclose(fptr);
-			return -1;
-		}
+	entry.blocks = size / MEMPAK_BLOCK_SIZE;
 
-		entry.blocks = filesize / MEMPAK_BLOCK_SIZE;
+	printf("Note size: %d blocks\n", entry.blocks);
+	printf("Note name: %s\n", entry.utf8_name);
 
-		printf("Note size: %d blocks\n", entry.blocks);
-		printf("Note name: %s\n", entry.utf8_name);
+	if (entry.blocks > free_blocks) {
+		fprintf(stderr, "Not enough space (note is %d blocks and only %d free blocks in mempak)\n",
+			entry.blocks, free_blocks);
+		return -2;
+	}
 
-		if (entry.blocks > free_blocks) {
-			fprintf(stderr, "Not enough space (note is %d blocks and only %d free blocks in mempak)\n",
-				entry.blocks, free_blocks);
-			fclose(fptr);
-			return -2;
-		}
+	data = calloc(1, entry.blocks * MEMPAK_BLOCK_SIZE);
+	if (!data) {
+		perror("calloc");
+		return -1;
+	}
+	memcpy(data, note + 32, entry.blocks * MEMPAK_BLOCK_SIZE);
 
-		data = calloc(1, entry.blocks * MEMPAK_BLOCK_SIZE);
-		if (!data) {
-			perror("calloc");
-			fclose(fptr);
+	if (dst_note_id == -1) { // Auto (first free note)
+		if (0 != mempak_findFreeNote(mpk, &oldentry, note_id)) {
+			fprintf(stderr, "Could not find an empty note\n");
+			free(data);
 			return -1;
 		}
-
-		if (1 != fread(data, entry.blocks * MEMPAK_BLOCK_SIZE, 1, fptr)) {
-			perror("could not load note data");
+	} else { // Specific note
+		get_mempak_entry(mpk, dst_note_id, &oldentry);
+		if (oldentry.valid) {
+			printf("Overwriting note %d\n", dst_note_id);
+			delete_mempak_entry(mpk, &oldentry);
+		} else {
+			fprintf(stderr, "No note id %d\n", dst_note_id);
 			free(data);
-			fclose(fptr);
 			return -1;
 		}
+		if (note_id)
+			*note_id = dst_note_id;
+	}
 
-		if (dst_note_id == -1) { // Auto (first free note)
-			if (0 != mempak_findFreeNote(mpk, &oldentry, note_id)) {
-				fprintf(stderr, "Could not find an empty note\n");
-				free(data);
-				fclose(fptr);
-				return -1;
-			}
-		} else { // Specific note
-			get_mempak_entry(mpk, dst_note_id, &oldentry);
-			if (oldentry.valid) {
-				printf("Overwriting note %d\n", dst_note_id);
-				delete_mempak_entry(mpk, &oldentry);
-			} else {
-				fprintf(stderr, "No note id %d\n", dst_note_id);
-				free(data);
-				fclose(fptr);
-				return -1;
-			}
-			if (note_id)
-				*note_id = dst_note_id;
-		}
+	res = write_mempak_entry_data(mpk, &entry, data);
+	free(data);
+	if (res != 0) {
+		fprintf(stderr, "Failed to write note (error %d)\n", res);
+		return -1;
+	}
 
-		res = write_mempak_entry_data(mpk, &entry, data);
-		if (res != 0) {
-			fprintf(stderr, "Failed to write note (error %d)\n", res);
-			free(data);
-			fclose(fptr);
-			return -1;
-		}
+	return 0;
+}
 
-		return 0;
-	} else {
-		fprintf(stderr, "Input file does not appear to be in a supported format.\n");
+/**
+ * \param mpk The memory pack to operate on
+ * \param notefile The filename of the note to load
+ * \param dst_note_id 0-15: (Over)write to specific note, -1: auto (first free)
+ * \param note_id Stores the id of the note that was used
+ * \return -1: Error, -2: Not enough space in mempak
+ */
+int mempak_importNote(mempak_structure_t *mpk, const char *notefile, int dst_note_id, int *note_id)
+{
+	struct mapfile *mf;
+	int res;
+
+	mf = mapfile_open(notefile, MAPFILE_READ);
+	if (!mf) {
+		perror("fopen");
+		return -1;
 	}
 
-	if (data)
-		free(data);
-	fclose(fptr);
-	return -1;
+	res = mempak_importNoteFromBuffer(mpk, mf->data, mf->size, dst_note_id, note_id);
+	mapfile_close(mf);
+
+	return res;
 }
 
-int mempak_exportNote(mempak_structure_t *mpk, int note_id, const char *dst_filename)
+/**
+ * \brief Import a note from a note store
+ * \param hash The identifier of the note in the store
+ * \return -1: Error, -2: Not enough space in mempak
+ */
+int mempak_importNoteFromStore(mempak_structure_t *mpk, struct notestore *ns, const char *hash, int dst_note_id, int *note_id)
+{
+	unsigned char note[MEMPAK_NOTE_MAX_FILE_SIZE];
+	long size;
+
+	size = notestore_get(ns, hash, note, sizeof(note));
+	if (size < 0) {
+		fprintf(stderr, "Note %s not found in store\n", hash);
+		return -1;
+	}
+
+	return mempak_importNoteFromBuffer(mpk, note, size, dst_note_id, note_id);
+}
+
+/**
+ * \brief Export a note to a note store. Notes already in the store are not stored again.
+ * \param hash If not NULL, receives the identifier of the note in the store
+ * \return 0: Added, 1: Already in the store, negative: Error
+ */
+int mempak_exportNoteToStore(mempak_structure_t *mpk, int note_id, struct notestore *ns, char *hash)
+{
+	unsigned char note[MEMPAK_NOTE_MAX_FILE_SIZE];
+	int size;
+
+	size = mempak_exportNoteToBuffer(mpk, note_id, note, sizeof(note));
+	if (size < 0) {
+		return size;
+	}
+
+	return notestore_put(ns, note, size, hash);
+}
+
+/**
+ * \brief Export a note to memory, in the same format as mempak_exportNote
+ * \param mpk The memory pack to operate on
+ * \param note_id The note to export (0-15)
+ * \param dst Destination buffer
+ * \param dst_size Size of the destination buffer (MEMPAK_NOTE_MAX_FILE_SIZE is always enough)
+ * \return The size of the note file, -1: Error accessing note, -2: Invalid note, -3: Error accessing note data, -4: Buffer too small
+ */
+int mempak_exportNoteToBuffer(mempak_structure_t *mpk, int note_id, unsigned char *dst, int dst_size)
 {
-	FILE *fptr;
 	entry_structure_t note_header;
-	unsigned char databuf[0x10000];
 
 	if (!mpk)
 		return -1;
 
 	if (0 != get_mempak_entry(mpk, note_id, &note_header)) {
-		fprintf(stderr, "Error accessing note\n");
 		return -1;
 	}
 
 	if (!note_header.valid) {
-		fprintf(stderr, "Invaid note\n");
-		return -1;
+		return -2;
 	}
 
-	if (0 != read_mempak_entry_data(mpk, &note_header, databuf)) {
-		fprintf(stderr, "Error accessing note data\n");
-		return -1;
+	if (dst_size < 32 + note_header.blocks * MEMPAK_BLOCK_SIZE) {
+		return -4;
 	}
 
-	fptr = fopen(dst_filename, "wb");
-	if (!fptr) {
-		perror("fopen");
-		return -1;
+	if (0 != read_mempak_entry_data(mpk, &note_header, dst + 32)) {
+		return -3;
 	}
 
 	/* For compatibility with bryc's javascript mempak editor[1], I set
@@ -242,43 +277,62 @@ int mempak_exportNote(mempak_structure_t *mpk, int note_id, const char *dst_file
 	note_header.raw_data[0x06] = 0xCA;
 	note_header.raw_data[0x07] = 0xFE;
 
-	fwrite(note_header.raw_data, 32, 1, fptr);
-	fwrite(databuf, MEMPAK_BLOCK_SIZE, note_header.blocks, fptr);
-	fclose(fptr);
+	memcpy(dst, note_header.raw_data, 32);
 
-	return 0;
+	return 32 + note_header.blocks * MEMPAK_BLOCK_SIZE;
 }
 
-int mempak_saveToFile(mempak_structure_t *mpk, const char *dst_filename, unsigned char format)
+int mempak_exportNote(mempak_structure_t *mpk, int note_id, const char *dst_filename)
 {
 	FILE *fptr;
-	int i;
+	unsigned char databuf[MEMPAK_NOTE_MAX_FILE_SIZE];
+	int size;
 
 	if (!mpk)
 		return -1;
 
+	size = mempak_exportNoteToBuffer(mpk, note_id, databuf, sizeof(databuf));
+	switch (size)
+	{
+		case -1: fprintf(stderr, "Error accessing note\n"); return -1;
+		case -2: fprintf(stderr, "Invaid note\n"); return -1;
+		case -3: fprintf(stderr, "Error accessing note data\n"); return -1;
+	}
+	if (size < 0)
+		return -1;
+
 	fptr = fopen(dst_filename, "wb");
 	if (!fptr) {
 		perror("fopen");
 		return -1;
 	}
 
+	fwrite(databuf, size, 1, fptr);
+	fclose(fptr);
+
+	return 0;
+}
+
+/* Build the content of an image file. dst must hold MEMPAK_MAX_FILE_SIZE bytes.
+ * \return The file size, or -1 if the format is not supported */
+static long mempak_buildFile(mempak_structure_t *mpk, unsigned char format, unsigned char *dst)
+{
+	int i;
+
 	switch(format)
 	{
 		default:
-			fclose(fptr);
 			return -1;
 
 		case MPK_FORMAT_MPK:
-			fwrite(mpk->data, sizeof(mpk->data), 1, fptr);
-			break;
+			memcpy(dst, mpk->data, sizeof(mpk->data));
+			return sizeof(mpk->data);
 
 		case MPK_FORMAT_MPK4:
-			fwrite(mpk->data, sizeof(mpk->data), 1, fptr);
-			fwrite(mpk->data, sizeof(mpk->data), 1, fptr);
-			fwrite(mpk->data, sizeof(mpk->data), 1, fptr);
-			fwrite(mpk->data, sizeof(mpk->data), 1, fptr);
-			break;
+			for (i=0; i<4; i++) {
+				memcpy(dst + i * sizeof(mpk->data), mpk->data, sizeof(mpk->data));
+			}
+			return 4 * sizeof(mpk->data);
 
 		case MPK_FORMAT_N64:
 			// Note: This should work well for files that will
@@ -294,38 +348,140 @@ int mempak_saveToFile(mempak_structure_t *mpk, const char *dst_filename, unsigne
 			// Then at 0x40, there are 0x1000 bytes. I think there are 256
 			// bytes available for each of block. See comments in
 			// mempak_loadFromFile for more info.
-			fprintf(fptr, "123-456-STD");
+			memset(dst, 0, DEXDRIVE_COMMENT_OFFSET);
+			memcpy(dst, "123-456-STD", 11);
 
-			fseek(fptr, DEXDRIVE_COMMENT_OFFSET, SEEK_SET);
 			for (i=0; i<MEMPAK_NUM_NOTES; i++) {
-				unsigned char tmp = 0;
-				fwrite(mpk->note_comments[i], 255, 1, fptr);
+				unsigned char *comment = dst + DEXDRIVE_COMMENT_OFFSET + i * 256;
+
+				memcpy(comment, mpk->note_comments[i], 255);
 				// I'm not sure about the exact convention of the
 				// original format. Is is that comments are zero-terminated,
 				// but if the length is 256 then non-terminated (implcit termination?)
 				//
 				// Just to make sure nothing crashes by loading a file generated
 				// by this tool, I make sure there is always a zero.
-				fwrite(&tmp, 1, 1, fptr);
+				comment[255] = 0;
 			}
 
+			memcpy(dst + DEXDRIVE_DATA_OFFSET, mpk->data, sizeof(mpk->data));
+			return DEXDRIVE_DATA_OFFSET + sizeof(mpk->data);
+	}
+}
+
+int mempak_saveToFile(mempak_structure_t *mpk, const char *dst_filename, unsigned char format)
+{
+	FILE *fptr;
+	unsigned char *buf;
+	long size;
+
+	if (!mpk)
+		return -1;
 
-			fseek(fptr, DEXDRIVE_DATA_OFFSET, SEEK_SET);
-			fwrite(mpk->data, sizeof(mpk->data), 1, fptr);
-			break;
+	buf = malloc(MEMPAK_MAX_FILE_SIZE);
+	if (!buf) {
+		perror("malloc");
+		return -1;
+	}
+
+	size = mempak_buildFile(mpk, format, buf);
+	if (size < 0) {
+		free(buf);
+		return -1;
+	}
+
+	fptr = fopen(dst_filename, "wb");
+	if (!fptr) {
+		perror("fopen");
+		free(buf);
+		return -1;
+	}
+
+	if (1 != fwrite(buf, size, 1, fptr)) {
+		perror(dst_filename);
+		fclose(fptr);
+		free(buf);
+		return -1;
+	}
+	free(buf);
+
+	if (fclose(fptr)) {
+		perror(dst_filename);
+		return -1;
 	}
 
-	fclose(fptr);
 	return 0;
 }
 
-mempak_structure_t *mempak_loadFromFile(const char *filename)
+/**
+ * \brief Save a mempak to the file it was loaded from, in the same format
+ *
+ * The result is the same as with mempak_saveToFile(), but only the blocks
+ * that changed are written. When the file size does not match the format,
+ * the whole file is written.
+ */
+int mempak_updateFile(mempak_structure_t *mpk, const char *filename)
 {
-	FILE *fptr;
-	long file_size;
-	int i;
-	int num_images = -1;
+	struct mapfile *mf;
+	unsigned char *buf;
+	long size, i;
+	int res = 0;
+
+	if (!mpk)
+		return -1;
+
+	buf = malloc(MEMPAK_MAX_FILE_SIZE);
+	if (!buf) {
+		perror("malloc");
+		return -1;
+	}
+
+	size = mempak_buildFile(mpk, mpk->file_format, buf);
+	if (size < 0) {
+		free(buf);
+		return -1;
+	}
+
+	mf = mapfile_open(filename, MAPFILE_SHARED);
+	if (!mf || mf->size != size) {
+		mapfile_close(mf);
+		free(buf);
+		return mempak_saveToFile(mpk, filename, mpk->file_format);
+	}
+
+	for (i=0; i<size; i+=MEMPAK_BLOCK_SIZE) {
+		long len = size - i < MEMPAK_BLOCK_SIZE ? size - i : MEMPAK_BLOCK_SIZE;
+
+		if (memcmp(mf->data + i, buf + i, len)) {
+			memcpy(mf->data + i, buf + i, len);
+			if (mapfile_sync(mf, i, len)) {
+				perror(filename);
+				res = -1;
+			}
+		}
+	}
+
+	mapfile_close(mf);
+	free(buf);
+
+	return res;
+}
+
+/**
+ * \brief Load a mempak image from memory
+ *
+ * Accepts the same formats as mempak_loadFromFile, but does not print anything.
+ * Raw images of unknown size are loaded with file_format set to MPK_FORMAT_INVALID.
+ *
+ * \param buf The file content
+ * \param size The file size
+ * \return The mempak, or NULL on allocation failure
+ */
+mempak_structure_t *mempak_loadFromMemory(const unsigned char *buf, long size)
+{
+	static const char magic[11] = "123-456-STD";
 	long offset = 0;
+	int i;
 	mempak_structure_t *mpk;
 
 	mpk = calloc(1, sizeof(mempak_structure_t));
@@ -334,69 +490,79 @@ mempak_structure_t *mempak_loadFromFile(const char *filename)
 		return NULL;
 	}
 
-	fptr = fopen(filename, "rb");
-	if (!fptr) {
-		perror("fopen");
-		free(mpk);
-		return NULL;
-	}
-
-	fseek(fptr, 0, SEEK_END);
-	file_size = ftell(fptr);
-	fseek(fptr, 0, SEEK_SET);
-
-	printf("File size: %ld bytes\n", file_size);
-
 	/* Raw binary images. Those can contain more than one card's data. For
 	 * instance, Mupen64 seems to contain four saves. (I suppose each 32kB block is
 	 * for the virtual mempak of one controller) */
-	for (i=1; i<=4; i++) {
-		if (file_size == 0x8000*i) {
-			num_images = i;
-			printf("MPK file Contains %d image(s)\n", num_images);
-			if (file_size == 0x8000) {
-				mpk->file_format = MPK_FORMAT_MPK;
-			} else {
-				mpk->file_format = MPK_FORMAT_MPK4;
-			}
-		}
-	}
-
-	if (num_images < 0) {
-		char header[11];
-		char *magic = "123-456-STD";
+	if (size == 0x8000) {
+		mpk->file_format = MPK_FORMAT_MPK;
+	} else if (size == 0x8000*2 || size == 0x8000*3 || size == 0x8000*4) {
+		mpk->file_format = MPK_FORMAT_MPK4;
+	} else if (size >= (long)sizeof(magic) && 0 == memcmp(buf, magic, sizeof(magic))) {
 		/* If the size is not a fixed multiple, it could be a .N64 file */
-		fread(header, 11, 1, fptr);
-		if (0 == memcmp(header, magic, sizeof(header))) {
-			printf(".N64 file detected\n");
-
-			/* At 0x40 there are often comments in .N64 files.
-			 * The actual memory card data starts at 0x1040.
-			 * This means there are exactly 0x1000 bytes for
-			 * one large comment, or, since 0x1000 / 256 = 16,
-			 * more likely one comment per note? That's what
-			 * I'm assuming here. */
-			fseek(fptr, DEXDRIVE_COMMENT_OFFSET, SEEK_SET);
+
+		/* At 0x40 there are often comments in .N64 files.
+		 * The actual memory card data starts at 0x1040.
+		 * This means there are exactly 0x1000 bytes for
+		 * one large comment, or, since 0x1000 / 256 = 16,
+		 * more likely one comment per note? That's what
+		 * I'm assuming here. */
 #if MAX_NOTE_COMMENT_SIZE != 257
 #error
 #endif
-			for (i=0; i<16; i++) {
-				fread(mpk->note_comments[i], 256, 1, fptr);
-				/* The comments appear to be zero terminated, but I don't
-				 * know if the original tool allowed entering a maximum
-				 * of 256 or 255 bytes. So to be safe, I use buffers of
-				 * 257 bytes */
-				mpk->note_comments[i][256] = 0;
-			}
+		for (i=0; i<16; i++) {
+			long pos = DEXDRIVE_COMMENT_OFFSET + i * 256;
+
+			if (pos + 256 > size)
+				break;
+			memcpy(mpk->note_comments[i], buf + pos, 256);
+			/* The comments appear to be zero terminated, but I don't
+			 * know if the original tool allowed entering a maximum
+			 * of 256 or 255 bytes. So to be safe, I use buffers of
+			 * 257 bytes */
+			mpk->note_comments[i][256] = 0;
+		}
 
-			offset = DEXDRIVE_DATA_OFFSET;
-			mpk->file_format = MPK_FORMAT_N64;
+		offset = DEXDRIVE_DATA_OFFSET;
+		mpk->file_format = MPK_FORMAT_N64;
+	}
+
+	if (size > offset) {
+		long len = size - offset;
+
+		memcpy(mpk->data, buf + offset, len < MEMPAK_MEM_SIZE ? len : MEMPAK_MEM_SIZE);
+	}
+
+	return mpk;
+}
+
+mempak_structure_t *mempak_loadFromFile(const char *filename)
+{
+	struct mapfile *mf;
+	mempak_structure_t *mpk;
+
+	mf = mapfile_open(filename, MAPFILE_READ);
+	if (!mf) {
+		perror("fopen");
+		return NULL;
+	}
+
+	printf("File size: %ld bytes\n", mf->size);
+
+	mpk = mempak_loadFromMemory(mf->data, mf->size);
+	if (mpk) {
+		switch (mpk->file_format)
+		{
+			case MPK_FORMAT_MPK:
+			case MPK_FORMAT_MPK4:
+				printf("MPK file Contains %ld image(s)\n", mf->size / 0x8000);
+				break;
+			case MPK_FORMAT_N64:
+				printf(".N64 file detected\n");
+				break;
 		}
 	}
 
-	fseek(fptr, offset, SEEK_SET);
-	fread(mpk->data, sizeof(mpk->data), 1, fptr);
-	fclose(fptr);
+	mapfile_close(mf);
 
 	return mpk;
 }
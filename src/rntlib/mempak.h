@@ -11,20 +11,50 @@
 #define MPK_FORMAT_MPK4		2 // MPK + 3 times 32kB padding
 #define MPK_FORMAT_N64		3
 
+/* Largest image file (MPK4) */
+#define MEMPAK_MAX_FILE_SIZE	(4 * MEMPAK_MEM_SIZE)
+
+/* Note files: 32 bytes note table entry followed by the data blocks */
+#define MEMPAK_NOTE_MAX_FILE_SIZE	(32 + 123 * 256)
+
+/* The filesystem metadata: Header (sector 0), TOC and backup (1-2) and note table (3-4) */
+#define MEMPAK_META_SIZE	(5 * 256)
+
+/* Parsed filesystem, built from the metadata when first needed (see mempak_fs.c).
+ * It is rebuilt when the metadata no longer matches the copy taken when it was built,
+ * so writing directly to data[] is allowed. */
+struct mempak_fs_view {
+	int built;
+	unsigned char meta[MEMPAK_META_SIZE];
+	int toc; // Sector of the valid TOC (1 or 2), or negative if the pak is invalid
+	int free_blocks;
+	int note_blocks[MEMPAK_NUM_NOTES]; // Length of each note. Negative if its chain is invalid.
+};
+
 typedef struct mempak_structure
 {
 	unsigned char data[MEMPAK_MEM_SIZE];
 	unsigned char file_format;
 
 	char note_comments[MEMPAK_NUM_NOTES][MAX_NOTE_COMMENT_SIZE];
+
+	struct mempak_fs_view fs;
 } mempak_structure_t;
 
 mempak_structure_t *mempak_new(void);
 mempak_structure_t *mempak_loadFromFile(const char *filename);
+mempak_structure_t *mempak_loadFromMemory(const unsigned char *buf, long size);
 
 int mempak_saveToFile(mempak_structure_t *mpk, const char *dst_filename, unsigned char format);
+int mempak_updateFile(mempak_structure_t *mpk, const char *filename);
 int mempak_exportNote(mempak_structure_t *mpk, int note_id, const char *dst_filename);
+int mempak_exportNoteToBuffer(mempak_structure_t *mpk, int note_id, unsigned char *dst, int dst_size);
 int mempak_importNote(mempak_structure_t *mpk, const char *notefile, int dst_note_id, int *note_id);
+int mempak_importNoteFromBuffer(mempak_structure_t *mpk, const unsigned char *note, long size, int dst_note_id, int *note_id);
+
+struct notestore;
+int mempak_exportNoteToStore(mempak_structure_t *mpk, int note_id, struct notestore *ns, char *hash);
+int mempak_importNoteFromStore(mempak_structure_t *mpk, struct notestore *ns, const char *hash, int dst_note_id, int *note_id);
 void mempak_free(mempak_structure_t *mpk);
 
 int mempak_getFilenameFormat(const char *filename);
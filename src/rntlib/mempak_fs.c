@@ -135,6 +135,7 @@ int write_mempak_sector( mempak_structure_t *pak, int sector, uint8_t *sector_da
     if( sector_data == 0 ) { return -1; }
 
 	memcpy(pak->data + sector * MEMPAK_BLOCK_SIZE, sector_data, 256);
+	pak->fs.built = 0;
 #if 0
     /* Sectors are 256 bytes, a mempak writes 32 bytes at a time */
     for( int i = 0; i < 8; i++ )
@@ -600,7 +601,7 @@ static int __write_note( entry_structure_t *note, uint8_t *out_note )
  * @retval -3 The filesystem was invalid
  * @return The number of blocks in a note
  */
-static int __get_num_pages( uint8_t *sector, int inode )
+static int __get_num_pages( const uint8_t *sector, int inode )
 {
     if( inode < BLOCK_VALID_FIRST || inode > BLOCK_VALID_LAST ) { return -1; }
 
@@ -643,7 +644,7 @@ static int __get_num_pages( uint8_t *sector, int inode )
  *
  * @return The number of free blocks
  */
-static int __get_free_space( uint8_t *sector )
+static int __get_free_space( const uint8_t *sector )
 {
     int space = 0;
 
@@ -659,59 +660,27 @@ static int __get_free_space( uint8_t *sector )
 }
 
 /**
- * @brief Get the inode of the n'th block in a note
+ * @brief Get the inode of the block following another in a note
  *
  * @param[in] sector
  *            A valid TOC sector
  * @param[in] inode
- *            The starting inode of the note
- * @param[in] block
- *            The block offset (starting from 0) to retrieve
- * 
- * @retval -2 if there were free blocks in the file
+ *            The current block of the note
+ *
+ * @retval -2 if inode was the last block, or if there were free blocks in the file
  * @retval -3 if the filesystem was invalid
- * @return The inode of the n'th block
+ * @return The inode of the next block
  */
-static int __get_note_block( uint8_t *sector, int inode, int block )
+static int __get_next_block( const uint8_t *sector, int inode )
 {
-    if( inode < BLOCK_VALID_FIRST || inode > BLOCK_VALID_LAST ) { return -1; }
-    if( block < 0 || block > 123 ) { return -1; }
-
-    int tally = block + 1;
-    int last = inode;
+    int next = sector[(inode << 1) + 1];
 
-    /* Only going through until we hit the requested node */
-    while( tally > 0 )
-    {
-        /* Count down to zero, when zero is hit, this is the node we want */
-        tally--;
+    if( next == BLOCK_LAST || next == BLOCK_EMPTY ) { return -2; }
 
-        if( !tally )
-        {
-            return last;
-        }
-        else
-        {
-            switch( sector[(last << 1) + 1] )
-            {
-                case BLOCK_LAST:
-                    /* Last block, couldn't find block number */
-                    return -2;
-                case BLOCK_EMPTY:
-                    /* Error, can't have free blocks! */
-                    return -2;
-                default:
-                    last = sector[(last << 1) + 1];
-
-                    /* Failed to point to valid next block */
-                    if( last < 5 || last >= 128 ) { return -3; }
-                    break;
-            }
-        }
-    }
+    /* Failed to point to valid next block */
+    if( next < BLOCK_VALID_FIRST || next > BLOCK_VALID_LAST ) { return -3; }
 
-    /* Invalid filesystem */
-    return -3;
+    return next;
 }
 
 /**
@@ -725,7 +694,7 @@ static int __get_note_block( uint8_t *sector, int inode, int block )
  * @retval 1 the first sector has a valid TOC
  * @retval 2 the second sector has a valid TOC
  */
-static int __get_valid_toc( mempak_structure_t *mpk )
+static int __find_valid_toc( mempak_structure_t *mpk )
 {
     /* We will need only one sector at a time */
     uint8_t data[MEMPAK_BLOCK_SIZE];
@@ -777,6 +746,63 @@ static int __get_valid_toc( mempak_structure_t *mpk )
     }
 }
 
+/**
+ * @brief Get the parsed filesystem of a mempak
+ *
+ * The header, TOC and note table are validated and the note chains are
+ * walked once, when the view is built. The view is rebuilt when the
+ * metadata sectors are written or no longer match the ones it was built
+ * from.
+ */
+static const struct mempak_fs_view *__get_fs_view( mempak_structure_t *mpk )
+{
+    struct mempak_fs_view *fs = &mpk->fs;
+    const uint8_t *toc, *note;
+
+    if( fs->built && memcmp( fs->meta, mpk->data, MEMPAK_META_SIZE ) == 0 )
+    {
+        return fs;
+    }
+
+    memcpy( fs->meta, mpk->data, MEMPAK_META_SIZE );
+    fs->toc = __find_valid_toc( mpk );
+    fs->free_blocks = 0;
+
+    for( int i = 0; i < MEMPAK_NUM_NOTES; i++ )
+    {
+        fs->note_blocks[i] = -1;
+    }
+
+    if( fs->toc > 0 )
+    {
+        toc = fs->meta + fs->toc * MEMPAK_BLOCK_SIZE;
+        fs->free_blocks = __get_free_space( toc );
+
+        for( int i = 0; i < MEMPAK_NUM_NOTES; i++ )
+        {
+            note = fs->meta + (3 * MEMPAK_BLOCK_SIZE) + (i * 32);
+            fs->note_blocks[i] = __get_num_pages( toc, (note[6] << 8) | note[7] );
+        }
+    }
+
+    fs->built = 1;
+
+    return fs;
+}
+
+/**
+ * @brief Retrieve the sector number of the first valid TOC found
+ *
+ * @retval -2 the mempak was not inserted or was bad
+ * @retval -3 the mempak was unformatted or the header was invalid
+ * @retval 1 the first sector has a valid TOC
+ * @retval 2 the second sector has a valid TOC
+ */
+static int __get_valid_toc( mempak_structure_t *mpk )
+{
+    return __get_fs_view( mpk )->toc;
+}
+
 /**
  * @brief Return whether a mempak is valid
  *
@@ -855,15 +881,8 @@ int get_mempak_entry( mempak_structure_t *mpk, int entry, entry_structure_t *ent
         return 0;
     }
 
-    /* Grab the TOC sector */
-    if( read_mempak_sector( mpk, toc, data ) )
-    {
-        /* Couldn't read TOC */
-        return -2;
-    }
-
     /* Get the length of the entry */
-    int blocks = __get_num_pages( data, entry_data->inode );
+    int blocks = __get_fs_view( mpk )->note_blocks[entry];
 
     if( blocks > 0 )
     {
@@ -893,24 +912,16 @@ int get_mempak_entry( mempak_structure_t *mpk, int entry, entry_structure_t *ent
  */
 int get_mempak_free_space( mempak_structure_t *mpk )
 {
-    uint8_t data[MEMPAK_BLOCK_SIZE];
-    int toc;
+    const struct mempak_fs_view *fs = __get_fs_view( mpk );
 
     /* Make sure mempak is valid */
-    if( (toc = __get_valid_toc( mpk )) <= 0 )
+    if( fs->toc <= 0 )
     {
         /* Bad mempak or was removed, return */
         return -2;
     }
 
-    /* Grab the valid TOC to get free space */
-    if( read_mempak_sector( mpk, toc, data ) )
-    {
-        /* Couldn't read TOC */
-        return -2;
-    }
-
-    return __get_free_space( data );
+    return fs->free_blocks;
 }
 
 /**
@@ -1023,8 +1034,9 @@ int format_mempak( mempak_structure_t *mpk )
  */
 int read_mempak_entry_data( mempak_structure_t *mpk, entry_structure_t *entry, uint8_t *data )
 {
-    int toc;
-    uint8_t tocdata[MEMPAK_BLOCK_SIZE];
+    const struct mempak_fs_view *fs;
+    const uint8_t *tocdata;
+    int block;
 
     /* Some serious sanity checking */
     if( entry == 0 || data == 0 ) { return -1; }
@@ -1033,23 +1045,22 @@ int read_mempak_entry_data( mempak_structure_t *mpk, entry_structure_t *entry, u
     if( entry->inode < BLOCK_VALID_FIRST || entry->inode > BLOCK_VALID_LAST ) { return -1; }
 
     /* Grab the TOC sector so we can get to the individual blocks the data comprises of */
-    if( (toc = __get_valid_toc( mpk )) <= 0 )
+    fs = __get_fs_view( mpk );
+    if( fs->toc <= 0 )
     {
         /* Bad mempak or was removed, return */
         return -2;
     }
+    tocdata = fs->meta + fs->toc * MEMPAK_BLOCK_SIZE;
 
-    /* Grab the valid TOC to get free space */
-    if( read_mempak_sector( mpk, toc, tocdata ) )
-    {
-        /* Couldn't read TOC */
-        return -2;
-    }
-
-    /* Now loop through blocks and grab each one */
+    /* Now follow the chain of blocks and grab each one */
+    block = entry->inode;
     for( int i = 0; i < entry->blocks; i++ )
     {
-        int block = __get_note_block( tocdata, entry->inode, i );
+        if( i )
+        {
+            block = __get_next_block( tocdata, block );
+        }
 
         if( read_mempak_sector( mpk, block, data + (i * MEMPAK_BLOCK_SIZE) ) )
         {
@@ -1155,10 +1166,15 @@ int write_mempak_entry_data( mempak_structure_t *mpk, entry_structure_t *entry,
         entry->game_id = 0x4535;
     }
 
-    /* Loop through allocated blocks and write data to sectors */
+    /* Follow the chain of allocated blocks and write data to sectors */
+    int block = entry->inode;
+
     for( int i = 0; i < entry->blocks; i++ )
     {
-        int block = __get_note_block( sector, entry->inode, i );
+        if( i )
+        {
+            block = __get_next_block( sector, block );
+        }
 
         if( write_mempak_sector( mpk, block, data + (i * MEMPAK_BLOCK_SIZE) ) )
         {
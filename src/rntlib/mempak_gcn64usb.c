@@ -19,16 +19,45 @@
 #include <stdint.h>
 #include <string.h>
 #include "raphnetadapter.h"
+#include "rnt_priv.h"
 #include "gcn64lib.h"
 #include "mempak.h"
 #include "mempak_gcn64usb.h"
 #include "hexdump.h"
 #include "gcn64_protocol.h"
 #include "requests.h"
+#include "imgcache.h"
 
 #define MEMPAK_IO_RETRIES	5
 
-/* pak_address_crc is renamed from __calc_address_crc from from libdragon which is public domain. */
+/* The mempak address and data CRCs were originally computed bit by bit (adapted
+ * from __calc_address_crc and __calc_data_crc from libdragon, which are public
+ * domain). They are done on every block transferred, so tables are used instead. */
+
+/* The address CRC is linear: it is the xor of a value per address bit (bits 5 to 15).
+ * Bits 8-15 and bits 5-7 are looked up separately. */
+static const uint8_t pak_address_crc_hi[256] = {
+	0x00, 0x16, 0x19, 0x0f, 0x07, 0x11, 0x1e, 0x08, 0x0e, 0x18, 0x17, 0x01, 0x09, 0x1f, 0x10, 0x06,
+	0x1c, 0x0a, 0x05, 0x13, 0x1b, 0x0d, 0x02, 0x14, 0x12, 0x04, 0x0b, 0x1d, 0x15, 0x03, 0x0c, 0x1a,
+	0x0d, 0x1b, 0x14, 0x02, 0x0a, 0x1c, 0x13, 0x05, 0x03, 0x15, 0x1a, 0x0c, 0x04, 0x12, 0x1d, 0x0b,
+	0x11, 0x07, 0x08, 0x1e, 0x16, 0x00, 0x0f, 0x19, 0x1f, 0x09, 0x06, 0x10, 0x18, 0x0e, 0x01, 0x17,
+	0x1a, 0x0c, 0x03, 0x15, 0x1d, 0x0b, 0x04, 0x12, 0x14, 0x02, 0x0d, 0x1b, 0x13, 0x05, 0x0a, 0x1c,
+	0x06, 0x10, 0x1f, 0x09, 0x01, 0x17, 0x18, 0x0e, 0x08, 0x1e, 0x11, 0x07, 0x0f, 0x19, 0x16, 0x00,
+	0x17, 0x01, 0x0e, 0x18, 0x10, 0x06, 0x09, 0x1f, 0x19, 0x0f, 0x00, 0x16, 0x1e, 0x08, 0x07, 0x11,
+	0x0b, 0x1d, 0x12, 0x04, 0x0c, 0x1a, 0x15, 0x03, 0x05, 0x13, 0x1c, 0x0a, 0x02, 0x14, 0x1b, 0x0d,
+	0x01, 0x17, 0x18, 0x0e, 0x06, 0x10, 0x1f, 0x09, 0x0f, 0x19, 0x16, 0x00, 0x08, 0x1e, 0x11, 0x07,
+	0x1d, 0x0b, 0x04, 0x12, 0x1a, 0x0c, 0x03, 0x15, 0x13, 0x05, 0x0a, 0x1c, 0x14, 0x02, 0x0d, 0x1b,
+	0x0c, 0x1a, 0x15, 0x03, 0x0b, 0x1d, 0x12, 0x04, 0x02, 0x14, 0x1b, 0x0d, 0x05, 0x13, 0x1c, 0x0a,
+	0x10, 0x06, 0x09, 0x1f, 0x17, 0x01, 0x0e, 0x18, 0x1e, 0x08, 0x07, 0x11, 0x19, 0x0f, 0x00, 0x16,
+	0x1b, 0x0d, 0x02, 0x14, 0x1c, 0x0a, 0x05, 0x13, 0x15, 0x03, 0x0c, 0x1a, 0x12, 0x04, 0x0b, 0x1d,
+	0x07, 0x11, 0x1e, 0x08, 0x00, 0x16, 0x19, 0x0f, 0x09, 0x1f, 0x10, 0x06, 0x0e, 0x18, 0x17, 0x01,
+	0x16, 0x00, 0x0f, 0x19, 0x11, 0x07, 0x08, 0x1e, 0x18, 0x0e, 0x01, 0x17, 0x1f, 0x09, 0x06, 0x10,
+	0x0a, 0x1c, 0x13, 0x05, 0x0d, 0x1b, 0x14, 0x02, 0x04, 0x12, 0x1d, 0x0b, 0x03, 0x15, 0x1a, 0x0c,
+};
+
+static const uint8_t pak_address_crc_lo[8] = {
+	0x00, 0x15, 0x1f, 0x0a, 0x0b, 0x1e, 0x14, 0x01,
+};
 
 /**
  * @brief Calculate the 5 bit CRC on a mempak address
@@ -43,32 +72,31 @@
  */
 uint16_t pak_address_crc( uint16_t address )
 {
-    /* CRC table */
-    uint16_t xor_table[16] = { 0x0, 0x0, 0x0, 0x0, 0x0, 0x15, 0x1F, 0x0B, 0x16, 0x19, 0x07, 0x0E, 0x1C, 0x0D, 0x1A, 0x01 };
-    uint16_t crc = 0;
-	int i;
-
-    /* Make sure we have a valid address */
-    address &= ~0x1F;
-
-    /* Go through each bit in the address, and if set, xor the right value into the output */
-    for( i = 15; i >= 5; i-- )
-    {   
-        /* Is this bit set? */
-        if( ((address >> i) & 0x1) )
-        {
-           crc ^= xor_table[i];
-        }
-    }   
+	/* Make sure we have a valid address */
+	address &= ~0x1F;
 
-    /* Just in case */
-    crc &= 0x1F;
-
-    /* Create a new address with the CRC appended */
-    return address | crc;
+	return address | (pak_address_crc_hi[address >> 8] ^ pak_address_crc_lo[(address >> 5) & 7]);
 }
 
-/* adapted from __calc_data_crc is from libdragon which is public domain. */
+/* CRC-8, polynomial 0x85. pak_data_crc_table[x] is x followed by 8 zero bits, modulo the polynomial. */
+static const uint8_t pak_data_crc_table[256] = {
+	0x00, 0x85, 0x8f, 0x0a, 0x9b, 0x1e, 0x14, 0x91, 0xb3, 0x36, 0x3c, 0xb9, 0x28, 0xad, 0xa7, 0x22,
+	0xe3, 0x66, 0x6c, 0xe9, 0x78, 0xfd, 0xf7, 0x72, 0x50, 0xd5, 0xdf, 0x5a, 0xcb, 0x4e, 0x44, 0xc1,
+	0x43, 0xc6, 0xcc, 0x49, 0xd8, 0x5d, 0x57, 0xd2, 0xf0, 0x75, 0x7f, 0xfa, 0x6b, 0xee, 0xe4, 0x61,
+	0xa0, 0x25, 0x2f, 0xaa, 0x3b, 0xbe, 0xb4, 0x31, 0x13, 0x96, 0x9c, 0x19, 0x88, 0x0d, 0x07, 0x82,
+	0x86, 0x03, 0x09, 0x8c, 0x1d, 0x98, 0x92, 0x17, 0x35, 0xb0, 0xba, 0x3f, 0xae, 0x2b, 0x21, 0xa4,
+	0x65, 0xe0, 0xea, 0x6f, 0xfe, 0x7b, 0x71, 0xf4, 0xd6, 0x53, 0x59, 0xdc, 0x4d, 0xc8, 0xc2, 0x47,
+	0xc5, 0x40, 0x4a, 0xcf, 0x5e, 0xdb, 0xd1, 0x54, 0x76, 0xf3, 0xf9, 0x7c, 0xed, 0x68, 0x62, 0xe7,
+	0x26, 0xa3, 0xa9, 0x2c, 0xbd, 0x38, 0x32, 0xb7, 0x95, 0x10, 0x1a, 0x9f, 0x0e, 0x8b, 0x81, 0x04,
+	0x89, 0x0c, 0x06, 0x83, 0x12, 0x97, 0x9d, 0x18, 0x3a, 0xbf, 0xb5, 0x30, 0xa1, 0x24, 0x2e, 0xab,
+	0x6a, 0xef, 0xe5, 0x60, 0xf1, 0x74, 0x7e, 0xfb, 0xd9, 0x5c, 0x56, 0xd3, 0x42, 0xc7, 0xcd, 0x48,
+	0xca, 0x4f, 0x45, 0xc0, 0x51, 0xd4, 0xde, 0x5b, 0x79, 0xfc, 0xf6, 0x73, 0xe2, 0x67, 0x6d, 0xe8,
+	0x29, 0xac, 0xa6, 0x23, 0xb2, 0x37, 0x3d, 0xb8, 0x9a, 0x1f, 0x15, 0x90, 0x01, 0x84, 0x8e, 0x0b,
+	0x0f, 0x8a, 0x80, 0x05, 0x94, 0x11, 0x1b, 0x9e, 0xbc, 0x39, 0x33, 0xb6, 0x27, 0xa2, 0xa8, 0x2d,
+	0xec, 0x69, 0x63, 0xe6, 0x77, 0xf2, 0xf8, 0x7d, 0x5f, 0xda, 0xd0, 0x55, 0xc4, 0x41, 0x4b, 0xce,
+	0x4c, 0xc9, 0xc3, 0x46, 0xd7, 0x52, 0x58, 0xdd, 0xff, 0x7a, 0x70, 0xf5, 0x64, 0xe1, 0xeb, 0x6e,
+	0xaf, 0x2a, 0x20, 0xa5, 0x34, 0xb1, 0xbb, 0x3e, 0x1c, 0x99, 0x93, 0x16, 0x87, 0x02, 0x08, 0x8d,
+};
 
 /**
  * @brief Calculate the 8 bit CRC over a n-byte block of data
@@ -86,35 +114,14 @@ uint16_t pak_address_crc( uint16_t address )
  */
 uint8_t pak_data_crc( const uint8_t *data, int n )
 {
-    uint8_t ret = 0;
-	int i,j;
-
-    for( i = 0; i <= n; i++ )
-    {
-        for( j = 7; j >= 0; j-- )
-        {
-            int tmp = 0;
-
-            if( ret & 0x80 )
-            {
-                tmp = 0x85;
-            }
-
-            ret <<= 1;
-
-            if( i < n )
-            {
-                if( data[i] & (0x01 << j) )
-                {
-                    ret |= 0x1;
-                }
-            }
-
-            ret ^= tmp;
-        }
-    }
-
-    return ret;
+	uint8_t ret = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		ret = pak_data_crc_table[ret ^ data[i]];
+	}
+
+	return ret;
 }
 
 int gcn64lib_mempak_readBlock(rnt_hdl_t hdl, unsigned char channel, unsigned short addr, unsigned char dst[32])
@@ -142,6 +149,7 @@ int gcn64lib_mempak_readBlock(rnt_hdl_t hdl, unsigned char channel, unsigned sho
 	crc = pak_data_crc(dst, 32);
 	if (crc != cmd[32]) {
 		fprintf(stderr, "Bad CRC reading address 0x%04x. Expected 0x%02x, got 0x%02x\n", addr, crc, cmd[32]);
+		RNT_STAT_ADD(hdl, crc_errors, 1);
 		return -2;
 	}
 
@@ -246,6 +254,7 @@ int gcn64lib_mempak_writeBlock(rnt_hdl_t hdl, unsigned char channel, unsigned sh
 
 	if (res != data_crc) {
 		//fprintf(stderr, "CRC error\n");
+		RNT_STAT_ADD(hdl, crc_errors, 1);
 		return -1;
 	}
 
@@ -254,6 +263,204 @@ int gcn64lib_mempak_writeBlock(rnt_hdl_t hdl, unsigned char channel, unsigned sh
 	return 0;
 }
 
+/* Number of blocks submitted at once by gcn64lib_mempak_readBlocks/writeBlocks
+ * before waiting for completion (and checking for abort requests) */
+#define MEMPAK_IO_WINDOW	64
+
+/* A block to transfer: data is found (or stored) at image[addr] */
+struct mempak_blockref {
+	unsigned char chn;
+	unsigned short addr;
+	unsigned char *image;
+	int done;
+};
+
+struct mempak_blockio {
+	struct blockio_op op;
+	struct mempak_blockref *ref;
+	unsigned char tx[3 + 32];
+	unsigned char rx[33];
+	int ok;
+	int bad_crc;
+};
+
+static void mempak_readCompleted(struct blockio_op *op, void *ctx)
+{
+	struct mempak_blockio *bio = ctx;
+
+	bio->ok = 0;
+	if (op->rx_len != 33) {
+		return;
+	}
+	if (pak_data_crc(bio->rx, 32) != bio->rx[32]) {
+		fprintf(stderr, "Bad CRC reading address 0x%04x. Expected 0x%02x, got 0x%02x\n", bio->ref->addr, pak_data_crc(bio->rx, 32), bio->rx[32]);
+		bio->bad_crc = 1;
+		return;
+	}
+	bio->ok = 1;
+}
+
+static void mempak_writeCompleted(struct blockio_op *op, void *ctx)
+{
+	struct mempak_blockio *bio = ctx;
+
+	bio->ok = (op->rx_len == 1) && (bio->rx[0] == pak_data_crc(bio->tx + 3, 32));
+	bio->bad_crc = (op->rx_len == 1) && !bio->ok;
+}
+
+/* Transfer a list of blocks, possibly on different channels. Blocks are submitted
+ * in list order, so interleaving channels in the list interleaves them on the wire.
+ * Completed blocks get their done flag set. Returns 0, -2 (some blocks failed) or -4 (aborted) */
+static int mempak_blocksIO(rnt_hdl_t hdl, struct mempak_blockref *refs, int n_blocks, int write, int (*progressCb)(const struct mempak_blockref *ref, void *ctx), void *ctx)
+{
+	struct mempak_blockio *bios;
+	struct mempak_blockref **todo;
+	gcn64lib_siq *q;
+	int n_todo, n_failed, try, i, j, n, retval = 0;
+	uint16_t addr_crc;
+
+	bios = calloc(MEMPAK_IO_WINDOW, sizeof(struct mempak_blockio));
+	todo = calloc(n_blocks + 1, sizeof(struct mempak_blockref *));
+	q = gcn64lib_siqNew(hdl);
+	if (!bios || !todo || !q) {
+		retval = -2;
+		goto done;
+	}
+
+	for (i=0; i<n_blocks; i++) {
+		refs[i].done = 0;
+		todo[i] = &refs[i];
+	}
+	n_todo = n_blocks;
+
+	for (try = 0; n_todo && try < MEMPAK_IO_RETRIES; try++) {
+		n_failed = 0;
+
+		for (i=0; i<n_todo; i+=n) {
+			n = n_todo - i;
+			if (n > MEMPAK_IO_WINDOW)
+				n = MEMPAK_IO_WINDOW;
+
+			for (j=0; j<n; j++) {
+				struct mempak_blockio *bio = &bios[j];
+
+				bio->ref = todo[i+j];
+				addr_crc = pak_address_crc(bio->ref->addr);
+				bio->tx[1] = addr_crc >> 8;
+				bio->tx[2] = addr_crc & 0xff;
+				bio->op.chn = bio->ref->chn;
+				bio->op.tx_data = bio->tx;
+				bio->op.rx_data = bio->rx;
+				bio->ok = 0;
+				bio->bad_crc = 0;
+				if (write) {
+					bio->tx[0] = N64_EXPANSION_WRITE;
+					memcpy(bio->tx + 3, bio->ref->image + bio->ref->addr, 32);
+					bio->op.tx_len = 3 + 32;
+					bio->op.rx_len = 1;
+				} else {
+					bio->tx[0] = N64_EXPANSION_READ;
+					bio->op.tx_len = 3;
+					bio->op.rx_len = 33;
+				}
+				gcn64lib_siqSubmit(q, &bio->op, write ? mempak_writeCompleted : mempak_readCompleted, bio);
+			}
+			gcn64lib_siqFlush(q);
+
+			for (j=0; j<n; j++) {
+				struct mempak_blockio *bio = &bios[j];
+
+				if (bio->bad_crc) {
+					RNT_STAT_ADD(hdl, crc_errors, 1);
+				}
+				if (!bio->ok) {
+					// Blocks before i+j are done, so this does not overwrite pending ones.
+					todo[n_failed++] = bio->ref;
+					continue;
+				}
+				if (!write) {
+					memcpy(bio->ref->image + bio->ref->addr, bio->rx, 32);
+				}
+				bio->ref->done = 1;
+				if (progressCb) {
+					if (progressCb(bio->ref, ctx)) {
+						retval = -4;
+						goto done;
+					}
+				}
+			}
+		}
+
+		n_todo = n_failed;
+	}
+
+	if (n_todo) {
+		retval = -2;
+	}
+
+done:
+	gcn64lib_siqFree(q);
+	free(todo);
+	free(bios);
+
+	return retval;
+}
+
+struct mempak_progress_adapter {
+	int (*progressCb)(int cur_addr, void *ctx);
+	void *ctx;
+};
+
+static int mempak_singleChannelProgress(const struct mempak_blockref *ref, void *ctx)
+{
+	struct mempak_progress_adapter *pa = ctx;
+
+	return pa->progressCb(ref->addr, pa->ctx);
+}
+
+static int mempak_singleChannelIO(rnt_hdl_t hdl, unsigned char channel, const unsigned short *addrs, int n_blocks, unsigned char *image, int write, int (*progressCb)(int cur_addr, void *ctx), void *ctx)
+{
+	struct mempak_progress_adapter pa = { progressCb, ctx };
+	struct mempak_blockref *refs;
+	int i, res;
+
+	refs = calloc(n_blocks + 1, sizeof(struct mempak_blockref));
+	if (!refs) {
+		perror("calloc");
+		return -2;
+	}
+
+	for (i=0; i<n_blocks; i++) {
+		refs[i].chn = channel;
+		refs[i].addr = addrs[i];
+		refs[i].image = image;
+	}
+
+	res = mempak_blocksIO(hdl, refs, n_blocks, write, progressCb ? mempak_singleChannelProgress : NULL, &pa);
+	free(refs);
+
+	return res;
+}
+
+int gcn64lib_mempak_readBlocks(rnt_hdl_t hdl, unsigned char channel, const unsigned short *addrs, int n_blocks, unsigned char *image, int (*progressCb)(int cur_addr, void *ctx), void *ctx)
+{
+	return mempak_singleChannelIO(hdl, channel, addrs, n_blocks, image, 0, progressCb, ctx);
+}
+
+int gcn64lib_mempak_writeBlocks(rnt_hdl_t hdl, unsigned char channel, const unsigned short *addrs, int n_blocks, const unsigned char *image, int (*progressCb)(int cur_addr, void *ctx), void *ctx)
+{
+	return mempak_singleChannelIO(hdl, channel, addrs, n_blocks, (unsigned char*)image, 1, progressCb, ctx);
+}
+
+static void mempak_allBlocks(unsigned short addrs[MEMPAK_MEM_SIZE / 0x20])
+{
+	int i;
+
+	for (i=0; i<MEMPAK_MEM_SIZE / 0x20; i++) {
+		addrs[i] = i * 0x20;
+	}
+}
+
 /**
  * \brief Read a physical mempak
  * \param hdl The Adapter handler
@@ -265,8 +472,8 @@ int gcn64lib_mempak_writeBlock(rnt_hdl_t hdl, unsigned char channel, unsigned sh
 int gcn64lib_mempak_download(rnt_hdl_t hdl, int channel, mempak_structure_t **mempak, int (*progressCb)(int cur_addr, void *ctx), void *ctx)
 {
 	mempak_structure_t *pak;
-	unsigned short addr;
-	int res, try;
+	unsigned short addrs[MEMPAK_MEM_SIZE / 0x20];
+	int res;
 
 	if (!mempak) {
 		return -3;
@@ -282,36 +489,132 @@ int gcn64lib_mempak_download(rnt_hdl_t hdl, int channel, mempak_structure_t **me
 	}
 	pak->file_format = MPK_FORMAT_MPK;
 
-	for (addr = 0x0000; addr < MEMPAK_MEM_SIZE; addr+= 0x20)
-	{
-		for (try = 0; try < MEMPAK_IO_RETRIES; try++) {
-			res = gcn64lib_mempak_readBlock(hdl, channel, addr, &pak->data[addr]);
-			if (res == 0x20) {
-				break;
-			}
+	mempak_allBlocks(addrs);
+	res = gcn64lib_mempak_readBlocks(hdl, channel, addrs, MEMPAK_MEM_SIZE / 0x20, pak->data, progressCb, ctx);
+	if (res < 0) {
+		if (res == -2) {
+			fprintf(stderr, "Error: Short read\n");
 		}
+		free(pak);
+		return res;
+	}
+	*mempak = pak;
 
-		if (try >= MEMPAK_IO_RETRIES) {
-			fprintf(stderr, "Error: Short read\n");
-			free(pak);
-			return -2;
+	return 0;
+}
+
+struct mempak_channels_progress {
+	int (*progressCb)(int channel, int cur_addr, void *ctx);
+	void *ctx;
+};
+
+static int mempak_channelsProgress(const struct mempak_blockref *ref, void *ctx)
+{
+	struct mempak_channels_progress *cp = ctx;
+
+	return cp->progressCb(ref->chn, ref->addr, cp->ctx);
+}
+
+/**
+ * \brief Read the mempaks connected to several channels of a multi-port adapter
+ *
+ * Blocks for all channels are interleaved and go through the same SI queue, so a
+ * single pass over the address space is made. Operations for different channels
+ * share block IO reports whenever they fit together.
+ *
+ * \param hdl The Adapter handler
+ * \param channels The adapter channels to read
+ * \param n_channels The number of channels (and of entries in mempaks)
+ * \param mempaks Receives a mempak per channel, or NULL when the channel has no mempak or could not be read.
+ * \param progressCb Callback to notify read progress (called after each block). The callback can return non-zero to abort.
+ * \return The number of mempaks read, -3: Other errors, -4: Aborted
+ */
+int gcn64lib_mempak_downloadChannels(rnt_hdl_t hdl, const int *channels, int n_channels, mempak_structure_t **mempaks, int (*progressCb)(int channel, int cur_addr, void *ctx), void *ctx)
+{
+	struct mempak_channels_progress cp = { progressCb, ctx };
+	struct mempak_blockref *refs;
+	int i, addr, n_refs = 0, n_read = 0, res;
+
+	if (!channels || !mempaks || n_channels < 1) {
+		return -3;
+	}
+
+	for (i=0; i<n_channels; i++) {
+		mempaks[i] = NULL;
+		if (gcn64lib_mempak_detect(hdl, channels[i])) {
+			fprintf(stderr, "No mempak on channel %d\n", channels[i]);
+			continue;
+		}
+		mempaks[i] = calloc(1, sizeof(mempak_structure_t));
+		if (!mempaks[i]) {
+			perror("calloc");
+			goto error;
+		}
+		mempaks[i]->file_format = MPK_FORMAT_MPK;
+	}
+
+	refs = calloc(n_channels * (MEMPAK_MEM_SIZE / 0x20), sizeof(struct mempak_blockref));
+	if (!refs) {
+		perror("calloc");
+		goto error;
+	}
+
+	// Address-major order so all channels progress together
+	for (addr=0; addr<MEMPAK_MEM_SIZE; addr += 0x20) {
+		for (i=0; i<n_channels; i++) {
+			if (!mempaks[i])
+				continue;
+			refs[n_refs].chn = channels[i];
+			refs[n_refs].addr = addr;
+			refs[n_refs].image = mempaks[i]->data;
+			n_refs++;
+		}
+	}
+
+	res = mempak_blocksIO(hdl, refs, n_refs, 0, progressCb ? mempak_channelsProgress : NULL, &cp);
+	if (res == -4) {
+		free(refs);
+		for (i=0; i<n_channels; i++) {
+			free(mempaks[i]);
+			mempaks[i] = NULL;
 		}
+		return -4;
+	}
+
+	for (i=0; i<n_refs; i++) {
+		if (!refs[i].done) {
+			int k;
 
-		if (progressCb) {
-			if (progressCb(addr, ctx)) {
-				return -4;
+			for (k=0; k<n_channels; k++) {
+				if (mempaks[k] && refs[i].image == mempaks[k]->data) {
+					fprintf(stderr, "Error: Short read on channel %d\n", channels[k]);
+					free(mempaks[k]);
+					mempaks[k] = NULL;
+				}
 			}
 		}
 	}
-	*mempak = pak;
+	free(refs);
 
-	return 0;
+	for (i=0; i<n_channels; i++) {
+		if (mempaks[i])
+			n_read++;
+	}
+
+	return n_read;
+
+error:
+	for (i=0; i<n_channels; i++) {
+		free(mempaks[i]);
+		mempaks[i] = NULL;
+	}
+	return -3;
 }
 
 int gcn64lib_mempak_upload(rnt_hdl_t hdl, int channel, mempak_structure_t *pak, int (*progressCb)(int cur_addr, void *ctx), void *ctx)
 {
-	unsigned short addr;
-	int res, try;
+	unsigned short addrs[MEMPAK_MEM_SIZE / 0x20];
+	int res;
 
 	if (!pak) {
 		return -3;
@@ -320,27 +623,170 @@ int gcn64lib_mempak_upload(rnt_hdl_t hdl, int channel, mempak_structure_t *pak,
 		return -1;
 	}
 
-	for (addr = 0x0000; addr < MEMPAK_MEM_SIZE; addr+= 0x20)
-	{
-		for (try = 0; try < MEMPAK_IO_RETRIES; try++) {
-			res = gcn64lib_mempak_writeBlock(hdl, channel, addr, &pak->data[addr]);
-			if (res == 0) {
-				break;
-			}
+	mempak_allBlocks(addrs);
+	res = gcn64lib_mempak_writeBlocks(hdl, channel, addrs, MEMPAK_MEM_SIZE / 0x20, pak->data, progressCb, ctx);
+	if (res == -2) {
+		fprintf(stderr, "Write error\n");
+	}
+
+	return res;
+}
+
+/* The first ID block of a formatted pak contains a random serial number. It is
+ * compared to find out if a cached image may still describe the pak. */
+#define MEMPAK_ID_BLOCK_ADDR	0x0020
+
+/**
+ * \brief Write only the blocks of a mempak that differ from its current contents
+ *
+ * \param hdl The Adapter handler
+ * \param channel The adapter channel (for multi-port adapters)
+ * \param pak The contents to write
+ * \param current A cached image of what the pak currently holds (eg: from a previous read or write),
+ *                or NULL to read the pak first. The ID block is read back to make sure the cache is
+ *                for this pak; if it does not match, the pak is read.
+ * \param flags MEMPAK_UPLOAD_VERIFY to read back the written blocks
+ * \param progressCb Callback to notify progress (called after each block read or written). The callback can return non-zero to abort.
+ * \return Number of blocks written, -1: No mempak, -2: IO/error, -3: Other errors, -4: Aborted, -5: Verify failed
+ */
+int gcn64lib_mempak_uploadDiff(rnt_hdl_t hdl, int channel, const mempak_structure_t *pak, const mempak_structure_t *current, int flags, int (*progressCb)(int cur_addr, void *ctx), void *ctx)
+{
+	unsigned short addrs[MEMPAK_MEM_SIZE / 0x20];
+	unsigned char id_block[32];
+	unsigned char *image;
+	int addr, n_dirty = 0, res;
+
+	if (!pak) {
+		return -3;
+	}
+	if (gcn64lib_mempak_detect(hdl, channel)) {
+		return -1;
+	}
+
+	image = malloc(MEMPAK_MEM_SIZE);
+	if (!image) {
+		perror("malloc");
+		return -3;
+	}
+
+	if (current) {
+		if (gcn64lib_mempak_readBlock(hdl, channel, MEMPAK_ID_BLOCK_ADDR, id_block) != 32 ||
+				memcmp(id_block, current->data + MEMPAK_ID_BLOCK_ADDR, 32)) {
+			printf("Cached image does not match the mempak. Reading it.\n");
+			current = NULL;
 		}
+	}
 
-		if (try >= MEMPAK_IO_RETRIES) {
-			fprintf(stderr, "Write error\n");
-			return -2;
+	if (current) {
+		memcpy(image, current->data, MEMPAK_MEM_SIZE);
+	} else {
+		mempak_allBlocks(addrs);
+		res = gcn64lib_mempak_readBlocks(hdl, channel, addrs, MEMPAK_MEM_SIZE / 0x20, image, progressCb, ctx);
+		if (res < 0) {
+			free(image);
+			return res;
 		}
+	}
 
-		if (progressCb) {
-			if (progressCb(addr, ctx)) {
-				return -4;
+	for (addr = 0; addr < MEMPAK_MEM_SIZE; addr += 0x20) {
+		if (memcmp(image + addr, pak->data + addr, 32)) {
+			addrs[n_dirty++] = addr;
+		}
+	}
+
+	res = gcn64lib_mempak_writeBlocks(hdl, channel, addrs, n_dirty, pak->data, progressCb, ctx);
+	if (res == 0 && (flags & MEMPAK_UPLOAD_VERIFY)) {
+		res = gcn64lib_mempak_readBlocks(hdl, channel, addrs, n_dirty, image, progressCb, ctx);
+		if (res == 0) {
+			for (addr = 0; addr < n_dirty; addr++) {
+				if (memcmp(image + addrs[addr], pak->data + addrs[addr], 32)) {
+					fprintf(stderr, "Verify failed at address 0x%04x\n", addrs[addr]);
+					res = -5;
+					break;
+				}
 			}
 		}
 	}
+	free(image);
+
+	if (res == -2) {
+		fprintf(stderr, "Write error\n");
+	}
+
+	return res < 0 ? res : n_dirty;
+}
+
+/* Build the image cache key for a pak from its ID block (FNV-1a hash) */
+static int mempak_cacheKey(rnt_hdl_t hdl, int channel, const unsigned char id_block[32], char *key, int keymax)
+{
+	char card_id[16];
+	uint32_t h = 2166136261u;
+	int i;
+
+	for (i=0; i<32; i++) {
+		h = (h ^ id_block[i]) * 16777619u;
+	}
+	snprintf(card_id, sizeof(card_id), "mpk_%08x", h);
+
+	return imgcache_makeKey(hdl, channel, card_id, key, keymax);
+}
+
+/**
+ * \brief Get the cached image of the connected mempak
+ *
+ * Only the ID block is read from the pak to identify it. The image is what the
+ * pak contained when it was last read or written by this computer: It is not
+ * up to date if the pak was since used elsewhere (eg: in a console).
+ *
+ * \param hdl The Adapter handler
+ * \param channel The adapter channel (for multi-port adapters)
+ * \param mempak Pointer to mempak_structure pointer to store the new mempak
+ * \return 0: Success, -1: No mempak, -2: IO/error, -3: Not in cache
+ */
+int gcn64lib_mempak_loadCached(rnt_hdl_t hdl, int channel, mempak_structure_t **mempak)
+{
+	unsigned char id_block[32];
+	char key[IMGCACHE_KEY_MAXCHARS];
+	mempak_structure_t *pak;
+
+	if (!mempak) {
+		return -3;
+	}
+	if (gcn64lib_mempak_detect(hdl, channel)) {
+		return -1;
+	}
+	if (gcn64lib_mempak_readBlock(hdl, channel, MEMPAK_ID_BLOCK_ADDR, id_block) != 32) {
+		return -2;
+	}
+	if (mempak_cacheKey(hdl, channel, id_block, key, sizeof(key))) {
+		return -3;
+	}
+
+	pak = calloc(1, sizeof(mempak_structure_t));
+	if (!pak) {
+		return -3;
+	}
+	pak->file_format = MPK_FORMAT_MPK;
+
+	if (imgcache_load(key, pak->data, MEMPAK_MEM_SIZE, 0x20) ||
+			memcmp(pak->data + MEMPAK_ID_BLOCK_ADDR, id_block, 32)) {
+		free(pak);
+		return -3;
+	}
+
+	*mempak = pak;
 
 	return 0;
 }
 
+/** \brief Save what a pak contains (after reading or writing it) in the image cache */
+int gcn64lib_mempak_storeCached(rnt_hdl_t hdl, int channel, const mempak_structure_t *pak)
+{
+	char key[IMGCACHE_KEY_MAXCHARS];
+
+	if (!pak || mempak_cacheKey(hdl, channel, pak->data + MEMPAK_ID_BLOCK_ADDR, key, sizeof(key))) {
+		return -1;
+	}
+
+	return imgcache_store(key, pak->data, MEMPAK_MEM_SIZE, 0x20);
+}
@@ -10,7 +10,25 @@ int gcn64lib_mempak_detect(rnt_hdl_t hdl, unsigned char channel);
 int gcn64lib_mempak_readBlock(rnt_hdl_t hdl, unsigned char channel, unsigned short addr, unsigned char dst[32]);
 int gcn64lib_mempak_writeBlock(rnt_hdl_t hdl, unsigned char channel, unsigned short addr, const unsigned char data[32]);
 
+/* Multi-block IO. Block data is found (or stored) at image[addr]. Operations are packed
+ * in block IO reports and only failed blocks are retried. Returns 0, -2 (IO error) or -4 (aborted) */
+int gcn64lib_mempak_readBlocks(rnt_hdl_t hdl, unsigned char channel, const unsigned short *addrs, int n_blocks, unsigned char *image, int (*progressCb)(int cur_addr, void *ctx), void *ctx);
+int gcn64lib_mempak_writeBlocks(rnt_hdl_t hdl, unsigned char channel, const unsigned short *addrs, int n_blocks, const unsigned char *image, int (*progressCb)(int cur_addr, void *ctx), void *ctx);
+
 int gcn64lib_mempak_download(rnt_hdl_t hdl, int channel, mempak_structure_t **mempak, int (*progressCb)(int cur_addr, void *ctx), void *ctx);
+/* Read the mempaks of several channels in one interleaved pass. mempaks[i] is NULL for channels
+ * without a mempak or that failed. Returns the number of mempaks read, -3 or -4 (aborted) */
+int gcn64lib_mempak_downloadChannels(rnt_hdl_t hdl, const int *channels, int n_channels, mempak_structure_t **mempaks, int (*progressCb)(int channel, int cur_addr, void *ctx), void *ctx);
 int gcn64lib_mempak_upload(rnt_hdl_t hdl, int channel, mempak_structure_t *pak, int (*progressCb)(int cur_addr, void *ctx), void *ctx);
 
+#define MEMPAK_UPLOAD_VERIFY	1 // Read back written blocks
+/* Write only the blocks that differ from current (read from the pak if NULL). Returns the number of
+ * blocks written, or the same errors as gcn64lib_mempak_upload and -5 when verification fails */
+int gcn64lib_mempak_uploadDiff(rnt_hdl_t hdl, int channel, const mempak_structure_t *pak, const mempak_structure_t *current, int flags, int (*progressCb)(int cur_addr, void *ctx), void *ctx);
+
+/* Image cache (see imgcache.h). loadCached reads the ID block to identify the pak
+ * and returns 0, -1 (no mempak), -2 (IO error) or -3 (not in cache) */
+int gcn64lib_mempak_loadCached(rnt_hdl_t hdl, int channel, mempak_structure_t **mempak);
+int gcn64lib_mempak_storeCached(rnt_hdl_t hdl, int channel, const mempak_structure_t *pak);
+
 #endif // _mempak_gcn64usb_h__
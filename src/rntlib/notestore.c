@@ -0,0 +1,508 @@
+/*	gcn64ctl : raphnet adapter management tools
+	Copyright (C) 2007-2018  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE // for strcasestr
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+#include "notestore.h"
+#include "mempak.h"
+#include "mapfile.h"
+
+#ifdef WINDOWS
+#include <io.h>
+#include "strcasestr.h"
+#define PATH_SEP	"\\"
+#else
+#define PATH_SEP	"/"
+#endif
+
+#define NOTESTORE_DIR_MAX	960
+#define NOTESTORE_PATH_MAX	1024
+
+struct notestore {
+	char dir[NOTESTORE_DIR_MAX];
+	struct notestore_entry *entries;
+	int count, alloc;
+
+	/* Open addressing table of entry indexes + 1 (0 for empty slots) */
+	int *table;
+	int table_size;
+
+	/* Open addressing table of the notes of each vendor and game id, and for
+	 * each entry, the index + 1 of the next entry of the same game (0 for none) */
+	struct notestore_game *games;
+	int games_size;
+	int *next_same_game;
+};
+
+struct notestore_game {
+	int first, last; // Entry indexes + 1. 0 for empty slots
+};
+
+void notestore_hash(const unsigned char *note, long size, char dst[NOTESTORE_HASH_CHARS+1])
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	long i;
+
+	for (i=0; i<size; i++) {
+		h ^= note[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	snprintf(dst, NOTESTORE_HASH_CHARS+1, "%016llx%08lx", (unsigned long long)h, crc32(0, note, size));
+}
+
+static int notestore_mkdir(const char *path)
+{
+	int res;
+
+#ifdef WINDOWS
+	res = mkdir(path);
+#else
+	res = mkdir(path, 0755);
+#endif
+	if (res && errno != EEXIST) {
+		return -1;
+	}
+	return 0;
+}
+
+/* The hashes are hexadecimal strings. Their first characters are as good as any hash of them. */
+static unsigned int notestore_slot(struct notestore *ns, const char *hash)
+{
+	unsigned int v = 0;
+	int i;
+
+	for (i=0; i<8 && hash[i]; i++) {
+		v = (v << 4) | (hash[i] <= '9' ? hash[i] - '0' : (hash[i] | 0x20) - 'a' + 10);
+	}
+
+	return v & (ns->table_size - 1);
+}
+
+static unsigned int notestore_gameSlot(struct notestore *ns, uint32_t vendor, uint16_t game_id)
+{
+	return ((vendor * 2654435761u) ^ (game_id * 40503u)) & (ns->games_size - 1);
+}
+
+/* Find the slot of a vendor and game id, or the empty slot where it goes */
+static struct notestore_game *notestore_findGame(struct notestore *ns, uint32_t vendor, uint16_t game_id)
+{
+	unsigned int i;
+
+	for (i = notestore_gameSlot(ns, vendor, game_id); ns->games[i].first; i = (i + 1) & (ns->games_size - 1)) {
+		const struct notestore_entry *e = &ns->entries[ns->games[i].first - 1];
+
+		if (e->vendor == vendor && e->game_id == game_id) {
+			break;
+		}
+	}
+
+	return &ns->games[i];
+}
+
+/* Append entry i to the list of its game. Entries must be added in index order. */
+static void notestore_linkGame(struct notestore *ns, int i)
+{
+	struct notestore_game *g = notestore_findGame(ns, ns->entries[i].vendor, ns->entries[i].game_id);
+
+	ns->next_same_game[i] = 0;
+	if (g->last) {
+		ns->next_same_game[g->last - 1] = i + 1;
+	} else {
+		g->first = i + 1;
+	}
+	g->last = i + 1;
+}
+
+int notestore_lookup(struct notestore *ns, const char *hash)
+{
+	unsigned int i;
+
+	if (!ns->table_size)
+		return -1;
+
+	for (i = notestore_slot(ns, hash); ns->table[i]; i = (i + 1) & (ns->table_size - 1)) {
+		if (0 == strcmp(ns->entries[ns->table[i] - 1].hash, hash)) {
+			return ns->table[i] - 1;
+		}
+	}
+
+	return -1;
+}
+
+static int notestore_addEntry(struct notestore *ns, const struct notestore_entry *entry)
+{
+	unsigned int i;
+
+	if (notestore_lookup(ns, entry->hash) >= 0) {
+		return 1;
+	}
+
+	if (ns->count >= ns->alloc) {
+		int alloc = ns->alloc ? ns->alloc * 2 : 1024;
+		struct notestore_entry *entries;
+		int *next;
+
+		entries = realloc(ns->entries, alloc * sizeof(struct notestore_entry));
+		if (!entries) {
+			perror("realloc");
+			return -1;
+		}
+		ns->entries = entries;
+
+		next = realloc(ns->next_same_game, alloc * sizeof(int));
+		if (!next) {
+			perror("realloc");
+			return -1;
+		}
+		ns->next_same_game = next;
+		ns->alloc = alloc;
+	}
+
+	if ((ns->count + 1) * 2 > ns->games_size) {
+		int size = ns->games_size ? ns->games_size * 2 : 512;
+		int j;
+
+		free(ns->games);
+		ns->games = calloc(size, sizeof(struct notestore_game));
+		if (!ns->games) {
+			perror("calloc");
+			ns->games_size = 0;
+			return -1;
+		}
+		ns->games_size = size;
+
+		for (j=0; j<ns->count; j++) {
+			notestore_linkGame(ns, j);
+		}
+	}
+
+	if ((ns->count + 1) * 2 > ns->table_size) {
+		int size = ns->table_size ? ns->table_size * 2 : 2048;
+		int j;
+
+		free(ns->table);
+		ns->table = calloc(size, sizeof(int));
+		if (!ns->table) {
+			perror("calloc");
+			ns->table_size = 0;
+			return -1;
+		}
+		ns->table_size = size;
+
+		for (j=0; j<ns->count; j++) {
+			for (i = notestore_slot(ns, ns->entries[j].hash); ns->table[i]; i = (i + 1) & (size - 1))
+				;
+			ns->table[i] = j + 1;
+		}
+	}
+
+	ns->entries[ns->count] = *entry;
+	for (i = notestore_slot(ns, entry->hash); ns->table[i]; i = (i + 1) & (ns->table_size - 1))
+		;
+	ns->table[i] = ns->count + 1;
+	notestore_linkGame(ns, ns->count);
+	ns->count++;
+
+	return 0;
+}
+
+static int notestore_loadIndex(struct notestore *ns)
+{
+	char path[NOTESTORE_PATH_MAX];
+	char line[512];
+	FILE *fptr;
+
+	snprintf(path, sizeof(path), "%s" PATH_SEP "index", ns->dir);
+
+	fptr = fopen(path, "r");
+	if (!fptr) {
+		/* New store */
+		return errno == ENOENT ? 0 : -1;
+	}
+
+	while (fgets(line, sizeof(line), fptr)) {
+		struct notestore_entry entry = { };
+		unsigned int vendor, game_id, region;
+		int name_pos = 0;
+		char *eol;
+
+		eol = strchr(line, '\n');
+		if (!eol) {
+			/* Last line of an interrupted append */
+			break;
+		}
+		*eol = 0;
+
+		if (5 != sscanf(line, "%24s %x %x %x %d%n", entry.hash, &vendor, &game_id, &region, &entry.blocks, &name_pos) || line[name_pos] != ' ') {
+			fprintf(stderr, "notestore: Ignoring bad index line: %s\n", line);
+			continue;
+		}
+		name_pos++;
+		entry.vendor = vendor;
+		entry.game_id = game_id;
+		entry.region = region;
+		snprintf(entry.name, sizeof(entry.name), "%s", line + name_pos);
+
+		if (notestore_addEntry(ns, &entry) < 0) {
+			fclose(fptr);
+			return -1;
+		}
+	}
+
+	fclose(fptr);
+	return 0;
+}
+
+struct notestore *notestore_open(const char *dir)
+{
+	struct notestore *ns;
+
+	ns = calloc(1, sizeof(struct notestore));
+	if (!ns) {
+		perror("calloc");
+		return NULL;
+	}
+
+	if (strlen(dir) >= sizeof(ns->dir)) {
+		fprintf(stderr, "notestore: Path too long\n");
+		free(ns);
+		return NULL;
+	}
+	strcpy(ns->dir, dir);
+
+	if (notestore_mkdir(dir) || notestore_loadIndex(ns)) {
+		perror(dir);
+		notestore_close(ns);
+		return NULL;
+	}
+
+	return ns;
+}
+
+void notestore_close(struct notestore *ns)
+{
+	if (!ns)
+		return;
+
+	free(ns->entries);
+	free(ns->table);
+	free(ns->games);
+	free(ns->next_same_game);
+	free(ns);
+}
+
+static void notestore_path(struct notestore *ns, const char *hash, char *dst, int dstmax)
+{
+	snprintf(dst, dstmax, "%s" PATH_SEP "%.2s" PATH_SEP "%s.note", ns->dir, hash, hash);
+}
+
+int notestore_put(struct notestore *ns, const unsigned char *note, long size, char hash[NOTESTORE_HASH_CHARS+1])
+{
+	struct notestore_entry entry = { };
+	entry_structure_t parsed;
+	unsigned char header[32];
+	char path[NOTESTORE_PATH_MAX], tmppath[NOTESTORE_PATH_MAX + 4];
+	FILE *fptr;
+
+	if (size < 32 + MEMPAK_BLOCK_SIZE || size > MEMPAK_NOTE_MAX_FILE_SIZE || (size - 32) % MEMPAK_BLOCK_SIZE) {
+		return -1;
+	}
+
+	/* Only notes exported with an inode number of 0xCAFE (see mempak_exportNote) */
+	if (note[0x06] != 0xCA || note[0x07] != 0xFE) {
+		return -1;
+	}
+
+	memcpy(header, note, sizeof(header));
+	header[0x06] = 0x00;
+	header[0x07] = 0x05; // BLOCK_VALID_FIRST
+	if (mempak_parse_entry(header, &parsed)) {
+		return -1;
+	}
+
+	notestore_hash(note, size, entry.hash);
+	if (hash) {
+		strcpy(hash, entry.hash);
+	}
+
+	if (notestore_lookup(ns, entry.hash) >= 0) {
+		return 1;
+	}
+
+	entry.vendor = parsed.vendor;
+	entry.game_id = parsed.game_id;
+	entry.region = parsed.region;
+	entry.blocks = (size - 32) / MEMPAK_BLOCK_SIZE;
+	snprintf(entry.name, sizeof(entry.name), "%s", parsed.utf8_name);
+
+	/* The note file first, then its index line. An interrupted put leaves a note that
+	 * is not indexed, and is written again the next time. */
+	snprintf(path, sizeof(path), "%s" PATH_SEP "%.2s", ns->dir, entry.hash);
+	if (notestore_mkdir(path)) {
+		perror(path);
+		return -1;
+	}
+
+	notestore_path(ns, entry.hash, path, sizeof(path));
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+	fptr = fopen(tmppath, "wb");
+	if (!fptr) {
+		perror(tmppath);
+		return -1;
+	}
+	if (1 != fwrite(note, size, 1, fptr)) {
+		perror(tmppath);
+		fclose(fptr);
+		remove(tmppath);
+		return -1;
+	}
+	if (fclose(fptr)) {
+		perror(tmppath);
+		remove(tmppath);
+		return -1;
+	}
+
+	remove(path);
+	if (rename(tmppath, path)) {
+		perror(path);
+		remove(tmppath);
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s" PATH_SEP "index", ns->dir);
+	fptr = fopen(path, "a");
+	if (!fptr) {
+		perror(path);
+		return -1;
+	}
+	fprintf(fptr, "%s %06x %04x %02x %d %s\n", entry.hash, entry.vendor, entry.game_id, entry.region, entry.blocks, entry.name);
+	if (fclose(fptr)) {
+		perror(path);
+		return -1;
+	}
+
+	if (notestore_addEntry(ns, &entry) < 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+long notestore_get(struct notestore *ns, const char *hash, unsigned char *dst, long dstmax)
+{
+	char path[NOTESTORE_PATH_MAX];
+	char check[NOTESTORE_HASH_CHARS+1];
+	struct mapfile *mf;
+	long size;
+
+	if (notestore_lookup(ns, hash) < 0) {
+		return -1;
+	}
+
+	notestore_path(ns, hash, path, sizeof(path));
+	mf = mapfile_open(path, MAPFILE_READ);
+	if (!mf) {
+		perror(path);
+		return -1;
+	}
+
+	size = mf->size;
+	if (size > dstmax) {
+		mapfile_close(mf);
+		return -1;
+	}
+
+	/* Never return a damaged note */
+	notestore_hash(mf->data, size, check);
+	if (strcmp(check, hash)) {
+		fprintf(stderr, "notestore: %s is damaged\n", path);
+		mapfile_close(mf);
+		return -1;
+	}
+
+	memcpy(dst, mf->data, size);
+	mapfile_close(mf);
+
+	return size;
+}
+
+int notestore_count(struct notestore *ns)
+{
+	return ns->count;
+}
+
+const struct notestore_entry *notestore_getEntry(struct notestore *ns, int index)
+{
+	if (index < 0 || index >= ns->count)
+		return NULL;
+
+	return &ns->entries[index];
+}
+
+int notestore_find(struct notestore *ns, long vendor, long game_id, const char *name, int start)
+{
+	int i;
+
+	if (start < 0) {
+		start = 0;
+	}
+
+	/* With both a vendor and a game id, only the notes of that game are visited */
+	if (vendor >= 0 && game_id >= 0) {
+		struct notestore_game *g;
+
+		if (!ns->games_size)
+			return -1;
+
+		g = notestore_findGame(ns, vendor, game_id);
+		for (i = g->first; i; i = ns->next_same_game[i - 1]) {
+			const struct notestore_entry *entry = &ns->entries[i - 1];
+
+			if (i - 1 < start)
+				continue;
+			if (name && !strcasestr(entry->name, name))
+				continue;
+
+			return i - 1;
+		}
+
+		return -1;
+	}
+
+	for (i = start; i<ns->count; i++) {
+		const struct notestore_entry *entry = &ns->entries[i];
+
+		if (vendor >= 0 && entry->vendor != vendor)
+			continue;
+		if (game_id >= 0 && entry->game_id != game_id)
+			continue;
+		if (name && !strcasestr(entry->name, name))
+			continue;
+
+		return i;
+	}
+
+	return -1;
+}
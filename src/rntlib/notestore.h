@@ -0,0 +1,70 @@
+#ifndef _notestore_h__
+#define _notestore_h__
+
+#include <stdint.h>
+
+/* Content-addressed store of mempak notes. Notes are kept once, in the note
+ * file format (see mempak_exportNote), under a name derived from their
+ * content. An index of the notes (vendor, game id, name) is kept in memory
+ * and in an index file appended to as notes are added.
+ *
+ * Layout:
+ *   store/index
+ *   store/ab/ab0123456789abcdef012345.note
+ */
+
+#define NOTESTORE_HASH_CHARS	24
+
+struct notestore_entry {
+	char hash[NOTESTORE_HASH_CHARS+1];
+	uint32_t vendor;
+	uint16_t game_id;
+	uint8_t region;
+	int blocks;
+	char name[19*4];
+};
+
+struct notestore;
+
+/** \brief Compute the identifier of a note file (64-bit FNV-1a and CRC32 of its content) */
+void notestore_hash(const unsigned char *note, long size, char dst[NOTESTORE_HASH_CHARS+1]);
+
+/** \brief Open a store, creating its directory if needed */
+struct notestore *notestore_open(const char *dir);
+void notestore_close(struct notestore *ns);
+
+/**
+ * \brief Add a note file to the store
+ * \param hash If not NULL, receives the identifier of the note
+ * \return 0 if the note was added, 1 if it was already in the store, negative on error
+ */
+int notestore_put(struct notestore *ns, const unsigned char *note, long size, char hash[NOTESTORE_HASH_CHARS+1]);
+
+/**
+ * \brief Read a note file from the store
+ * \param dst Destination buffer. MEMPAK_NOTE_MAX_FILE_SIZE bytes is always enough.
+ * \return The size of the note file, or negative on error
+ */
+long notestore_get(struct notestore *ns, const char *hash, unsigned char *dst, long dstmax);
+
+int notestore_count(struct notestore *ns);
+const struct notestore_entry *notestore_getEntry(struct notestore *ns, int index);
+
+/** \brief Get the index of a note, or -1 if it is not in the store */
+int notestore_lookup(struct notestore *ns, const char *hash);
+
+/**
+ * \brief Find notes by vendor, game id and/or name
+ *
+ * When both a vendor and a game id are given, the notes are found through an
+ * index. Other searches go through all the notes.
+ *
+ * \param vendor Vendor to look for, or -1 for any
+ * \param game_id Game id to look for, or -1 for any
+ * \param name Text to look for in the note name (case insensitive), or NULL for any
+ * \param start Index where the search starts (0, then the last match + 1)
+ * \return The index of the next matching note, or -1
+ */
+int notestore_find(struct notestore *ns, long vendor, long game_id, const char *name, int start);
+
+#endif // _notestore_h__
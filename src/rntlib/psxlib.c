@@ -1,9 +1,13 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "rnt_priv.h"
 #include "psxlib.h"
 #include "requests.h"
 #include "hexdump.h"
+#include "timer.h"
+#include "imgcache.h"
+#include "mapfile.h"
 
 //#define DEBUG_EXCHANGES
 
@@ -66,34 +70,249 @@ static uint8_t xorbuf(const uint8_t *buf, int len)
 	return r;
 }
 
-int psxlib_readMemoryCard(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst, uiio *u)
+/* Sector reads are 140 byte transactions split in chunks of at most 60
+ * bytes (the maximum allowed by the adapter protocol). */
+#define PSXLIB_SECTOR_XFER_LEN		140
+#define PSXLIB_SECTOR_CHUNK_MAX		60
+#define PSXLIB_SECTOR_N_CHUNKS		((PSXLIB_SECTOR_XFER_LEN + PSXLIB_SECTOR_CHUNK_MAX - 1) / PSXLIB_SECTOR_CHUNK_MAX)
+
+/* Number of sectors queued at once by psxlib_readMemoryCard */
+#define PSXLIB_READ_WINDOW			16
+
+static void psxlib_initSectorRequest(uint8_t request[6], uint16_t sector)
+{
+	request[0] = 0x81;
+	request[1] = 0x52;
+	request[2] = 0x00;
+	request[3] = 0x00;
+	request[4] = sector >> 8;
+	request[5] = sector & 0xff;
+}
+
+/* Adapter channel and flags for the sector read chunk starting at offset done. */
+static uint8_t psxlib_sectorChunkFlgChn(uint8_t chn, int done, int chunksize)
+{
+	uint8_t flgchn = chn;
+
+	// First exchange?
+	if (done == 0) {
+		// insert a delay (or expect a longer time before the ACK) before the 8th byte
+		// (command ACKnowlege)
+		flgchn |= FLG_LATE_8TH<<4;
+	}
+
+	// Last exchange?
+	if (done + chunksize < PSXLIB_SECTOR_XFER_LEN) {
+		// Make sure the cart stays selected until the end
+		flgchn |= FLG_NO_DESELECT<<4;
+	}
+
+	return flgchn;
+}
+
+static int psxlib_checkSectorReply(const uint8_t inbuf[PSXLIB_SECTOR_XFER_LEN], uint16_t sector)
 {
+	uint16_t confirmed_sector;
+	uint8_t chk;
+
+	// Check for memory card ID
+	if (inbuf[2] != 0x5A ||
+		inbuf[3] != 0x5D)
+	{
+		return PSXLIB_ERR_NO_CARD_DETECTED;
+	}
+
+	// Check for command acknowledge
+	if (inbuf[6] != 0x5C ||
+		inbuf[7] != 0x5D)
+	{
+		return PSXLIB_ERR_NO_COMMAND_ACK;
+	}
+
+	// Make sure confirmed sector matches
+	confirmed_sector = inbuf[8] << 8 | inbuf[9];
+	if (confirmed_sector != sector) {
+		return PSXLIB_ERR_INVALID_SECTOR;
+	}
+
+	// Validate the checksum
+	chk = xorbuf(inbuf + 8, 2 + 128 + 1);
+	if (chk != 0) {
+		return PSXLIB_ERR_BAD_CHECKSUM;
+	}
+
+	// Make sure the 'G' at the end is present
+	if (inbuf[139] != 'G') {
+		return PSXLIB_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+struct psx_sector_read {
+	struct rnt_request rq[PSXLIB_SECTOR_N_CHUNKS];
+	uint8_t cmd[PSXLIB_SECTOR_N_CHUNKS][4 + 6];
+	uint8_t rep[PSXLIB_SECTOR_N_CHUNKS][2 + 64];
+	uint8_t inbuf[PSXLIB_SECTOR_XFER_LEN];
 	uint16_t sector;
-	int res;
+	uint8_t *dst;
+	int result;
+	int *n_pending;
+};
+
+static void psxlib_sectorChunkCompleted(rnt_hdl_t hdl, struct rnt_request *rq)
+{
+	struct psx_sector_read *sr = rq->ctx;
+	int i = rq - sr->rq;
+	int offset = i * PSXLIB_SECTOR_CHUNK_MAX;
+	int chunksize = sr->cmd[i][3];
+
+	(*sr->n_pending)--;
+
+	if (sr->result) {
+		return;
+	}
+
+	if (rq->result_len < 2 || sr->rep[i][1] != chunksize) {
+		sr->result = PSXLIB_ERR_IO_ERROR;
+		return;
+	}
+	memcpy(sr->inbuf + offset, sr->rep[i] + 2, chunksize);
+
+	if (offset + chunksize == PSXLIB_SECTOR_XFER_LEN) {
+		sr->result = psxlib_checkSectorReply(sr->inbuf, sr->sector);
+		if (sr->result == 0) {
+			memcpy(sr->dst, sr->inbuf + 10, PSXLIB_MC_SECTOR_SIZE);
+		}
+	}
+}
+
+/* Queue all the exchanges for reading a sector. Results are stored
+ * in the psx_sector_read structure by the completion callbacks. */
+static int psxlib_submitSectorRead(rnt_hdl_t hdl, uint8_t chn, struct psx_sector_read *sr)
+{
+	int i, chunksize, txlen, done = 0;
+
+	sr->result = 0;
+	for (i=0; i<PSXLIB_SECTOR_N_CHUNKS; i++) {
+		chunksize = PSXLIB_SECTOR_XFER_LEN - done;
+		if (chunksize > PSXLIB_SECTOR_CHUNK_MAX) {
+			chunksize = PSXLIB_SECTOR_CHUNK_MAX;
+		}
+
+		// Keep sending zero while we are just reading
+		txlen = (done == 0) ? 6 : 0;
+
+		sr->cmd[i][0] = RQ_PSX_RAW;
+		sr->cmd[i][1] = psxlib_sectorChunkFlgChn(chn, done, chunksize);
+		sr->cmd[i][2] = txlen;
+		sr->cmd[i][3] = chunksize;
+		psxlib_initSectorRequest(sr->cmd[i] + 4, sr->sector);
+
+		memset(&sr->rq[i], 0, sizeof(struct rnt_request));
+		sr->rq[i].outcmd = sr->cmd[i];
+		sr->rq[i].outlen = 4 + txlen;
+		sr->rq[i].result = sr->rep[i];
+		sr->rq[i].result_max = sizeof(sr->rep[i]);
+		sr->rq[i].completed = psxlib_sectorChunkCompleted;
+		sr->rq[i].ctx = sr;
+
+		(*sr->n_pending)++;
+		if (rnt_submit(hdl, &sr->rq[i])) {
+			(*sr->n_pending)--;
+			return PSXLIB_ERR_IO_ERROR;
+		}
+
+		done += chunksize;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Read a complete memory card
+ *
+ * The exchanges for a window of sectors are queued at once. The next exchange is
+ * sent to the adapter while the answer to the previous one is being processed,
+ * and sectors are written straight to dst. Sectors that fail are retried once
+ * individually.
+ */
+int psxlib_readMemoryCard(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst, uiio *u)
+{
+	struct psx_sector_read *window;
+	uint64_t t_start, elapsed;
+	char endmsg[64];
+	int sector, n_sectors, n_pending, i, res = 0;
 
 	u = getUIIO(u);
 
+	window = calloc(PSXLIB_READ_WINDOW, sizeof(struct psx_sector_read));
+	if (!window) {
+		perror("calloc");
+		return PSXLIB_ERR_UNKNOWN;
+	}
+
 	u->cur_progress = 0;
 	u->max_progress = PSXLIB_MC_N_SECTORS;
 	u->progress_type = PROGRESS_TYPE_ADDRESS;
 	u->caption = "Reading memory card...";
 	u->progressStart(u);
 
-	for (sector = 0; sector < PSXLIB_MC_N_SECTORS; sector++) {
-		res = psxlib_readMemoryCardSector(hdl, chn, sector, dst->contents + sector * PSXLIB_MC_SECTOR_SIZE);
+	t_start = getMilliseconds();
+
+	for (sector = 0; sector < PSXLIB_MC_N_SECTORS; sector += n_sectors) {
+		n_sectors = PSXLIB_MC_N_SECTORS - sector;
+		if (n_sectors > PSXLIB_READ_WINDOW) {
+			n_sectors = PSXLIB_READ_WINDOW;
+		}
+
+		n_pending = 0;
+		for (i=0; !res && i<n_sectors; i++) {
+			window[i].sector = sector + i;
+			window[i].dst = dst->contents + (sector + i) * PSXLIB_MC_SECTOR_SIZE;
+			window[i].n_pending = &n_pending;
+			res = psxlib_submitSectorRead(hdl, chn, &window[i]);
+		}
+
+		rnt_harvest(hdl, 0);
+		if (res || n_pending) {
+			res = PSXLIB_ERR_IO_ERROR;
+			break;
+		}
+
+		for (i=0; !res && i<n_sectors; i++) {
+			if (window[i].result) {
+				res = psxlib_readMemoryCardSector(hdl, chn, window[i].sector, window[i].dst);
+			}
+		}
 		if (res) {
-			u->progressEnd(u, "Error");
-			return res;
+			break;
 		}
 
-		u->cur_progress = sector;
+		u->cur_progress = sector + n_sectors - 1;
 		if (u->update(u)) {
-			u->progressEnd(u, "Aborted");
-			return PSXLIB_ERR_USER_CANCELLED;
+			res = PSXLIB_ERR_USER_CANCELLED;
+			break;
 		}
 	}
 
-	u->progressEnd(u, "Done");
+	free(window);
+
+	if (res == PSXLIB_ERR_USER_CANCELLED) {
+		u->progressEnd(u, "Aborted");
+		return res;
+	}
+	if (res) {
+		u->progressEnd(u, "Error");
+		return res;
+	}
+
+	elapsed = getMilliseconds() - t_start;
+	if (elapsed < 1) {
+		elapsed = 1;
+	}
+	snprintf(endmsg, sizeof(endmsg), "Done (%.1f KiB/s)", (PSXLIB_MC_TOTAL_SIZE / 1024.0) * 1000.0 / elapsed);
+	u->progressEnd(u, endmsg);
 
 	return 0;
 }
@@ -133,6 +352,104 @@ int psxlib_writeMemoryCard(rnt_hdl_t hdl, uint8_t chn, const struct psx_memoryca
 	return 0;
 }
 
+/**
+ * \brief Write only the sectors that differ from the current card contents
+ *
+ * \param hdl The adapter handle
+ * \param chn The adapter channel
+ * \param src The contents to write
+ * \param current What the card currently holds, or NULL to read the card first
+ * \param verify When non-zero, written sectors are read back and compared
+ * \param u Progress and user interaction (may be NULL)
+ * \return The number of sectors written, or a negative PSXLIB_ERR_* value
+ */
+int psxlib_writeMemoryCardDiff(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *src, const struct psx_memorycard *current, int verify, uiio *u)
+{
+	struct psx_memorycard *card = NULL;
+	uint16_t *dirty;
+	uint8_t sector_data[PSXLIB_MC_SECTOR_SIZE];
+	int sector, i, n_dirty = 0, res = 0;
+
+	if (!src) {
+		return PSXLIB_ERR_BAD_PARAM;
+	}
+
+	u = getUIIO(u);
+
+	dirty = calloc(PSXLIB_MC_N_SECTORS, sizeof(uint16_t));
+	if (!dirty) {
+		perror("calloc");
+		return PSXLIB_ERR_UNKNOWN;
+	}
+
+	if (!current) {
+		card = malloc(sizeof(struct psx_memorycard));
+		if (!card) {
+			perror("malloc");
+			free(dirty);
+			return PSXLIB_ERR_UNKNOWN;
+		}
+		res = psxlib_readMemoryCard(hdl, chn, card, u);
+		if (res) {
+			free(card);
+			free(dirty);
+			return res;
+		}
+		current = card;
+	}
+
+	for (sector = 0; sector < PSXLIB_MC_N_SECTORS; sector++) {
+		if (memcmp(current->contents + sector * PSXLIB_MC_SECTOR_SIZE, src->contents + sector * PSXLIB_MC_SECTOR_SIZE, PSXLIB_MC_SECTOR_SIZE)) {
+			dirty[n_dirty++] = sector;
+		}
+	}
+	free(card);
+
+	if (n_dirty == 0) {
+		free(dirty);
+		return 0;
+	}
+
+	u->cur_progress = 0;
+	u->max_progress = n_dirty;
+	u->progress_type = PROGRESS_TYPE_ADDRESS;
+	u->caption = verify ? "Writing and verifying changed sectors..." : "Writing changed sectors...";
+	u->progressStart(u);
+
+	for (i = 0; i < n_dirty; i++) {
+		const uint8_t *data = src->contents + dirty[i] * PSXLIB_MC_SECTOR_SIZE;
+
+		res = psxlib_writeMemoryCardSector(hdl, chn, dirty[i], data);
+		if (res == 0 && verify) {
+			res = psxlib_readMemoryCardSector(hdl, chn, dirty[i], sector_data);
+			if (res == 0 && memcmp(sector_data, data, PSXLIB_MC_SECTOR_SIZE)) {
+				res = PSXLIB_ERR_VERIFY_FAILED;
+			}
+		}
+		if (res) {
+			break;
+		}
+
+		u->cur_progress = i;
+		if (u->update(u)) {
+			if (UIIO_YES == u->ask(UIIO_NOYES, "If you interrupt the transfer, some or all saves on your memory card will be corrupted.\n\nReally stop?")) {
+				res = PSXLIB_ERR_USER_CANCELLED;
+				break;
+			}
+		}
+	}
+	free(dirty);
+
+	if (res) {
+		u->progressEnd(u, res == PSXLIB_ERR_USER_CANCELLED ? "Aborted" : "Error");
+		return res;
+	}
+
+	u->progressEnd(u, "Done");
+
+	return n_dirty;
+}
+
 int psxlib_writeMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, const uint8_t data[128])
 {
 	uint8_t request[128+10] = {
@@ -215,16 +532,10 @@ int psxlib_writeMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, co
 
 int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uint8_t dst[128])
 {
-	uint8_t request[6] = {
-		0x81, 0x52, 0x00, 0x00,
-		sector >> 8, sector & 0xff
-	};
-	uint8_t inbuf[140];
+	uint8_t request[6];
+	uint8_t inbuf[PSXLIB_SECTOR_XFER_LEN];
 	int res, done;
-	uint16_t confirmed_sector;
-	uint8_t chk;
 	int todo, chunksize;
-	uint8_t flgchn;
 	int txlen;
 
 	// Out:
@@ -240,45 +551,21 @@ int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uin
 	// And due to the adapter protocol overhead, the maximum is 60. Three exchanges
 	// are therefore required.
 
+	psxlib_initSectorRequest(request, sector);
 
-	// A total of 140 bytes should be sent.
-	//
-	// First send 7 bytes. (the pause after this helps for the extra delay after 5C is sent.
-	// Then 60
-	// Then 60
-	// Then 13
-	//
-	//
-
-	todo = 140;
+	todo = PSXLIB_SECTOR_XFER_LEN;
 	done = 0;
 	do
 	{
 		chunksize = todo;
-		if (chunksize > 60) {
-			chunksize = 60;
+		if (chunksize > PSXLIB_SECTOR_CHUNK_MAX) {
+			chunksize = PSXLIB_SECTOR_CHUNK_MAX;
 		}
 
-		flgchn = chn;
-
-		// First exchange?
-		if (done == 0) {
-			txlen = sizeof(request);
-			// insert a delay (or expect a longer time before the ACK) before the 8th byte
-			// (command ACKnowlege)
-			flgchn |= FLG_LATE_8TH<<4;
-		} else {
-			// Keep sending zero while we are just reading
-			txlen = 0;
-		}
+		// Keep sending zero while we are just reading
+		txlen = (done == 0) ? sizeof(request) : 0;
 
-		// Last exchange?
-		if (chunksize < todo) {
-			// Make sure the cart stays selected until the end
-			flgchn |= FLG_NO_DESELECT<<4;
-		}
-
-		res = psxlib_exchange(hdl, flgchn, request, txlen, inbuf + done, chunksize);
+		res = psxlib_exchange(hdl, psxlib_sectorChunkFlgChn(chn, done, chunksize), request, txlen, inbuf + done, chunksize);
 		if (res < 0) {
 			return PSXLIB_ERR_IO_ERROR;
 		}
@@ -293,43 +580,81 @@ int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uin
 	while (todo > 0);
 
 	/* Now a few checks */
-
-	// Check for memory card ID
-	if (inbuf[2] != 0x5A ||
-		inbuf[3] != 0x5D)
-	{
-		return PSXLIB_ERR_NO_CARD_DETECTED;
+	res = psxlib_checkSectorReply(inbuf, sector);
+	if (res) {
+		return res;
 	}
 
-	// Check for command acknowledge
-	if (inbuf[6] != 0x5C ||
-		inbuf[7] != 0x5D)
-	{
-		return PSXLIB_ERR_NO_COMMAND_ACK;
+	memcpy(dst, inbuf + 10, PSXLIB_MC_SECTOR_SIZE);
+
+	return 0;
+}
+
+/* Memory cards have no identifier (unlike N64 mempaks). They are identified by
+ * their directory: The header frame and the 15 directory frames of block 0. */
+#define PSXLIB_CACHE_ID_SECTORS	16
+
+/* Build the image cache key for a card from its directory (FNV-1a hash) */
+static int psxlib_cacheKey(rnt_hdl_t hdl, uint8_t chn, const uint8_t *directory, char *key, int keymax)
+{
+	char card_id[16];
+	uint32_t h = 2166136261u;
+	int i;
+
+	for (i=0; i<PSXLIB_CACHE_ID_SECTORS * PSXLIB_MC_SECTOR_SIZE; i++) {
+		h = (h ^ directory[i]) * 16777619u;
 	}
+	snprintf(card_id, sizeof(card_id), "psx_%08x", h);
 
-	// Make sure confirmed sector matches
-	confirmed_sector = inbuf[8] << 8 | inbuf[9];
-	if (confirmed_sector != sector) {
-		return PSXLIB_ERR_INVALID_SECTOR;
+	return imgcache_makeKey(hdl, chn, card_id, key, keymax);
+}
+
+/**
+ * \brief Get the image of the last memory card read or written on this channel
+ *
+ * The directory is read from the card to select the cached image, and only an image
+ * with the same directory is returned.
+ */
+int psxlib_loadCached(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst)
+{
+	uint8_t directory[PSXLIB_CACHE_ID_SECTORS * PSXLIB_MC_SECTOR_SIZE];
+	char key[IMGCACHE_KEY_MAXCHARS];
+	int sector, res;
+
+	if (!dst) {
+		return PSXLIB_ERR_BAD_PARAM;
 	}
 
-	// Validate the checksum
-	chk = xorbuf(inbuf + 8, 2 + 128 + 1);
-	if (chk != 0) {
-		return PSXLIB_ERR_BAD_CHECKSUM;
+	for (sector = 0; sector < PSXLIB_CACHE_ID_SECTORS; sector++) {
+		res = psxlib_readMemoryCardSector(hdl, chn, sector, directory + sector * PSXLIB_MC_SECTOR_SIZE);
+		if (res) {
+			return res;
+		}
 	}
 
-	// Make sure the 'G' at the end is present
-	if (inbuf[139] != 'G') {
-		return PSXLIB_ERR_UNKNOWN;
+	if (psxlib_cacheKey(hdl, chn, directory, key, sizeof(key))) {
+		return PSXLIB_ERR_BAD_PARAM;
 	}
 
-	memcpy(dst, inbuf + 10, PSXLIB_MC_SECTOR_SIZE);
+	if (imgcache_load(key, dst->contents, PSXLIB_MC_TOTAL_SIZE, PSXLIB_MC_SECTOR_SIZE) ||
+			memcmp(dst->contents, directory, sizeof(directory))) {
+		return PSXLIB_ERR_FILE_NOT_FOUND;
+	}
 
 	return 0;
 }
 
+int psxlib_storeCached(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *mc_data)
+{
+	char key[IMGCACHE_KEY_MAXCHARS];
+
+	if (!mc_data || psxlib_cacheKey(hdl, chn, mc_data->contents, key, sizeof(key))) {
+		return PSXLIB_ERR_BAD_PARAM;
+	}
+
+	return imgcache_store(key, mc_data->contents, PSXLIB_MC_TOTAL_SIZE, PSXLIB_MC_SECTOR_SIZE);
+}
+
 int psxlib_writeMemoryCardToFile(const struct psx_memorycard *mc_data, const char *filename, int format)
 {
 	FILE *fptr;
@@ -359,33 +684,24 @@ int psxlib_writeMemoryCardToFile(const struct psx_memorycard *mc_data, const cha
 
 int psxlib_loadMemoryCardFromFile(const char *filename, int format, struct psx_memorycard *dst_mc_data)
 {
-	FILE *fptr;
-	long filesize;
+	struct mapfile *mf;
 
 	if (!dst_mc_data || !filename) {
 		return PSXLIB_ERR_BAD_PARAM;
 	}
 
-	fptr = fopen(filename, "rb");
-	if (!fptr) {
+	mf = mapfile_open(filename, MAPFILE_READ);
+	if (!mf) {
 		return PSXLIB_ERR_FILE_NOT_FOUND;
 	}
 
-	fseek(fptr, 0, SEEK_END);
-	filesize = ftell(fptr);
-	fseek(fptr, 0, SEEK_SET);
-
-	if (filesize != PSXLIB_MC_TOTAL_SIZE) {
-		fclose(fptr);
+	if (mf->size != PSXLIB_MC_TOTAL_SIZE) {
+		mapfile_close(mf);
 		return PSXLIB_ERR_FILE_FORMAT_NOT_SUPPORTED;
 	}
 
-	if (1 != fread(dst_mc_data->contents, PSXLIB_MC_TOTAL_SIZE, 1, fptr)) {
-		fclose(fptr);
-		return PSXLIB_ERR_FILE_READ_ERROR;
-	}
-
-	fclose(fptr);
+	memcpy(dst_mc_data->contents, mf->data, PSXLIB_MC_TOTAL_SIZE);
+	mapfile_close(mf);
 
 	return 0;
 }
@@ -420,6 +736,7 @@ const char *psxlib_getErrorString(int code)
 		case PSXLIB_ERR_BUFFER_TOO_SMALL: return "Buffer too small";
 		case PSXLIB_ERR_FILE_FORMAT_NOT_SUPPORTED: return "File format not supported";
 		case PSXLIB_ERR_USER_CANCELLED: return "Cancelled";
+		case PSXLIB_ERR_VERIFY_FAILED: return "Verification failed";
 	}
 
 	return "(unknown - internal error)";
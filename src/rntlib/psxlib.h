@@ -15,6 +15,7 @@
 #define PSXLIB_ERR_FILE_FORMAT_NOT_SUPPORTED	-9
 #define PSXLIB_ERR_FILE_READ_ERROR	-10
 #define PSXLIB_ERR_USER_CANCELLED	-11
+#define PSXLIB_ERR_VERIFY_FAILED	-12
 
 #define PSXLIB_ERR_BUFFER_TOO_SMALL	-100
 #define PSXLIB_ERR_BAD_PARAM		-101
@@ -44,12 +45,17 @@ int psxlib_enableAnalog(rnt_hdl_t hdl, uint8_t chn, uint8_t port, uint8_t enable
 int psxlib_readMemoryCard(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst, uiio *u);
 int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uint8_t dst[128]);
 int psxlib_writeMemoryCard(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *src, uiio *u);
+int psxlib_writeMemoryCardDiff(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *src, const struct psx_memorycard *current, int verify, uiio *u);
 int psxlib_writeMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, const uint8_t data[128]);
 
 #define PSXLIB_FILE_FORMAT_AUTO	-1
 #define PSXLIB_FILE_FORMAT_RAW	0 // 128kB headerless image
 int psxlib_loadMemoryCardFromFile(const char *filename, int format, struct psx_memorycard *dst_mc_data);
 int psxlib_writeMemoryCardToFile(const struct psx_memorycard *mc_data, const char *filename, int format);
+/* Image cache (see imgcache.h). Cards are identified by their directory, which
+ * loadCached reads from the card. */
+int psxlib_loadCached(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst);
+int psxlib_storeCached(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *mc_data);
 
 #define PSX_CTL_ID_NONE			0xFF
 #define PSX_CTL_ID_NEGCON		0x23
@@ -18,12 +18,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "raphnetadapter.h"
 #include "rnt_priv.h"
+#include "rnt_sim.h"
 #include "gcn64lib.h"
 #include "requests.h"
 #include "hexdump.h"
 #include "timer.h"
+#include "delay.h"
 
 #include "hidapi.h"
 
@@ -180,14 +183,44 @@ int rnt_init(int verbose)
 {
 	dusbr_verbose = verbose;
 	hid_init();
+	rnt_hotplug_init();
 	return 0;
 }
 
 void rnt_shutdown(void)
 {
+	rnt_sim_removeAll();
+	rnt_hotplug_shutdown();
 	hid_exit();
 }
 
+static int hid_transport_send(void *dev, const unsigned char *data, size_t length)
+{
+	return hid_send_feature_report(dev, data, length);
+}
+
+static int hid_transport_get(void *dev, unsigned char *data, size_t length)
+{
+	return hid_get_feature_report(dev, data, length);
+}
+
+static const wchar_t *hid_transport_error(void *dev)
+{
+	return hid_error(dev);
+}
+
+static void hid_transport_close(void *dev)
+{
+	hid_close(dev);
+}
+
+static const struct rnt_transport hid_transport = {
+	.send_feature_report = hid_transport_send,
+	.get_feature_report = hid_transport_get,
+	.error = hid_transport_error,
+	.close = hid_transport_close,
+};
+
 #define PID_NOT_HANDLED		0
 #define PID_HANDLED			1
 #define PID_HANDLED_LEGACY	2
@@ -211,6 +244,22 @@ static char isProductIdHandled(unsigned short pid, int interface_number, struct
 	return PID_NOT_HANDLED;
 }
 
+int rnt_lookupCaps(uint16_t pid, struct rnt_adap_caps *caps)
+{
+	int i;
+
+	for (i=0; supported_adapters[i].vid; i++) {
+		if (supported_adapters[i].vid == OUR_VENDOR_ID && pid == supported_adapters[i].pid && supported_adapters[i].if_number != -1) {
+			memcpy(caps, &supported_adapters[i].caps, sizeof (struct rnt_adap_caps));
+			if (caps->n_channels == 0)
+				caps->n_channels = 1;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
 struct rnt_adap_list_ctx *rnt_allocListCtx(void)
 {
 	struct rnt_adap_list_ctx *ctx;
@@ -221,9 +270,7 @@ struct rnt_adap_list_ctx *rnt_allocListCtx(void)
 void rnt_freeListCtx(struct rnt_adap_list_ctx *ctx)
 {
 	if (ctx) {
-		if (ctx->devs) {
-			hid_free_enumeration(ctx->devs);
-		}
+		free(ctx->devs);
 		free(ctx);
 	}
 }
@@ -243,6 +290,71 @@ int rnt_countDevices(void)
 	return count;
 }
 
+int rnt_enumerate(struct rnt_adap_info **list)
+{
+	struct hid_device_info *devs, *cur_dev;
+	struct rnt_adap_caps caps;
+	struct rnt_adap_info *info;
+	int handled, count = 0, alloc = 0;
+
+	*list = NULL;
+
+	if (IS_VERBOSE()) {
+		printf("Start listing\n");
+	}
+
+	devs = hid_enumerate(OUR_VENDOR_ID, 0x0000);
+	if (!devs) {
+		printf("Hid enumerate returned NULL\n");
+		return 0;
+	}
+
+	for (cur_dev = devs; cur_dev; cur_dev = cur_dev->next)
+	{
+		if (IS_VERBOSE()) {
+			printf("Considering 0x%04x:0x%04x\n", cur_dev->vendor_id, cur_dev->product_id);
+		}
+		handled = isProductIdHandled(cur_dev->product_id, cur_dev->interface_number, &caps);
+		if (handled == PID_NOT_HANDLED)
+			continue;
+
+		if (!cur_dev->product_string || !cur_dev->serial_number) {
+			if (IS_VERBOSE()) {
+				printf("Warning: Skipping device wihout product string or serial\n");
+			}
+			continue;
+		}
+
+		if (count >= alloc) {
+			alloc = alloc ? alloc * 2 : 8;
+			info = realloc(*list, alloc * sizeof(struct rnt_adap_info));
+			if (!info) {
+				perror("realloc");
+				break;
+			}
+			*list = info;
+		}
+
+		info = &(*list)[count++];
+		memset(info, 0, sizeof(struct rnt_adap_info));
+		info->usb_vid = cur_dev->vendor_id;
+		info->usb_pid = cur_dev->product_id;
+		info->version_major = cur_dev->release_number >> 8;
+		info->version_minor = cur_dev->release_number & 0xff;
+		wcsncpy(info->str_prodname, cur_dev->product_string, PRODNAME_MAXCHARS-1);
+		wcsncpy(info->str_serial, cur_dev->serial_number, SERIAL_MAXCHARS-1);
+		strncpy(info->str_path, cur_dev->path, PATH_MAXCHARS-1);
+		memcpy(&info->caps, &caps, sizeof(info->caps));
+		if (handled == PID_HANDLED_LEGACY) {
+			info->legacy_adapter = 1;
+		}
+	}
+
+	hid_free_enumeration(devs);
+
+	return count;
+}
+
 /**
  * \brief List instances of our rgbleds device on the USB busses.
  * \param info Pointer to rnt_adap_info structure to store data
@@ -251,9 +363,6 @@ int rnt_countDevices(void)
  */
 struct rnt_adap_info *rnt_listDevices(struct rnt_adap_info *info, struct rnt_adap_list_ctx *ctx)
 {
-	struct rnt_adap_caps caps;
-	int handled;
-
 	memset(info, 0, sizeof(struct rnt_adap_info));
 
 	if (!ctx) {
@@ -261,63 +370,34 @@ struct rnt_adap_info *rnt_listDevices(struct rnt_adap_info *info, struct rnt_ada
 		return NULL;
 	}
 
-	if (ctx->devs)
-		goto jumpin;
+	/* Simulated adapters come first */
+	if (ctx->sim_next < rnt_sim_count()) {
+		rnt_sim_getInfo(ctx->sim_next++, info);
+		return info;
+	}
 
-	if (IS_VERBOSE()) {
-		printf("Start listing\n");
+	/* From the hotplug monitor cache when available (see rnt_hotplug.c) */
+	if (!ctx->listed) {
+		ctx->n_devs = rnt_hotplug_getDevices(&ctx->devs);
+		ctx->listed = 1;
 	}
 
-	ctx->devs = hid_enumerate(OUR_VENDOR_ID, 0x0000);
-	if (!ctx->devs) {
-		printf("Hid enumerate returned NULL\n");
+	if (ctx->cur_dev >= ctx->n_devs) {
 		return NULL;
 	}
 
-	for (ctx->cur_dev = ctx->devs; ctx->cur_dev; ctx->cur_dev = ctx->cur_dev->next)
-	{
-		if (IS_VERBOSE()) {
-			printf("Considering 0x%04x:0x%04x\n", ctx->cur_dev->vendor_id, ctx->cur_dev->product_id);
-		}
-		handled = isProductIdHandled(ctx->cur_dev->product_id, ctx->cur_dev->interface_number, &caps);
-		if (handled != PID_NOT_HANDLED)
-		{
-				info->usb_vid = ctx->cur_dev->vendor_id;
-				info->usb_pid = ctx->cur_dev->product_id;
-				info->version_major = ctx->cur_dev->release_number >> 8;
-				info->version_minor = ctx->cur_dev->release_number & 0xff;
-				if (!ctx->cur_dev->product_string || !ctx->cur_dev->serial_number) {
-					if (IS_VERBOSE()) {
-						printf("Warning: Skipping device wihout product string or serial\n");
-					}
-					continue;
-				}
+	memcpy(info, &ctx->devs[ctx->cur_dev++], sizeof(struct rnt_adap_info));
 
-				wcsncpy(info->str_prodname, ctx->cur_dev->product_string, PRODNAME_MAXCHARS-1);
-				wcsncpy(info->str_serial, ctx->cur_dev->serial_number, SERIAL_MAXCHARS-1);
-				strncpy(info->str_path, ctx->cur_dev->path, PATH_MAXCHARS-1);
-				memcpy(&info->caps, &caps, sizeof(info->caps));
-				if (handled == PID_HANDLED_LEGACY) {
-					info->legacy_adapter = 1;
-				}
-				return info;
-		}
-
-		jumpin:
-		// prevent 'error: label at end of compound statement'
-		continue;
-	}
-
-	return NULL;
+	return info;
 }
 
 static int rnt_featToCaps(const struct rnt_dyn_features *dyn, struct rnt_adap_caps *caps);
 
 rnt_hdl_t rnt_openDevice(const struct rnt_adap_info *dev)
 {
-	hid_device *hdev = NULL;
 	rnt_hdl_t hdl;
 	char version[64];
+	void *rec;
 
 	if (!dev)
 		return NULL;
@@ -340,17 +420,34 @@ rnt_hdl_t rnt_openDevice(const struct rnt_adap_info *dev)
 			printf("Opening device path: '%s'\n", dev->str_path);
 		}
 
-		hdev = hid_open_path(dev->str_path);
-		if (!hdev) {
+		if (0 == strncmp(dev->str_path, RNT_SIM_PATH_PREFIX, strlen(RNT_SIM_PATH_PREFIX))) {
+			hdl->dev = rnt_sim_open(dev->str_path);
+			hdl->transport = &rnt_sim_transport;
+		} else if (0 == strncmp(dev->str_path, RNT_TRACE_REPLAY_PREFIX, strlen(RNT_TRACE_REPLAY_PREFIX))) {
+			hdl->dev = rnt_trace_openReplay(dev->str_path);
+			hdl->transport = &rnt_trace_replay_transport;
+		} else {
+			hdl->dev = hid_open_path(dev->str_path);
+			hdl->transport = &hid_transport;
+		}
+
+		if (!hdl->dev) {
 			free(hdl);
 			return NULL;
 		}
 
-		hdl->hdev = hdev;
+		// Record the session if tracing is enabled (see rnt_trace_setRecordFile)
+		rec = rnt_trace_startRecording(hdl->dev, hdl->transport, dev);
+		if (rec) {
+			hdl->dev = rec;
+			hdl->transport = &rnt_trace_record_transport;
+		}
 	}
 
 	hdl->version_major = dev->version_major;
 	hdl->version_minor = dev->version_minor;
+	hdl->wait_mode = RNT_WAIT_BACKOFF;
+	hdl->timeout_ms = RNT_DEFAULT_TIMEOUT_MS;
 	hdl->report_size = dev->caps.rpsize ? dev->caps.rpsize : 63;
 
 	if (!(dev->caps.features & RNTF_BLOCK_IO) && !dev->caps.rpsize) {
@@ -365,8 +462,8 @@ rnt_hdl_t rnt_openDevice(const struct rnt_adap_info *dev)
 
 		if (rnt_readSupportedFeatures(hdl, &feats) < 0) {
 			fprintf(stderr, "Failed to query features\n");
-			if (hdev) {
-				hid_close(hdev);
+			if (hdl->dev) {
+				hdl->transport->close(hdl->dev);
 			}
 			free(hdl);
 			return NULL;
@@ -448,10 +545,11 @@ rnt_hdl_t rnt_openBy(struct rnt_adap_info *dev, unsigned char flags)
 
 void rnt_closeDevice(rnt_hdl_t hdl)
 {
-	hid_device *hdev = hdl->hdev;
+	// Complete what was submitted so owners get their callbacks
+	rnt_harvest(hdl, 0);
 
-	if (hdev) {
-		hid_close(hdev);
+	if (hdl->dev) {
+		hdl->transport->close(hdl->dev);
 	}
 
 	free(hdl);
@@ -459,12 +557,11 @@ void rnt_closeDevice(rnt_hdl_t hdl)
 
 int rnt_send_cmd(rnt_hdl_t hdl, const unsigned char *cmd, int cmdlen)
 {
-	hid_device *hdev = hdl->hdev;
 	unsigned char buffer[hdl->report_size+1];
 	int n;
 	int attempts_left=2;
 
-	if (!hdev) {
+	if (!hdl->dev) {
 		return -1;
 	}
 
@@ -479,44 +576,54 @@ int rnt_send_cmd(rnt_hdl_t hdl, const unsigned char *cmd, int cmdlen)
 	memcpy(buffer + 1, cmd, cmdlen);
 
 	while (attempts_left--) {
-		n = hid_send_feature_report(hdev, buffer, sizeof(buffer));
+		n = hdl->transport->send_feature_report(hdl->dev, buffer, sizeof(buffer));
 		if (n >= 0) {
 			break;
 		}
 		fprintf(stderr, "send feature report: retry\n");
+		if (attempts_left) {
+			RNT_STAT_ADD(hdl, send_retries, 1);
+		}
 	}
 
 	if (n < 0) {
-		fprintf(stderr, "Could not send feature report (%ls)\n", hid_error(hdev));
+		fprintf(stderr, "Could not send feature report (%ls)\n", hdl->transport->error(hdl->dev));
+		RNT_STAT_ADD(hdl, errors, 1);
 		return -1;
 	}
 
+	RNT_STAT_ADD(hdl, requests, 1);
+	RNT_STAT_ADD(hdl, bytes_out, cmdlen);
+	hdl->sent_rq = cmdlen > 0 ? cmd[0] : 0;
+	hdl->sent_us = getMicroseconds();
+
 	return 0;
 }
 
 int rnt_poll_result(rnt_hdl_t hdl, unsigned char *cmd, int cmd_maxlen)
 {
-	hid_device *hdev = hdl->hdev;
 	unsigned char buffer[hdl->report_size+1];
 	int res_len;
 	int n;
 
-	if (!hdev) {
+	if (!hdl->dev) {
 		return -1;
 	}
 
 	memset(buffer, 0, sizeof(buffer));
 	buffer[0] = 0x00; // report ID set to 0 (device has only one)
 
-	n = hid_get_feature_report(hdev, buffer, sizeof(buffer));
+	n = hdl->transport->get_feature_report(hdl->dev, buffer, sizeof(buffer));
 	if (n < 0) {
-		fprintf(stderr, "Could not send feature report (%ls)\n", hid_error(hdev));
+		fprintf(stderr, "Could not send feature report (%ls)\n", hdl->transport->error(hdl->dev));
+		RNT_STAT_ADD(hdl, errors, 1);
 		return -1;
 	}
 	if (n==0) {
 		return 0;
 	}
 	res_len = n-1;
+	RNT_STAT_ADD(hdl, bytes_in, res_len);
 
 	if (res_len>0) {
 		int copy_len;
@@ -533,23 +640,140 @@ int rnt_poll_result(rnt_hdl_t hdl, unsigned char *cmd, int cmd_maxlen)
 	return res_len;
 }
 
-int rnt_exchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char *result, int result_max)
+static int rnt_latencyBucket(uint64_t us)
+{
+	int e, idx;
+
+	if (us < 8) {
+		return us;
+	}
+
+	for (e = 3; (us >> (e + 1)) && e < 63; e++)
+		;
+
+	idx = 8 + (e - 3) * 4 + ((us >> (e - 2)) & 3);
+
+	return idx < RNT_LAT_BUCKETS ? idx : RNT_LAT_BUCKETS - 1;
+}
+
+/* Largest value counted in a bucket */
+static uint64_t rnt_latencyBucketMax(int idx)
+{
+	int e, sub;
+
+	if (idx < 8) {
+		return idx;
+	}
+
+	e = 3 + (idx - 8) / 4;
+	sub = (idx - 8) % 4;
+
+	return (1ULL << e) + (sub + 1) * (1ULL << (e - 2)) - 1;
+}
+
+static void rnt_statsAddLatency(rnt_hdl_t hdl, uint8_t rq, uint64_t latency_us)
+{
+	struct rnt_latency_hist *h = &hdl->stats.latency[rq];
+	uint64_t max;
+
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->total_us, latency_us, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->buckets[rnt_latencyBucket(latency_us)], 1, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+	while (latency_us > max) {
+		if (__atomic_compare_exchange_n(&h->max_us, &max, latency_us, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+}
+
+uint64_t rnt_latencyPercentile(const struct rnt_latency_hist *hist, double fraction)
+{
+	uint64_t seen = 0, rank, v;
+	int i;
+
+	if (!hist || !hist->count) {
+		return 0;
+	}
+
+	rank = fraction * hist->count;
+	if (rank < 1) {
+		rank = 1;
+	}
+
+	for (i=0; i<RNT_LAT_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= rank) {
+			v = rnt_latencyBucketMax(i);
+			return v < hist->max_us ? v : hist->max_us;
+		}
+	}
+
+	return hist->max_us;
+}
+
+int rnt_getStats(rnt_hdl_t hdl, struct rnt_stats *dst)
+{
+	const uint64_t *src64;
+	uint64_t *dst64;
+	int i, j;
+
+	if (!hdl || !dst)
+		return -1;
+
+	src64 = (const uint64_t *)&hdl->stats;
+	dst64 = (uint64_t *)dst;
+
+	// Counters first: they are all uint64_t, up to the histograms
+	for (i=0; i<offsetof(struct rnt_stats, latency) / sizeof(uint64_t); i++) {
+		dst64[i] = __atomic_load_n(&src64[i], __ATOMIC_RELAXED);
+	}
+
+	for (i=0; i<256; i++) {
+		const struct rnt_latency_hist *h = &hdl->stats.latency[i];
+
+		dst->latency[i].count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+		dst->latency[i].total_us = __atomic_load_n(&h->total_us, __ATOMIC_RELAXED);
+		dst->latency[i].max_us = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+		for (j=0; j<RNT_LAT_BUCKETS; j++) {
+			dst->latency[i].buckets[j] = __atomic_load_n(&h->buckets[j], __ATOMIC_RELAXED);
+		}
+	}
+
+	return 0;
+}
+
+void rnt_resetStats(rnt_hdl_t hdl)
+{
+	if (hdl) {
+		memset(&hdl->stats, 0, sizeof(hdl->stats));
+	}
+}
+
+/* Adaptive backoff parameters for RNT_WAIT_BACKOFF. Most answers are ready
+ * after one or two polls, so those are done without delay. */
+#define BACKOFF_FREE_POLLS	2
+#define BACKOFF_MIN_US		100
+#define BACKOFF_MAX_US		2000
+
+static int rnt_wait_result(rnt_hdl_t hdl, unsigned char *result, int result_max, int timeout_ms, int *empty_polls)
 {
 	int n;
+	int polls = 0;
+	unsigned long delay_us = BACKOFF_MIN_US;
 	uint64_t time_start, time_now;
 
-	n = rnt_send_cmd(hdl, outcmd, outlen);
-	if (n<0) {
-		// only complain when this fails on non-legacy devices
-		if (hdl->hdev)
-			fprintf(stderr, "Error sending command\n");
-		return -1;
+	if (!timeout_ms) {
+		timeout_ms = hdl->timeout_ms ? hdl->timeout_ms : RNT_DEFAULT_TIMEOUT_MS;
 	}
 
 	time_start = getMilliseconds();
 
 	/* Answer to the command comes later. For now, this is polled, but in
-	 * the future an interrupt-in transfer could be used. */
+	 * the future an interrupt-in transfer could be used. HIDAPI gives no
+	 * access to the underlying file descriptor and feature reports are
+	 * control transfers, so there is nothing to block on: back off
+	 * instead of spinning. */
 	do {
 		n = rnt_poll_result(hdl, result, result_max);
 		if (n < 0) {
@@ -557,20 +781,198 @@ int rnt_exchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char
 			break;
 		}
 		if (n==0) {
-//			printf("."); fflush(stdout);
+			polls++;
+
+			if (hdl->wait_mode == RNT_WAIT_BACKOFF && polls > BACKOFF_FREE_POLLS) {
+				_delay_us(delay_us);
+				if (delay_us < BACKOFF_MAX_US) {
+					delay_us *= 2;
+				}
+			}
 		}
 
 		time_now = getMilliseconds();
-		if ((time_now - time_start) > 1000) {
+		if ((time_now - time_start) > timeout_ms) {
 			fprintf(stderr, "rnt exchange timeout\n");
-			return -1;
+			RNT_STAT_ADD(hdl, timeouts, 1);
+			n = -1;
+			break;
 		}
 
 	} while (n==0);
 
+	if (n > 0) {
+		rnt_statsAddLatency(hdl, hdl->sent_rq, getMicroseconds() - hdl->sent_us);
+	}
+	RNT_STAT_ADD(hdl, empty_polls, polls);
+	hdl->last_empty_polls = polls;
+	if (empty_polls) {
+		*empty_polls = polls;
+	}
+
 	return n;
 }
 
+int rnt_exchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char *result, int result_max)
+{
+	int n;
+
+	if (hdl->rq_inflight) {
+		fprintf(stderr, "rnt_exchange: Cannot be used while a submitted request is in progress\n");
+		return -1;
+	}
+
+	/* Keep ordering with previously submitted requests */
+	if (hdl->rq_head) {
+		rnt_harvest(hdl, 0);
+	}
+
+	n = rnt_send_cmd(hdl, outcmd, outlen);
+	if (n<0) {
+		// only complain when this fails on non-legacy devices
+		if (hdl->dev)
+			fprintf(stderr, "Error sending command\n");
+		return -1;
+	}
+
+	return rnt_wait_result(hdl, result, result_max, 0, NULL);
+}
+
+int rnt_submit(rnt_hdl_t hdl, struct rnt_request *rq)
+{
+	if (!hdl || !rq) {
+		return -1;
+	}
+
+	rq->next = NULL;
+	rq->result_len = 0;
+	rq->empty_polls = 0;
+
+	if (hdl->rq_tail) {
+		hdl->rq_tail->next = rq;
+	} else {
+		hdl->rq_head = rq;
+	}
+	hdl->rq_tail = rq;
+	hdl->rq_count++;
+
+	return 0;
+}
+
+static struct rnt_request *rnt_dequeue(rnt_hdl_t hdl)
+{
+	struct rnt_request *rq = hdl->rq_head;
+
+	if (rq) {
+		hdl->rq_head = rq->next;
+		if (!hdl->rq_head) {
+			hdl->rq_tail = NULL;
+		}
+		rq->next = NULL;
+	}
+
+	return rq;
+}
+
+/* Send the next queued request, completing the ones that cannot be sent. */
+static struct rnt_request *rnt_send_next(rnt_hdl_t hdl)
+{
+	struct rnt_request *rq;
+
+	while ((rq = rnt_dequeue(hdl))) {
+		if (rnt_send_cmd(hdl, rq->outcmd, rq->outlen) == 0) {
+			return rq;
+		}
+
+		if (hdl->dev)
+			fprintf(stderr, "Error sending command\n");
+		rq->result_len = -1;
+		hdl->rq_count--;
+		if (rq->completed) {
+			rq->completed(hdl, rq);
+		}
+	}
+
+	return NULL;
+}
+
+int rnt_harvest(rnt_hdl_t hdl, int max_requests)
+{
+	struct rnt_request *rq;
+	int done = 0;
+
+	if (!hdl || hdl->rq_inflight) {
+		return -1;
+	}
+
+	while (!max_requests || done < max_requests) {
+		rq = hdl->rq_inflight;
+		if (!rq) {
+			rq = rnt_send_next(hdl);
+			if (!rq) {
+				break;
+			}
+		}
+
+		rq->result_len = rnt_wait_result(hdl, rq->result, rq->result_max, rq->timeout_ms, &rq->empty_polls);
+		hdl->rq_count--;
+		done++;
+
+		/* Get the adapter started on the next request before handing
+		 * this result to the caller. */
+		hdl->rq_inflight = NULL;
+		if (!max_requests || done < max_requests) {
+			hdl->rq_inflight = rnt_send_next(hdl);
+		}
+
+		if (rq->completed) {
+			rq->completed(hdl, rq);
+		}
+	}
+	hdl->rq_inflight = NULL;
+
+	return done;
+}
+
+int rnt_pendingRequests(rnt_hdl_t hdl)
+{
+	if (!hdl)
+		return -1;
+
+	return hdl->rq_count;
+}
+
+int rnt_setWaitMode(rnt_hdl_t hdl, int mode)
+{
+	if (!hdl)
+		return -1;
+
+	if (mode != RNT_WAIT_BACKOFF && mode != RNT_WAIT_SPIN)
+		return -1;
+
+	hdl->wait_mode = mode;
+
+	return 0;
+}
+
+int rnt_setTimeout(rnt_hdl_t hdl, int timeout_ms)
+{
+	if (!hdl || timeout_ms < 0)
+		return -1;
+
+	hdl->timeout_ms = timeout_ms ? timeout_ms : RNT_DEFAULT_TIMEOUT_MS;
+
+	return 0;
+}
+
+int rnt_getLastEmptyPolls(rnt_hdl_t hdl)
+{
+	if (!hdl)
+		return -1;
+
+	return hdl->last_empty_polls;
+}
+
 int rnt_suspendPolling(rnt_hdl_t hdl, unsigned char suspend)
 {
 	unsigned char cmd[2];
@@ -693,7 +1095,7 @@ int rnt_getVersion(rnt_hdl_t hdl, char *dst, int dstmax)
 		return -1;
 
 	/* legacy device. Version must be built from */
-	if (!hdl->hdev) {
+	if (!hdl->dev) {
 		snprintf(dst, dstmax, "%d.%d(.x)", hdl->version_major, hdl->version_minor);
 		return 0;
 	}
@@ -122,12 +122,147 @@ rnt_hdl_t rnt_openDevice(const struct rnt_adap_info *dev);
  **/
 rnt_hdl_t rnt_openBy(struct rnt_adap_info *dev, unsigned char flags);
 
+/**
+ * \brief Open a device, waiting for it to be connected if needed
+ *
+ * Same as rnt_openBy, but retries when adapters are connected (eg: after a
+ * firmware update) until timeout_ms has elapsed.
+ **/
+rnt_hdl_t rnt_waitOpenBy(struct rnt_adap_info *dev, unsigned char flags, int timeout_ms);
+
+/**
+ * \brief Wait until adapters may have been connected or disconnected since the
+ * device list was last read
+ *
+ * On Linux, kernel and udev events are monitored (netlink) and the device list
+ * is only enumerated again when something changed, or when the last enumeration
+ * is over a second old (in case events are not delivered). Elsewhere, this waits
+ * a moment and the device list is enumerated every time.
+ *
+ * \return Non-zero if the device list should be read again, 0 on timeout (immediately
+ *         when timeout_ms is zero or negative)
+ **/
+int rnt_waitDeviceChange(int timeout_ms);
+
+#define RNT_HOTPLUG_ADDED	1
+#define RNT_HOTPLUG_REMOVED	2
+typedef void (*rnt_hotplug_func)(int event, const struct rnt_adap_info *info, void *ctx);
+
+/**
+ * \brief Wait until adapters are connected or disconnected, compared to when called
+ *
+ * \param timeout_ms Maximum time to wait
+ * \param func Called for each adapter connected or disconnected (can be NULL)
+ * \return The number of adapters connected or disconnected, 0 on timeout
+ **/
+int rnt_waitHotplug(int timeout_ms, rnt_hotplug_func func, void *ctx);
+
 void rnt_closeDevice(rnt_hdl_t hdl);
 
 int rnt_send_cmd(rnt_hdl_t hdl, const unsigned char *cmd, int len);
 int rnt_poll_result(rnt_hdl_t hdl, unsigned char *cmd, int cmdlen);
 int rnt_exchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char *result, int result_max);
 
+/**
+ * \brief A request for asynchronous submission through rnt_submit()
+ *
+ * The buffers and the structure itself must remain valid until the
+ * completed callback is called.
+ */
+struct rnt_request {
+	unsigned char *outcmd;
+	int outlen;
+	unsigned char *result;
+	int result_max;
+	/** Time allowed for the answer. 0 for the handle default (see rnt_setTimeout) */
+	int timeout_ms;
+	/** Set before calling completed: Answer length, or negative on error */
+	int result_len;
+	/** Set before calling completed: Polls that returned no answer yet */
+	int empty_polls;
+	/** Called from rnt_harvest() once the answer is received. May be NULL.
+	 * The callback may submit new requests, but must not call rnt_exchange(). */
+	void (*completed)(rnt_hdl_t hdl, struct rnt_request *rq);
+	void *ctx;
+
+	struct rnt_request *next; // For internal use
+};
+
+/**
+ * \brief Queue a request for the adapter
+ * \param hdl The adapter handle
+ * \param rq The request
+ * \return 0 on success
+ **/
+int rnt_submit(rnt_hdl_t hdl, struct rnt_request *rq);
+
+/**
+ * \brief Process queued requests back-to-back
+ *
+ * The next request is sent to the adapter before the completion
+ * callback of the previous one is called, so the adapter is kept busy
+ * while the host handles results.
+ *
+ * \param hdl The adapter handle
+ * \param max_requests Stop after this many completions (0 for no limit)
+ * \return The number of requests completed
+ **/
+int rnt_harvest(rnt_hdl_t hdl, int max_requests);
+
+/** \brief Return the number of requests queued and not yet completed */
+int rnt_pendingRequests(rnt_hdl_t hdl);
+
+#define RNT_DEFAULT_TIMEOUT_MS	1000
+
+/* Ways to wait for the answer to a command */
+#define RNT_WAIT_BACKOFF	0 // Poll right away a few times, then sleep increasingly between polls (default)
+#define RNT_WAIT_SPIN		1 // Poll continuously (lowest latency, uses a full CPU core)
+
+int rnt_setWaitMode(rnt_hdl_t hdl, int mode);
+/** \brief Set the default time to wait for answers (0 restores RNT_DEFAULT_TIMEOUT_MS) */
+int rnt_setTimeout(rnt_hdl_t hdl, int timeout_ms);
+/** \brief Get the number of empty polls the last completed command took */
+int rnt_getLastEmptyPolls(rnt_hdl_t hdl);
+
+/* Latency histogram. Values are in microseconds. Below 8us there is one bucket
+ * per microsecond. Then each power of two is divided in 4 buckets, so values
+ * are known to within 25%. Values past the last bucket are counted in it. */
+#define RNT_LAT_BUCKETS		96
+
+struct rnt_latency_hist {
+	uint64_t count;
+	uint64_t total_us;
+	uint64_t max_us;
+	uint32_t buckets[RNT_LAT_BUCKETS];
+};
+
+/** \brief Get the upper bound of the latency below which a fraction (0.0 to 1.0) of the values are */
+uint64_t rnt_latencyPercentile(const struct rnt_latency_hist *hist, double fraction);
+
+struct rnt_stats {
+	uint64_t requests;		// Commands sent to the adapter
+	uint64_t bytes_out;		// Command bytes sent (without the report ID)
+	uint64_t bytes_in;		// Answer bytes received (without the report ID)
+	uint64_t send_retries;	// Feature reports sent a second time after an error
+	uint64_t errors;		// Feature reports that could not be sent or read
+	uint64_t timeouts;		// Commands that got no answer in time
+	uint64_t empty_polls;	// Polls made before the answer was ready
+	uint64_t crc_errors;	// Bad data CRC in mempak reads and writes
+
+	/* Time between sending a command and receiving its answer, per
+	 * request (RQ_*, the first command byte) */
+	struct rnt_latency_hist latency[256];
+};
+
+/**
+ * \brief Get the statistics of an adapter handle
+ *
+ * Counters are updated with atomic operations, so this may be called
+ * from another thread while the handle is in use.
+ */
+int rnt_getStats(rnt_hdl_t hdl, struct rnt_stats *dst);
+void rnt_resetStats(rnt_hdl_t hdl);
+
 int rnt_suspendPolling(rnt_hdl_t hdl, unsigned char suspend);
 int rnt_setConfig(rnt_hdl_t hdl, unsigned char param, unsigned char *data, unsigned char len);
 int rnt_getConfig(rnt_hdl_t hdl, unsigned char param, unsigned char *rx, unsigned char rx_max);
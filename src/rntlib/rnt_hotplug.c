@@ -0,0 +1,303 @@
+/*	gcn64ctl : raphnet adapter management tools
+	Copyright (C) 2007-2018  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include "raphnetadapter.h"
+#include "rnt_priv.h"
+#include "timer.h"
+#include "delay.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif
+
+/* How often the device list is enumerated when there is no hotplug monitor */
+#define HOTPLUG_POLL_INTERVAL_MS	250
+
+#ifdef __linux__
+
+#define UEVENT_GROUP_KERNEL	1
+#define UEVENT_GROUP_UDEV	2
+#define UEVENT_MSG_SIZE		8192
+
+/* The cache is also refreshed after this long, in case events are not delivered
+ * (e.g. in containers or without udev) even though the socket could be bound */
+#define HOTPLUG_CACHE_TTL_MS	1000
+
+/* Kernel and udev events are received through a netlink socket. The result
+ * of the last enumeration is kept until an event says a HID or USB device was
+ * added or removed, or until it is HOTPLUG_CACHE_TTL_MS old. */
+static int monitor_fd = -1;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rnt_adap_info *cache;
+static int cache_count, cache_valid;
+static uint64_t cache_time;
+
+/* Both message formats (kernel: "action@devpath", udev: "libudev" header) carry
+ * the device properties as NUL terminated KEY=value strings. */
+static int hotplug_isRelevant(const char *msg, int len)
+{
+	const char *p;
+
+	for (p = msg; p < msg + len; p += strlen(p) + 1) {
+		if (0 == strcmp(p, "SUBSYSTEM=hidraw") || 0 == strcmp(p, "SUBSYSTEM=usb")) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Read the pending events. Must be called with cache_lock held.
+ * \return The number of relevant events */
+static int hotplug_read(void)
+{
+	char msg[UEVENT_MSG_SIZE];
+	int n, events = 0;
+
+	while (1) {
+		n = recv(monitor_fd, msg, sizeof(msg) - 1, MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == ENOBUFS) {
+				// Events were lost
+				events++;
+				continue;
+			}
+			break;
+		}
+		msg[n] = 0;
+
+		if (hotplug_isRelevant(msg, n)) {
+			events++;
+		}
+	}
+
+	if (events) {
+		cache_valid = 0;
+	}
+
+	return events;
+}
+
+int rnt_hotplug_init(void)
+{
+	struct sockaddr_nl addr = { };
+
+	if (monitor_fd >= 0)
+		return 0;
+
+	monitor_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (monitor_fd < 0) {
+		return -1;
+	}
+
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = UEVENT_GROUP_KERNEL | UEVENT_GROUP_UDEV;
+	if (bind(monitor_fd, (struct sockaddr*)&addr, sizeof(addr))) {
+		close(monitor_fd);
+		monitor_fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+void rnt_hotplug_shutdown(void)
+{
+	pthread_mutex_lock(&cache_lock);
+	if (monitor_fd >= 0) {
+		close(monitor_fd);
+		monitor_fd = -1;
+	}
+	free(cache);
+	cache = NULL;
+	cache_count = 0;
+	cache_valid = 0;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+int rnt_hotplug_getDevices(struct rnt_adap_info **list)
+{
+	int count;
+
+	if (monitor_fd < 0) {
+		return rnt_enumerate(list);
+	}
+
+	pthread_mutex_lock(&cache_lock);
+
+	hotplug_read();
+	if (!cache_valid || getMilliseconds() - cache_time >= HOTPLUG_CACHE_TTL_MS) {
+		free(cache);
+		cache_count = rnt_enumerate(&cache);
+		cache_valid = 1;
+		cache_time = getMilliseconds();
+	}
+
+	*list = NULL;
+	count = cache_count;
+	if (count) {
+		*list = malloc(count * sizeof(struct rnt_adap_info));
+		if (*list) {
+			memcpy(*list, cache, count * sizeof(struct rnt_adap_info));
+		} else {
+			perror("malloc");
+			count = 0;
+		}
+	}
+
+	pthread_mutex_unlock(&cache_lock);
+
+	return count;
+}
+
+#else
+
+int rnt_hotplug_init(void)
+{
+	return -1;
+}
+
+void rnt_hotplug_shutdown(void)
+{
+}
+
+int rnt_hotplug_getDevices(struct rnt_adap_info **list)
+{
+	return rnt_enumerate(list);
+}
+
+#endif
+
+int rnt_waitDeviceChange(int timeout_ms)
+{
+	// Callers compute the timeout from a deadline, which may just have passed
+	if (timeout_ms <= 0) {
+		return 0;
+	}
+
+#ifdef __linux__
+	if (monitor_fd >= 0) {
+		struct pollfd pfd = { .fd = monitor_fd, .events = POLLIN };
+		uint64_t deadline = getMilliseconds() + timeout_ms;
+		int64_t remaining;
+		int events;
+
+		while ((remaining = deadline - getMilliseconds()) > 0) {
+			int res;
+
+			res = poll(&pfd, 1, remaining < HOTPLUG_CACHE_TTL_MS ? remaining : HOTPLUG_CACHE_TTL_MS);
+			if (res < 0 && errno != EINTR) {
+				break;
+			}
+
+			pthread_mutex_lock(&cache_lock);
+			events = hotplug_read();
+			pthread_mutex_unlock(&cache_lock);
+
+			if (events) {
+				return events;
+			}
+
+			/* No events for a while. The cached list has expired, so have
+			 * callers look again in case events are not delivered. */
+			if (res == 0 && remaining > HOTPLUG_CACHE_TTL_MS) {
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+#endif
+
+	_delay_us(1000 * (timeout_ms < HOTPLUG_POLL_INTERVAL_MS ? timeout_ms : HOTPLUG_POLL_INTERVAL_MS));
+	return 1;
+}
+
+/* Report the adapters of list a missing from list b */
+static int hotplug_report(const struct rnt_adap_info *a, int n_a, const struct rnt_adap_info *b, int n_b, int event, rnt_hotplug_func func, void *ctx)
+{
+	int i, j, count = 0;
+
+	for (i=0; i<n_a; i++) {
+		for (j=0; j<n_b; j++) {
+			if (0 == strcmp(a[i].str_path, b[j].str_path) && 0 == wcscmp(a[i].str_serial, b[j].str_serial))
+				break;
+		}
+		if (j == n_b) {
+			if (func) {
+				func(event, &a[i], ctx);
+			}
+			count++;
+		}
+	}
+
+	return count;
+}
+
+int rnt_waitHotplug(int timeout_ms, rnt_hotplug_func func, void *ctx)
+{
+	struct rnt_adap_info *before, *after;
+	int n_before, n_after, changes = 0;
+	uint64_t deadline = getMilliseconds() + timeout_ms;
+	int64_t remaining;
+
+	n_before = rnt_hotplug_getDevices(&before);
+
+	while (!changes && (remaining = deadline - getMilliseconds()) > 0) {
+		if (!rnt_waitDeviceChange(remaining))
+			break;
+
+		n_after = rnt_hotplug_getDevices(&after);
+		changes = hotplug_report(before, n_before, after, n_after, RNT_HOTPLUG_REMOVED, func, ctx);
+		changes += hotplug_report(after, n_after, before, n_before, RNT_HOTPLUG_ADDED, func, ctx);
+
+		free(before);
+		before = after;
+		n_before = n_after;
+	}
+
+	free(before);
+
+	return changes;
+}
+
+rnt_hdl_t rnt_waitOpenBy(struct rnt_adap_info *dev, unsigned char flags, int timeout_ms)
+{
+	uint64_t deadline = getMilliseconds() + timeout_ms;
+	int64_t remaining;
+	rnt_hdl_t hdl;
+
+	while (1) {
+		hdl = rnt_openBy(dev, flags);
+		if (hdl)
+			return hdl;
+
+		/* Also retry after events for devices already listed: udev may only
+		 * now have given access to the device node. */
+		remaining = deadline - getMilliseconds();
+		if (remaining <= 0 || !rnt_waitDeviceChange(remaining))
+			return NULL;
+	}
+}
@@ -5,15 +5,77 @@
 #include "raphnetadapter.h"
 
 struct rnt_adap_list_ctx {
-	struct hid_device_info *devs, *cur_dev;
+	struct rnt_adap_info *devs;
+	int n_devs, cur_dev, listed;
+	int sim_next; // Next simulated adapter to list
+};
+
+/* Exchanges feature reports with an opened adapter. Same conventions as
+ * the hidapi functions (the first byte is the report ID, get returns 0 when
+ * the answer is not ready yet) */
+struct rnt_transport {
+	int (*send_feature_report)(void *dev, const unsigned char *data, size_t length);
+	int (*get_feature_report)(void *dev, unsigned char *data, size_t length);
+	const wchar_t *(*error)(void *dev);
+	void (*close)(void *dev);
 };
 
 typedef struct _rnt_hdl_t {
-	hid_device *hdev;
+	// NULL for legacy adapters (no command interface)
+	void *dev;
+	const struct rnt_transport *transport;
 	int report_size;
 	struct rnt_adap_info info;
 	// Version info for legacy devices
 	uint8_t version_major, version_minor;
+
+	// Requests queued by rnt_submit(), waiting for rnt_harvest()
+	struct rnt_request *rq_head, *rq_tail;
+	int rq_count;
+	// Request sent to the adapter whose answer has not been read yet
+	struct rnt_request *rq_inflight;
+
+	// How answers are waited for. See rnt_setWaitMode()
+	int wait_mode;
+	int timeout_ms;
+	int last_empty_polls;
+
+	// See rnt_getStats(). Only updated with RNT_STAT_ADD.
+	struct rnt_stats stats;
+	// The last command sent, for latency statistics
+	uint8_t sent_rq;
+	uint64_t sent_us;
 } *rnt_hdl_t;
 
+/* Statistics may be read by another thread (rnt_getStats) */
+#define RNT_STAT_ADD(hdl, counter, n)	__atomic_fetch_add(&(hdl)->stats.counter, (n), __ATOMIC_RELAXED)
+
+/** \brief Enumerate the adapters (not simulated) connected now. *list must be freed.
+ * \return The number of adapters */
+int rnt_enumerate(struct rnt_adap_info **list);
+
+/* Hotplug monitor and enumeration cache (rnt_hotplug.c) */
+int rnt_hotplug_init(void);
+void rnt_hotplug_shutdown(void);
+/** \brief Same as rnt_enumerate, but from a cache kept up to date by the hotplug monitor */
+int rnt_hotplug_getDevices(struct rnt_adap_info **list);
+
+/** \brief Get the capabilities of an adapter from its product ID (0 on success) */
+int rnt_lookupCaps(uint16_t pid, struct rnt_adap_caps *caps);
+
+/* Simulated adapters (rnt_sim.c) */
+#define RNT_SIM_PATH_PREFIX	"sim:"
+extern const struct rnt_transport rnt_sim_transport;
+int rnt_sim_count(void);
+int rnt_sim_getInfo(int index, struct rnt_adap_info *info);
+void *rnt_sim_open(const char *path);
+
+/* Session traces (rnt_trace.c) */
+#define RNT_TRACE_REPLAY_PREFIX	"replay:"
+extern const struct rnt_transport rnt_trace_record_transport;
+extern const struct rnt_transport rnt_trace_replay_transport;
+/* Returns a transport device recording the session, or NULL when not recording */
+void *rnt_trace_startRecording(void *dev, const struct rnt_transport *transport, const struct rnt_adap_info *info);
+void *rnt_trace_openReplay(const char *path);
+
 #endif
@@ -0,0 +1,967 @@
+/*	gcn64ctl : raphnet adapter management tools
+	Copyright (C) 2007-2018  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include "rnt_sim.h"
+#include "rnt_priv.h"
+#include "requests.h"
+#include "gcn64_protocol.h"
+#include "mempak_gcn64usb.h"
+#include "timer.h"
+
+#define SIM_VERSION_STR		"3.6.1"
+#define SIM_REPORT_SIZE		63
+
+#define SIM_PAK_SIZE		0x8000
+#define SIM_GB_ROM_SIZE		(256 * 1024)
+#define SIM_GB_RAM_SIZE		(32 * 1024)
+#define SIM_PSX_MC_SIZE		0x20000
+#define SIM_PSX_SECTOR_SIZE	128
+#define SIM_WII_EXT_ADDR	0x52
+
+struct sim_gbcart {
+	uint8_t rom[SIM_GB_ROM_SIZE];
+	uint8_t ram[SIM_GB_RAM_SIZE];
+	int rom_bank;
+	int ram_bank;
+	int ram_enabled;
+};
+
+struct sim_xferpak {
+	int powered;
+	uint8_t id_reg; // Last value written at 0x8000, read back like a rumble pak unless powered
+	int bank;
+	int access_mode;
+	struct sim_gbcart cart;
+};
+
+struct sim_psxcard {
+	uint8_t data[SIM_PSX_MC_SIZE];
+	uint8_t flag;
+	int pos; // Position in the current transaction, -1 when the card is not addressed
+	uint8_t cmd;
+	uint8_t msb, lsb;
+	uint8_t chk;
+	uint8_t wbuf[SIM_PSX_SECTOR_SIZE];
+	int corrupt;
+};
+
+struct sim_wiiext {
+	uint8_t regs[256];
+	uint8_t ptr;
+};
+
+struct sim_channel {
+	int device;
+	uint8_t *pak;
+	struct sim_xferpak *xpak;
+	struct sim_psxcard *mc;
+	struct sim_wiiext *ext;
+};
+
+struct sim_adapter {
+	struct rnt_sim_config cfg;
+	struct rnt_adap_caps caps;
+	struct sim_channel chn[RNT_SIM_MAX_CHANNELS];
+	uint32_t rng;
+
+	/* Answer to the last request */
+	unsigned char reply[SIM_REPORT_SIZE];
+	int reply_len;
+	int reply_pending;
+	uint64_t reply_time;
+};
+
+static struct sim_adapter *sim_adapters[RNT_SIM_MAX_ADAPTERS];
+static int sim_n_adapters;
+
+/* xorshift32 */
+static uint32_t sim_random(struct sim_adapter *a)
+{
+	a->rng ^= a->rng << 13;
+	a->rng ^= a->rng >> 17;
+	a->rng ^= a->rng << 5;
+	return a->rng;
+}
+
+static int sim_injectError(struct sim_adapter *a)
+{
+	if (a->cfg.error_rate <= 0)
+		return 0;
+
+	return (sim_random(a) % a->cfg.error_rate) == 0;
+}
+
+/*** Gameboy cartridge (MBC5) ***/
+
+static void sim_gbcart_init(struct sim_gbcart *cart)
+{
+	uint16_t global = 0;
+	uint8_t chk = 0;
+	int i;
+
+	for (i=0; i<SIM_GB_ROM_SIZE; i++) {
+		cart->rom[i] = ((i * 2654435761u) >> 24) ^ (i >> 14);
+	}
+	for (i=0; i<SIM_GB_RAM_SIZE; i++) {
+		cart->ram[i] = i ^ (i >> 8);
+	}
+
+	memset(cart->rom + 0x134, 0, 0x1C);
+	memcpy(cart->rom + 0x134, "RNTSIM", 6);
+	cart->rom[0x147] = 0x1B; // MBC5+RAM+BATTERY
+	cart->rom[0x148] = 0x03; // 256K
+	cart->rom[0x149] = 0x03; // 32K
+	cart->rom[0x14A] = 0x01; // Non-japanese
+	for (i=0x134; i<=0x14C; i++) {
+		chk -= cart->rom[i] + 1;
+	}
+	cart->rom[0x14D] = chk;
+
+	for (i=0; i<SIM_GB_ROM_SIZE; i++) {
+		if (i != 0x14E && i != 0x14F)
+			global += cart->rom[i];
+	}
+	cart->rom[0x14E] = global >> 8;
+	cart->rom[0x14F] = global;
+
+	cart->rom_bank = 1;
+}
+
+static uint8_t sim_gbcart_read(struct sim_gbcart *cart, unsigned int addr)
+{
+	if (addr < 0x4000) {
+		return cart->rom[addr];
+	}
+	if (addr < 0x8000) {
+		return cart->rom[(cart->rom_bank * 0x4000 + addr - 0x4000) % SIM_GB_ROM_SIZE];
+	}
+	if (addr >= 0xA000 && addr < 0xC000 && cart->ram_enabled) {
+		return cart->ram[(cart->ram_bank * 0x2000 + addr - 0xA000) % SIM_GB_RAM_SIZE];
+	}
+	return 0xFF;
+}
+
+static void sim_gbcart_write(struct sim_gbcart *cart, unsigned int addr, uint8_t value)
+{
+	if (addr < 0x2000) {
+		cart->ram_enabled = (value & 0x0F) == 0x0A;
+	} else if (addr < 0x3000) {
+		cart->rom_bank = (cart->rom_bank & 0x100) | value;
+	} else if (addr < 0x4000) {
+		cart->rom_bank = (cart->rom_bank & 0xFF) | ((value & 1) << 8);
+	} else if (addr < 0x6000) {
+		cart->ram_bank = value & 0x0F;
+	} else if (addr >= 0xA000 && addr < 0xC000 && cart->ram_enabled) {
+		cart->ram[(cart->ram_bank * 0x2000 + addr - 0xA000) % SIM_GB_RAM_SIZE] = value;
+	}
+}
+
+/*** N64 accessories (32 byte blocks in pak address space) ***/
+
+static void sim_pak_read(struct sim_channel *c, unsigned int addr, uint8_t dst[32])
+{
+	struct sim_xferpak *x = c->xpak;
+	int i;
+
+	memset(dst, 0, 32);
+
+	if (c->pak) {
+		if (addr < SIM_PAK_SIZE) {
+			memcpy(dst, c->pak + addr, 32);
+		}
+		return;
+	}
+
+	if (!x)
+		return;
+
+	if (addr >= 0x8000 && addr < 0x9000) {
+		memset(dst, x->powered ? 0x84 : x->id_reg, 32);
+	} else if (addr >= 0xA000 && addr < 0xB000) {
+		memset(dst, x->bank, 32);
+	} else if (addr >= 0xB000 && addr < 0xC000) {
+		memset(dst, (x->powered ? 0x80 : 0x00) | (x->access_mode ? 0x01 : 0x00), 32);
+	} else if (addr >= 0xC000 && x->powered && x->access_mode) {
+		for (i=0; i<32; i++) {
+			dst[i] = sim_gbcart_read(&x->cart, x->bank * 0x4000 + addr - 0xC000 + i);
+		}
+	}
+}
+
+static void sim_pak_write(struct sim_channel *c, unsigned int addr, const uint8_t data[32])
+{
+	struct sim_xferpak *x = c->xpak;
+	int i;
+
+	if (c->pak) {
+		if (addr < SIM_PAK_SIZE) {
+			memcpy(c->pak + addr, data, 32);
+		}
+		return;
+	}
+
+	if (!x)
+		return;
+
+	if (addr >= 0x8000 && addr < 0x9000) {
+		if (data[0] == 0x84) {
+			x->powered = 1;
+		} else if (data[0] == 0xFE) {
+			x->powered = 0;
+		}
+		x->id_reg = data[0] == 0xFE ? 0x00 : data[0];
+	} else if (addr >= 0xA000 && addr < 0xB000) {
+		x->bank = data[0] & 3;
+	} else if (addr >= 0xB000 && addr < 0xC000) {
+		x->access_mode = data[0] & 1;
+	} else if (addr >= 0xC000 && x->powered && x->access_mode) {
+		for (i=0; i<32; i++) {
+			sim_gbcart_write(&x->cart, x->bank * 0x4000 + addr - 0xC000 + i, data[i]);
+		}
+	}
+}
+
+/* Returns the number of bytes answered (0 when there is no answer) */
+static int sim_siCommand(struct sim_adapter *a, int chn, const uint8_t *tx, int tx_len, uint8_t *rx)
+{
+	struct sim_channel *c;
+	int has_pak;
+	unsigned int addr;
+
+	if (chn < 0 || chn >= RNT_SIM_MAX_CHANNELS || tx_len < 1)
+		return 0;
+
+	c = &a->chn[chn];
+	switch (c->device)
+	{
+		case RNT_SIM_CONTROLLER:
+		case RNT_SIM_MEMPAK:
+		case RNT_SIM_XFERPAK:
+			break;
+		default:
+			return 0;
+	}
+	has_pak = c->pak || c->xpak;
+
+	switch (tx[0])
+	{
+		case N64_GET_CAPABILITIES:
+		case N64_RESET:
+			rx[0] = 0x05;
+			rx[1] = 0x00;
+			rx[2] = has_pak ? 0x01 : 0x02;
+			return N64_CAPS_REPLY_LENGTH;
+
+		case N64_GET_STATUS:
+			memset(rx, 0, N64_GET_STATUS_REPLY_LENGTH);
+			return N64_GET_STATUS_REPLY_LENGTH;
+
+		case N64_EXPANSION_READ:
+			if (tx_len != 3)
+				return 0;
+			addr = ((tx[1] << 8) | tx[2]) & 0xFFE0;
+			sim_pak_read(c, addr, rx);
+			rx[32] = pak_data_crc(rx, 32);
+			if (!has_pak) {
+				rx[32] ^= 0xFF;
+			}
+			if (sim_injectError(a)) {
+				rx[32] ^= 0x01;
+			}
+			return 33;
+
+		case N64_EXPANSION_WRITE:
+			if (tx_len != 35)
+				return 0;
+			addr = ((tx[1] << 8) | tx[2]) & 0xFFE0;
+			if (has_pak) {
+				sim_pak_write(c, addr, tx + 3);
+			}
+			rx[0] = pak_data_crc(tx + 3, 32);
+			if (!has_pak) {
+				rx[0] ^= 0xFF;
+			}
+			if (sim_injectError(a)) {
+				rx[0] ^= 0x01;
+			}
+			return 1;
+	}
+
+	return 0;
+}
+
+/*** PSX memory card. Emulated one byte (as clocked on the bus) at a time. ***/
+
+static uint8_t sim_psx_byte(struct sim_adapter *a, struct sim_psxcard *mc, uint8_t tx)
+{
+	int pos = mc->pos;
+	int sector, i;
+
+	if (pos < 0) {
+		return 0xFF;
+	}
+	mc->pos++;
+
+	switch (pos)
+	{
+		case 0:
+			if (tx != 0x81) {
+				mc->pos = -1; // Not for a memory card
+			}
+			return 0xFF;
+		case 1:
+			mc->cmd = tx;
+			if (tx != 'R' && tx != 'W') {
+				mc->pos = -1;
+			}
+			return mc->flag;
+		case 2: return 0x5A;
+		case 3: return 0x5D;
+		case 4: mc->msb = tx; return 0x00;
+		case 5: mc->lsb = tx; mc->chk = mc->msb ^ mc->lsb; return mc->msb;
+	}
+
+	sector = (mc->msb << 8) | mc->lsb;
+
+	if (mc->cmd == 'R') {
+		switch (pos)
+		{
+			case 6: return 0x5C;
+			case 7: return 0x5D;
+			case 8:
+				if (sector >= SIM_PSX_MC_SIZE / SIM_PSX_SECTOR_SIZE) {
+					mc->pos = -1;
+					return 0xFF;
+				}
+				mc->corrupt = sim_injectError(a);
+				return mc->msb;
+			case 9: return mc->lsb;
+			case 138: return mc->corrupt ? ~mc->chk : mc->chk;
+			case 139: return 0x47;
+		}
+		if (pos < 138) {
+			uint8_t v = mc->data[sector * SIM_PSX_SECTOR_SIZE + pos - 10];
+			mc->chk ^= v;
+			return v;
+		}
+		mc->pos = -1;
+		return 0xFF;
+	}
+
+	// Write
+	if (pos < 134) {
+		mc->wbuf[pos - 6] = tx;
+		mc->chk ^= tx;
+		return pos == 6 ? mc->lsb : mc->wbuf[pos - 7];
+	}
+	switch (pos)
+	{
+		case 134:
+			mc->corrupt = (tx != mc->chk) || sim_injectError(a);
+			return mc->wbuf[SIM_PSX_SECTOR_SIZE - 1];
+		case 135: return 0x5C;
+		case 136: return 0x5D;
+		case 137:
+			mc->pos = -1;
+			if (sector >= SIM_PSX_MC_SIZE / SIM_PSX_SECTOR_SIZE) {
+				return 0xFF;
+			}
+			if (mc->corrupt) {
+				return 0x4E;
+			}
+			for (i=0; i<SIM_PSX_SECTOR_SIZE; i++) {
+				mc->data[sector * SIM_PSX_SECTOR_SIZE + i] = mc->wbuf[i];
+			}
+			mc->flag = 0x00;
+			return 0x47;
+	}
+
+	return 0xFF;
+}
+
+/*** Wiimote extension (I2C) ***/
+
+static void sim_wiiext_init(struct sim_wiiext *ext)
+{
+	static const uint8_t classic_id[6] = { 0x00, 0x00, 0xA4, 0x20, 0x01, 0x01 };
+	static const uint8_t classic_idle[6] = { 0x5F, 0xDF, 0x8F, 0x00, 0xFF, 0xFF };
+
+	memcpy(ext->regs, classic_idle, sizeof(classic_idle));
+	memcpy(ext->regs + 0xFA, classic_id, sizeof(classic_id));
+}
+
+/* Returns 0 on success (ACK), non-zero otherwise */
+static int sim_i2c(struct sim_adapter *a, int chn, int addr, const uint8_t *wr, int wr_len, uint8_t *rd, int rd_len)
+{
+	struct sim_wiiext *ext;
+	int i;
+
+	if (chn < 0 || chn >= RNT_SIM_MAX_CHANNELS)
+		return 1;
+
+	ext = a->chn[chn].ext;
+	if (!ext || addr != SIM_WII_EXT_ADDR || sim_injectError(a))
+		return 1;
+
+	if (wr_len > 0) {
+		ext->ptr = wr[0];
+		for (i=1; i<wr_len; i++) {
+			ext->regs[ext->ptr++] = wr[i];
+		}
+	}
+
+	for (i=0; i<rd_len; i++) {
+		rd[i] = ext->regs[ext->ptr++];
+	}
+
+	return 0;
+}
+
+/*** Requests ***/
+
+static int sim_supportedRequests(struct sim_adapter *a, uint8_t *dst)
+{
+	static const uint8_t common[] = {
+		RQ_RNT_ECHO, RQ_RNT_SET_CONFIG_PARAM, RQ_RNT_GET_CONFIG_PARAM, RQ_RNT_SUSPEND_POLLING,
+		RQ_RNT_GET_VERSION, RQ_RNT_GET_SIGNATURE, RQ_RNT_GET_CONTROLLER_TYPE, RQ_RNT_SET_VIBRATION,
+		RQ_RNT_GET_SUPPORTED_REQUESTS, RQ_RNT_GET_SUPPORTED_MODES, RQ_RNT_GET_SUPPORTED_CFG_PARAMS,
+		RQ_RNT_RESET_FIRMWARE, RQ_RNT_JUMP_TO_BOOTLOADER,
+	};
+	int n = sizeof(common);
+
+	memcpy(dst, common, n);
+	if (a->caps.ports & RNTF_PORT_PSX) {
+		dst[n++] = RQ_PSX_RAW;
+	} else {
+		dst[n++] = RQ_GCN64_RAW_SI_COMMAND;
+		if (a->caps.features & RNTF_BLOCK_IO) {
+			dst[n++] = RQ_GCN64_BLOCK_IO;
+		}
+	}
+
+	return n;
+}
+
+static int sim_controllerType(struct sim_adapter *a, int chn)
+{
+	if (chn < 0 || chn >= RNT_SIM_MAX_CHANNELS)
+		return CTL_TYPE_NONE;
+
+	switch (a->chn[chn].device)
+	{
+		case RNT_SIM_CONTROLLER:
+		case RNT_SIM_MEMPAK:
+		case RNT_SIM_XFERPAK:
+			return CTL_TYPE_N64;
+		case RNT_SIM_WII_EXT:
+			return CTL_TYPE_CLASSIC;
+	}
+
+	return CTL_TYPE_NONE;
+}
+
+static int sim_blockIO(struct sim_adapter *a, const uint8_t *cmd, int cmdlen, uint8_t *reply)
+{
+	int p, q, chn, tx_len, rx_len, n;
+	uint8_t rx[64];
+
+	// See gcn64lib_blockIO() for the format
+	memset(reply, 0xff, SIM_REPORT_SIZE);
+	reply[0] = RQ_GCN64_BLOCK_IO;
+
+	for (p=1, q=1; p + 3 <= cmdlen && cmd[p] != 0xff; ) {
+		chn = cmd[p];
+		tx_len = cmd[p+1] & 0x3F;
+		rx_len = cmd[p+2] & 0x3F;
+		if (p + 3 + tx_len > cmdlen || q + 1 + rx_len > SIM_REPORT_SIZE)
+			break;
+
+		n = sim_siCommand(a, chn, cmd + p + 3, tx_len, rx);
+		if (n == 0) {
+			reply[q] = rx_len | 0x80; // Timeout
+		} else if (n < rx_len) {
+			reply[q] = n | 0x40; // Partial
+		} else {
+			reply[q] = rx_len;
+		}
+		memcpy(reply + q + 1, rx, n < rx_len ? n : rx_len);
+
+		q += 1 + rx_len;
+		p += 3 + tx_len;
+	}
+
+	return SIM_REPORT_SIZE;
+}
+
+static int sim_psxRaw(struct sim_adapter *a, const uint8_t *cmd, int cmdlen, uint8_t *reply)
+{
+	int chn, flags, tx_len, max_rx, n_bytes, i;
+	struct sim_psxcard *mc;
+
+	if (cmdlen < 4)
+		return 1;
+
+	chn = cmd[1] & 0x0F;
+	flags = cmd[1] >> 4;
+	tx_len = cmd[2];
+	max_rx = cmd[3];
+	if (tx_len > cmdlen - 4)
+		tx_len = cmdlen - 4;
+	if (max_rx > SIM_REPORT_SIZE - 2)
+		max_rx = SIM_REPORT_SIZE - 2;
+
+	reply[0] = RQ_PSX_RAW;
+	mc = chn < RNT_SIM_MAX_CHANNELS ? a->chn[chn].mc : NULL;
+	if (!mc) {
+		memset(reply + 2, 0xFF, max_rx);
+		reply[1] = max_rx;
+		return 2 + max_rx;
+	}
+
+	n_bytes = tx_len > max_rx ? tx_len : max_rx;
+	for (i=0; i<n_bytes; i++) {
+		uint8_t rx = sim_psx_byte(a, mc, i < tx_len ? cmd[4 + i] : 0x00);
+		if (i < max_rx) {
+			reply[2 + i] = rx;
+		}
+	}
+	reply[1] = max_rx;
+
+	if (!(flags & FLG_NO_DESELECT)) {
+		mc->pos = 0;
+	}
+
+	return 2 + max_rx;
+}
+
+static int sim_i2cTransactions(struct sim_adapter *a, const uint8_t *cmd, int cmdlen, uint8_t *reply)
+{
+	int p, q, chn, addr, wr_len, rd_len;
+	uint8_t rd[64];
+
+	// See wusbmote_i2c_transactions() for the format
+	memset(reply, 0, SIM_REPORT_SIZE);
+	reply[0] = RQ_WUSBMOTE_I2C_TRANSACTIONS;
+
+	for (p=1, q=1; p + 4 <= cmdlen; ) {
+		chn = cmd[p];
+		addr = cmd[p+1];
+		wr_len = cmd[p+2];
+		rd_len = cmd[p+3];
+		if (!chn && !addr && !wr_len && !rd_len)
+			break;
+		if (p + 4 + wr_len > cmdlen || rd_len > sizeof(rd))
+			break;
+
+		if (sim_i2c(a, chn, addr, cmd + p + 4, wr_len, rd, rd_len)) {
+			if (q + 1 > SIM_REPORT_SIZE)
+				break;
+			reply[q++] = 1;
+		} else {
+			if (q + 2 + rd_len > SIM_REPORT_SIZE)
+				break;
+			reply[q++] = 0;
+			reply[q++] = rd_len;
+			memcpy(reply + q, rd, rd_len);
+			q += rd_len;
+		}
+		p += 4 + wr_len;
+	}
+
+	return SIM_REPORT_SIZE;
+}
+
+static int sim_request(struct sim_adapter *a, const uint8_t *cmd, int cmdlen, uint8_t *reply)
+{
+	int n;
+
+	if (cmdlen < 1)
+		return 0;
+
+	reply[0] = cmd[0];
+
+	switch (cmd[0])
+	{
+		case RQ_RNT_GET_VERSION:
+			strcpy((char*)reply + 1, SIM_VERSION_STR);
+			return 2 + strlen(SIM_VERSION_STR);
+
+		case RQ_RNT_GET_SIGNATURE:
+			reply[1] = 0;
+			return 2;
+
+		case RQ_RNT_GET_SUPPORTED_REQUESTS:
+			return 1 + sim_supportedRequests(a, reply + 1);
+
+		case RQ_RNT_GET_SUPPORTED_MODES:
+		case RQ_RNT_GET_SUPPORTED_CFG_PARAMS:
+		case RQ_RNT_GET_SUPPORTED_MAPPINGS:
+			return 1;
+
+		case RQ_RNT_GET_CONFIG_PARAM:
+			reply[1] = cmdlen > 1 ? cmd[1] : 0;
+			reply[2] = 0;
+			return 3;
+
+		case RQ_RNT_GET_CONTROLLER_TYPE:
+			reply[1] = cmdlen > 1 ? cmd[1] : 0;
+			reply[2] = sim_controllerType(a, reply[1]);
+			return 3;
+
+		case RQ_GCN64_RAW_SI_COMMAND:
+			if (cmdlen < 3 || cmd[2] > cmdlen - 3)
+				return 1;
+			reply[1] = cmd[1];
+			n = sim_siCommand(a, cmd[1], cmd + 3, cmd[2], reply + 3);
+			reply[2] = n;
+			return SIM_REPORT_SIZE;
+
+		case RQ_GCN64_BLOCK_IO:
+			return sim_blockIO(a, cmd, cmdlen, reply);
+
+		case RQ_PSX_RAW:
+			return sim_psxRaw(a, cmd, cmdlen, reply);
+
+		case RQ_WUSBMOTE_I2C_TRANSACTIONS:
+			return sim_i2cTransactions(a, cmd, cmdlen, reply);
+	}
+
+	// Echo (including RQ_RNT_ECHO)
+	n = cmdlen < SIM_REPORT_SIZE ? cmdlen : SIM_REPORT_SIZE;
+	memcpy(reply, cmd, n);
+
+	return n;
+}
+
+/*** Transport ***/
+
+static int sim_send_feature_report(void *dev, const unsigned char *data, size_t length)
+{
+	struct sim_adapter *a = dev;
+	uint64_t delay = a->cfg.latency_us;
+
+	if (length < 1)
+		return -1;
+
+	// data[0] is the report ID
+	a->reply_len = sim_request(a, data + 1, length - 1, a->reply);
+	a->reply_pending = 1;
+
+	if (a->cfg.jitter_us > 0) {
+		delay += sim_random(a) % (a->cfg.jitter_us + 1);
+	}
+	a->reply_time = getMicroseconds() + delay;
+
+	return length;
+}
+
+static int sim_get_feature_report(void *dev, unsigned char *data, size_t length)
+{
+	struct sim_adapter *a = dev;
+	int n;
+
+	if (length < 1)
+		return -1;
+
+	// Nothing to read yet
+	if (!a->reply_pending || getMicroseconds() < a->reply_time)
+		return 0;
+
+	n = a->reply_len;
+	if (n > length - 1) {
+		n = length - 1;
+	}
+	memcpy(data + 1, a->reply, n);
+	a->reply_pending = 0;
+
+	return n + 1;
+}
+
+static const wchar_t *sim_error(void *dev)
+{
+	return L"simulated adapter error";
+}
+
+static void sim_close(void *dev)
+{
+	struct sim_adapter *a = dev;
+	int i;
+
+	a->reply_pending = 0;
+	for (i=0; i<RNT_SIM_MAX_CHANNELS; i++) {
+		if (a->chn[i].mc) {
+			a->chn[i].mc->pos = 0;
+		}
+	}
+}
+
+const struct rnt_transport rnt_sim_transport = {
+	.send_feature_report = sim_send_feature_report,
+	.get_feature_report = sim_get_feature_report,
+	.error = sim_error,
+	.close = sim_close,
+};
+
+/*** Adapter management ***/
+
+static void sim_freeAdapter(struct sim_adapter *a)
+{
+	int i;
+
+	for (i=0; i<RNT_SIM_MAX_CHANNELS; i++) {
+		free(a->chn[i].pak);
+		free(a->chn[i].xpak);
+		free(a->chn[i].mc);
+		free(a->chn[i].ext);
+	}
+	free(a);
+}
+
+static int sim_initChannel(struct sim_channel *c, int device)
+{
+	int i;
+
+	c->device = device;
+
+	switch (device)
+	{
+		case RNT_SIM_NONE:
+		case RNT_SIM_CONTROLLER:
+			return 0;
+
+		case RNT_SIM_MEMPAK:
+			c->pak = malloc(SIM_PAK_SIZE);
+			if (!c->pak)
+				return -1;
+			for (i=0; i<SIM_PAK_SIZE; i++) {
+				c->pak[i] = (i * 31) ^ (i >> 7);
+			}
+			return 0;
+
+		case RNT_SIM_XFERPAK:
+			c->xpak = calloc(1, sizeof(struct sim_xferpak));
+			if (!c->xpak)
+				return -1;
+			sim_gbcart_init(&c->xpak->cart);
+			return 0;
+
+		case RNT_SIM_PSX_MC:
+			c->mc = calloc(1, sizeof(struct sim_psxcard));
+			if (!c->mc)
+				return -1;
+			for (i=0; i<SIM_PSX_MC_SIZE; i++) {
+				c->mc->data[i] = (i * 31) ^ (i >> 7);
+			}
+			c->mc->flag = 0x08;
+			return 0;
+
+		case RNT_SIM_WII_EXT:
+			c->ext = calloc(1, sizeof(struct sim_wiiext));
+			if (!c->ext)
+				return -1;
+			sim_wiiext_init(c->ext);
+			return 0;
+	}
+
+	return -1;
+}
+
+int rnt_sim_addAdapter(const struct rnt_sim_config *cfg)
+{
+	struct sim_adapter *a;
+	int i;
+
+	if (!cfg)
+		return -1;
+
+	if (sim_n_adapters >= RNT_SIM_MAX_ADAPTERS) {
+		fprintf(stderr, "Too many simulated adapters\n");
+		return -1;
+	}
+
+	a = calloc(1, sizeof(struct sim_adapter));
+	if (!a) {
+		perror("calloc");
+		return -1;
+	}
+
+	memcpy(&a->cfg, cfg, sizeof(struct rnt_sim_config));
+	if (rnt_lookupCaps(cfg->usb_pid, &a->caps)) {
+		fprintf(stderr, "Cannot simulate adapter with unknown product ID 0x%04x\n", cfg->usb_pid);
+		free(a);
+		return -1;
+	}
+
+	for (i=0; i<RNT_SIM_MAX_CHANNELS; i++) {
+		if (sim_initChannel(&a->chn[i], cfg->devices[i])) {
+			fprintf(stderr, "Could not initialize simulated device on channel %d\n", i);
+			sim_freeAdapter(a);
+			return -1;
+		}
+	}
+
+	a->rng = cfg->seed ? cfg->seed : 1;
+
+	sim_adapters[sim_n_adapters] = a;
+	return sim_n_adapters++;
+}
+
+void rnt_sim_removeAll(void)
+{
+	int i;
+
+	for (i=0; i<sim_n_adapters; i++) {
+		sim_freeAdapter(sim_adapters[i]);
+		sim_adapters[i] = NULL;
+	}
+	sim_n_adapters = 0;
+}
+
+int rnt_sim_count(void)
+{
+	return sim_n_adapters;
+}
+
+int rnt_sim_getInfo(int index, struct rnt_adap_info *info)
+{
+	char buf[64];
+
+	if (index < 0 || index >= sim_n_adapters)
+		return -1;
+
+	memset(info, 0, sizeof(struct rnt_adap_info));
+	info->usb_vid = OUR_VENDOR_ID;
+	info->usb_pid = sim_adapters[index]->cfg.usb_pid;
+	info->access = 1;
+	info->version_major = 3;
+	info->version_minor = 6;
+	memcpy(&info->caps, &sim_adapters[index]->caps, sizeof(struct rnt_adap_caps));
+
+	snprintf(buf, sizeof(buf), "Simulated adapter (%04x)", info->usb_pid);
+	mbstowcs(info->str_prodname, buf, PRODNAME_MAXCHARS-1);
+	snprintf(buf, sizeof(buf), "SIM%d", index);
+	mbstowcs(info->str_serial, buf, SERIAL_MAXCHARS-1);
+	snprintf(info->str_path, PATH_MAXCHARS, "%s%d", RNT_SIM_PATH_PREFIX, index);
+
+	return 0;
+}
+
+void *rnt_sim_open(const char *path)
+{
+	int index;
+
+	if (strncmp(path, RNT_SIM_PATH_PREFIX, strlen(RNT_SIM_PATH_PREFIX)))
+		return NULL;
+
+	index = atoi(path + strlen(RNT_SIM_PATH_PREFIX));
+	if (index < 0 || index >= sim_n_adapters)
+		return NULL;
+
+	return sim_adapters[index];
+}
+
+static const struct {
+	const char *name;
+	int device;
+	uint16_t default_pid;
+} sim_device_names[] = {
+	{ "none", RNT_SIM_NONE, 0x0060 },
+	{ "controller", RNT_SIM_CONTROLLER, 0x0060 },
+	{ "mempak", RNT_SIM_MEMPAK, 0x0060 },
+	{ "xferpak", RNT_SIM_XFERPAK, 0x0060 },
+	{ "psx_mc", RNT_SIM_PSX_MC, 0x0044 },
+	{ "wii_ext", RNT_SIM_WII_EXT, 0x0028 },
+	{ }
+};
+
+int rnt_sim_parseConfig(const char *spec, struct rnt_sim_config *cfg)
+{
+	char buf[256];
+	char *tok, *next, *value;
+	int i, chn;
+
+	if (!spec || !cfg)
+		return -1;
+
+	memset(cfg, 0, sizeof(struct rnt_sim_config));
+	cfg->devices[0] = RNT_SIM_MEMPAK;
+
+	if (strlen(spec) >= sizeof(buf)) {
+		fprintf(stderr, "Simulated adapter description too long\n");
+		return -1;
+	}
+	strcpy(buf, spec);
+
+	for (tok = buf; tok; tok = next) {
+		next = strchr(tok, ',');
+		if (next) {
+			*next = 0;
+			next++;
+		}
+
+		value = strchr(tok, '=');
+		if (!value) {
+			fprintf(stderr, "Invalid simulated adapter parameter '%s'\n", tok);
+			return -1;
+		}
+		*value = 0;
+		value++;
+
+		if (0 == strcmp(tok, "pid")) {
+			cfg->usb_pid = strtol(value, NULL, 0);
+		} else if (0 == strcmp(tok, "latency")) {
+			cfg->latency_us = atoi(value);
+		} else if (0 == strcmp(tok, "jitter")) {
+			cfg->jitter_us = atoi(value);
+		} else if (0 == strcmp(tok, "errors")) {
+			cfg->error_rate = atoi(value);
+		} else if (0 == strcmp(tok, "seed")) {
+			cfg->seed = strtoul(value, NULL, 0);
+		} else if (1 == sscanf(tok, "ch%d", &chn) && chn >= 0 && chn < RNT_SIM_MAX_CHANNELS) {
+			for (i=0; sim_device_names[i].name; i++) {
+				if (0 == strcmp(value, sim_device_names[i].name))
+					break;
+			}
+			if (!sim_device_names[i].name) {
+				fprintf(stderr, "Unknown simulated device '%s'\n", value);
+				return -1;
+			}
+			cfg->devices[chn] = sim_device_names[i].device;
+		} else {
+			fprintf(stderr, "Unknown simulated adapter parameter '%s'\n", tok);
+			return -1;
+		}
+	}
+
+	if (cfg->latency_us < 0 || cfg->jitter_us < 0 || cfg->error_rate < 0) {
+		fprintf(stderr, "Invalid simulated adapter timing or error rate\n");
+		return -1;
+	}
+
+	if (!cfg->usb_pid) {
+		for (i=0; sim_device_names[i].name; i++) {
+			if (sim_device_names[i].device == cfg->devices[0]) {
+				cfg->usb_pid = sim_device_names[i].default_pid;
+			}
+		}
+	}
+
+	return 0;
+}
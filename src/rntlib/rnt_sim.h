@@ -0,0 +1,61 @@
+#ifndef _rnt_sim_h__
+#define _rnt_sim_h__
+
+#include <stdint.h>
+
+/* Simulated adapters: Software adapters emulating the feature report protocol,
+ * listed and opened like real adapters. Used to test and benchmark without
+ * hardware. */
+
+#define RNT_SIM_MAX_ADAPTERS	8
+#define RNT_SIM_MAX_CHANNELS	4
+
+/* What is connected to a channel */
+#define RNT_SIM_NONE			0 // Nothing. SI commands get no answer.
+#define RNT_SIM_CONTROLLER		1 // N64 controller without accessory
+#define RNT_SIM_MEMPAK			2 // N64 controller with a mempak
+#define RNT_SIM_XFERPAK			3 // N64 controller with a transfer pak and an MBC5 gameboy cartridge
+#define RNT_SIM_PSX_MC			4 // PSX memory card
+#define RNT_SIM_WII_EXT			5 // Wiimote extension (classic controller)
+
+struct rnt_sim_config {
+	/** The adapter to emulate. Capabilities are the ones of the real adapter. */
+	uint16_t usb_pid;
+	int devices[RNT_SIM_MAX_CHANNELS];
+	/** Time before the answer to a request can be read */
+	int latency_us;
+	/** Random extra time (0 to jitter_us) added to latency */
+	int jitter_us;
+	/** Corrupt one in error_rate transfers (0 for none) */
+	int error_rate;
+	/** Random number generator seed, for reproducible jitter and errors */
+	uint32_t seed;
+};
+
+/**
+ * \brief Parse a simulated adapter description
+ *
+ * The description is a comma separated list of key=value pairs:
+ *
+ *   pid=0x0060,ch0=mempak,ch1=xferpak,latency=500,jitter=200,errors=1000,seed=1
+ *
+ * Devices are none, controller, mempak, xferpak, psx_mc and wii_ext. When the
+ * pid is not specified, an adapter matching the device on channel 0 is used.
+ *
+ * \return 0 on success
+ */
+int rnt_sim_parseConfig(const char *spec, struct rnt_sim_config *cfg);
+
+/**
+ * \brief Add a simulated adapter
+ *
+ * Simulated adapters are listed before real adapters by rnt_listDevices(), with
+ * serial numbers SIM0, SIM1, etc. Their memory (mempaks, cartridge, memory cards)
+ * persists until rnt_sim_removeAll() or rnt_shutdown().
+ *
+ * \return The index of the adapter, or a negative value on error
+ */
+int rnt_sim_addAdapter(const struct rnt_sim_config *cfg);
+void rnt_sim_removeAll(void);
+
+#endif // _rnt_sim_h__
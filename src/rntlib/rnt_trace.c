@@ -0,0 +1,584 @@
+/*	gcn64ctl : raphnet adapter management tools
+	Copyright (C) 2007-2018  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <pthread.h>
+#include "rnt_trace.h"
+#include "rnt_priv.h"
+#include "timer.h"
+
+/* Trace file format (little endian):
+ *
+ * Header:
+ *   "RNTTRC01", vid (16 bit), pid (16 bit), version major, version minor,
+ *   serial length, serial (UTF-8), product name length, product name (UTF-8)
+ *
+ * Then one record per feature report:
+ *   kind, time since previous record in ns (varint), length (varint), data
+ *
+ * For TRACE_SEND records, the data is what was sent. For TRACE_GET records,
+ * the length is the value returned by get_feature_report (0 when the answer
+ * was not ready) and the data is the answer. TRACE_ERROR is set in kind when
+ * the transport returned an error.
+ */
+#define TRACE_MAGIC			"RNTTRC01"
+#define TRACE_SEND			0x01
+#define TRACE_GET			0x02
+#define TRACE_KIND_MASK		0x0f
+#define TRACE_ERROR			0x80
+
+// Records are written to the file each time this fills
+#define TRACE_BUFSIZE		65536
+#define TRACE_MAX_RECORD	(1 + 10 + 5 + 256)
+
+/* Adapters may be opened and closed from several threads */
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static char record_filename[PATH_MAXCHARS];
+static int recording;
+static int replay_mode = RNT_TRACE_REPLAY_TIMED;
+
+struct trace_recorder {
+	char filename[PATH_MAXCHARS];
+	void *dev;
+	const struct rnt_transport *transport;
+	FILE *fptr;
+	uint64_t last_ns;
+	int write_failed;
+	int buf_used;
+	unsigned char buf[TRACE_BUFSIZE];
+};
+
+struct trace_replay {
+	unsigned char *data;
+	long size;
+	long pos;
+	int timed;
+
+	// Time of the last request, replayed and recorded
+	uint64_t sent_ns, sent_rec_ns;
+	// Recorded time of the record at pos
+	uint64_t rec_ns;
+
+	uint64_t start_ns, recorded_duration_ns;
+	int n_requests, n_differ;
+	int ended;
+};
+
+static int putVarint(unsigned char *dst, uint64_t v)
+{
+	int n = 0;
+
+	while (v >= 0x80) {
+		dst[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	dst[n++] = v;
+
+	return n;
+}
+
+static int getVarint(const unsigned char *src, long avail, uint64_t *v)
+{
+	int n = 0, shift = 0;
+
+	*v = 0;
+	while (n < avail && shift < 64) {
+		*v |= (uint64_t)(src[n] & 0x7f) << shift;
+		if (!(src[n++] & 0x80)) {
+			return n;
+		}
+		shift += 7;
+	}
+
+	return -1;
+}
+
+int rnt_trace_setRecordFile(const char *filename)
+{
+	if (filename && strlen(filename) >= sizeof(record_filename)) {
+		fprintf(stderr, "Trace file name too long\n");
+		return -1;
+	}
+
+	pthread_mutex_lock(&record_lock);
+	if (!filename) {
+		record_filename[0] = 0;
+	} else {
+		strcpy(record_filename, filename);
+	}
+	pthread_mutex_unlock(&record_lock);
+
+	return 0;
+}
+
+void rnt_trace_setReplayMode(int mode)
+{
+	replay_mode = mode;
+}
+
+/*** Recording ***/
+
+static void trace_flush(struct trace_recorder *rec)
+{
+	if (rec->buf_used && !rec->write_failed) {
+		if (1 != fwrite(rec->buf, rec->buf_used, 1, rec->fptr)) {
+			perror(rec->filename);
+			rec->write_failed = 1;
+		}
+	}
+	rec->buf_used = 0;
+}
+
+static void trace_record(struct trace_recorder *rec, int kind, const unsigned char *data, int len)
+{
+	uint64_t now = getNanoseconds();
+	unsigned char *p;
+
+	if (len < 0) {
+		kind |= TRACE_ERROR;
+		len = 0;
+	}
+	if (len > TRACE_MAX_RECORD - 16) {
+		len = TRACE_MAX_RECORD - 16;
+	}
+
+	if (rec->buf_used + TRACE_MAX_RECORD > TRACE_BUFSIZE) {
+		trace_flush(rec);
+	}
+
+	p = rec->buf + rec->buf_used;
+	*p++ = kind;
+	p += putVarint(p, now - rec->last_ns);
+	p += putVarint(p, len);
+	memcpy(p, data, len);
+	p += len;
+
+	rec->buf_used = p - rec->buf;
+	rec->last_ns = now;
+}
+
+static int trace_send_feature_report(void *dev, const unsigned char *data, size_t length)
+{
+	struct trace_recorder *rec = dev;
+	int res;
+
+	res = rec->transport->send_feature_report(rec->dev, data, length);
+	trace_record(rec, TRACE_SEND, data, res < 0 ? -1 : length);
+
+	return res;
+}
+
+static int trace_get_feature_report(void *dev, unsigned char *data, size_t length)
+{
+	struct trace_recorder *rec = dev;
+	int res;
+
+	res = rec->transport->get_feature_report(rec->dev, data, length);
+	trace_record(rec, TRACE_GET, data, res);
+
+	return res;
+}
+
+static const wchar_t *trace_error(void *dev)
+{
+	struct trace_recorder *rec = dev;
+
+	return rec->transport->error(rec->dev);
+}
+
+static void trace_close(void *dev)
+{
+	struct trace_recorder *rec = dev;
+
+	trace_flush(rec);
+	if (fclose(rec->fptr)) {
+		perror(rec->filename);
+	}
+	rec->transport->close(rec->dev);
+	free(rec);
+
+	pthread_mutex_lock(&record_lock);
+	recording = 0;
+	pthread_mutex_unlock(&record_lock);
+}
+
+const struct rnt_transport rnt_trace_record_transport = {
+	.send_feature_report = trace_send_feature_report,
+	.get_feature_report = trace_get_feature_report,
+	.error = trace_error,
+	.close = trace_close,
+};
+
+static int trace_putString(unsigned char *dst, const wchar_t *str)
+{
+	char buf[256];
+	size_t n;
+
+	n = wcstombs(buf, str, sizeof(buf) - 1);
+	if (n == (size_t)-1) {
+		n = 0;
+	}
+	dst[0] = n;
+	memcpy(dst + 1, buf, n);
+
+	return 1 + n;
+}
+
+void *rnt_trace_startRecording(void *dev, const struct rnt_transport *transport, const struct rnt_adap_info *info)
+{
+	struct trace_recorder *rec;
+	unsigned char *p;
+
+	pthread_mutex_lock(&record_lock);
+
+	if (!record_filename[0]) {
+		pthread_mutex_unlock(&record_lock);
+		return NULL;
+	}
+
+	if (recording) {
+		pthread_mutex_unlock(&record_lock);
+		fprintf(stderr, "Warning: A session is already being recorded. %ls will not be traced.\n", info->str_serial);
+		return NULL;
+	}
+
+	rec = calloc(1, sizeof(struct trace_recorder));
+	if (!rec) {
+		pthread_mutex_unlock(&record_lock);
+		perror("calloc");
+		return NULL;
+	}
+	strcpy(rec->filename, record_filename);
+
+	rec->fptr = fopen(rec->filename, "wb");
+	if (!rec->fptr) {
+		pthread_mutex_unlock(&record_lock);
+		perror(rec->filename);
+		free(rec);
+		return NULL;
+	}
+	recording = 1;
+
+	pthread_mutex_unlock(&record_lock);
+
+	rec->dev = dev;
+	rec->transport = transport;
+
+	p = rec->buf;
+	memcpy(p, TRACE_MAGIC, 8);
+	p += 8;
+	*p++ = info->usb_vid;
+	*p++ = info->usb_vid >> 8;
+	*p++ = info->usb_pid;
+	*p++ = info->usb_pid >> 8;
+	*p++ = info->version_major;
+	*p++ = info->version_minor;
+	p += trace_putString(p, info->str_serial);
+	p += trace_putString(p, info->str_prodname);
+	rec->buf_used = p - rec->buf;
+
+	rec->last_ns = getNanoseconds();
+
+	return rec;
+}
+
+/*** Replay ***/
+
+/* Read the header. Returns its size, or -1 if the file is not a trace */
+static int trace_parseHeader(const unsigned char *data, long size, struct rnt_adap_info *info)
+{
+	char buf[256];
+	long p;
+
+	if (size < 16 || memcmp(data, TRACE_MAGIC, 8)) {
+		return -1;
+	}
+
+	info->usb_vid = data[8] | data[9] << 8;
+	info->usb_pid = data[10] | data[11] << 8;
+	info->version_major = data[12];
+	info->version_minor = data[13];
+	p = 14;
+
+	if (p + 1 + data[p] >= size) {
+		return -1;
+	}
+	memcpy(buf, data + p + 1, data[p]);
+	buf[data[p]] = 0;
+	mbstowcs(info->str_serial, buf, SERIAL_MAXCHARS - 1);
+	p += 1 + data[p];
+
+	if (p + 1 + data[p] > size) {
+		return -1;
+	}
+	memcpy(buf, data + p + 1, data[p]);
+	buf[data[p]] = 0;
+	mbstowcs(info->str_prodname, buf, PRODNAME_MAXCHARS - 1);
+	p += 1 + data[p];
+
+	return p;
+}
+
+static unsigned char *trace_loadFile(const char *filename, long *size)
+{
+	unsigned char *data;
+	FILE *fptr;
+
+	fptr = fopen(filename, "rb");
+	if (!fptr) {
+		perror(filename);
+		return NULL;
+	}
+
+	fseek(fptr, 0, SEEK_END);
+	*size = ftell(fptr);
+	fseek(fptr, 0, SEEK_SET);
+
+	data = malloc(*size > 0 ? *size : 1);
+	if (!data) {
+		perror("malloc");
+		fclose(fptr);
+		return NULL;
+	}
+
+	if (*size > 0 && 1 != fread(data, *size, 1, fptr)) {
+		perror(filename);
+		free(data);
+		fclose(fptr);
+		return NULL;
+	}
+
+	fclose(fptr);
+
+	return data;
+}
+
+/* Decode the record at pos. Returns the position of the next record, or -1 at the end of the trace. */
+static long trace_peek(struct trace_replay *rp, long pos, int *kind, uint64_t *delta_ns, const unsigned char **data, int *len)
+{
+	uint64_t v;
+	int n;
+
+	if (pos >= rp->size) {
+		return -1;
+	}
+
+	*kind = rp->data[pos++];
+
+	n = getVarint(rp->data + pos, rp->size - pos, delta_ns);
+	if (n < 0) {
+		return -1;
+	}
+	pos += n;
+
+	n = getVarint(rp->data + pos, rp->size - pos, &v);
+	if (n < 0 || v > rp->size - pos - n) {
+		return -1;
+	}
+	pos += n;
+
+	*data = rp->data + pos;
+	*len = v;
+
+	return pos + v;
+}
+
+static int replay_send_feature_report(void *dev, const unsigned char *data, size_t length)
+{
+	struct trace_replay *rp = dev;
+	const unsigned char *rec_data;
+	uint64_t delta;
+	int kind, len;
+	long next;
+
+	// Skip polls the recorded session made and the replay did not
+	while ((next = trace_peek(rp, rp->pos, &kind, &delta, &rec_data, &len)) >= 0) {
+		rp->pos = next;
+		rp->rec_ns += delta;
+		if ((kind & TRACE_KIND_MASK) == TRACE_SEND) {
+			break;
+		}
+	}
+
+	if (next < 0) {
+		rp->ended = 1;
+		return -1;
+	}
+
+	rp->n_requests++;
+	if (len != length || memcmp(rec_data, data, len)) {
+		if (!rp->n_differ) {
+			fprintf(stderr, "replay: Request %d differs from the recorded session\n", rp->n_requests);
+		}
+		rp->n_differ++;
+	}
+
+	rp->sent_ns = getNanoseconds();
+	rp->sent_rec_ns = rp->rec_ns;
+
+	if (kind & TRACE_ERROR) {
+		return -1;
+	}
+
+	return length;
+}
+
+static int replay_get_feature_report(void *dev, unsigned char *data, size_t length)
+{
+	struct trace_replay *rp = dev;
+	const unsigned char *rec_data;
+	uint64_t delta, rec_ns = rp->rec_ns;
+	int kind, len;
+	long pos = rp->pos;
+
+	// Find the recorded answer to the last request, skipping empty polls.
+	while ((pos = trace_peek(rp, pos, &kind, &delta, &rec_data, &len)) >= 0) {
+		rec_ns += delta;
+		if ((kind & TRACE_KIND_MASK) != TRACE_GET) {
+			// No answer was received (timeout)
+			return 0;
+		}
+		if (len || (kind & TRACE_ERROR)) {
+			break;
+		}
+	}
+
+	if (pos < 0) {
+		rp->ended = 1;
+		return -1;
+	}
+
+	// Reproduce the recorded delay between the request and its answer
+	if (rp->timed && getNanoseconds() - rp->sent_ns < rec_ns - rp->sent_rec_ns) {
+		return 0;
+	}
+
+	rp->pos = pos;
+	rp->rec_ns = rec_ns;
+
+	if (kind & TRACE_ERROR) {
+		return -1;
+	}
+
+	memcpy(data, rec_data, len < length ? len : length);
+
+	return len;
+}
+
+static const wchar_t *replay_error(void *dev)
+{
+	struct trace_replay *rp = dev;
+
+	return rp->ended ? L"End of recorded session" : L"Error in recorded session";
+}
+
+static void replay_close(void *dev)
+{
+	struct trace_replay *rp = dev;
+
+	printf("Replayed %d requests (%d differed). Recorded session: %.3f ms, replay: %.3f ms\n",
+		rp->n_requests, rp->n_differ,
+		rp->recorded_duration_ns / 1000000.0,
+		(getNanoseconds() - rp->start_ns) / 1000000.0);
+
+	free(rp->data);
+	free(rp);
+}
+
+const struct rnt_transport rnt_trace_replay_transport = {
+	.send_feature_report = replay_send_feature_report,
+	.get_feature_report = replay_get_feature_report,
+	.error = replay_error,
+	.close = replay_close,
+};
+
+int rnt_trace_getReplayInfo(const char *filename, struct rnt_adap_info *info)
+{
+	unsigned char *data;
+	long size;
+	int res;
+
+	if (strlen(filename) + strlen(RNT_TRACE_REPLAY_PREFIX) >= PATH_MAXCHARS) {
+		fprintf(stderr, "Trace file name too long\n");
+		return -1;
+	}
+
+	data = trace_loadFile(filename, &size);
+	if (!data) {
+		return -1;
+	}
+
+	memset(info, 0, sizeof(struct rnt_adap_info));
+	res = trace_parseHeader(data, size, info);
+	free(data);
+
+	if (res < 0) {
+		fprintf(stderr, "%s: Not a trace file\n", filename);
+		return -1;
+	}
+
+	info->access = 1;
+	if (rnt_lookupCaps(info->usb_pid, &info->caps)) {
+		info->caps.n_channels = 1;
+	}
+	snprintf(info->str_path, PATH_MAXCHARS, "%s%s", RNT_TRACE_REPLAY_PREFIX, filename);
+
+	return 0;
+}
+
+void *rnt_trace_openReplay(const char *path)
+{
+	struct trace_replay *rp;
+	struct rnt_adap_info info;
+	const unsigned char *rec_data;
+	uint64_t delta;
+	int kind, len;
+	long pos;
+
+	if (strncmp(path, RNT_TRACE_REPLAY_PREFIX, strlen(RNT_TRACE_REPLAY_PREFIX)))
+		return NULL;
+
+	rp = calloc(1, sizeof(struct trace_replay));
+	if (!rp) {
+		perror("calloc");
+		return NULL;
+	}
+
+	rp->data = trace_loadFile(path + strlen(RNT_TRACE_REPLAY_PREFIX), &rp->size);
+	if (!rp->data) {
+		free(rp);
+		return NULL;
+	}
+
+	rp->pos = trace_parseHeader(rp->data, rp->size, &info);
+	if (rp->pos < 0) {
+		free(rp->data);
+		free(rp);
+		return NULL;
+	}
+
+	for (pos = rp->pos; (pos = trace_peek(rp, pos, &kind, &delta, &rec_data, &len)) >= 0; ) {
+		rp->recorded_duration_ns += delta;
+	}
+
+	rp->timed = replay_mode == RNT_TRACE_REPLAY_TIMED;
+	rp->start_ns = getNanoseconds();
+
+	return rp;
+}
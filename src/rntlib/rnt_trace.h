@@ -0,0 +1,42 @@
+#ifndef _rnt_trace_h__
+#define _rnt_trace_h__
+
+#include "raphnetadapter.h"
+
+/* Session traces: Every feature report exchanged with an adapter, with
+ * nanosecond timestamps, recorded to a compact binary file. A recorded
+ * session can be replayed through the library without the adapter. */
+
+/**
+ * \brief Record the sessions of adapters opened from now on
+ *
+ * Only one session is recorded at a time. Adapters opened while a session
+ * is being recorded are not traced (a warning is displayed). The file is
+ * complete once the adapter is closed.
+ *
+ * \param filename The trace file to create, or NULL to stop tracing new sessions
+ * \return 0 on success
+ */
+int rnt_trace_setRecordFile(const char *filename);
+
+/* How recorded sessions are replayed */
+#define RNT_TRACE_REPLAY_TIMED	0 // Answers become available at their recorded time (default)
+#define RNT_TRACE_REPLAY_FAST	1 // Answers are available right away
+
+void rnt_trace_setReplayMode(int mode);
+
+/**
+ * \brief Prepare the replay of a recorded session
+ *
+ * The information is the one of the recorded adapter. Opening it with
+ * rnt_openDevice() replays the session: The library gets the recorded
+ * answers as long as it sends the recorded requests. A summary is
+ * displayed when the device is closed.
+ *
+ * \param filename The trace file
+ * \param info Adapter information to pass to rnt_openDevice()
+ * \return 0 on success
+ */
+int rnt_trace_getReplayInfo(const char *filename, struct rnt_adap_info *info);
+
+#endif // _rnt_trace_h__
@@ -11,12 +11,40 @@ uint64_t getMilliseconds()
 #ifndef WINDOWS
 	struct timespec time_now;
 	clock_gettime(CLOCK_MONOTONIC, &time_now);
-	return time_now.tv_sec * 1000 + time_now.tv_nsec / 1000 / 1000;
+	return time_now.tv_sec * 1000ULL + time_now.tv_nsec / 1000 / 1000;
 #else
 	return GetTickCount64();
 #endif
 }
 
+uint64_t getMicroseconds()
+{
+#ifndef WINDOWS
+	struct timespec time_now;
+	clock_gettime(CLOCK_MONOTONIC, &time_now);
+	return time_now.tv_sec * 1000000ULL + time_now.tv_nsec / 1000;
+#else
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (count.QuadPart / freq.QuadPart) * 1000000 + (count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#endif
+}
+
+uint64_t getNanoseconds()
+{
+#ifndef WINDOWS
+	struct timespec time_now;
+	clock_gettime(CLOCK_MONOTONIC, &time_now);
+	return time_now.tv_sec * 1000000000ULL + time_now.tv_nsec;
+#else
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (count.QuadPart / freq.QuadPart) * 1000000000ULL + (count.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+#endif
+}
+
 
 #ifdef TEST_TIMER
 #include <stdio.h>
@@ -4,5 +4,7 @@
 #include <stdint.h>
 
 uint64_t getMilliseconds();
+uint64_t getMicroseconds();
+uint64_t getNanoseconds();
 
 #endif // _timer_h__
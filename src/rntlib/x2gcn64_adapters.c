@@ -14,7 +14,6 @@
 	You should have received a copy of the GNU General Public License
 	along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
-#define _GNU_SOURCE // for memmem
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,10 +22,7 @@
 #include "hexdump.h"
 #include "ihex.h"
 #include "delay.h"
-
-#ifdef WINDOWS
-#include "memmem.h"
-#endif
+#include "timer.h"
 
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
@@ -722,31 +718,194 @@ int x2gcn64_adapter_bootApplication(rnt_hdl_t hdl, int channel)
 	return 0;
 }
 
+static void x2gcn64_adapter_buildBlockWrite(unsigned char *buf, int block_id, const unsigned char *data)
+{
+	buf[0] = 'R';
+	buf[1] = 0xf2;
+	buf[2] = block_id >> 8;
+	buf[3] = block_id & 0xff;
+	memcpy(buf + 4, data, 32);
+}
+
+static int x2gcn64_adapter_sendFirmwareBlock(rnt_hdl_t hdl, int channel, int block_id, const unsigned char *data)
+{
+	unsigned char buf[64];
+	int n;
+
+	x2gcn64_adapter_buildBlockWrite(buf, block_id, data);
+
+	n = gcn64lib_rawSiCommand(hdl, channel, buf, 4 + 32, buf, 4);
+	if (n<0) {
+		fprintf(stderr, "\nRaw command failed\n");
+		return n;
+	}
+
+	if (n != 4) {
+		fprintf(stderr, "\nInvalid upload block answer\n");
+		return -1;
+	}
+
+	// [0] ACK (should be 0x00)
+	// [1] Need to poll?
+	// [2] Block ID high
+	// [3] Block ID low
+
+	if (buf[0] != 0x00) {
+		fprintf(stderr, "Busy\n");
+		return -1;
+	}
+
+	if (buf[1]) {
+		if (x2gcn64_adapter_waitNotBusy(hdl, channel, 1)) {
+			fprintf(stderr, "Error waiting not busy\n");
+			return -1;
+		}
+	}
+
+//	printf("\n");
+//	printf("Block ID: 0x%04x\n", (buf[2]<<8) | buf[3]);
+
+	return 0;
+}
+
 // Note: eraseAll needs to be performed first
 int x2gcn64_adapter_sendFirmwareBlocks(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len)
 {
-	unsigned char buf[64];
 	int i, block_id;
 	int n;
 
 	for (i=0; i<len; i+=32) {
 		block_id = i / 32;
-		buf[0] = 'R';
-		buf[1] = 0xf2;
-		buf[2] = block_id >> 8;
-		buf[3] = block_id & 0xff;
-		memcpy(buf + 4, firmware+i, 32);
 
 		printf("Block %d / %d\r", block_id+1, len / 32); fflush(stdout);
 
-		n = gcn64lib_rawSiCommand(hdl, channel, buf, 4 + 32, buf, 4);
+		n = x2gcn64_adapter_sendFirmwareBlock(hdl, channel, block_id, firmware + i);
 		if (n<0) {
-			fprintf(stderr, "\nRaw command failed\n");
 			return n;
 		}
+	}
+
+	return 0;
+}
+
+static int isBlank(const unsigned char *data, int len)
+{
+	int i;
+
+	for (i=0; i<len; i++) {
+		if (data[i] != 0xff)
+			return 0;
+	}
+
+	return 1;
+}
+
+#define MAX_BLOCKS_PER_PAGE	(255 / 32)
+
+static int validPageSize(int page_size, int len)
+{
+	return page_size >= 32 && page_size % 32 == 0 && page_size / 32 <= MAX_BLOCKS_PER_PAGE && len % page_size == 0;
+}
+
+/* Pages written by x2gcn64_adapter_sendFirmwarePages() */
+static int pageIsWritten(const unsigned char *firmware, int addr, int page_size, int len)
+{
+	return addr + page_size >= len || !isBlank(firmware + addr, page_size);
+}
+
+#define PAGE_WRITE_ESTIMATE_MS	5
+#define PAGE_WRITE_MAX_MS		100
+#define PAGE_WRITE_TIMEOUT_MS	5000
+#define PAGE_RETRIES			5
+
+struct fwblock_write {
+	struct blockio_op op;
+	unsigned char cmd[4 + 32];
+	unsigned char answer[4];
+};
+
+struct fwflash {
+	rnt_hdl_t hdl;
+	int channel;
+	gcn64lib_siq *q;
+	uint64_t write_started; // When the last page write started, 0 if none in progress
+	int write_ms; // Page write time estimate
+};
+
+/* Poll the busy status until the page write in progress completes. The polling interval
+ * starts short and grows, and the time measured refines the page write time estimate. */
+static int fwflash_waitIdle(struct fwflash *fl)
+{
+	uint64_t start = getMilliseconds(), now;
+	int busy, interval_ms = 1;
+
+	while ((busy = x2gcn64_adapter_boot_isBusy(fl->hdl, fl->channel))) {
+		if (busy < 0) {
+			return -1;
+		}
+		if (getMilliseconds() - start > PAGE_WRITE_TIMEOUT_MS) {
+			fprintf(stderr, "\nAdapter answer timeout\n");
+			return -1;
+		}
+		_delay_us(interval_ms * 1000);
+		if (interval_ms < 32) {
+			interval_ms *= 2;
+		}
+	}
+
+	if (fl->write_started) {
+		now = getMilliseconds();
+		fl->write_ms = (fl->write_ms * 3 + (int)(now - fl->write_started)) / 4;
+		if (fl->write_ms < 1) {
+			fl->write_ms = 1;
+		}
+		if (fl->write_ms > PAGE_WRITE_MAX_MS) {
+			fl->write_ms = PAGE_WRITE_MAX_MS;
+		}
+		fl->write_started = 0;
+	}
+
+	return 0;
+}
+
+/* Send the blocks of a page in a single burst (block IO when the adapter supports it).
+ *
+ * The page write started by the previous page is not waited for. The burst is sent when
+ * the write is expected to be complete, so its transfer overlaps the end of the write. A
+ * page with blocks refused (or not answered) because the adapter was still busy is sent
+ * again as a whole once the adapter is idle. Rewriting blocks with the same data is
+ * harmless. If the page was programmed before all its blocks were received, what is
+ * left out is caught by the verify step. */
+static int fwflash_sendPage(struct fwflash *fl, const unsigned char *firmware, int addr, int page_size)
+{
+	struct fwblock_write writes[MAX_BLOCKS_PER_PAGE];
+	int i, try, n_blocks = page_size / 32, accepted, flash_write;
+	uint64_t now;
+
+	for (try=0; try<PAGE_RETRIES; try++) {
+		if (fl->write_started) {
+			now = getMilliseconds();
+			if (now < fl->write_started + fl->write_ms) {
+				_delay_us((fl->write_started + fl->write_ms - now) * 1000);
+			}
+		}
 
-		if (n != 4) {
-			fprintf(stderr, "\nInvalid upload block answer\n");
+		for (i=0; i<n_blocks; i++) {
+			struct fwblock_write *w = &writes[i];
+
+			x2gcn64_adapter_buildBlockWrite(w->cmd, addr / 32 + i, firmware + addr + i * 32);
+			w->op.chn = fl->channel;
+			w->op.tx_len = sizeof(w->cmd);
+			w->op.tx_data = w->cmd;
+			w->op.rx_len = sizeof(w->answer);
+			w->op.rx_data = w->answer;
+			if (gcn64lib_siqSubmit(fl->q, &w->op, NULL, NULL)) {
+				gcn64lib_siqFlush(fl->q);
+				return -1;
+			}
+		}
+		if (gcn64lib_siqFlush(fl->q)) {
+			fprintf(stderr, "\nBlock IO failed\n");
 			return -1;
 		}
 
@@ -754,46 +913,285 @@ int x2gcn64_adapter_sendFirmwareBlocks(rnt_hdl_t hdl, int channel, unsigned char
 		// [1] Need to poll?
 		// [2] Block ID high
 		// [3] Block ID low
+		accepted = 1;
+		flash_write = 0;
+		for (i=0; i<n_blocks; i++) {
+			struct fwblock_write *w = &writes[i];
+
+			if (w->op.rx_len != sizeof(w->answer) || w->answer[0] != 0x00) {
+				accepted = 0;
+			} else if (w->answer[1]) {
+				flash_write = 1;
+			}
+		}
+
+		if (accepted) {
+			if (fl->write_started && fl->write_ms > 1) {
+				// The previous write was over in time. Try sending a bit sooner.
+				fl->write_ms -= fl->write_ms / 8 + 1;
+			}
+			fl->write_started = flash_write ? getMilliseconds() : 0;
+			return 0;
+		}
 
-		if (buf[0] != 0x00) {
-			fprintf(stderr, "Busy\n");
+		if (!fl->write_started && !flash_write) {
+			// The adapter was not busy writing a page
+			fprintf(stderr, "\nUpload block refused at address 0x%04x\n", addr);
 			return -1;
 		}
 
-		if (buf[1]) {
-			if (x2gcn64_adapter_waitNotBusy(hdl, channel, 1)) {
-				fprintf(stderr, "Error waiting not busy\n");
-				return -1;
+		if (!fl->write_started) {
+			// A page write started within this burst.
+			fl->write_started = getMilliseconds();
+		}
+		fl->write_ms += fl->write_ms / 2 + 1;
+		if (fwflash_waitIdle(fl)) {
+			return -1;
+		}
+	}
+
+	fprintf(stderr, "\nPage at address 0x%04x refused %d times\n", addr, PAGE_RETRIES);
+	return -1;
+}
+
+/* Note: eraseAll needs to be performed first.
+ *
+ * Same result as x2gcn64_adapter_sendFirmwareBlocks(), but pages left blank (0xFF) are
+ * not sent since the flash is already erased. The bootloader writes a page to flash
+ * when its last block is received, so pages are skipped or written as a whole. The last
+ * page is always written, as it holds the marker placed at the end of the firmware.
+ *
+ * If the page size is not usable, every block is sent.
+ *
+ * Progress is reported through u (stdio if NULL).
+ */
+int x2gcn64_adapter_sendFirmwarePages(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len, int page_size, uiio *u)
+{
+	struct fwflash fl = { .hdl = hdl, .channel = channel, .write_ms = PAGE_WRITE_ESTIMATE_MS };
+	int addr, sparse = 1;
+	int res = 0;
+
+	u = getUIIO(u);
+
+	if (!validPageSize(page_size, len)) {
+		page_size = 32;
+		sparse = 0;
+	}
+
+	fl.q = gcn64lib_siqNew(hdl);
+	if (!fl.q) {
+		return -1;
+	}
+
+	u->cur_progress = 0;
+	u->max_progress = len;
+	u->progress_type = PROGRESS_TYPE_ADDRESS;
+	u->caption = "Writing firmware";
+	u->multi_progress = 1;
+	u->progressStart(u);
+
+	for (addr=0; addr<len; addr+=page_size) {
+		if (sparse && !pageIsWritten(firmware, addr, page_size, len))
+			continue;
+
+		res = fwflash_sendPage(&fl, firmware, addr, page_size);
+		if (res < 0) {
+			break;
+		}
+
+		u->cur_progress = addr + page_size;
+		if (u->update(u)) {
+			if (UIIO_YES == u->ask(UIIO_NOYES, "If you interrupt the update, the adapter will stay in the bootloader until a firmware is installed.\n\nReally stop?")) {
+				res = -1;
+				break;
 			}
 		}
+	}
 
-//		printf("\n");
-//		printf("Block ID: 0x%04x\n", (buf[2]<<8) | buf[3]);
+	// The last page write
+	if (res == 0 && fl.write_started) {
+		res = fwflash_waitIdle(&fl);
 	}
 
-	return 0;
+	gcn64lib_siqFree(fl.q);
+
+	u->progressEnd(u, res ? "Error" : "Done");
+
+	return res;
 }
 
-int x2gcn64_adapter_verifyFirmware(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len)
+#define VERIFY_REGION_SIZE	256
+#define VERIFY_WINDOW		64 // blocks
+
+struct fwblock_read {
+	struct blockio_op op;
+	unsigned char cmd[4];
+};
+
+/* Wait for the reads of the window and check that they all succeeded */
+static int flushReads(gcn64lib_siq *q, struct fwblock_read *reads, int n, const unsigned char *readback)
 {
-	unsigned char buf[32];
-	int i;
+	int i, res = 0;
 
-	for (i=0; i<len; i+=32) {
+	if (gcn64lib_siqFlush(q)) {
+		fprintf(stderr, "\nBlock IO failed\n");
+		return -1;
+	}
 
-		x2gcn64_adapter_boot_readBlock(hdl, channel, i/32, buf);
-		if (memcmp(buf, firmware + i, 32)) {
-			printf("\nMismatch in block address 0x%04x\n", i);
-			printf("Written: "); printHexBuf(firmware + i, 32);
-			printf("   Read: "); printHexBuf(buf, 32);
-			return -1;
+	for (i=0; i<n; i++) {
+		if (reads[i].op.rx_len != 32) {
+			fprintf(stderr, "\nCould not read block address 0x%04x\n", (unsigned int)(reads[i].op.rx_data - readback));
+			res = -1;
+		}
+	}
+
+	return res;
+}
+
+/* Read back the whole flash in bursts of VERIFY_WINDOW blocks (block IO when
+ * the adapter supports it). The blocks are stored at their address in readback. */
+static int readbackRegions(rnt_hdl_t hdl, int channel, unsigned char *readback, int len, int region_size, uiio *u)
+{
+	struct fwblock_read reads[VERIFY_WINDOW];
+	gcn64lib_siq *q;
+	int addr, i, n = 0, done = 0;
+	int res = 0;
+
+	q = gcn64lib_siqNew(hdl);
+	if (!q) {
+		return -1;
+	}
+
+	u->cur_progress = 0;
+	u->max_progress = len;
+	u->progress_type = PROGRESS_TYPE_ADDRESS;
+	u->caption = "Reading back firmware";
+	u->multi_progress = 0;
+	u->progressStart(u);
+
+	for (addr=0; addr<len && res == 0; addr+=region_size) {
+		for (i=addr; i<addr+region_size; i+=32) {
+			struct fwblock_read *r = &reads[n++];
+
+			r->cmd[0] = 'R';
+			r->cmd[1] = 0xf1;
+			r->cmd[2] = (i/32) >> 8;
+			r->cmd[3] = (i/32) & 0xff;
+			r->op.chn = channel;
+			r->op.tx_len = sizeof(r->cmd);
+			r->op.tx_data = r->cmd;
+			r->op.rx_len = 32;
+			r->op.rx_data = readback + i;
+			if (gcn64lib_siqSubmit(q, &r->op, NULL, NULL)) {
+				res = -1;
+				break;
+			}
+
+			if (n == VERIFY_WINDOW) {
+				res = flushReads(q, reads, n, readback);
+				if (res)
+					break;
+				done += n;
+				n = 0;
+				u->cur_progress = done * 32;
+				u->update(u);
+			}
+		}
+	}
+
+	if (res == 0 && n) {
+		res = flushReads(q, reads, n, readback);
+		u->cur_progress = (done + n) * 32;
+		u->update(u);
+	}
+
+	gcn64lib_siqFree(q);
+
+	u->progressEnd(u, res ? "Error" : "Done");
+
+	return res;
+}
+
+static void printMismatchMap(const unsigned char *firmware, const unsigned char *readback, int addr, int size)
+{
+	int i, first = -1;
+
+	printf("\nMismatch in region 0x%04x-0x%04x: ", addr, addr + size - 1);
+	for (i=0; i<size; i+=32) {
+		if (memcmp(firmware + addr + i, readback + addr + i, 32)) {
+			printf("X");
+			if (first < 0)
+				first = addr + i;
 		} else {
-			printf("Block %d / %d ok\r", i/32 + 1, len / 32); fflush(stdout);
+			printf(".");
+		}
+	}
+	printf("\n");
+
+	printf("Written: "); printHexBuf(firmware + first, 32);
+	printf("   Read: "); printHexBuf(readback + first, 32);
+}
+
+/* Read back the flash and compare it with firmware one region (a page, or VERIFY_REGION_SIZE
+ * bytes) at a time. Regions that differ are listed with a map of the blocks that differ.
+ *
+ * \param u Progress is reported through u (stdio if NULL).
+ */
+int x2gcn64_adapter_verifyFirmwarePages(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len, int page_size, uiio *u)
+{
+	unsigned char *readback;
+	int addr, region_size, bad_regions = 0, checked = 0;
+	int res;
+
+	if (len % 32) {
+		return -1;
+	}
+
+	if (validPageSize(page_size, len)) {
+		region_size = page_size;
+	} else {
+		region_size = len % VERIFY_REGION_SIZE ? 32 : VERIFY_REGION_SIZE;
+	}
+
+	u = getUIIO(u);
+
+	readback = malloc(len);
+	if (!readback) {
+		perror("malloc");
+		return -1;
+	}
+
+	res = readbackRegions(hdl, channel, readback, len, region_size, u);
+	if (res < 0) {
+		free(readback);
+		return res;
+	}
+
+	for (addr=0; addr<len; addr+=region_size) {
+		checked++;
+		if (memcmp(firmware + addr, readback + addr, region_size)) {
+			printMismatchMap(firmware, readback, addr, region_size);
+			bad_regions++;
 		}
 	}
+
+	free(readback);
+
+	if (bad_regions) {
+		u->error("%d of %d regions differ\n", bad_regions, checked);
+		return -1;
+	}
+
+	u->printf("%d regions ok\n", checked);
+
 	return 0;
 }
 
+int x2gcn64_adapter_verifyFirmware(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len)
+{
+	return x2gcn64_adapter_verifyFirmwarePages(hdl, channel, firmware, len, 0, NULL);
+}
+
 int x2gcn64_adapter_waitForBootloader(rnt_hdl_t hdl, int channel, int timeout_s)
 {
 	struct x2gcn64_adapter_info inf;
@@ -832,18 +1230,21 @@ const char *x2gcn64_getAdapterSignature(int type)
 
 /**
  * \param signature If NULL, reads adapter info and automatically use the corresponding signature.
+ * \param u Used for messages and progress. If NULL, stdio is used.
  */
-int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfile, const char *signature)
+int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfile, const char *signature, uiio *u)
 {
 	unsigned char *buf;
 	int max_addr;
 	int ret = 0, res;
 	struct x2gcn64_adapter_info inf;
 
+	u = getUIIO(u);
+
 	if (!signature) {
 		res = x2gcn64_adapter_getInfo(hdl, channel, &inf);
 		if (res < 0) {
-			fprintf(stderr, "Failed to read adapter info\n");
+			u->error("Failed to read adapter info\n");
 			return -1;
 		}
 
@@ -853,57 +1254,53 @@ int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfi
 	}
 
 	////////////////////
-	printf("step [1/7] : Load .hex file...\n");
+	u->printf("step [1/7] : Load .hex file...\n");
 	buf = malloc(FIRMWARE_BUF_SIZE);
 	if (!buf) {
-		perror("malloc");
+		u->perror("malloc");
 		return -1;
 	}
 	memset(buf, 0xff, FIRMWARE_BUF_SIZE);
 
-	max_addr = load_ihex(hexfile, buf, FIRMWARE_BUF_SIZE);
-	if (max_addr < 0) {
-		fprintf(stderr, "Update failed : Could not load hex file\n");
+	// The signature in the file makes sure this firmware is intended for this product
+	max_addr = load_ihex_with_signature(hexfile, buf, FIRMWARE_BUF_SIZE, signature);
+	if (max_addr == IHEX_ERR_SIGNATURE) {
+		u->error("Update aborted : Signature not found. This hex file is not for this adapter.\n");
 		ret = -1;
 		goto err;
 	}
-
-	if (signature) {
-		// look for the signature somewhere in the file to make sure
-		// this firmware is intended for this product
-		if (!memmem(buf, max_addr + 1, signature, strlen(signature))) {
-			fprintf(stderr, "Update aborted : Signature not found. This hex file is not for this adapter.\n");
-			ret = -1;
-			goto err;
-		}
+	if (max_addr < 0) {
+		u->error("Update failed : Could not load hex file\n");
+		ret = -1;
+		goto err;
 	}
 
-	printf("Firmware size: %d bytes\n", max_addr+1);
+	u->printf("Firmware size: %d bytes\n", max_addr+1);
 
 
 	////////////////////
-	printf("step [2/7] : Get adapter info...\n");
+	u->printf("step [2/7] : Get adapter info...\n");
 	res = x2gcn64_adapter_getInfo(hdl, channel, &inf);
 	if (res < 0) {
-		fprintf(stderr, "Failed to read adapter info\n");
+		u->error("Failed to read adapter info\n");
 		return -1;
 	}
 	x2gcn64_adapter_printInfo(&inf);
 
 	if (inf.in_bootloader) {
-		printf("step [3/7] : Enter bootloader... Skipped. Already in bootloader.\n");
+		u->printf("step [3/7] : Enter bootloader... Skipped. Already in bootloader.\n");
 	} else {
 		// Catch Atmega8 adapters programmed with a new firmware but without bootloader.
 		if (!inf.app.upgradeable) {
-			fprintf(stderr, "Error : This adapter is not upgradable. (i.e. No bootloader on Atmega8)\n");
+			u->error("Error : This adapter is not upgradable. (i.e. No bootloader on Atmega8)\n");
 			ret = -1;
 			goto err;
 		}
 
-		printf("step [3/7] : Enter bootloader...\n");
+		u->printf("step [3/7] : Enter bootloader...\n");
 		res = x2gcn64_adapter_enterBootloader(hdl, channel);
 		if (res < 0) {
-			fprintf(stderr, "Failed to enter the bootloader\n");
+			u->error("Failed to enter the bootloader\n");
 			ret = -1;
 			goto err;
 		}
@@ -911,41 +1308,48 @@ int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfi
 		// Re-read the info structure, as we will need the bootloader start address.
 		res = x2gcn64_adapter_getInfo(hdl, channel, &inf);
 		if (res < 0) {
-			fprintf(stderr, "Failed to read info after enterring bootloader\n");
+			u->error("Failed to read info after enterring bootloader\n");
 			ret = -1;
 			goto err;
 		}
 	}
 
 	////////////////////
-	printf("step [4/7] : Erase current firmware... "); fflush(stdout);
-	x2gcn64_adapter_boot_eraseAll(hdl, channel);
+	u->printf("step [4/7] : Erase current firmware... ");
+	// Blank pages are not written in step 5, so they must really be erased.
+	if (x2gcn64_adapter_boot_eraseAll(hdl, channel)) {
+		u->error("Erase failed : Update failed\n");
+		ret = -1;
+		goto err;
+	}
 
 	if (x2gcn64_adapter_waitNotBusy(hdl, channel, 1)) {
 		ret = -1;
 		goto err;
 	}
-	printf("Ok\n");
+	u->printf("Ok\n");
 
 
-	printf("step [5/7] : Write new firmware...\n");
+	u->printf("step [5/7] : Write new firmware...\n");
 	// Note: We write up to the bootloader, even if the firmware was shorter (it usually is).
-	// This is to make sure that the marker we placed at the end gets written.
-	res = x2gcn64_adapter_sendFirmwareBlocks(hdl, channel, buf, inf.bootldr.bootloader_start_address);
+	// This is to make sure that the marker we placed at the end gets written. Blank pages
+	// in between are skipped.
+	res = x2gcn64_adapter_sendFirmwarePages(hdl, channel, buf, inf.bootldr.bootloader_start_address, inf.bootldr.mcu_page_size, u);
 	if (res < 0) {
 		ret = -1;
 		goto err;
 	}
 
-	printf("step [6/7] : Verify firmware...\n");
-	res = x2gcn64_adapter_verifyFirmware(hdl, channel, buf, inf.bootldr.bootloader_start_address);
+	u->printf("step [6/7] : Verify firmware...\n");
+	// The pages skipped in step 5 are read back too, to make sure they were erased.
+	res = x2gcn64_adapter_verifyFirmwarePages(hdl, channel, buf, inf.bootldr.bootloader_start_address, inf.bootldr.mcu_page_size, u);
 	if (res < 0) {
-		printf("Verify failed : Update failed\n");
+		u->error("Verify failed : Update failed\n");
 		ret = -1;
 		goto err;
 	}
 
-	printf("step [7/7] : Launch new firmware.\n");
+	u->printf("step [7/7] : Launch new firmware.\n");
 	x2gcn64_adapter_bootApplication(hdl, channel);
 
 err:
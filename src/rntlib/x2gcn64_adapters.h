@@ -2,6 +2,7 @@
 #define _gc2n64_adapter_h__
 
 #include "raphnetadapter.h"
+#include "uiio.h"
 
 #define GC2N64_MAX_MAPPING_PAIRS	32
 #define GC2N64_NUM_MAPPINGS			5
@@ -79,10 +80,12 @@ int x2gcn64_adapter_dumpFlash(rnt_hdl_t hdl, int channel);
 int x2gcn64_adapter_enterBootloader(rnt_hdl_t hdl, int channel);
 int x2gcn64_adapter_bootApplication(rnt_hdl_t hdl, int channel);
 int x2gcn64_adapter_sendFirmwareBlocks(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len);
+int x2gcn64_adapter_sendFirmwarePages(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len, int page_size, uiio *u);
 int x2gcn64_adapter_verifyFirmware(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len);
+int x2gcn64_adapter_verifyFirmwarePages(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len, int page_size, uiio *u);
 int x2gcn64_adapter_waitForBootloader(rnt_hdl_t hdl, int channel, int timeout_s);
 
-int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfile, const char *signature);
+int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfile, const char *signature, uiio *u);
 
 /* Gamecube to N64 adapter specific */
 void gc2n64_adapter_printMapping(struct gc2n64_adapter_mapping *map);
@@ -164,12 +164,225 @@ int xferpak_setBank(xferpak *xpak, int bank)
 	res = xferpak_writeBlock(xpak, 0xA000, buf);
 	if (res < 0) {
 		fprintf(stderr, "transfer pak io error (%d)\n", res);
+		xpak->cur_bank = -1;
 		return XFERPAK_IO_ERROR;
 	}
+	xpak->cur_bank = bank;
 
 	return 0;
 }
 
+/* Transfer pak streams: Block reads and writes (including bank switches) are
+ * queued in order and packed in block IO reports. Data is only valid (and errors
+ * only known) once the stream is flushed. */
+
+/* Number of operations queued before waiting for completion */
+#define XFERPAK_STREAM_WINDOW	128
+
+struct xferpak_stream;
+
+struct xferpak_streamop {
+	struct blockio_op op;
+	struct xferpak_stream *st;
+	unsigned char tx[3 + 32];
+	unsigned char rx[33];
+	unsigned char *dst;
+};
+
+struct xferpak_stream {
+	xferpak *xpak;
+	gcn64lib_siq *q;
+	int bank; // Transfer pak bank once queued operations are done
+	int error;
+	int n_ops;
+	struct xferpak_streamop ops[XFERPAK_STREAM_WINDOW];
+};
+
+static struct xferpak_stream *xferpak_streamNew(xferpak *xpak)
+{
+	struct xferpak_stream *st;
+
+	st = calloc(1, sizeof(struct xferpak_stream));
+	if (!st) {
+		perror("calloc");
+		return NULL;
+	}
+
+	st->q = gcn64lib_siqNew(xpak->hdl);
+	if (!st->q) {
+		free(st);
+		return NULL;
+	}
+
+	st->xpak = xpak;
+	st->bank = xpak->cur_bank;
+
+	return st;
+}
+
+static void xferpak_streamReadCompleted(struct blockio_op *op, void *ctx)
+{
+	struct xferpak_streamop *sop = ctx;
+
+	if (op->rx_len != 33 || pak_data_crc(sop->rx, 32) != sop->rx[32]) {
+		sop->st->error = XFERPAK_IO_ERROR;
+		return;
+	}
+	memcpy(sop->dst, sop->rx, 32);
+}
+
+static void xferpak_streamWriteCompleted(struct blockio_op *op, void *ctx)
+{
+	struct xferpak_streamop *sop = ctx;
+
+	if (op->rx_len != 1 || sop->rx[0] != pak_data_crc(sop->tx + 3, 32)) {
+		sop->st->error = XFERPAK_IO_ERROR;
+	}
+}
+
+static int xferpak_streamFlush(struct xferpak_stream *st)
+{
+	if (gcn64lib_siqFlush(st->q)) {
+		st->error = XFERPAK_IO_ERROR;
+	}
+	st->n_ops = 0;
+
+	return st->error;
+}
+
+/* Flushes the stream and frees it. Returns the first error that occured. */
+static int xferpak_streamEnd(struct xferpak_stream *st)
+{
+	int res;
+
+	res = xferpak_streamFlush(st);
+	// The bank register state is unknown if something failed
+	st->xpak->cur_bank = res ? -1 : st->bank;
+
+	gcn64lib_siqFree(st->q);
+	free(st);
+
+	return res;
+}
+
+/* Queue a pak block operation. For writes, data is copied immediately. For reads,
+ * dst receives the data once the stream is flushed. */
+static int xferpak_streamBlock(struct xferpak_stream *st, unsigned int addr, const unsigned char *data, unsigned char *dst)
+{
+	struct xferpak_streamop *sop;
+	uint16_t addr_crc;
+
+	if (st->n_ops >= XFERPAK_STREAM_WINDOW) {
+		if (xferpak_streamFlush(st)) {
+			return st->error;
+		}
+	}
+
+	sop = &st->ops[st->n_ops++];
+	sop->st = st;
+	sop->dst = dst;
+	addr_crc = pak_address_crc(addr);
+	sop->tx[1] = addr_crc >> 8;
+	sop->tx[2] = addr_crc & 0xff;
+	sop->op.chn = st->xpak->channel;
+	sop->op.tx_data = sop->tx;
+	sop->op.rx_data = sop->rx;
+
+	if (data) {
+		sop->tx[0] = N64_EXPANSION_WRITE;
+		memcpy(sop->tx + 3, data, 32);
+		sop->op.tx_len = 3 + 32;
+		sop->op.rx_len = 1;
+		return gcn64lib_siqSubmit(st->q, &sop->op, xferpak_streamWriteCompleted, sop);
+	}
+
+	sop->tx[0] = N64_EXPANSION_READ;
+	sop->op.tx_len = 3;
+	sop->op.rx_len = 33;
+	return gcn64lib_siqSubmit(st->q, &sop->op, xferpak_streamReadCompleted, sop);
+}
+
+static int xferpak_streamSetBank(struct xferpak_stream *st, int bank)
+{
+	unsigned char buf[32];
+
+	if (st->bank == bank)
+		return 0;
+
+	memset(buf, bank, sizeof(buf));
+	st->bank = bank;
+
+	return xferpak_streamBlock(st, 0xA000, buf, NULL);
+}
+
+/* Queue IO in gameboy cartridge address space. Exactly one of data (write) or dst (read) must be set. */
+static int xferpak_streamCart(struct xferpak_stream *st, unsigned int start_addr, unsigned int len, const unsigned char *data, unsigned char *dst)
+{
+	uiio *u = st->xpak->u;
+	unsigned int addr;
+	int res;
+
+	for (addr = start_addr; addr < start_addr + len; addr += 32)
+	{
+		res = xferpak_streamSetBank(st, addr >> 14);
+		if (res < 0) {
+			return res;
+		}
+
+		if (u) {
+			u->cur_progress += 32;
+			// Don't call update too often for performance reason
+			if (!(u->cur_progress & 0x1FF)) {
+				if (u->update(u)) {
+					return XFERPAK_USER_CANCELLED;
+				}
+			}
+		}
+
+		res = xferpak_streamBlock(st, 0xC000 + (addr & 0x3FFF), data, dst);
+		if (res < 0) {
+			return XFERPAK_IO_ERROR;
+		}
+
+		if (data) {
+			data += 32;
+		} else {
+			dst += 32;
+		}
+	}
+
+	return 0;
+}
+
+/* Queue a write of value to a cartridge register (eg: MBC bank select) */
+static int xferpak_streamCartRegister(struct xferpak_stream *st, unsigned int addr, unsigned char value)
+{
+	unsigned char buf[32];
+
+	memset(buf, value, sizeof(buf));
+
+	return xferpak_streamCart(st, addr, sizeof(buf), buf, NULL);
+}
+
+static int xferpak_streamCartIO(xferpak *xpak, unsigned int start_addr, unsigned int len, const unsigned char *data, unsigned char *dst)
+{
+	struct xferpak_stream *st;
+	int res, end_res;
+
+	st = xferpak_streamNew(xpak);
+	if (!st) {
+		return XFERPAK_OUT_OF_MEMORY;
+	}
+
+	res = xferpak_streamCart(st, start_addr, len, data, dst);
+	end_res = xferpak_streamEnd(st);
+	if (res == 0) {
+		res = end_res;
+	}
+
+	return res;
+}
+
 int xferpak_enableCartridge(xferpak *xpak, int enable)
 {
 	unsigned char buf[32];
@@ -191,91 +404,156 @@ int xferpak_enableCartridge(xferpak *xpak, int enable)
 
 int xferpak_writeCart(xferpak *xpak, unsigned int start_addr, unsigned int len, const unsigned char *data)
 {
-	int addr;
 	int res;
 
 //	printf("Writing to gb cartridge: 0x%04x [%d bytes] : ", start_addr, len);
 //	printHexBuf(data, len);
 
-	for (addr = 0; addr < len; addr += 32)
-	{
-		xferpak_setBank(xpak, (addr + start_addr) >> 14);
+	res = xferpak_streamCartIO(xpak, start_addr, len, data, NULL);
+	if (res == XFERPAK_IO_ERROR) {
+		fprintf(stderr, "Could not write to cartridge\n");
+	}
 
-		if (xpak->u) {
-			xpak->u->cur_progress += 32;
-			// Don't call update too often for performance reason
-			if (!(xpak->u->cur_progress & 0x1FF)) {
-				if (xpak->u->update(xpak->u)) {
-					return XFERPAK_USER_CANCELLED;
-				}
-			}
-		}
+	return res;
+}
 
-		res = xferpak_writeBlock(xpak, 0xC000 + ((addr+start_addr) & 0x3FFF), data);
-		if (res < 0) {
-			fprintf(stderr, "Could not write to cartridge\n");
-			return XFERPAK_IO_ERROR;
-		}
+int xferpak_readCart(xferpak *xpak, unsigned int start_addr, unsigned int len, unsigned char *dst)
+{
+	int res;
 
-		data += 32;
+	//printf("Reading gb cartridge address: 0x%04x [%d bytes]...\n", start_addr, len);
+	res = xferpak_streamCartIO(xpak, start_addr, len, NULL, dst);
+	if (res == XFERPAK_IO_ERROR) {
+		fprintf(stderr, "Could not read cartridge\n");
 	}
 
-	return 0;
+	return res;
 }
 
-int xferpak_readCart(xferpak *xpak, unsigned int start_addr, unsigned int len, unsigned char *dst)
+/* MBC ROM bank selection, queued on a stream so it can directly follow
+ * the reads from the previous bank. */
+typedef int (*xferpak_streamSelectFn)(struct xferpak_stream *st, int bank);
+
+static int xferpak_stream_mbc5_select_rom_bank(struct xferpak_stream *st, int bank)
 {
-	unsigned char buf[32];
-	int addr;
 	int res;
 
-	//printf("Reading gb cartridge address: 0x%04x [%d bytes]...\n", start_addr, len);
-	for (addr = 0; addr < len; addr += 32)
-	{
-		xferpak_setBank(xpak, (addr + start_addr) >> 14);
+	// 0x2000 Lower 8 bits for ROM bank number
+	res = xferpak_streamCartRegister(st, 0x2000, bank & 0xff);
+	if (res<0) {
+		return res;
+	}
 
-		if (xpak->u) {
-			xpak->u->cur_progress += 32;
-			// Don't call update too often for performance reason
-			if (!(xpak->u->cur_progress & 0x1FF)) {
-				if (xpak->u->update(xpak->u)) {
-					return XFERPAK_USER_CANCELLED;
-				}
-			}
-		}
+	// 0x3000 High bit of ROM bank number
+	return xferpak_streamCartRegister(st, 0x3000, (bank >> 8) & 0xff);
+}
 
-		res = xferpak_readBlock(xpak, 0xC000 + ((addr+start_addr) & 0x3FFF), buf);
-		if (res != 32) {
-			fprintf(stderr, "Could not read cartridge header\n");
-			return XFERPAK_IO_ERROR;
-		}
-		memcpy(dst, buf, 32);
-		dst+=32;
+static int xferpak_stream_mbc3_select_rom_bank(struct xferpak_stream *st, int bank)
+{
+	// 0x2000 Lower 8 bits for ROM bank number
+	return xferpak_streamCartRegister(st, 0x2000, bank & 0xff);
+}
+
+static int xferpak_stream_mbc2_select_rom_bank(struct xferpak_stream *st, int bank)
+{
+	int res;
+
+	// 0x6000 ROM/RAM Mode Select (0x00: ROM banking mode)
+	res = xferpak_streamCartRegister(st, 0x6000, 0x00);
+	if (res<0) {
+		return res;
 	}
 
-	return 0;
+	// 0x2100 Lower 4 bits for ROM bank number
+	return xferpak_streamCartRegister(st, 0x2100, bank & 0x0f);
 }
 
-int xferpak_gb_mbc5_select_rom_bank(xferpak *xpak, int bank)
+static int xferpak_stream_mbc1_select_rom_bank(struct xferpak_stream *st, int bank)
 {
-	unsigned char buf[32];
 	int res;
 
-	// 0x2000 Lower 8 bits for ROM bank number
-	memset(buf, bank & 0xff, sizeof(buf));
-	res = xferpak_writeCart(xpak, 0x2000, sizeof(buf), buf);
+	// 0x6000 ROM/RAM Mode Select (0x00: ROM banking mode)
+	res = xferpak_streamCartRegister(st, 0x6000, 0x00);
 	if (res<0) {
 		return res;
 	}
 
-	// 0x3000 High bit of ROM bank number
-	memset(buf, (bank >> 8) & 0xff, sizeof(buf));
-	res = xferpak_writeCart(xpak, 0x3000, sizeof(buf), buf);
+	// 0x2000 Lower 5 bits for ROM bank number
+	res = xferpak_streamCartRegister(st, 0x2000, bank & 0x1f);
 	if (res<0) {
 		return res;
 	}
 
-	return 0;
+	// 0x4000 Bits 5-6 for ROM bank number
+	return xferpak_streamCartRegister(st, 0x4000, bank >> 5);
+}
+
+static int xferpak_selectROMBank(xferpak *xpak, xferpak_streamSelectFn selectFn, int bank)
+{
+	struct xferpak_stream *st;
+	int res, end_res;
+
+	st = xferpak_streamNew(xpak);
+	if (!st) {
+		return XFERPAK_OUT_OF_MEMORY;
+	}
+
+	res = selectFn(st, bank);
+	end_res = xferpak_streamEnd(st);
+	if (res == 0) {
+		res = end_res;
+	}
+
+	return res;
+}
+
+/* Read a banked ROM in a single stream: Each bank selection is queued right after
+ * the reads of the previous bank and the 0xA000 transfer pak bank register is only
+ * written when the cartridge address crosses a 16K boundary. When fixed_bank0 is
+ * set, bank 0 is read at 0x0000 and selection starts at bank 1. */
+static int xferpak_gb_streamROM(xferpak *xpak, unsigned int rom_size, unsigned char *dstbuf, int fixed_bank0, xferpak_streamSelectFn selectFn)
+{
+	struct xferpak_stream *st;
+	unsigned int i;
+	int res = 0, end_res;
+
+	st = xferpak_streamNew(xpak);
+	if (!st) {
+		return XFERPAK_OUT_OF_MEMORY;
+	}
+
+	i = 0;
+	if (fixed_bank0) {
+		/* First read bank 00 at its fixed address. */
+		res = xferpak_streamCart(st, 0x0000, 0x4000, NULL, dstbuf);
+		i = 0x4000;
+	}
+
+	/* Now read all other banks */
+	for (; res == 0 && i<rom_size; i += 0x4000)
+	{
+		res = selectFn(st, i / 0x4000);
+		if (res < 0) {
+			break;
+		}
+
+		res = xferpak_streamCart(st, 0x4000, 0x4000, NULL, dstbuf + i);
+	}
+
+	end_res = xferpak_streamEnd(st);
+	if (res == 0) {
+		res = end_res;
+	}
+	if (res == XFERPAK_IO_ERROR) {
+		fprintf(stderr, "transfer pak io error reading ROM\n");
+	}
+
+	return res;
+}
+
+int xferpak_gb_mbc5_select_rom_bank(xferpak *xpak, int bank)
+{
+	return xferpak_selectROMBank(xpak, xferpak_stream_mbc5_select_rom_bank, bank);
 }
 
 int xferpak_gb_mbc1_select_rom_mode(xferpak *xpak)
@@ -316,64 +594,17 @@ int xferpak_gb_mbc1_select_ram_mode(xferpak *xpak)
 
 int xferpak_gb_mbc3_select_rom_bank(xferpak *xpak, int bank)
 {
-	unsigned char buf[32];
-	int res;
-
-	// 0x2000 Lower 8 bits for ROM bank number
-	memset(buf, bank & 0xff, sizeof(buf));
-	res = xferpak_writeCart(xpak, 0x2000, sizeof(buf), buf);
-	if (res<0) {
-		return res;
-	}
-
-	return 0;
+	return xferpak_selectROMBank(xpak, xferpak_stream_mbc3_select_rom_bank, bank);
 }
 
 int xferpak_gb_mbc2_select_rom_bank(xferpak *xpak, int bank)
 {
-	unsigned char buf[32];
-	int res;
-
-	res = xferpak_gb_mbc1_select_rom_mode(xpak);
-	if (res < 0) {
-		return res;
-	}
-
-	// 0x2000 Lower 4 bits for ROM bank number
-	memset(buf, bank & 0x0f, sizeof(buf));
-	res = xferpak_writeCart(xpak, 0x2100, sizeof(buf), buf);
-	if (res<0) {
-		return res;
-	}
-
-	return 0;
+	return xferpak_selectROMBank(xpak, xferpak_stream_mbc2_select_rom_bank, bank);
 }
 
 int xferpak_gb_mbc1_select_rom_bank(xferpak *xpak, int bank)
 {
-	unsigned char buf[32];
-	int res;
-
-	res = xferpak_gb_mbc1_select_rom_mode(xpak);
-	if (res < 0) {
-		return res;
-	}
-
-	// 0x2000 Lower 5 bits for ROM bank number
-	memset(buf, bank & 0x1f, sizeof(buf));
-	res = xferpak_writeCart(xpak, 0x2000, sizeof(buf), buf);
-	if (res<0) {
-		return res;
-	}
-
-	// 0x4000 Bits 5-6 for ROM bank number
-	memset(buf, bank >> 5, sizeof(buf));
-	res = xferpak_writeCart(xpak, 0x4000, sizeof(buf), buf);
-	if (res<0) {
-		return res;
-	}
-
-	return 0;
+	return xferpak_selectROMBank(xpak, xferpak_stream_mbc1_select_rom_bank, bank);
 }
 
 int xferpak_gb_mbc1235_enable_ram(xferpak *xpak, int enable)
@@ -742,181 +973,28 @@ int xferpak_gb_mbc35_readRAM(xferpak *xpak, unsigned int ram_size, unsigned char
 
 int xferpak_gb_mbc5_readROM(xferpak *xpak, unsigned int rom_size, unsigned char *dstbuf)
 {
-	int i, res;
-	unsigned char bankbuf[0x4000];
-	int cur_bank = -1;
-
-	//printf("Reading MBC5 rom (size=0x%06x)...\n", rom_size);
-	for (i=0; i<rom_size; i+= sizeof(bankbuf))
-	{
-		if ((i/sizeof(bankbuf)) != cur_bank) {
-			cur_bank = i/sizeof(bankbuf);
-			//printf("Selecting MBC5 ROM bank 0x%x\n", cur_bank);
-			res = xferpak_gb_mbc5_select_rom_bank(xpak, cur_bank);
-			if (res < 0) {
-				fprintf(stderr, "failed to set mbc5 bank\n");
-				return XFERPAK_IO_ERROR;
-			}
-		}
-
-		res = xferpak_readCart(xpak, 0x4000, sizeof(bankbuf), bankbuf);
-		if (res < 0) {
-			return res;
-		}
-
-		memcpy(dstbuf, bankbuf, sizeof(bankbuf));
-		dstbuf += sizeof(bankbuf);
-	}
-
-	return 0;
+	return xferpak_gb_streamROM(xpak, rom_size, dstbuf, 0, xferpak_stream_mbc5_select_rom_bank);
 }
 
 int xferpak_gb_mbc3_readROM(xferpak *xpak, unsigned int rom_size, unsigned char *dstbuf)
 {
-	int i, res;
-	unsigned char bankbuf[0x4000];
-	int cur_bank = -1;
-
-	/* First read bank 00 at its fixed address. */
-	res = xferpak_readCart(xpak, 0x0000, sizeof(bankbuf), bankbuf);
-	if (res < 0) {
-		fprintf(stderr, "transfer pak io error (%d)\n", res);
-		return res;
-	}
-	memcpy(dstbuf, bankbuf, sizeof(bankbuf));
-	dstbuf += sizeof(bankbuf);
-
-	/* Now read all other banks */
-	for (i=sizeof(bankbuf); i<rom_size; i+= sizeof(bankbuf))
-	{
-		if ((i/sizeof(bankbuf)) != cur_bank) {
-			cur_bank = i/sizeof(bankbuf);
-			//printf("Selecting MBC5 ROM bank 0x%x\n", cur_bank);
-			res = xferpak_gb_mbc3_select_rom_bank(xpak, cur_bank);
-			if (res < 0) {
-				fprintf(stderr, "failed to set mbc5 bank\n");
-				return XFERPAK_IO_ERROR;
-			}
-		}
-
-		res = xferpak_readCart(xpak, 0x4000, sizeof(bankbuf), bankbuf);
-		if (res < 0) {
-			return res;
-		}
-
-		memcpy(dstbuf, bankbuf, sizeof(bankbuf));
-		dstbuf += sizeof(bankbuf);
-	}
-
-	return 0;
+	return xferpak_gb_streamROM(xpak, rom_size, dstbuf, 1, xferpak_stream_mbc3_select_rom_bank);
 }
 
 int xferpak_gb_mbc2_readROM(xferpak *xpak, unsigned int rom_size, unsigned char *dstbuf)
 {
-	int i, res;
-	unsigned char bankbuf[0x4000];
-	int cur_bank = -1;
-
-	/* First read bank 00 at its fixed address. */
-	res = xferpak_readCart(xpak, 0x0000, sizeof(bankbuf), bankbuf);
-	if (res < 0) {
-		fprintf(stderr, "transfer pak io error (%d)\n", res);
-		return res;
-	}
-	memcpy(dstbuf, bankbuf, sizeof(bankbuf));
-	dstbuf += sizeof(bankbuf);
-
-	/* Now read all other banks */
-	for (i=sizeof(bankbuf); i<rom_size; i+= sizeof(bankbuf))
-	{
-		if ((i/sizeof(bankbuf)) != cur_bank) {
-			cur_bank = i/sizeof(bankbuf);
-			res = xferpak_gb_mbc2_select_rom_bank(xpak, cur_bank);
-			if (res < 0) {
-				fprintf(stderr, "failed to set mbc1 bank\n");
-				return XFERPAK_IO_ERROR;
-			}
-		}
-
-		res = xferpak_readCart(xpak, 0x4000, sizeof(bankbuf), bankbuf);
-		if (res < 0) {
-			return res;
-		}
-
-		memcpy(dstbuf, bankbuf, sizeof(bankbuf));
-		dstbuf += sizeof(bankbuf);
-	}
-
-	return 0;
+	return xferpak_gb_streamROM(xpak, rom_size, dstbuf, 1, xferpak_stream_mbc2_select_rom_bank);
 }
 
 int xferpak_gb_mbc1_readROM(xferpak *xpak, unsigned int rom_size, unsigned char *dstbuf)
 {
-	int i, res;
-	unsigned char bankbuf[0x4000];
-	int cur_bank = -1;
-
-	/* First read bank 00 at its fixed address. */
-	res = xferpak_readCart(xpak, 0x0000, sizeof(bankbuf), bankbuf);
-	if (res < 0) {
-		fprintf(stderr, "transfer pak io error (%d)\n", res);
-		return res;
-	}
-	memcpy(dstbuf, bankbuf, sizeof(bankbuf));
-	dstbuf += sizeof(bankbuf);
-
-	/* Now read all other banks */
-	for (i=sizeof(bankbuf); i<rom_size; i+= sizeof(bankbuf))
-	{
-		if ((i/sizeof(bankbuf)) != cur_bank) {
-			cur_bank = i/sizeof(bankbuf);
-			res = xferpak_gb_mbc1_select_rom_bank(xpak, cur_bank);
-			if (res < 0) {
-				fprintf(stderr, "failed to set mbc1 bank\n");
-				return XFERPAK_IO_ERROR;
-			}
-		}
-
-		res = xferpak_readCart(xpak, 0x4000, sizeof(bankbuf), bankbuf);
-		if (res < 0) {
-			return res;
-		}
-
-		memcpy(dstbuf, bankbuf, sizeof(bankbuf));
-		dstbuf += sizeof(bankbuf);
-	}
-
-	return 0;
+	return xferpak_gb_streamROM(xpak, rom_size, dstbuf, 1, xferpak_stream_mbc1_select_rom_bank);
 }
 
 // Note: This is the same code as MBC5, no idea if this is correct
 int xferpak_gb_pocketcam_readROM(xferpak *xpak, unsigned int rom_size, unsigned char *dstbuf)
 {
-	int i, res;
-	unsigned char bankbuf[0x4000];
-	int cur_bank = -1;
-
-	for (i=0; i<rom_size; i+= sizeof(bankbuf))
-	{
-		if ((i/sizeof(bankbuf)) != cur_bank) {
-			cur_bank = i/sizeof(bankbuf);
-			res = xferpak_gb_mbc5_select_rom_bank(xpak, cur_bank);
-			if (res < 0) {
-				fprintf(stderr, "failed to set mbc5 bank\n");
-				return XFERPAK_IO_ERROR;
-			}
-		}
-
-		res = xferpak_readCart(xpak, 0x4000, sizeof(bankbuf), bankbuf);
-		if (res < 0) {
-			return res;
-		}
-
-		memcpy(dstbuf, bankbuf, sizeof(bankbuf));
-		dstbuf += sizeof(bankbuf);
-	}
-
-	return 0;
+	return xferpak_gb_streamROM(xpak, rom_size, dstbuf, 0, xferpak_stream_mbc5_select_rom_bank);
 }
 
 int xferpak_gb_32k_read(xferpak *xpak, unsigned char *dstbuf)